@@ -0,0 +1,72 @@
+#ifndef ADAPTIVE_CHUNK_H
+#define ADAPTIVE_CHUNK_H
+
+#include <Arduino.h>
+
+/**
+ * AdaptiveChunkController - link-aware upload chunk sizing and drain pacing
+ *
+ * Heap headroom only sets the ceiling. Within [minChunk, ceiling] the chunk
+ * size moves along a power-of-two ladder driven by what the link actually
+ * does:
+ *   - a chunk that needed EAGAIN retries or stalled (slow per-KB latency)
+ *     halves the chunk and adds inter-chunk pacing so lwIP can drain
+ *   - a run of clean chunks at or above the running throughput doubles the
+ *     chunk and removes pacing
+ *   - RSSI sets the starting point and caps the size on weak links; a
+ *     throughput seeded from the network self-test overrides it at the edges
+ *
+ * State is kept across files so a session converges once per backend.
+ * Pure logic (no WiFi / timing calls) so it can be unit tested natively.
+ */
+class AdaptiveChunkController {
+public:
+    // RSSI thresholds (dBm) used for the starting point / weak-link cap
+    static const int RSSI_STRONG_DBM = -60;
+    static const int RSSI_WEAK_DBM   = -72;
+
+    // A chunk slower than this per KB counts as a stall (retransmit burst)
+    static const uint32_t STALL_MS_PER_KB = 250;
+    // Clean chunks needed before growing the chunk size
+    static const uint8_t GROW_AFTER_CLEAN_CHUNKS = 8;
+    // Inter-chunk pacing bounds
+    static const uint16_t PACE_STEP_MS = 2;
+    static const uint16_t PACE_MAX_MS  = 40;
+    // Seeded throughput (bytes/s) that overrides the RSSI start point
+    static const uint32_t SEED_FAST_BPS = 128 * 1024;
+    static const uint32_t SEED_SLOW_BPS = 16 * 1024;
+
+    AdaptiveChunkController(size_t minChunk, size_t maxChunk);
+
+    // Call before each file: ceiling = min(maxChunk, heapLimit); RSSI picks the
+    // start point on first use and caps the chunk on a weak link.
+    void beginFile(size_t heapLimit, int rssi);
+
+    // Feed the outcome of one chunk write.
+    void recordChunk(size_t bytes, unsigned long elapsedMs, int eagainRetries);
+
+    // Seed the throughput estimate from an external measurement (bytes/s),
+    // e.g. the network self-test. 0 is ignored. Call before the first beginFile()
+    // to also pick the starting chunk size.
+    void seedThroughput(uint32_t bytesPerSec);
+
+    size_t   getChunkSize() const   { return chunkSize; }
+    uint16_t getPaceDelayMs() const { return paceMs; }
+    uint32_t getThroughputBps() const { return ewmaBps; }
+    uint32_t getStallCount() const  { return stallCount; }
+
+private:
+    size_t minChunk;
+    size_t maxChunk;
+    size_t ceiling;
+    size_t chunkSize;
+    uint16_t paceMs;
+    uint8_t cleanStreak;
+    uint32_t ewmaBps;
+    uint32_t stallCount;
+    bool initialized;
+
+    size_t clampToLadder(size_t size) const;
+};
+
+#endif // ADAPTIVE_CHUNK_H
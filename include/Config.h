@@ -46,6 +46,7 @@ private:
     String endpointType;  // SMB, CLOUD, SMB,CLOUD
     String endpointUser;
     String endpointPassword;
+    bool smbFolderArchive;  // Send each DATALOG day as one tar object on SMB
     int gmtOffsetHours;
     bool saveLogs;
     bool debugMode;
@@ -69,6 +70,7 @@ private:
     int exclusiveAccessMinutes;    // X: max minutes of exclusive SD access
     int cooldownMinutes;           // Y: minutes to release SD between upload cycles
     bool enable1BitSdMode;         // Whether to use 1-bit SDIO mode instead of 4-bit
+    bool sdBusAutotune;            // Calibrate bus width/clock per card (default: true)
     bool minimizeReboots;           // Skip elective reboots between upload sessions
     bool flushLogsDuringUpload;      // Continue periodic log flushes during uploads (default: false)
     
@@ -157,8 +159,10 @@ public:
     int getExclusiveAccessMinutes() const;
     int getCooldownMinutes() const;
     bool getEnable1BitSdMode() const;
+    bool getSdBusAutotune() const;
     bool getMinimizeReboots() const;
     bool getFlushLogsDuringUpload() const;
+    bool getSmbFolderArchive() const;
     bool isSmartMode() const;
     
     // Power management getters
@@ -15,12 +15,7 @@
 #include "OTAManager.h"
 #endif
 
-// Global trigger flags for upload and state reset
-extern volatile bool g_triggerUploadFlag;
-extern volatile bool g_resetStateFlag;
-extern volatile bool g_softRebootFlag;
-extern volatile bool g_monitorActivityFlag;
-extern volatile bool g_stopMonitorFlag;
+// Web requests reach the FSM as events (g_fsmEvents); this flag is read by the upload task
 extern volatile bool g_abortUploadFlag;
 
 // Config edit lock — set by web UI to pause FSM uploads while user edits config
@@ -66,6 +61,9 @@ private:
     void handleApiConfigRawGet();   // GET /api/config-raw
     void handleApiConfigRawPost();  // POST /api/config-raw
     void handleApiConfigLock();     // POST /api/config-lock
+    void handleApiNetBench();       // GET /api/netbench[?run=1]
+    void handleApiNightSummary();   // GET /api/night-summary
+    void handleApiHeap();           // GET /api/heap
 
 #ifdef ENABLE_OTA_UPDATES
     // OTA handlers
@@ -0,0 +1,62 @@
+#ifndef DIR_SCANNER_H
+#define DIR_SCANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <dirent.h>
+
+/**
+ * DirScanner - lightweight directory enumeration over POSIX opendir/readdir
+ *
+ * File::openNextFile() opens every entry as a full VFS File (open + stat)
+ * even when the caller only needs its name and type. DirScanner reads the
+ * directory stream directly: the name and d_type come from readdir(), and
+ * size/mtime are only fetched with stat() when the caller asks for them.
+ *
+ * Paths passed to open() are the same as used with fs::FS ("/DATALOG"); the
+ * VFS mount point given to the constructor is prepended.
+ *
+ * Usage:
+ *   DirScanner dir(SD_MOUNT_POINT);
+ *   if (dir.open("/DATALOG")) {
+ *       while (dir.next()) {
+ *           if (dir.isDirectory()) { ... dir.name() ... }
+ *       }
+ *   }
+ */
+class DirScanner {
+public:
+    static const size_t MAX_PATH_LEN = 128;
+
+    explicit DirScanner(const char* mountPoint);
+    ~DirScanner();
+
+    bool open(const char* path);      // false if missing or not a directory
+    void close();
+    bool isOpen() const { return dir != nullptr; }
+
+    // Advance to the next entry ("." and ".." are skipped). False at the end.
+    bool next();
+
+    const char* name() const;         // Entry name only (no directory prefix)
+    bool isDirectory() const;
+    bool isFile() const;
+
+    // stat() the current entry on demand
+    bool stat(uint32_t& size, time_t& mtime);
+
+private:
+    const char* mountPoint;
+    DIR* dir;
+    struct dirent* entry;
+    char dirPath[MAX_PATH_LEN];       // mount point + opened path
+    int entryType;                    // DT_* of the current entry (resolved if DT_UNKNOWN)
+
+    bool buildEntryPath(char* buf, size_t len) const;
+
+    DirScanner(const DirScanner&);
+    DirScanner& operator=(const DirScanner&);
+};
+
+#endif // DIR_SCANNER_H
@@ -0,0 +1,56 @@
+#ifndef EDF_HEADER_H
+#define EDF_HEADER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * EdfHeader - fixed EDF/EDF+ header fields needed by the uploader
+ *
+ * Only the 256-byte fixed header and the per-signal "samples per record"
+ * column are read; labels, scaling and data records are left alone.
+ *
+ * The CPAP keeps the current night's BRP/PLD/EVE files open and appends
+ * records while therapy runs. A file is only "closed" once its header agrees
+ * with its size: the record count is known (not -1) and
+ * headerBytes + records * recordBytes == file size.
+ */
+
+static const size_t EDF_FIXED_HEADER_BYTES = 256;
+static const uint16_t EDF_MAX_SIGNALS = 256;
+
+struct EdfHeaderInfo {
+    uint32_t headerBytes;      // Fixed + signal headers
+    int32_t  dataRecords;      // -1 = unknown (recording in progress)
+    uint32_t recordDurationMs; // Duration of one data record
+    uint32_t recordBytes;      // Bytes per data record (2 per sample)
+    uint16_t signals;
+    // Start of recording as written by the CPAP (local time, no zone)
+    uint16_t startYear;
+    uint8_t  startMonth, startDay, startHour, startMinute, startSecond;
+};
+
+enum class EdfFileState : uint8_t {
+    Closed,   // Header matches the size; the file will not change
+    Open,     // Still being written (unknown record count or size mismatch)
+    Unknown   // Not a parseable EDF header
+};
+
+// Parse an ASCII numeric field (space padded). Accepts a leading '-' and a
+// fractional part; the value is returned scaled by `scale` (e.g. 1000 for ms).
+bool parseEdfNumber(const uint8_t* field, size_t len, int32_t scale, int32_t& out);
+
+// Parse the 256-byte fixed header. recordBytes is left 0 (needs the signal headers).
+bool parseEdfFixedHeader(const uint8_t* header, size_t len, EdfHeaderInfo& out);
+
+// Read the fixed header and the samples-per-record column from an open file
+bool readEdfHeader(fs::File& file, EdfHeaderInfo& out);
+
+EdfFileState classifyEdf(const EdfHeaderInfo& info, uint32_t fileSize);
+EdfFileState classifyEdfFile(fs::FS &sd, const char* path, uint32_t fileSize);
+
+const char* edfFileStateName(EdfFileState state);
+
+#endif // EDF_HEADER_H
@@ -0,0 +1,137 @@
+#ifndef EDF_SUMMARY_H
+#define EDF_SUMMARY_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "EdfHeader.h"
+
+/**
+ * EdfSummary - "last night" statistics reduced from the upload byte stream
+ *
+ * EdfStreamReducer is a read tap: the uploaders hand it every chunk they read
+ * from a DATALOG *_PLD.edf file, so the summary costs no extra SD reads. It
+ * parses the EDF header as it streams past (fixed header, labels, scaling and
+ * samples-per-record columns) and then folds the samples of the tracked
+ * signals into digital min/max/sum. Only complete data records count towards
+ * usage time. restart() drops partial state when an upload attempt is retried.
+ *
+ * NightSummaryStore keeps one NightSession per PLD file (a mask-on session)
+ * in a small text file on LittleFS, newest first, and aggregates the sessions
+ * of the most recent day for /api/night-summary.
+ */
+
+enum NightSignal : uint8_t {
+    NIGHT_PRESSURE = 0,   // "Press"    cmH2O
+    NIGHT_LEAK,           // "Leak"     reported in L/min (PLD stores L/s)
+    NIGHT_RESP_RATE,      // "RespRate" breaths/min
+    NIGHT_SIGNAL_COUNT
+};
+
+struct NightSignalStats {
+    float min;
+    float max;
+    float mean;
+    uint32_t samples;     // 0 = signal absent or no valid samples
+};
+
+struct NightSession {
+    uint32_t day;         // DATALOG folder, YYYYMMDD (the CPAP's therapy day)
+    uint32_t startTime;   // Recording start from the EDF header, HHMMSS
+    uint32_t usageSec;    // Complete data records x record duration
+    NightSignalStats stats[NIGHT_SIGNAL_COUNT];
+};
+
+struct NightSummary {
+    uint32_t day;
+    uint16_t sessions;
+    uint32_t usageSec;
+    NightSignalStats stats[NIGHT_SIGNAL_COUNT];
+};
+
+const char* nightSignalName(uint8_t signal);
+
+class EdfStreamReducer {
+public:
+    static const uint16_t MAX_SIGNALS = 32;
+
+    EdfStreamReducer();
+
+    // Arm the reducer for one file. False (and inactive) unless the path is a
+    // DATALOG/YYYYMMDD/*_PLD.edf file.
+    bool begin(const char* path);
+    // New upload attempt: the stream starts again at offset 0
+    void restart();
+    void feed(const uint8_t* data, size_t len);
+    // Summary of what has been fed. False if the header did not parse or no
+    // complete record arrived.
+    bool finish(NightSession& out) const;
+    void end();
+
+    bool isActive() const { return state != State::Idle && state != State::Failed; }
+
+private:
+    enum class State : uint8_t { Idle, FixedHeader, SignalHeaders, Records, Failed };
+
+    struct Tracked {
+        int16_t signal;           // Index in the file, -1 = not present
+        int32_t physMin, physMax; // x1000
+        int32_t digMin, digMax;
+        uint32_t recordStart;     // Byte range of this signal within a record
+        uint32_t recordEnd;
+        int16_t lo, hi;           // Digital extremes seen
+        int64_t sum;
+        uint32_t count;
+        uint8_t pendingLow;       // First byte of a sample split across chunks
+    };
+
+    State state;
+    uint32_t day;
+    uint32_t offset;              // Absolute stream offset
+    uint32_t recordPos;           // Offset within the current data record
+    uint32_t records;             // Complete data records seen
+    EdfHeaderInfo info;
+    uint8_t fixed[EDF_FIXED_HEADER_BYTES];
+    uint8_t field[16];            // Signal header field being assembled
+    uint16_t samples[MAX_SIGNALS];
+    Tracked tracked[NIGHT_SIGNAL_COUNT];
+
+    void feedHeader(const uint8_t*& data, size_t& len);
+    void onSignalField(uint8_t column, uint16_t signal);
+    bool finishHeader();
+    void feedRecords(const uint8_t* data, size_t len);
+    void addSample(Tracked& t, int16_t value);
+};
+
+class NightSummaryStore {
+public:
+    static const uint8_t MAX_SESSIONS = 32;
+    static const char* const PATH;
+
+    NightSummaryStore();
+
+    bool load(fs::FS &fs);
+    bool save(fs::FS &fs);   // No-op unless a session was recorded
+
+    // Insert or replace (same day and start time); the oldest session is
+    // dropped once the store is full
+    void record(const NightSession& session);
+
+    uint8_t count() const { return sessionCount; }
+    const NightSession& at(uint8_t index) const { return sessions[index]; }
+
+    // Aggregate the newest day straight from the file (no store instance, so
+    // the web server does not need the session table in RAM)
+    static bool readLatest(fs::FS &fs, NightSummary& out);
+
+private:
+    NightSession sessions[MAX_SESSIONS];
+    uint8_t sessionCount;
+    bool dirty;
+
+    static bool parseLine(const char* line, NightSession& out);
+    static void addToSummary(NightSummary& summary, const NightSession& session);
+};
+
+#endif // EDF_SUMMARY_H
@@ -0,0 +1,60 @@
+#ifndef FILE_FINGERPRINT_H
+#define FILE_FINGERPRINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UNIT_TEST
+#include "MockMD5.h"
+#else
+#include <esp_rom_md5.h>
+#endif
+
+/**
+ * FileFingerprint - streaming content fingerprint with a selectable algorithm
+ *
+ * Local change detection only has to notice accidental changes, so it uses
+ * the ROM table-driven CRC32 (esp_rom_crc32_le), several times cheaper per
+ * byte than the software MD5. MD5 stays available for entries written by
+ * older firmware and for callers that need it (SleepHQ content hashes).
+ *
+ * Fingerprints travel as text so the algorithm is recorded with the value:
+ *   "crc32:1a2b3c4d"                     CRC32
+ *   "0123456789abcdef0123456789abcdef"   MD5 (untagged, as before)
+ */
+
+enum class FingerprintAlgo : uint8_t {
+    Md5   = 0,
+    Crc32 = 1
+};
+
+// Algorithm for fingerprints that only drive local change detection
+static const FingerprintAlgo LOCAL_FINGERPRINT_ALGO = FingerprintAlgo::Crc32;
+
+class FileFingerprint {
+public:
+    static const size_t MAX_DIGEST_LEN = 16;
+    static const size_t MAX_TEXT_LEN = 33;   // Including the terminator
+
+    explicit FileFingerprint(FingerprintAlgo algo = LOCAL_FINGERPRINT_ALGO);
+
+    void reset();
+    void update(const uint8_t* data, size_t len);
+    // Writes digestLen(algo()) bytes; returns that length
+    size_t finish(uint8_t out[MAX_DIGEST_LEN]);
+    // Tagged text form (see above); out must hold MAX_TEXT_LEN bytes
+    void finishText(char* out);
+
+    FingerprintAlgo algo() const { return algorithm; }
+
+    static size_t digestLen(FingerprintAlgo algo);
+    static void format(FingerprintAlgo algo, const uint8_t* digest, char* out);
+    static bool parse(const char* text, FingerprintAlgo& algo, uint8_t out[MAX_DIGEST_LEN]);
+
+private:
+    FingerprintAlgo algorithm;
+    md5_context_t md5;
+    uint32_t crc;
+};
+
+#endif // FILE_FINGERPRINT_H
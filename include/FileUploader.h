@@ -9,6 +9,8 @@
 #include "ScheduleManager.h"
 #include "WiFiManager.h"
 #include "SDCardManager.h"
+#include "NetBench.h"
+#include "EdfSummary.h"
 
 // Forward declaration to avoid circular dependency
 #ifdef ENABLE_WEBSERVER
@@ -36,7 +38,8 @@ enum class UploadResult {
     COMPLETE,        // All eligible files uploaded
     TIMEOUT,         // X-minute timer expired (partial upload, not an error)
     ERROR,           // Upload failure
-    NOTHING_TO_DO    // Pre-flight scan found no work for any backend — skip reboot, go to cooldown
+    NOTHING_TO_DO,   // Pre-flight scan found no work for any backend — skip reboot, go to cooldown
+    BACKEND_DEFERRED // Work is pending but its backend's circuit breaker is open — retry after cooldown
 };
 
 // Filter for which data categories to upload
@@ -49,8 +52,9 @@ enum class DataFilter {
 class FileUploader {
 private:
     Config* config;
-    UploadStateManager* smbStateManager;    // tracks SMB-only uploads
-    UploadStateManager* cloudStateManager;  // tracks Cloud-only uploads
+    UploadStateStore* stateStore;           // one record set, a bit per backend
+    UploadStateManager* smbStateManager;    // SMB view of stateStore
+    UploadStateManager* cloudStateManager;  // Cloud view of stateStore
     ScheduleManager* scheduleManager;
     WiFiManager* wifiManager;
     // Tracks which phase is currently running (for GUI status)
@@ -69,16 +73,27 @@ private:
 #endif
 
     // File scanning (sm = state manager used for completed/pending checks)
+    // Load the shared state store, folding in per-backend files from older firmware
+    void openStateStore(fs::FS &stateFs);
+
     std::vector<String> scanDatalogFolders(fs::FS &sd, UploadStateManager* sm,
                                            bool includeCompleted = false);
     std::vector<String> scanFolderFiles(fs::FS &sd, const String& folderPath);
     std::vector<String> scanSettingsFiles(fs::FS &sd);
 
+    // SD file metadata for the current hold (owned by SDCardManager)
+    SdMetaCache* metaCache;
+    // Size of an SD file from the metadata cache, or by opening it when no
+    // cache is attached. False if the file is absent or unreadable.
+    bool getSdFileSize(fs::FS &sd, const char* path, unsigned long& size);
+
     // ── SMB pass helpers ────────────────────────────────────────────────────
     bool uploadMandatoryFilesSmb(class SDCardManager* sdManager, fs::FS &sd);
     bool uploadSingleFileSmb(class SDCardManager* sdManager, const String& filePath,
                              bool force = false);
     bool uploadDatalogFolderSmb(class SDCardManager* sdManager, const String& folderName);
+    bool connectSmb();  // begin() gated by the SMB circuit breaker
+    bool smbConnectFailed;  // SMB connect failed this session — don't retry until next session
 
     // ── Cloud pass helpers ───────────────────────────────────────────────────
     bool uploadDatalogFolderCloud(class SDCardManager* sdManager, const String& folderName);
@@ -95,6 +110,20 @@ private:
     bool cloudImportFailed;
     int  cloudDatalogFilesUploaded;  // DATALOG files uploaded this cloud pass; 0 = skip finalize
 
+    // Night summary: PLD files are reduced while they stream to a backend
+    // (no extra SD reads); one session per file is kept on LittleFS
+    EdfStreamReducer nightReducer;
+    NightSummaryStore nightStore;
+    bool nightStoreLoaded;
+    // Arm the reducer for localPath; returns the tap to hand to the uploader
+    // (nullptr for anything but a DATALOG *_PLD.edf file)
+    EdfStreamReducer* armNightTap(const char* localPath);
+    // Record the reduced session if the upload succeeded, then disarm.
+    // With `held`, the session is appended there instead, for callers whose
+    // upload is only confirmed later (folder archives)
+    void collectNightTap(bool uploaded, std::vector<NightSession>* held = nullptr);
+    void recordNightSessions(const std::vector<NightSession>& sessions);
+
     // Return the "primary" state manager for web UI (prefers cloud if both exist)
     UploadStateManager* primaryStateManager() const {
         if (cloudStateManager) return cloudStateManager;
@@ -111,15 +140,33 @@ public:
 
     bool begin();
 
+    // Route size/existence checks (scanners, state managers) through the
+    // SD card's per-hold metadata cache
+    void setMetaCache(SdMetaCache* cache);
+
     // Lightweight work probe — streaming directory check with no vector/String heap churn.
     // Returns which backends have pending work. Used before creating the upload task
     // so the no-work path avoids TLS allocation entirely.
     struct WorkProbeResult {
         bool hasCloudWork;
         bool hasSmbWork;
+        bool backendDeferred;  // A backend with pending work has its breaker open
     };
     WorkProbeResult hasWorkToUpload(fs::FS &sd);
 
+    // Predictive pre-warm (smart mode): DNS, TLS, OAuth token and SMB probe
+    // ahead of the learned therapy-end time. Network only — never touches SD.
+    void preWarmBackends();
+
+    // Network self-test (/api/netbench): fills status, persists measured
+    // throughput and seeds the uploaders' chunk tuners. Network only.
+    void runNetBench(NetBenchStatus& status);
+
+    // Deferred upload state compaction: uploads only append to the journal;
+    // main.cpp runs this from a background task in COOLDOWN/IDLE. LittleFS only.
+    bool isStateCompactionDue() const { return stateStore && stateStore->isCompactionDue(); }
+    bool compactStateIfDue();
+
     // Full session: phased upload (CLOUD → SMB) with SD card mounted.
     // TLS connects on-demand in cloud phase — no pre-warm needed (arena protects heap).
     // Safety resetConnection() before SMB phase handles any lingering TLS.
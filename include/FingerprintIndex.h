@@ -0,0 +1,107 @@
+#ifndef FINGERPRINT_INDEX_H
+#define FINGERPRINT_INDEX_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+#include "FileFingerprint.h"
+
+/**
+ * FingerprintIndex - file fingerprints kept sorted on flash, read by page
+ *
+ * The upload state used to hold every file fingerprint in a fixed RAM table,
+ * so past its capacity old entries were evicted and those files looked
+ * changed again. The index keeps the records in one LittleFS file, sorted by
+ * path hash, as fixed 32-byte records behind a 32-byte header, in pages of
+ * PAGE_RECORDS. RAM holds only the first key of each page (1KB at
+ * MAX_RECORDS) and a two-page cache: a lookup binary-searches the page keys,
+ * then reads at most one page and binary-searches that. Asking for the same
+ * path twice in a row (hasFileChanged, then markFileUploaded) is a cache hit.
+ *
+ * The file is never edited in place. Changes are collected (sorted) by the
+ * caller and merge() streams old file + changes into a new file, then renames
+ * it over the old one: a power cut leaves either version intact. A change
+ * with uploaded == 0 removes the record.
+ *
+ * Past MAX_RECORDS the records left untouched by the most merges go first
+ * (each record stores the merge generation that last wrote it).
+ */
+
+struct FingerprintRecord {
+    uint64_t pathHash;
+    uint32_t fileSize;
+    uint8_t digest[16];    // First digestLen(algo) bytes used
+    FingerprintAlgo algo;
+    uint8_t flags;
+    uint8_t uploaded;      // Backends whose last upload matches this fingerprint
+    uint8_t generation;    // Index merge that last wrote the record
+};
+
+struct FingerprintIndexStats {
+    uint32_t lookups;
+    uint32_t pageHits;
+    uint32_t pageReads;
+    uint32_t merges;
+    uint32_t evicted;
+};
+
+class FingerprintIndex {
+public:
+    static const uint16_t PAGE_RECORDS = 16;      // 512-byte pages
+    static const uint8_t CACHE_PAGES = 2;         // Also the merge's read/write buffers
+    static const uint32_t MAX_RECORDS = 2048;     // 64KB on flash
+    static const uint16_t MAX_PAGES = MAX_RECORDS / PAGE_RECORDS;
+
+    FingerprintIndex();
+
+    // Attach to the index file. A missing or damaged file reads as empty.
+    bool open(fs::FS &fs, const String& path);
+    // Forget the contents; the next merge writes a fresh file
+    void reset();
+
+    bool isOpen() const { return indexFs != nullptr; }
+    uint32_t count() const { return recordCount; }
+
+    bool find(uint64_t pathHash, FingerprintRecord& out);
+    // `changes` sorted by path hash, one per hash; uploaded == 0 removes
+    bool merge(const FingerprintRecord* changes, uint16_t changeCount);
+
+    const FingerprintIndexStats& stats() const { return indexStats; }
+
+private:
+    struct Header {
+        char magic[4];
+        uint16_t recordSize;
+        uint16_t reserved0;
+        uint32_t count;
+        uint8_t generation;
+        uint8_t reserved[19];
+    };
+
+    struct CachePage {
+        int32_t page;      // -1 = empty
+        uint16_t count;
+        uint32_t lastUse;
+        FingerprintRecord records[PAGE_RECORDS];
+    };
+
+    static const uint8_t AGE_BUCKETS = 64;        // Ages past 63 merges count as 63
+
+    fs::FS* indexFs;
+    String indexPath;
+    uint32_t recordCount;
+    uint8_t generation;
+    uint32_t useClock;
+    uint64_t pageKeys[MAX_PAGES];   // First path hash of each page
+    CachePage cache[CACHE_PAGES];
+    FingerprintIndexStats indexStats;
+
+    void invalidateCache();
+    bool readPageKeys(fs::File& file);
+    const CachePage* loadPage(uint32_t page);
+    bool mergePass(const FingerprintRecord* changes, uint16_t changeCount, uint8_t newGeneration,
+                   fs::File* out, uint8_t dropAge, uint32_t dropAtAge,
+                   uint32_t& kept, uint32_t ageCounts[AGE_BUCKETS]);
+};
+
+#endif // FINGERPRINT_INDEX_H
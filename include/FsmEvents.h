@@ -0,0 +1,74 @@
+#ifndef FSM_EVENTS_H
+#define FSM_EVENTS_H
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// ============================================================================
+// FSM Events — wake the main loop instead of having it poll flags
+// ============================================================================
+//
+// The web server, the upload and background tasks and the PCNT watch point
+// used to set volatile flags that loop() polled on every pass, so the loop
+// had to wake every 10-100 ms just to look. Now they post event bits to the
+// loop task's FreeRTOS notification value (eSetBits: no queue storage, repeat
+// posts coalesce) and loop() blocks in wait() until an event arrives or the
+// current state's own deadline passes:
+//
+//   g_fsmEvents.post(FSM_EVT_UPLOAD_TRIGGER);            // any task
+//   g_fsmEvents.postFromISR(FSM_EVT_BUS_ACTIVITY);       // ISR
+//
+//   if (!uploadTaskRunning && g_fsmEvents.take(FSM_EVT_UPLOAD_TRIGGER)) ...
+//   g_fsmEvents.wait(timeoutMs);                         // end of loop()
+//
+// Received bits stay pending until a handler take()s them, so an event the
+// FSM cannot act on yet (an upload trigger while the upload task runs) is
+// kept, and acted on at the first pass where it can be.
+// ============================================================================
+
+enum FsmEvent : uint32_t {
+    FSM_EVT_UPLOAD_TRIGGER = 1u << 0,   // POST /trigger-upload
+    FSM_EVT_RESET_STATE    = 1u << 1,   // /reset-state
+    FSM_EVT_SOFT_REBOOT    = 1u << 2,   // /soft-reboot
+    FSM_EVT_MONITOR_START  = 1u << 3,   // /api/monitor/start
+    FSM_EVT_MONITOR_STOP   = 1u << 4,   // /api/monitor/stop
+    FSM_EVT_NETBENCH       = 1u << 5,   // /api/netbench?run=1
+    FSM_EVT_UPLOAD_DONE    = 1u << 6,   // Upload task finished; result in uploadTaskResult
+    FSM_EVT_NET_TASK_DONE  = 1u << 7,   // Pre-warm / self-test / compaction task finished
+    FSM_EVT_BUS_ACTIVITY   = 1u << 8,   // PCNT saw SD bus edges (ISR)
+};
+
+class FsmEventQueue {
+public:
+    FsmEventQueue();
+
+    // Call from the task that runs the FSM (setup() runs in the loop task)
+    void begin();
+
+    void post(uint32_t events);
+    // Returns true if a higher-priority task was woken (pass to portYIELD_FROM_ISR)
+    bool postFromISR(uint32_t events);
+
+    // Loop task only
+    bool take(uint32_t events);          // True if any were pending; clears them
+    bool isPending(uint32_t events);
+    void clear(uint32_t events);
+    void wait(uint32_t timeoutMs);       // Returns early when an event is posted
+
+    uint32_t getEventWakeups() const { return eventWakeups; }
+    uint32_t getTimeoutWakeups() const { return timeoutWakeups; }
+
+private:
+    TaskHandle_t fsmTask;
+    volatile uint32_t earlyEvents;       // Posted before begin()
+    uint32_t pending;
+    uint32_t eventWakeups;
+    uint32_t timeoutWakeups;
+
+    void collect();
+};
+
+extern FsmEventQueue g_fsmEvents;
+
+#endif // FSM_EVENTS_H
@@ -0,0 +1,103 @@
+#ifndef HEAP_GOVERNOR_H
+#define HEAP_GOVERNOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// Heap Governor — one place for "is there enough contiguous heap for this?"
+// ============================================================================
+//
+// What limits this device is the largest free block (ma), not the free total:
+// SD mount, the TLS handshake, libsmb2 PDUs and TLS records each need
+// a contiguous piece, and each phase must leave enough for what it does next.
+// Those limits used to be separate magic numbers per module; here every
+// subsystem has a named budget with a floor — the contiguous heap that must
+// still be free after the budget's own allocation — and asks the governor:
+//
+//   size_t chunk = g_heapGovernor.reserve(HeapBudget::CloudBuffer, 4096, 1024);
+//   ...                                   // 4096, 2048 or 1024; 0 = refused
+//   g_heapGovernor.release(HeapBudget::CloudBuffer);
+//
+//   if (!g_heapGovernor.admit(HeapBudget::SdMount)) { ... }   // phase entry
+//   if (!g_heapGovernor.hasRoom(HeapBudget::Smb)) { ... }     // query only
+//
+// reserve()/admit() decisions and releases are kept in a short history, and
+// per-budget counters, for GET /api/heap.
+// ============================================================================
+
+enum class HeapBudget : uint8_t {
+    SdMount,      // FATFS mount and the first directory reads
+    Tls,          // TLS handshake (records themselves live in the TLS arena)
+    Smb,          // libsmb2 context, PDUs and directory operations
+    CloudBuffer,  // SleepHQ streaming chunk (pooled buffer; caps the chunk size)
+    WebResponse,  // Web handlers that build a response in memory
+    COUNT
+};
+
+static const uint8_t HEAP_BUDGET_COUNT = (uint8_t)HeapBudget::COUNT;
+static const uint8_t HEAP_HISTORY_SIZE = 16;
+
+struct HeapBudgetState {
+    uint32_t held;      // Bytes currently reserved (0 when released or sizeless)
+    uint32_t peak;      // Largest grant since boot
+    uint16_t grants;
+    uint16_t denials;
+    bool active;        // Reserved/admitted and not yet released
+};
+
+enum class HeapOp : uint8_t { Grant, Deny, Release };
+
+struct HeapDecision {
+    uint32_t ms;
+    HeapBudget budget;
+    HeapOp op;
+    uint32_t requested;  // Preferred size (0 for admit/release)
+    uint32_t granted;
+    uint32_t largest;    // Largest free block when decided
+};
+
+class HeapGovernor {
+public:
+    typedef uint32_t (*LargestBlockFn)();
+
+    HeapGovernor();
+
+    // Largest of preferred, preferred/2, ... (not below minimum) that leaves
+    // the budget's floor free; 0 if even minimum does not fit. The budget
+    // holds the grant until release().
+    size_t reserve(HeapBudget budget, size_t preferred, size_t minimum);
+    // Enter a phase that allocates as it goes: true if its floor is free now
+    bool admit(HeapBudget budget);
+    void release(HeapBudget budget);
+
+    // Floor check without recording anything (for hot paths)
+    bool hasRoom(HeapBudget budget, size_t bytes = 0) const;
+
+    static uint32_t floorOf(HeapBudget budget);
+    static const char* budgetName(HeapBudget budget);
+
+    const HeapBudgetState& state(HeapBudget budget) const { return budgets[(uint8_t)budget]; }
+    // i-th most recent decision (0 = newest); false past the end
+    bool history(uint8_t i, HeapDecision& out) const;
+
+    // Write the budgets and history as a JSON object; returns length (0 if cut)
+    size_t toJson(char* out, size_t outLen) const;
+
+    // Largest free block source (ESP.getMaxAllocHeap() by default)
+    void setProbe(LargestBlockFn fn) { probe = fn; }
+    void reset();
+
+private:
+    LargestBlockFn probe;
+    HeapBudgetState budgets[HEAP_BUDGET_COUNT];
+    HeapDecision ring[HEAP_HISTORY_SIZE];
+    uint8_t ringHead;    // Next slot to write
+    uint8_t ringCount;
+
+    void record(HeapBudget budget, HeapOp op, uint32_t requested, uint32_t granted, uint32_t largest);
+};
+
+extern HeapGovernor g_heapGovernor;
+
+#endif // HEAP_GOVERNOR_H
@@ -0,0 +1,95 @@
+#ifndef IO_BUFFER_POOL_H
+#define IO_BUFFER_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ============================================================================
+// I/O Buffer Pool — shared static buffers for file streaming
+// ============================================================================
+//
+// The SMB upload buffer, the SleepHQ hash/stream chunks, the checksum read
+// buffer and the logger's flush buffer are all "read a chunk, hand it on"
+// buffers whose lifetimes barely overlap. Instead of a malloc per SMB session
+// and 4KB stack arrays on the 12KB upload-task stack, they check out slots
+// from a fixed pool in .bss (same idea as the TLS arena):
+//
+//   Slot 0     8KB  — SMB upload buffer / tar staging
+//   Slots 1-2  4KB  — checksum, SleepHQ hash + stream, logger flush
+//
+// A request takes the smallest free slot that fits. When every fitting slot
+// is out (or the size exceeds the largest slot) it falls back to the heap and
+// counts a miss, so callers never have to handle "pool empty" separately from
+// an ordinary allocation failure.
+//
+//   IoBuffer buf(4096, "checksum");
+//   if (!buf) { ... }                       // heap fallback also failed
+//   file.read(buf.data(), buf.size());
+//
+// Checkout/return is task-safe (the logger flushes from the main loop while
+// the upload task streams). Buffers are not zeroed.
+// ============================================================================
+
+static const uint8_t IO_POOL_SLOT_COUNT = 3;
+
+struct IoPoolStats {
+    uint32_t checkouts;      // Served from a pool slot
+    uint32_t heapFallbacks;  // Served from the heap (pool busy or too large)
+    uint32_t failures;       // Heap fallback failed too
+    uint8_t  inUse;          // Slots checked out now
+    uint8_t  peakInUse;
+};
+
+class IoBufferPool {
+public:
+    // Size of slot i (0 = largest)
+    static size_t slotSize(uint8_t i);
+    static size_t largestSlot() { return slotSize(0); }
+
+    // Low-level API; prefer IoBuffer. `owner` must be a string literal (kept
+    // for status output). Returns nullptr only if the heap fallback fails.
+    static uint8_t* checkout(size_t size, const char* owner);
+    static void give(uint8_t* buf);
+
+    static IoPoolStats stats();
+    // Owner of slot i, or nullptr when free
+    static const char* slotOwner(uint8_t i);
+    static void logStatus();
+};
+
+// Scoped checkout: returns the buffer when it goes out of scope
+class IoBuffer {
+public:
+    IoBuffer() : buf(nullptr), len(0) {}
+    IoBuffer(size_t size, const char* owner)
+        : buf(IoBufferPool::checkout(size, owner)), len(buf ? size : 0) {}
+    ~IoBuffer() { release(); }
+
+    // Check out (again); a held buffer is returned first
+    bool acquire(size_t size, const char* owner) {
+        release();
+        buf = IoBufferPool::checkout(size, owner);
+        len = buf ? size : 0;
+        return buf != nullptr;
+    }
+    void release() {
+        if (buf) {
+            IoBufferPool::give(buf);
+            buf = nullptr;
+            len = 0;
+        }
+    }
+
+    uint8_t* data() const { return buf; }
+    size_t size() const { return len; }
+    explicit operator bool() const { return buf != nullptr; }
+
+private:
+    uint8_t* buf;
+    size_t len;
+
+    IoBuffer(const IoBuffer&);
+    IoBuffer& operator=(const IoBuffer&);
+};
+
+#endif // IO_BUFFER_POOL_H
@@ -218,11 +218,11 @@ protected:
     Logger& operator=(const Logger&) = delete;
 
     /**
-     * Get current timestamp as formatted string
-     * Returns [HH:MM:SS] format or [--:--:--] if time not synced
+     * Write the current timestamp into `out` (at least 12 bytes)
+     * "[HH:MM:SS] " format or "[--:--:--] " if time not synced
      * Virtual to allow mocking in tests
      */
-    virtual String getTimestamp();
+    virtual void getTimestamp(char* out, size_t outLen);
 
     /**
      * Write data to serial interface
@@ -0,0 +1,64 @@
+#ifndef NET_BENCH_H
+#define NET_BENCH_H
+
+#include <Arduino.h>
+
+// ============================================================================
+// Network self-test (GET /api/netbench?run=1)
+// ============================================================================
+// Bounded, network-only measurements of each configured backend so slow
+// uploads can be attributed to WiFi, the NAS or the cloud.  Never touches the
+// SD card.  Measured throughput is persisted to NVS and seeds the uploaders'
+// AdaptiveChunkController on the next boot.
+
+// Bytes written / posted per backend and wall-clock cap per phase
+static const uint32_t NETBENCH_SMB_WRITE_BYTES  = 256 * 1024;
+static const uint32_t NETBENCH_CLOUD_POST_BYTES = 64 * 1024;
+static const uint32_t NETBENCH_PHASE_MAX_MS     = 10000;
+
+// NVS namespace / keys for the last measured throughput (bytes/s)
+#define NETBENCH_PREFS_NAMESPACE "cpap_net"
+#define NETBENCH_PREFS_SMB_BPS   "smb_bps"
+#define NETBENCH_PREFS_CLOUD_BPS "cloud_bps"
+
+struct SmbBenchResult {
+    bool     ok;
+    uint32_t tcpConnectMs;  // raw TCP handshake to port 445 (includes DNS)
+    uint32_t sessionMs;     // SMB negotiate + auth + tree connect
+    uint32_t writeBytes;    // scratch file bytes written
+    uint32_t writeMs;
+};
+
+struct CloudBenchResult {
+    bool     ok;
+    uint32_t dnsMs;
+    uint32_t tlsMs;          // TCP + TLS handshake
+    uint32_t apiRttMs;       // authenticated GET over the open connection
+    uint32_t postBytes;      // body bytes accepted by the socket
+    uint32_t postMs;         // body send time
+    uint32_t postResponseMs; // last body byte -> status line
+    int      postHttpCode;
+};
+
+enum class NetBenchState : uint8_t {
+    IDLE    = 0,  // never run since boot
+    RUNNING = 1,
+    DONE    = 2
+};
+
+struct NetBenchStatus {
+    NetBenchState    state;
+    uint32_t         finishedTs;  // Unix time (0 if NTP not synced)
+    uint32_t         durationMs;
+    int              rssi;
+    bool             smbTested;
+    bool             cloudTested;
+    SmbBenchResult   smb;
+    CloudBenchResult cloud;
+};
+
+static inline uint32_t netBenchBps(uint32_t bytes, uint32_t ms) {
+    return ms > 0 ? (uint32_t)(((uint64_t)bytes * 1000ULL) / ms) : 0;
+}
+
+#endif // NET_BENCH_H
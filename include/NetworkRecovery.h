@@ -43,3 +43,53 @@ static const unsigned long WIFI_CYCLE_WAIT_MS = 15000;      // 15 seconds
 //
 // Returns true if WiFi is connected after the attempt.
 bool tryCoordinatedWifiCycle(bool feedWatchdog = false);
+
+// ============================================================================
+// Failure-classifying escalating recovery
+// ============================================================================
+// Most upload failures are not "WiFi is dead": a stale socket, a poisoned ARP
+// entry or an expired DHCP lease recover in a few hundred milliseconds without
+// dropping the association. recoverNetwork() classifies the failure, picks the
+// cheapest step that can fix that class, and escalates one step per repeated
+// failure inside NET_RECOVERY_ESCALATION_WINDOW_MS. Only the last two steps
+// disturb the association; FullCycle is tryCoordinatedWifiCycle() with all of
+// its guards.
+
+enum class NetFailureClass : uint8_t {
+    Unknown,
+    Dns,              // Name resolution failed
+    HostUnreachable,  // EHOSTUNREACH / ARP resolution failed
+    ConnReset,        // TCP RST, EPIPE, broken socket
+    Timeout,          // Connect/read timed out
+    Tls,              // TLS alert / handshake failure
+    LinkLost          // STA not associated (see WiFiManager::getLastDisconnectReason)
+};
+
+enum class NetRecoveryStep : uint8_t {
+    None,
+    SocketReset,  // Caller already closed its socket; let lwIP reap it
+    ArpRefresh,   // Flush ARP cache + gratuitous ARP
+    DhcpRenew,    // Renew lease (keeps current IP) — also refreshes DNS servers
+    Reassociate,  // Reconnect to the AP without the full cycle delays
+    FullCycle     // tryCoordinatedWifiCycle()
+};
+
+// Repeated failures inside this window escalate to the next step.
+static const unsigned long NET_RECOVERY_ESCALATION_WINDOW_MS = 60000;  // 60 seconds
+
+// Minimum gap between reassociations (lighter than WIFI_CYCLE_COOLDOWN_MS).
+static const unsigned long NET_REASSOC_COOLDOWN_MS = 10000;            // 10 seconds
+
+// Classify a failure from an errno value and/or an error string
+// (libsmb2 smb2_get_error(), WiFiClientSecure::lastError()). Either may be 0/nullptr.
+NetFailureClass classifyNetworkFailure(int errorCode, const char* detail);
+
+// Run the next recovery step for this failure class. Returns true if WiFi is
+// connected with an IP afterwards (the caller should retry its connection).
+bool recoverNetwork(NetFailureClass failure, bool feedWatchdog = false);
+
+// Reset escalation after a successful connection.
+void noteNetworkHealthy();
+
+const char* netFailureClassName(NetFailureClass failure);
+const char* netRecoveryStepName(NetRecoveryStep step);
@@ -2,16 +2,40 @@
 #define OTA_MANAGER_H
 
 #include <Arduino.h>
-#include <Update.h>
 #include <WiFiClient.h>
+#include <WiFiClientSecure.h>
 #include <HTTPClient.h>
+#include <esp_ota_ops.h>
+#include <mbedtls/sha256.h>
+#include "OtaFlashWriter.h"
+#include "OtaImage.h"
+#include "OtaResume.h"
 
 class OTAManager {
 private:
     bool updateInProgress;
     size_t totalSize;
-    size_t writtenSize;
+    size_t writtenSize;     // Transfer bytes consumed (compressed / patch bytes)
     String currentVersion;
+
+    // Update partition writer: erases ahead and programs on a worker task,
+    // and can resume a partially written partition
+    const esp_partition_t* targetPartition;
+    OtaFlashWriter flash;
+    const char* otaError;   // Last failure, reported by getLastError()
+
+    // Transfer -> image decoding (raw, gzip, delta) and the image header check
+    OtaImageDecoder decoder;
+    size_t imageWritten;    // Image bytes written to the update partition
+    uint8_t imageHead[32];  // Start of a decoded image, held until it can be validated
+    size_t imageHeadLen;
+
+    // URL downloads: SHA-256 of the transfer, computed as it streams in, and
+    // the TLS client, kept across range requests instead of re-allocated
+    mbedtls_sha256_context sha;
+    bool hashing;
+    WiFiClientSecure* tlsClient;
+    OtaResumeState resume;  // Checkpoint being maintained for this download
     
     // Progress callback function pointer
     typedef void (*ProgressCallback)(size_t written, size_t total);
@@ -21,6 +45,19 @@ private:
     bool validateFirmware(const uint8_t* data, size_t length);
     bool isValidFirmwareHeader(const uint8_t* data);
 
+    bool writeImage(const uint8_t* data, size_t length);
+    bool flashImage(const uint8_t* data, size_t length);
+    static bool imageSink(void* ctx, const uint8_t* data, size_t length);
+    static bool readRunningImage(void* ctx, uint32_t offset, uint8_t* out, size_t length);
+
+    bool beginPartition(uint32_t resumeOffset);
+    bool resumeUpdate(const OtaResumeState& saved);
+    int requestDownload(HTTPClient& http, WiFiClient& client, const String& url);
+    bool streamDownload(HTTPClient& http);
+    void saveCheckpoint();
+    void releaseHash();
+    bool fail(const char* reason);
+
 public:
     OTAManager();
     
@@ -34,15 +71,20 @@ public:
     // Set progress callback
     void setProgressCallback(ProgressCallback callback);
     
-    // Manual OTA methods
+    // Manual OTA methods. The transfer may be a raw image, a gzip-compressed
+    // image or a delta patch against the running firmware (see OtaImage.h);
+    // sizes and progress refer to the transfer.
     bool startUpdate(size_t firmwareSize);
     bool writeChunk(const uint8_t* data, size_t length);
     bool finishUpdate();
     void abortUpdate();
     void forceReset();
     
-    // Download and install from URL
-    bool updateFromURL(const String& url);
+    // Download and install from URL. Dropped connections are resumed with HTTP
+    // Range requests; a raw image download interrupted by a reboot resumes from
+    // its last checkpoint when the same URL is requested again. If
+    // expectedSha256 (64 hex digits) is given, the transfer must match it.
+    bool updateFromURL(const String& url, const String& expectedSha256 = "");
     
     // Status methods
     bool isUpdateInProgress() const;
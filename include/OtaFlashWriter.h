@@ -0,0 +1,79 @@
+#ifndef OTA_FLASH_WRITER_H
+#define OTA_FLASH_WRITER_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+
+/**
+ * OtaFlashWriter - pipelined writes of a firmware image to the update partition
+ *
+ * esp_ota_write() erases each 4 KB sector when the write pointer reaches it,
+ * so the caller alternates between receiving a chunk and waiting on a sector
+ * erase plus program. Here a small worker task does the flash work instead:
+ *
+ *   caller ── write() ──► [buffer A | buffer B] ── full buffer ──► worker: program
+ *                                                                  worker: erase ahead
+ *
+ * - write() only copies into the filling buffer. When it is full, the buffer
+ *   is handed to the worker and the other one starts filling, so the next
+ *   network read overlaps the program of the previous 4 KB.
+ * - Between buffers the worker erases sectors up to OTA_ERASE_AHEAD bytes
+ *   beyond the write pointer, so a buffer rarely waits for an erase.
+ * - flush() hands over a partly filled buffer and waits until everything
+ *   written so far is in flash (a download checkpoint must describe flash
+ *   contents, and the image is verified from flash).
+ *
+ * The buffers, the worker's stack and its TCB are one heap block, allocated
+ * by begin() and freed by end(), so nothing is held between updates. The
+ * written image is verified by esp_ota_set_boot_partition().
+ */
+
+static const size_t OTA_WRITE_BUFFER_SIZE = 4096;     // One flash sector
+static const uint32_t OTA_ERASE_AHEAD = 32 * 1024;
+
+class OtaFlashWriter {
+public:
+    OtaFlashWriter();
+    ~OtaFlashWriter();
+
+    // Start writing `partition` at `offset` (non-zero when a download resumes;
+    // sector aligned). Sectors from `offset` on are erased before use.
+    bool begin(const esp_partition_t* partition, uint32_t offset);
+    bool write(const uint8_t* data, size_t len);
+    bool flush();
+    void end();  // Stops the worker; unflushed bytes are dropped
+
+    bool isActive() const { return work != nullptr; }
+    uint32_t bytesWritten() const { return writePos; }
+    esp_err_t lastError() const { return error; }
+
+private:
+    struct Work;
+    struct Job {
+        uint8_t buffer;     // Index into Work::buffers, or STOP
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    const esp_partition_t* partition;
+    Work* work;
+    TaskHandle_t task;
+    uint8_t filling;        // Buffer being filled by write()
+    size_t fillLen;
+    uint32_t writePos;      // Partition offset of the next byte handed to write()
+    volatile uint32_t submittedEnd;  // End of the last job handed to the worker
+    volatile uint32_t erasedTo;      // Sectors below this are erased (worker only)
+    volatile esp_err_t error;
+
+    bool submit();
+    bool waitIdle();
+    bool eraseNextSector();
+    static void workerTask(void* arg);
+    void runWorker();
+};
+
+#endif // OTA_FLASH_WRITER_H
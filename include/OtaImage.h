@@ -0,0 +1,186 @@
+#ifndef OTA_IMAGE_H
+#define OTA_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef UNIT_TEST
+#include "MockMiniz.h"
+#else
+#include <rom/miniz.h>
+#endif
+
+/**
+ * OtaImage - streaming decoders between the OTA transfer and the flash writer
+ *
+ * An OTA transfer may carry the application image in three forms, told apart
+ * by their first bytes:
+ *
+ *   Raw    0xE9 ...        plain ESP32 app image (firmware.bin)
+ *   Gzip   0x1F 0x8B ...   gzip member; the payload is Raw or Delta
+ *   Delta  "CPD1" ...      patch against the image in the running partition
+ *
+ * Everything is decoded as it arrives: gzip goes through the ROM tinfl
+ * inflater with one 32 KB window (allocated only for gzip transfers and freed
+ * at the end), and a delta patch reads the old image from flash in small
+ * pieces. Nothing is staged, so memory stays bounded whatever the image size.
+ *
+ * Delta patch ("CPD1", little-endian, bsdiff-style control stream):
+ *
+ *   0   "CPD1"
+ *   4   u32 source size    bytes of the running image the patch was built from
+ *   8   u32 source CRC32   checked against the running partition before use
+ *   12  u32 target size
+ *   16  u32 target CRC32   checked against the produced image at the end
+ *   20  records until target size bytes have been produced:
+ *         u32 diff length, u32 extra length, i32 source seek
+ *         diff bytes   (target = source + diff, byte-wise, mod 256)
+ *         extra bytes  (copied as-is)
+ *
+ * Patches are built with scripts/make_ota_delta.py and are normally shipped
+ * gzip-compressed: the diff bytes of a rebuilt image are mostly zero.
+ *
+ * Pure logic (flash and Update access go through callbacks) so the decoders
+ * can be unit tested natively.
+ */
+
+enum class OtaImageFormat : uint8_t {
+    Unknown = 0,
+    Raw,
+    Gzip,
+    Delta
+};
+
+const char* otaImageFormatName(OtaImageFormat format);
+
+// Needs the first 4 bytes of the stream (Raw and Gzip are known from fewer)
+OtaImageFormat detectOtaImageFormat(const uint8_t* data, size_t len);
+
+// Receives decoded image bytes in order. False aborts the decode.
+typedef bool (*OtaImageSink)(void* ctx, const uint8_t* data, size_t len);
+// Reads `len` bytes of the running image at `offset`
+typedef bool (*OtaSourceReader)(void* ctx, uint32_t offset, uint8_t* out, size_t len);
+
+// ============================================================================
+// Delta patch applier
+// ============================================================================
+
+class DeltaPatchApplier {
+public:
+    static const size_t HEADER_BYTES = 20;
+    static const size_t RECORD_BYTES = 12;
+
+    DeltaPatchApplier();
+
+    void begin(OtaSourceReader source, void* sourceCtx, OtaImageSink sink, void* sinkCtx);
+    bool feed(const uint8_t* data, size_t len);
+    // True once the whole target has been produced and its CRC matched
+    bool isComplete() const { return state == State::Done; }
+
+    uint32_t targetSize() const { return target; }
+    const char* error() const { return errorText; }
+
+private:
+    enum class State : uint8_t { Header, Record, Diff, Extra, Done, Failed };
+
+    OtaSourceReader source;
+    void* sourceCtx;
+    OtaImageSink sink;
+    void* sinkCtx;
+
+    State state;
+    uint8_t field[HEADER_BYTES];    // Header or control record being assembled
+    size_t fieldLen;
+    uint32_t sourceLen;
+    uint32_t target;
+    uint32_t targetCrc;
+    uint32_t produced;
+    uint32_t crc;
+    uint32_t sourcePos;
+    uint32_t diffLeft;
+    uint32_t extraLeft;
+    int32_t seek;
+    const char* errorText;
+    uint8_t scratch[256];           // Source bytes for the diff being applied
+
+    bool fail(const char* reason);
+    bool emit(const uint8_t* data, size_t len);
+    bool onHeader();
+    bool onRecord();
+    bool endRecord();
+    bool verifySource();
+};
+
+// ============================================================================
+// Transfer decoder (format sniffing, gzip framing, inflate, delta)
+// ============================================================================
+
+class OtaImageDecoder {
+public:
+    OtaImageDecoder();
+    ~OtaImageDecoder();
+
+    void begin(OtaImageSink sink, void* sinkCtx, OtaSourceReader source, void* sourceCtx);
+    // Transfer bytes, in order
+    bool write(const uint8_t* data, size_t len);
+    // End of transfer: true if every layer ended cleanly (gzip trailer matched,
+    // delta target complete)
+    bool finish();
+    // Release the inflate window
+    void end();
+    // Continue a raw image transfer whose first `bytes` are already in flash
+    // (resumed download)
+    void resumeRaw(uint32_t bytes);
+
+    OtaImageFormat transferFormat() const { return transfer; }
+    OtaImageFormat imageFormat() const { return payload; }
+    uint32_t imageBytes() const { return imageLen; }
+    const char* error() const { return errorText; }
+
+private:
+    enum class GzipState : uint8_t { Header, ExtraLen, Extra, Name, Comment, HeaderCrc, Body, Trailer, Done };
+
+    struct Inflate {
+        tinfl_decompressor tinfl;
+        uint8_t window[TINFL_LZ_DICT_SIZE];
+    };
+
+    OtaImageSink sink;
+    void* sinkCtx;
+    OtaSourceReader source;
+    void* sourceCtx;
+
+    OtaImageFormat transfer;
+    OtaImageFormat payload;
+    uint8_t transferSniff[4];       // Start of a stream whose format is not known yet
+    size_t transferSniffLen;
+    uint8_t payloadSniff[4];
+    size_t payloadSniffLen;
+    uint32_t imageLen;
+    const char* errorText;
+
+    // Gzip member state
+    GzipState gz;
+    uint8_t gzField[10];
+    size_t gzFieldLen;
+    uint8_t gzFlags;
+    uint16_t gzSkip;                // FEXTRA / FHCRC bytes still to skip
+    uint32_t gzCrc;
+    uint32_t gzSize;
+    Inflate* inflate;
+    size_t windowPos;
+
+    DeltaPatchApplier delta;
+
+    bool fail(const char* reason);
+    bool writeTransfer(const uint8_t* data, size_t len);
+    bool writePayload(const uint8_t* data, size_t len);
+    bool writeImage(const uint8_t* data, size_t len);
+    bool feedGzip(const uint8_t* data, size_t len);
+    bool inflateBody(const uint8_t*& data, size_t& len);
+    void nextHeaderField();
+    bool feedTrailer(const uint8_t* data, size_t len);
+    static bool deltaSink(void* ctx, const uint8_t* data, size_t len);
+};
+
+#endif // OTA_IMAGE_H
@@ -0,0 +1,60 @@
+#ifndef OTA_RESUME_H
+#define OTA_RESUME_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * OtaResume - checkpoint of an interrupted URL firmware download
+ *
+ * updateFromURL() retries a dropped connection in place with an HTTP Range
+ * request, whatever the transfer format. If the device reboots mid-download,
+ * a raw image transfer can continue from the last checkpoint instead of
+ * starting over: every OTA_CHECKPOINT_INTERVAL bytes the byte offset, the
+ * SHA-256 state at that offset and the server's validator (ETag or
+ * Last-Modified) are saved to LittleFS. The flash up to that offset is
+ * already in the update partition, so the next attempt for the same URL
+ * resumes the partition writer there and asks the server for the rest
+ * (If-Range). A gzip or delta transfer cannot resume across a reboot: its
+ * decoder state (inflate window) is not persisted.
+ *
+ * Line format (one line, fields separated by '|', validator last):
+ *   R|<url crc32 hex>|<partition label>|<total>|<offset>|<sha256 state hex>|<validator>
+ */
+
+static const uint32_t OTA_CHECKPOINT_INTERVAL = 64 * 1024;  // Multiple of the 64-byte SHA block
+static const size_t OTA_VALIDATOR_MAX = 72;
+
+struct OtaResumeState {
+    uint32_t urlCrc;             // CRC32 of the download URL
+    char partition[17];          // Update partition label the bytes went to
+    uint32_t totalSize;          // Size of the whole transfer
+    uint32_t offset;             // Bytes written and hashed
+    uint32_t shaState[8];        // SHA-256 midstate at `offset`
+    char validator[OTA_VALIDATOR_MAX];  // ETag (preferred) or Last-Modified
+};
+
+uint32_t otaUrlCrc(const char* url);
+
+// "bytes <start>-<end>/<total>". False if malformed or the total is unknown ("*").
+bool parseContentRange(const char* header, uint32_t& start, uint32_t& end, uint32_t& total);
+
+// 64 hex digits (either case, surrounding whitespace allowed) -> 32 bytes
+bool parseSha256Hex(const char* hex, uint8_t out[32]);
+void sha256ToHex(const uint8_t digest[32], char out[65]);
+
+class OtaResumeStore {
+public:
+    static const char* const PATH;
+
+    static bool formatLine(const OtaResumeState& state, char* out, size_t outLen);
+    static bool parseLine(const char* line, OtaResumeState& out);
+
+    static bool load(fs::FS &fs, OtaResumeState& out);
+    static bool save(fs::FS &fs, const OtaResumeState& state);
+    static void clear(fs::FS &fs);
+};
+
+#endif // OTA_RESUME_H
@@ -3,6 +3,14 @@
 
 #include <Arduino.h>
 #include <FS.h>
+#include "SdBusProfile.h"
+#include "SdHandover.h"
+#include "SdMetaCache.h"
+
+class TrafficMonitor;
+
+// VFS path SD_MMC is mounted at (for POSIX access, see DirScanner)
+#define SD_MOUNT_POINT "/sdcard"
 
 class SDCardManager {
 private:
@@ -10,16 +18,61 @@ private:
     bool espHasControl;
     unsigned long controlAcquiredAt;
 
+    // Bus profile the card is currently mounted with, and the card identity
+    // its calibrated profile is stored under (0 = unknown)
+    SdBusProfile activeProfile;
+    uint32_t cardId;
+
+    // Host-side bus activity (PCNT on CS_SENSE) for release handover polling
+    TrafficMonitor* trafficMonitor;
+
+    // Handover timing learned for the attached machine model
+    char machineModel[32];
+    uint32_t modelKey;          // FNV-1a of machineModel (0 = not yet identified)
+    SdHandoverStats handoverStats;
+    SdHandoverStats savedHandoverStats;  // As last read from / written to NVS
+    uint32_t lastAcquireMs;     // MUX switch -> mounted, for the current hold
+
+    // File metadata valid for the current hold (cleared on release)
+    SdMetaCache metaCache;
+
     void setControlPin(bool espControl);
+    bool mountWhenReady(const SdBusProfile& profile);
+    void waitForHostAfterRelease(int hostBaseline, unsigned long switchedAt);
+    void identifyMachineModel();
+    void loadHandoverStats();
+    void saveHandoverStats();
+
+    // ── Bus auto-tuning ──
+    SdBusProfile defaultProfile() const;
+    bool mountWithProfile(const SdBusProfile& profile);
+    bool mountWithFallback(const SdBusProfile& preferred, uint32_t preferredCardId);
+    uint32_t computeCardId();
+    bool loadProfile(uint32_t id, SdBusProfile& out);
+    void saveProfile(uint32_t id, const SdBusProfile& profile);
+    void forgetProfile(uint32_t id);
+    uint32_t loadLastCardId();
+    void saveLastCardId(uint32_t id);
+    bool benchmarkProfile(const SdBusProfile& profile, const char* refPath,
+                          uint32_t refBytes, uint32_t& refChecksum, SdBusTrial& trial);
 
 public:
     SDCardManager();
-    
+
     bool begin();
+    void setTrafficMonitor(TrafficMonitor* monitor) { trafficMonitor = monitor; }
     bool takeControl();
     void releaseControl();
     bool hasControl() const;
     fs::FS& getFS();
+    SdMetaCache& getMetaCache() { return metaCache; }
+
+    // Benchmark bus width/clock candidates and persist the fastest stable
+    // profile for this card. Runs only while the ESP holds the card and when
+    // the card has no profile yet or it is due for revalidation.
+    // Returns true if a calibration ran.
+    bool calibrateBusIfDue();
+    const SdBusProfile& getActiveProfile() const { return activeProfile; }
 };
 
 #endif // SDCARD_MANAGER_H
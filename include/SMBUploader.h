@@ -4,6 +4,12 @@
 #include <Arduino.h>
 #include <FS.h>
 #include <map>
+#include <vector>
+#include <functional>
+#include "AdaptiveChunk.h"
+#include "NetBench.h"
+#include "EdfSummary.h"
+#include "StaticString.h"
 
 #ifdef ENABLE_SMB_UPLOAD
 
@@ -11,6 +17,17 @@
 struct smb2_context;
 struct smb2fh;
 
+// Share-relative paths are built in place (base path + remote path)
+static const size_t SMB_PATH_MAX = 192;
+typedef StaticString<SMB_PATH_MAX> SmbPath;
+
+// One SD file of a folder archive (see SMBUploader::uploadArchive)
+struct SmbArchiveMember {
+    String localPath;   // e.g. "/DATALOG/20241101/20241101_221500_BRP.edf"
+    uint32_t size;      // Size at scan time (the card is held, so it cannot change)
+    bool changed;       // New or modified since the last upload (FileUploader bookkeeping)
+};
+
 /**
  * SMBUploader - Handles file uploads to SMB/CIFS shares
  * 
@@ -43,13 +60,32 @@ private:
     struct smb2_context* smb2;  // libsmb2 context
     bool connected;
     
-    // Pre-allocated upload buffer (avoids per-file malloc/free fragmentation)
+    // Upload buffer checked out of the I/O pool for the SMB phase
     uint8_t* uploadBuffer;
     size_t uploadBufferSize;
 
+    // Write chunk size / pacing within uploadBufferSize (link-driven)
+    AdaptiveChunkController chunkTuner;
+
+    // Optional reducer fed with every chunk written (night summary); not owned
+    EdfStreamReducer* readTap;
+
+    // Share-relative path (base path prepended, no leading slash) for libsmb2;
+    // false if it does not fit in SmbPath
+    bool toSharePath(const char* remotePath, SmbPath& out) const;
+
+    // Folder archive mode: the TarStreamWriter sink that pushes each full
+    // buffer through chunk-sized SMB writes
+    struct ArchiveWriteCtx;
+    static bool archiveSink(void* ctx, const uint8_t* data, size_t len);
+
     // Cache the last verified parent directory for current SMB session to
     // avoid redundant stat/mkdir checks for every file in the same folder.
     String lastVerifiedParentDir;
+
+    // libsmb2 error text from the last failed connect() — used to classify
+    // the failure for NetworkRecovery (empty after a successful connect).
+    char lastConnectError[96];
     
     /**
      * Parse SMB endpoint string into server and share components
@@ -104,7 +140,7 @@ public:
      * @param path Directory path to create (e.g., "/DATALOG/20241101")
      * @return true if directory created or already exists, false on error
      */
-    bool createDirectory(const String& path);
+    bool createDirectory(const char* path);
     
     /**
      * Upload a file from SD card to SMB share
@@ -114,10 +150,37 @@ public:
      * @param remotePath Path on SMB share (e.g., "/DATALOG/20241101/file.edf")
      * @param sd Reference to SD card filesystem
      * @param bytesTransferred Output parameter for bytes transferred (for rate calculation)
+     * @param fileChecksum Optional output: fingerprint text (LOCAL_FINGERPRINT_ALGO)
+     *                     of exactly the bytes written, computed while streaming
+     *                     (no second read of the file)
      * @return true if upload successful, false otherwise
      */
-    bool upload(const String& localPath, const String& remotePath, 
-                fs::FS &sd, unsigned long& bytesTransferred);
+    bool upload(const char* localPath, const char* remotePath, 
+                fs::FS &sd, unsigned long& bytesTransferred,
+                String* fileChecksum = nullptr);
+
+    /**
+     * Upload several SD files as one uncompressed tar object (folder archive mode)
+     * Headers and file data are packed into the upload buffer and only full
+     * buffers are written, so small files cost no extra SMB round trips.
+     * Nothing is staged locally. A sidecar index (remotePath + ".idx") lists
+     * one "name<TAB>data offset<TAB>size<TAB>mtime" line per member.
+     * Both are written as ".part" files and renamed into place on success.
+     * Single attempt: a transport failure disconnects and returns false.
+     *
+     * @param members Files in archive order
+     * @param localRoot Prefix stripped from local paths to form member names
+     *                  (e.g., "/DATALOG/" gives "20241101/file.edf")
+     * @param remotePath Archive path on SMB share (e.g., "/DATALOG/20241101.tar")
+     * @param sd Reference to SD card filesystem
+     * @param bytesTransferred Output parameter for archive bytes written
+     * @param memberHook Optional: called with (localPath, false) before a
+     *                   member's data is read and (localPath, true) after it
+     * @return true if the archive and its index were written, false otherwise
+     */
+    bool uploadArchive(const std::vector<SmbArchiveMember>& members, const String& localRoot,
+                       const String& remotePath, fs::FS &sd, unsigned long& bytesTransferred,
+                       const std::function<void(const String&, bool)>& memberHook = nullptr);
     
     /**
      * Cleanup and disconnect
@@ -132,16 +195,17 @@ public:
     bool isConnected() const;
     
     /**
-     * Pre-allocate upload buffer (must be called before first upload)
-     * Should be called BEFORE Cloud TLS initialization to get clean heap
+     * Check out the upload buffer (must be called before first upload)
+     * Served from the static I/O buffer pool (8KB slot); falls back to the
+     * heap only if that slot is busy.
      * 
-     * @param size Buffer size to allocate (e.g., 8192, 4096, 2048, 1024)
-     * @return true if allocation successful, false otherwise
+     * @param size Buffer size (at most 8192 for a pool slot)
+     * @return true if a buffer was obtained, false otherwise
      */
     bool allocateBuffer(size_t size);
     
     /**
-     * Free the upload buffer (releases heap for other phases)
+     * Return the upload buffer to the I/O pool
      * Safe to call even if no buffer is allocated.
      */
     void freeBuffer();
@@ -164,6 +228,24 @@ public:
      * @return true if successful, false on error
      */
     bool getRemoteFileInfo(const String& remotePath, std::map<String, size_t>& fileInfo);
+
+    /**
+     * Network self-test: time a raw TCP connect to port 445, the SMB session
+     * setup, and a bounded write of a scratch file (.netbench.tmp under the
+     * base path) which is deleted afterwards. Disconnects when done.
+     *
+     * @param totalBytes Scratch file size (capped by NETBENCH_PHASE_MAX_MS)
+     * @param result Output timings
+     * @return true if the write phase completed
+     */
+    bool runNetBench(uint32_t totalBytes, SmbBenchResult& result);
+
+    // Seed write chunk sizing from a previous self-test (bytes/s)
+    void seedThroughput(uint32_t bytesPerSec) { chunkTuner.seedThroughput(bytesPerSec); }
+
+    // Hand the bytes of the next upload() to a reducer (nullptr to detach).
+    // It is restarted at each attempt, so it only ever sees one full stream.
+    void setReadTap(EdfStreamReducer* tap) { readTap = tap; }
 };
 
 #endif // ENABLE_SMB_UPLOAD
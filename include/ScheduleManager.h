@@ -23,8 +23,29 @@ private:
     bool ntpSynced;
     const char* ntpServer;
     int gmtOffsetHours;
+    
+    // Session-end learning (smart mode predictive pre-warm)
+    // Ring of recent therapy-session end times as local minute-of-day (0-1439),
+    // persisted to NVS so the prediction survives reboots.
+    static const int SESSION_END_HISTORY = 7;
+    int16_t sessionEndMinutes[SESSION_END_HISTORY];
+    int sessionEndCount;
+    int sessionEndHead;                  // Next write slot
+    unsigned long lastSessionEndEpoch;   // time() of the last recorded end (0 = none)
+    unsigned long lastPreWarmEpoch;      // time() when pre-warm last started (0 = never)
+    
+    void loadSessionEndHistory();
+    void saveSessionEndHistory();
 
 public:
+    // Minimum samples before a session-end prediction is trusted
+    static const int SESSION_END_MIN_SAMPLES = 3;
+    // Ends closer than this to the previous one belong to the same night
+    // (e.g. mask off for a bathroom break) — the later end replaces the earlier.
+    static const unsigned long SESSION_END_MERGE_SECONDS = 8UL * 3600UL;
+    // Pre-warm this many minutes before the predicted session end
+    static const int PREWARM_LEAD_MINUTES = 10;
+    
     ScheduleManager();
     
     // New FSM-aware begin
@@ -61,6 +82,13 @@ public:
     int getUploadStartHour() const;
     int getUploadEndHour() const;
     bool isSmartMode() const;
+    
+    // Session-end learning (smart mode predictive pre-warm)
+    void recordSessionEnd(unsigned long endEpoch);   // Local time() when therapy ended
+    int getPredictedSessionEndMinute() const;        // Minute-of-day, -1 if not enough history
+    int getSessionEndSampleCount() const;
+    bool isPreWarmDue();                             // In [predicted - lead, predicted], once per night
+    void markPreWarmStarted();
 };
 
 #endif // SCHEDULE_MANAGER_H
@@ -0,0 +1,61 @@
+#ifndef SD_BUS_PROFILE_H
+#define SD_BUS_PROFILE_H
+
+#include <Arduino.h>
+
+/**
+ * SD bus profile (width + clock) and calibration helpers
+ *
+ * SDCardManager benchmarks each candidate profile while the ESP owns the card
+ * (sequential read throughput + read errors + data checksum against the
+ * default-profile read) and persists the fastest stable one per card in NVS.
+ * This file holds the pure logic (record format, selection, revalidation
+ * schedule) so it can be unit tested natively.
+ */
+
+// Clock values in kHz (match SDMMC_FREQ_DEFAULT / SDMMC_FREQ_HIGHSPEED)
+static const uint32_t SD_BUS_FREQ_DEFAULT_KHZ   = 20000;
+static const uint32_t SD_BUS_FREQ_HIGHSPEED_KHZ = 40000;
+
+// Re-run the calibration for a card after this long (needs NTP time)
+static const uint32_t SD_BUS_REVALIDATE_SECS = 7UL * 24UL * 3600UL;
+
+// A faster profile must beat a slower one by this margin (percent) to win —
+// otherwise the card ignored the clock request and the safer profile is kept.
+static const uint32_t SD_BUS_MIN_GAIN_PCT = 10;
+
+struct SdBusProfile {
+    uint8_t  width;        // 1 or 4
+    uint32_t freqKhz;      // SD_BUS_FREQ_*_KHZ
+    uint32_t readBps;      // sequential read throughput measured at calibration
+    uint32_t validatedTs;  // Unix time of the calibration (0 = unknown)
+};
+
+// Outcome of benchmarking one candidate profile
+struct SdBusTrial {
+    SdBusProfile profile;
+    bool         mounted;
+    uint8_t      passes;     // read passes attempted
+    uint8_t      errors;     // short reads / open failures / checksum mismatches
+    uint32_t     bytes;      // bytes read across all passes
+    uint32_t     elapsedMs;
+};
+
+inline bool sdBusProfileEquals(const SdBusProfile& a, const SdBusProfile& b) {
+    return a.width == b.width && a.freqKhz == b.freqKhz;
+}
+
+// NVS record: "<width>,<freqKhz>,<readBps>,<validatedTs>"
+int  formatSdBusProfile(const SdBusProfile& p, char* buf, size_t len);
+bool parseSdBusProfile(const char* s, SdBusProfile& out);
+
+// Index of the fastest trial with no errors, or -1. Trials are expected in
+// ascending clock/width order; a faster trial only replaces the current best
+// when it gains at least SD_BUS_MIN_GAIN_PCT.
+int selectFastestStableSdBusTrial(const SdBusTrial* trials, size_t count);
+
+// True when the card has no stored profile, or the stored one is older than
+// SD_BUS_REVALIDATE_SECS. Without a valid clock only missing profiles are due.
+bool isSdBusCalibrationDue(bool hasStored, const SdBusProfile& stored, uint32_t now);
+
+#endif // SD_BUS_PROFILE_H
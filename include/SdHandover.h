@@ -0,0 +1,68 @@
+#ifndef SD_HANDOVER_H
+#define SD_HANDOVER_H
+
+#include <Arduino.h>
+
+/**
+ * SD MUX handover timing
+ *
+ * Instead of fixed settle delays, SDCardManager polls readiness on both
+ * sides of the MUX:
+ *   - acquire: a short MUX settle, then the mount itself (the SD init
+ *     sequence polls ACMD41 until the card reports ready), retried with a
+ *     short backoff up to SD_ACQUIRE_READY_TIMEOUT_MS
+ *   - release: a short MUX settle, then wait for the CPAP's first access on
+ *     the host side (PCNT on CS_SENSE) up to a bound learned per machine model
+ *
+ * Measured settle times are kept per machine model (from Identification.*)
+ * in NVS. Pure logic here so it can be unit tested natively.
+ */
+
+// Minimum hold after toggling the MUX (analog switch + rail settle)
+static const uint32_t SD_MUX_SETTLE_MS = 20;
+// Acquire: give up re-trying the mount after this long
+static const uint32_t SD_ACQUIRE_READY_TIMEOUT_MS = 1500;
+static const uint32_t SD_ACQUIRE_RETRY_MS = 100;
+// Release: never wait longer than the old fixed delay for the CPAP's first access
+static const uint32_t SD_RELEASE_SETTLE_MAX_MS = 300;
+// Releases observed before the learned release bound is trusted
+static const uint8_t  SD_RELEASE_LEARN_SAMPLES = 3;
+// Models that seldom re-access the card promptly still get a full-bound probe this often
+static const uint8_t  SD_RELEASE_REPROBE_EVERY = 8;
+// NVS writes: learned latencies must move this much, or this many releases pass
+static const uint16_t SD_HANDOVER_SAVE_DELTA_MS = 10;
+static const uint8_t  SD_HANDOVER_SAVE_EVERY = 16;
+
+struct SdHandoverStats {
+    uint16_t acquireMs;      // EWMA: MUX switch -> card mounted
+    uint16_t releaseMs;      // EWMA: MUX switch -> first host access (seen releases only)
+    uint8_t  releaseSeen;    // releases where the host accessed the card within the bound
+    uint8_t  releaseMissed;  // releases with no host access within the bound
+};
+
+void sdHandoverRecordAcquire(SdHandoverStats& stats, uint32_t ms);
+void sdHandoverRecordRelease(SdHandoverStats& stats, bool hostAccessSeen, uint32_t ms);
+
+// How long the next release should wait for the host's first access.
+// Until enough releases were observed this is SD_RELEASE_SETTLE_MAX_MS; a
+// model that rarely touches the card right after handback gets the MUX settle
+// only (with a periodic full-bound probe); otherwise about twice the learned
+// latency.
+uint32_t sdHandoverReleaseWaitMs(const SdHandoverStats& stats);
+
+// Whether `current` is worth an NVS write over the last persisted `saved`:
+// still learning, release mode flipped (prompt vs seldom host access), a
+// latency moved by SD_HANDOVER_SAVE_DELTA_MS, or SD_HANDOVER_SAVE_EVERY
+// releases since. Every release bumps a counter, so saving unconditionally
+// would write flash on each handover.
+bool sdHandoverNeedsSave(const SdHandoverStats& saved, const SdHandoverStats& current);
+
+// NVS record: "<acquireMs>,<releaseMs>,<seen>,<missed>"
+int  formatSdHandoverStats(const SdHandoverStats& stats, char* buf, size_t len);
+bool parseSdHandoverStats(const char* s, SdHandoverStats& out);
+
+// Extract the machine model from Identification.json ("ProductName") or
+// Identification.tgt ("#PNA <name>"). Returns false if neither is present.
+bool parseMachineModel(const char* text, char* out, size_t outLen);
+
+#endif // SD_HANDOVER_H
@@ -0,0 +1,65 @@
+#ifndef SD_META_CACHE_H
+#define SD_META_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * SdMetaCache - per-hold file metadata cache for the SD card
+ *
+ * While the ESP holds the card the CPAP cannot write to it, so a file's size
+ * and timestamps stay valid until control is released. The cache fills
+ * lazily: the first get() for a path stat()s it on the VFS mount point and
+ * keeps the result (including "does not exist"), so hasFileChanged(), the
+ * upload paths and markFileUploaded() asking about the same file again do not
+ * open it just to learn its size. SDCardManager::releaseControl() clears it.
+ *
+ * Direct-mapped by a 64-bit path hash (FNV-1a, as UploadStateStore keys its
+ * file entries) with a fixed slot count: no heap, and two paths sharing a
+ * slot simply evict each other. A slot answers only for the full key, so a
+ * lookup never returns another file's metadata short of a 64-bit collision.
+ */
+
+enum SdMetaAttr : uint8_t {
+    SD_META_EXISTS = 0x01,
+    SD_META_DIR    = 0x02
+};
+
+struct SdFileMeta {
+    uint32_t size;
+    uint32_t mtime;     // FAT modification time (epoch seconds)
+    uint8_t  attr;      // SdMetaAttr bits; 0 = file does not exist
+};
+
+class SdMetaCache {
+public:
+    static const size_t SLOTS = 128;
+
+    explicit SdMetaCache(const char* mountPoint);
+
+    // Cached metadata, or stat() on a miss. Returns false if the file is absent.
+    bool get(const char* path, SdFileMeta& out);
+    bool lookup(const char* path, SdFileMeta& out) const;   // cache only, no stat()
+    void put(const char* path, const SdFileMeta& meta);
+    void invalidate(const char* path);
+    void clear();
+
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+
+private:
+    struct Slot {
+        uint64_t key;       // 0 = empty
+        uint16_t pathLen;   // cheap second check against hash collisions
+        SdFileMeta meta;
+    };
+
+    const char* mountPoint;
+    Slot slots[SLOTS];
+    uint32_t hits;
+    uint32_t misses;
+
+    static uint64_t hashPath(const char* path, uint16_t& len);
+};
+
+#endif // SD_META_CACHE_H
@@ -8,6 +8,9 @@
 
 #include <WiFiClientSecure.h>
 #include "Config.h"
+#include "AdaptiveChunk.h"
+#include "NetBench.h"
+#include "EdfSummary.h"
 
 /**
  * SleepHQUploader - Uploads CPAP data to SleepHQ cloud service via REST API
@@ -33,16 +36,24 @@ private:
     String currentImportId;
     bool connected;
     bool lowMemoryKeepAliveWarned;
+    bool transportError;   // Last upload() failed on the network/server side
+    bool sdReadError;      // Set by httpMultipartUpload when the SD file could not be read
     
     // TLS client
     WiFiClientSecure* tlsClient;
+
+    // Streaming chunk size / pacing (heap sets the ceiling, link sets the rest)
+    AdaptiveChunkController chunkTuner;
+
+    // Optional reducer fed with every chunk streamed (night summary); not owned
+    EdfStreamReducer* readTap;
     
     // HTTP helpers
-    bool httpRequest(const String& method, const String& path, 
+    bool httpRequest(const char* method, const char* path, 
                      const String& body, const String& contentType,
                      String& responseBody, int& httpCode);
-    bool httpMultipartUpload(const String& path, const String& fileName,
-                             const String& filePath, const String& contentHash,
+    bool httpMultipartUpload(const char* path, const char* fileName,
+                             const char* filePath, const String& contentHash,
                              unsigned long lockedFileSize,
                              fs::FS &sd, unsigned long& bytesTransferred,
                              String& responseBody, int& httpCode,
@@ -73,17 +84,32 @@ public:
     
     bool begin();
     bool preWarmTLS();  // Pre-allocate TLS buffers early (before SD mount) to reduce fragmentation
-    bool upload(const String& localPath, const String& remotePath, 
+    bool preWarm();     // DNS + TLS + OAuth token + team id ahead of an expected upload (no import)
+    bool upload(const char* localPath, const char* remotePath, 
                 fs::FS &sd, unsigned long& bytesTransferred, String& fileChecksum);
     void end();
     void resetConnection();  // Tear down TLS to reclaim heap between imports
     bool isConnected() const;
     bool isTlsAlive() const;  // Check if raw TLS connection is still active
+    // After a failed upload(): true when the link, auth or server failed
+    // (backend-level), false when the file itself could not be read or was rejected
+    bool hadTransportError() const { return transportError; }
     
     // Import session management (called by FileUploader)
     bool createImport();
     bool processImport();
     
+    // Network self-test: DNS, TLS handshake, authenticated API round trip and
+    // a bounded POST to an unrouted path (no import is created). Leaves TLS closed.
+    bool runNetBench(uint32_t postBytes, CloudBenchResult& result);
+
+    // Seed streaming chunk sizing from a previous self-test (bytes/s)
+    void seedThroughput(uint32_t bytesPerSec) { chunkTuner.seedThroughput(bytesPerSec); }
+
+    // Hand the bytes of the next upload() to a reducer (nullptr to detach).
+    // It is restarted at each attempt, so it only ever sees one full stream.
+    void setReadTap(EdfStreamReducer* tap) { readTap = tap; }
+    
     // Status getters
     const String& getTeamId() const;
     const String& getCurrentImportId() const;
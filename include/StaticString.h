@@ -0,0 +1,150 @@
+#ifndef STATIC_STRING_H
+#define STATIC_STRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * StaticString<N> - fixed-capacity string in an N-byte inline buffer
+ *
+ * For paths, URLs and log lines built once per file or per line: Arduino
+ * String concatenation ("/DATALOG/" + name, base + "/" + path) allocates on
+ * every step and the freed blocks fragment the heap that TLS and SD mounts
+ * need contiguous. A StaticString lives on the stack (or inside its owner)
+ * and never allocates.
+ *
+ * Writes that do not fit are cut at the capacity (N - 1 characters, always
+ * NUL-terminated) and set truncated(), which stays set until clear() or the
+ * next assign()/format(). Callers that use the result as a path must check
+ * it: a cut path names a different file.
+ *
+ *   StaticString<96> path;
+ *   path.format("%s/%s", folderPath, fileName.c_str());
+ *   if (path.truncated()) { ... }
+ *   sd.open(path.c_str());
+ *
+ * Pass c_str() to APIs taking const char*; there is deliberately no implicit
+ * conversion, since passing one to a const String& parameter would allocate.
+ */
+template <size_t N>
+class StaticString {
+public:
+    static_assert(N > 1, "StaticString needs room for at least one character");
+
+    StaticString() : len(0), overflow(false) { buf[0] = '\0'; }
+    explicit StaticString(const char* s) : len(0), overflow(false) {
+        buf[0] = '\0';
+        append(s);
+    }
+
+    StaticString& clear() {
+        len = 0;
+        overflow = false;
+        buf[0] = '\0';
+        return *this;
+    }
+
+    StaticString& assign(const char* s) { return clear().append(s); }
+    StaticString& assign(const char* s, size_t n) { return clear().append(s, n); }
+
+    StaticString& append(const char* s) { return s ? append(s, strlen(s)) : *this; }
+    // Arduino String (or anything with c_str() and length())
+    template <typename S>
+    StaticString& append(const S& s) { return append(s.c_str(), s.length()); }
+    StaticString& append(const char* s, size_t n) {
+        size_t room = N - 1 - len;
+        if (n > room) {
+            n = room;
+            overflow = true;
+        }
+        memcpy(buf + len, s, n);
+        len += n;
+        buf[len] = '\0';
+        return *this;
+    }
+    StaticString& append(char c) { return append(&c, 1); }
+
+    StaticString& operator+=(const char* s) { return append(s); }
+    template <typename S>
+    StaticString& operator+=(const S& s) { return append(s); }
+    StaticString& operator+=(char c) { return append(c); }
+
+    // printf-style append / replace
+    StaticString& appendf(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, fmt);
+        vappendf(fmt, args);
+        va_end(args);
+        return *this;
+    }
+    StaticString& format(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+        clear();
+        va_list args;
+        va_start(args, fmt);
+        vappendf(fmt, args);
+        va_end(args);
+        return *this;
+    }
+    StaticString& vappendf(const char* fmt, va_list args) {
+        size_t room = N - len;
+        int n = vsnprintf(buf + len, room, fmt, args);
+        if (n < 0) {
+            buf[len] = '\0';
+            overflow = true;
+        } else if ((size_t)n >= room) {
+            len = N - 1;
+            overflow = true;
+        } else {
+            len += (size_t)n;
+        }
+        return *this;
+    }
+
+    // Keep the first `n` characters (no-op if already shorter)
+    StaticString& truncate(size_t n) {
+        if (n < len) {
+            len = n;
+            buf[len] = '\0';
+        }
+        return *this;
+    }
+
+    const char* c_str() const { return buf; }
+    size_t length() const { return len; }
+    static size_t capacity() { return N - 1; }
+    bool isEmpty() const { return len == 0; }
+    bool truncated() const { return overflow; }
+
+    char operator[](size_t i) const { return i < len ? buf[i] : '\0'; }
+
+    int indexOf(char c) const {
+        const char* p = (const char*)memchr(buf, c, len);
+        return p ? (int)(p - buf) : -1;
+    }
+    int lastIndexOf(char c) const {
+        for (size_t i = len; i > 0; i--) {
+            if (buf[i - 1] == c) return (int)(i - 1);
+        }
+        return -1;
+    }
+    bool startsWith(const char* prefix) const {
+        size_t n = strlen(prefix);
+        return n <= len && memcmp(buf, prefix, n) == 0;
+    }
+    bool endsWith(const char* suffix) const {
+        size_t n = strlen(suffix);
+        return n <= len && memcmp(buf + len - n, suffix, n) == 0;
+    }
+    bool equals(const char* s) const { return s && strcmp(buf, s) == 0; }
+    bool operator==(const char* s) const { return equals(s); }
+    bool operator!=(const char* s) const { return !equals(s); }
+
+private:
+    char buf[N];
+    size_t len;
+    bool overflow;
+};
+
+#endif // STATIC_STRING_H
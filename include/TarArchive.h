@@ -0,0 +1,81 @@
+#ifndef TAR_ARCHIVE_H
+#define TAR_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * TarArchive - streaming ustar writer for the SMB folder archive mode
+ *
+ * A DATALOG day folder is sent to the share as one uncompressed tar object
+ * built on the fly: member headers and file data go through one caller-owned
+ * buffer, and only full buffers reach the sink (one SMB write each), so many
+ * small EVE/CSL files share a write with their neighbours' headers. Nothing
+ * is staged on SD or LittleFS.
+ *
+ * File data is read straight into the buffer: reserve() hands out the free
+ * tail (flushing first when it is full) and commit() accounts for what was
+ * read into it.
+ *
+ * Pure logic (no SMB / FS calls) so it can be unit tested natively.
+ */
+
+static const size_t TAR_BLOCK_SIZE = 512;
+static const size_t TAR_NAME_MAX = 99;   // ustar name field, NUL terminated
+
+// Zero padding after `size` bytes of member data
+inline uint32_t tarPadding(uint32_t size) {
+    return (uint32_t)((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE);
+}
+
+// Fill a 512-byte ustar header for a regular file (mode 0644). False if the
+// name does not fit or the size needs more than 11 octal digits.
+bool formatTarHeader(uint8_t* block, const char* name, uint32_t size, uint32_t mtime);
+
+// Sidecar index line: "<name>\t<data offset>\t<size>\t<mtime>\n". Returns the
+// length written, or 0 if it did not fit.
+size_t formatTarIndexLine(char* out, size_t outLen, const char* name,
+                          uint32_t dataOffset, uint32_t size, uint32_t mtime);
+
+// Receives each full buffer (and the final partial one). False aborts the archive.
+typedef bool (*TarSink)(void* ctx, const uint8_t* data, size_t len);
+
+class TarStreamWriter {
+public:
+    TarStreamWriter(uint8_t* buffer, size_t capacity, TarSink sink, void* ctx);
+
+    // Header for the next member; its data must total exactly `size` bytes
+    bool beginMember(const char* name, uint32_t size, uint32_t mtime);
+    // Free space at the end of the buffer (flushes when full). nullptr if the
+    // sink failed.
+    uint8_t* reserve(size_t& space);
+    // Account for `len` bytes written into the reserve() area
+    bool commit(size_t len);
+    // Pad the member to the block boundary. False if its size did not match.
+    bool endMember();
+    // End-of-archive marker (two zero blocks) and the final flush
+    bool finish();
+
+    // Bytes of archive produced so far (flushed or buffered)
+    uint32_t offset() const { return produced; }
+    // Archive offset of the current member's data
+    uint32_t memberDataOffset() const { return memberStart; }
+
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t fill;
+    TarSink sink;
+    void* ctx;
+    uint32_t produced;
+    uint32_t memberStart;
+    uint32_t memberSize;
+    uint32_t memberWritten;
+    bool failed;
+
+    bool put(const uint8_t* data, size_t len);
+    bool putZeros(size_t len);
+    bool flush();
+};
+
+#endif // TAR_ARCHIVE_H
@@ -38,6 +38,13 @@ public:
     void suspend();                   // Call when entering IDLE/COOLDOWN
     void resume();                    // Call when leaving IDLE/COOLDOWN
     bool isSuspended() const;         // True if PCNT is suspended
+
+    // Wake-up on activity: a PCNT watch point at count 1 calls `hook` from the
+    // ISR at the first edge after each sample, so a waiting loop() can run
+    // update() at once instead of polling. Return true if a higher-priority
+    // task was woken.
+    typedef bool (*ActivityHook)();
+    void setActivityHook(ActivityHook hook) { _activityHook = hook; }
     
     // Activity detection
     bool isBusy();                    // True if activity detected in last sample window
@@ -46,6 +53,10 @@ public:
     void resetIdleTracking();         // Reset silence counter (e.g., on state transition)
     bool hasActivityLatch() const;    // True if any activity occurred since the latch was last cleared
     void clearActivityLatch();        // Clear the activity latch
+
+    // Raw PCNT count without clearing it, or -1 if PCNT is unavailable/suspended.
+    // For short polls while update() is not running (e.g. SD handover in UPLOADING).
+    int peekRawCount() const;
     
     // Sample buffer for SD Activity Monitor web UI
     // Buffer is only allocated when monitoring mode is active (saves ~2.4KB RAM)
@@ -73,6 +84,9 @@ private:
     bool _initialized;
     pcnt_unit_handle_t _pcntUnit;
     pcnt_channel_handle_t _pcntChannel;
+    volatile ActivityHook _activityHook;
+
+    static bool onWatchPoint(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t* edata, void* ctx);
     
     // 100ms sampling
     unsigned long _lastSampleTime;
@@ -5,126 +5,88 @@
 #include <FS.h>
 #include <stdint.h>
 #include <vector>
+#include "FileFingerprint.h"
+#include "UploadStateStore.h"
+
+class SdMetaCache;
 
 class UploadStateManager {
 private:
-    using DayKey = uint32_t;
-    using UnixTs = uint32_t;
-    using PathHash = uint64_t;
-
-    struct PendingFolderEntry {
-        DayKey day;
-        UnixTs firstSeenTs;
-    };
-
-    struct FileFingerprintEntry {
-        PathHash pathHash;
-        uint32_t fileSize;
-        uint8_t md5[16];
-        uint8_t flags;
-    };
-
-    enum class JournalEventType : uint8_t {
-        SetTimestamp,
-        SetRetry,
-        AddCompleted,
-        RemoveCompleted,
-        AddPending,
-        RemovePending,
-        SetFile,
-        RemoveFile
-    };
-
-    struct JournalEvent {
-        JournalEventType type;
-        DayKey day;
-        UnixTs timestamp;
-        uint16_t retryCount;
-        PathHash pathHash;
-        uint32_t fileSize;
-        uint8_t md5[16];
-        bool hasMd5;
-    };
-
-    static const uint16_t MAX_COMPLETED_FOLDERS = 368;
-    static const uint16_t MAX_PENDING_FOLDERS = 16;
-    static const uint16_t MAX_FILE_ENTRIES = 250;
-    static const uint16_t MAX_JOURNAL_EVENTS = 200;
-    static const uint16_t COMPACTION_LINE_THRESHOLD = 250;
-    static const uint32_t COMPACTION_SIZE_THRESHOLD_BYTES = 8192;
-
-    static const uint8_t FILE_FLAG_ACTIVE = 0x01;
-    static const uint8_t FILE_FLAG_HAS_MD5 = 0x02;
-    static const uint8_t FILE_FLAG_PERSISTENT = 0x04;
-
-    String stateSnapshotPath;
-    String stateJournalPath;
-    UnixTs lastUploadTimestamp;
-    
-    struct CompletedFolderEntry {
-        DayKey day;
-    };
-    CompletedFolderEntry completedFolders[MAX_COMPLETED_FOLDERS];
-    uint16_t completedCount;
-    PendingFolderEntry pendingFolders[MAX_PENDING_FOLDERS];
-    uint16_t pendingCount;
-    FileFingerprintEntry fileEntries[MAX_FILE_ENTRIES];
-    uint16_t fileEntryCount;
-    DayKey currentRetryFolderDay;
-    int currentRetryCount;
-    JournalEvent journalEvents[MAX_JOURNAL_EVENTS];
-    uint16_t journalEventCount;
-    uint16_t journalLineCount;
-    bool forceCompaction;
-    int totalFoldersCount;  // Total DATALOG folders found (for progress tracking)
+    using DayKey = UploadStateStore::DayKey;
+    using UnixTs = UploadStateStore::UnixTs;
+    using PathHash = UploadStateStore::PathHash;
+    using AppendHashEntry = UploadStateStore::AppendHashEntry;
+    using QuarantineKind = UploadStateStore::QuarantineKind;
+
+    static const uint32_t APPEND_MAX_HEADER_BYTES = 32768;
+
+    UploadStateStore* store;
+    bool ownsStore;
+    uint8_t backend;
+    uint8_t backendBit;     // 1 << backend
+    SdMetaCache* metaCache;  // Optional: file sizes for the current SD hold
     
     static const unsigned long PENDING_FOLDER_TIMEOUT_SECONDS = 7 * 24 * 60 * 60;  // 604800 seconds
-    
-    void clearState();
 
-    static bool isDatalogPath(const String& path);
-    static bool parseDayKey(const String& text, DayKey& outDay);
-    static void dayKeyToChars(DayKey day, char* out, size_t outLen);
-    static PathHash hashPath(const String& path);
-    static bool parseHexMd5(const char* hex, uint8_t out[16]);
-    static void md5ToHex(const uint8_t md5[16], char out[33]);
+    // Backoff starts at the QUARANTINE_FAILURE_THRESHOLD-th consecutive failure
+    // and doubles per further failure up to the cap. A single transient failure
+    // is retried normally on the next session.
+    static const uint8_t QUARANTINE_FAILURE_THRESHOLD = 2;
+    static const unsigned long BACKEND_BACKOFF_BASE_SECONDS = 10 * 60;         // 10 min
+    static const unsigned long BACKEND_BACKOFF_MAX_SECONDS = 6 * 60 * 60;      // 6 h
+    static const unsigned long QUARANTINE_BACKOFF_BASE_SECONDS = 60 * 60;      // 1 h
+    static const unsigned long QUARANTINE_BACKOFF_MAX_SECONDS = 24 * 60 * 60;  // 24 h
 
-    int findCompletedIndex(DayKey day) const;
-    int findPendingIndex(DayKey day) const;
-    int findFileIndex(PathHash pathHash) const;
+    static bool isDatalogPath(const char* path);
+    static bool isAppendTracked(const char* path);
 
-    bool upsertFileEntry(PathHash pathHash, uint32_t fileSize, const uint8_t* md5, bool hasMd5, bool persistent, bool queue);
-    bool removeFileEntry(PathHash pathHash, bool queue);
+    int findQuarantineIndex(QuarantineKind kind, uint64_t key) const {
+        return store->findQuarantineIndex(kind, key, backend);
+    }
+    bool isQuarantinedInternal(QuarantineKind kind, uint64_t key, unsigned long now) const;
+    void recordFailureInternal(QuarantineKind kind, uint64_t key, unsigned long now);
 
-    bool addCompletedInternal(DayKey day, bool queue);
-    bool removeCompletedInternal(DayKey day, bool queue);
-    bool addPendingInternal(DayKey day, UnixTs ts, bool queue);
-    bool removePendingInternal(DayKey day, bool queue);
-    void setRetryInternal(DayKey day, int retryCount, bool queue);
-    void setTimestampInternal(UnixTs ts, bool queue);
+    bool buildAppendHash(fs::FS &sd, const char* filePath, PathHash pathHash, uint32_t size,
+                         FingerprintAlgo fullAlgo, uint8_t fullDigest[16]);
+    bool advanceAppendHash(fs::FS &sd, const char* filePath, PathHash pathHash, uint32_t size);
+    bool verifyAppendHash(fs::FS &sd, const char* filePath, const AppendHashEntry& entry);
 
-    void queueEvent(const JournalEvent& event);
-    bool flushJournal(fs::FS &sd);
-    bool appendJournalLine(File& file, const JournalEvent& event);
-    bool applySnapshotLine(const char* line);
-    bool applyJournalLine(const char* line);
-    bool shouldCompact(fs::FS &sd) const;
-    bool compactState(fs::FS &sd);
-    bool replayJournal(fs::FS &sd);
-
-    bool loadState(fs::FS &sd);
-    bool saveState(fs::FS &sd);
+    UploadStateManager(const UploadStateManager&);
+    UploadStateManager& operator=(const UploadStateManager&);
 
 public:
-    String calculateChecksum(fs::FS &sd, const String& filePath);
+    String calculateChecksum(fs::FS &sd, const char* filePath);   // Plain MD5 hex
+    // Tagged fingerprint text (see FileFingerprint) for the given algorithm
+    String calculateFingerprint(fs::FS &sd, const char* filePath, FingerprintAlgo algo);
+    // Owns a private single-backend store
     UploadStateManager();
+    // View of one backend in a shared store (see UploadStateStore)
+    UploadStateManager(UploadStateStore* sharedStore, uint8_t backend);
+    ~UploadStateManager();
+
+    // Snapshot/journal paths of the store; begin() loads it only if owned
     void setPaths(const String& snapshotPath, const String& journalPath);
     
     bool begin(fs::FS &sd);
+
+    // Answer size/existence queries from the SD metadata cache instead of
+    // opening the file (nullptr = always open)
+    void setMetaCache(SdMetaCache* cache) { metaCache = cache; }
     
-    // Checksum-based tracking for root/SETTINGS files
-    bool hasFileChanged(fs::FS &sd, const String& filePath);
-    void markFileUploaded(const String& filePath, const String& checksum, unsigned long fileSize = 0);
+    // Checksum-based tracking for root/SETTINGS files. The checksum passed to
+    // markFileUploaded() is fingerprint text; each entry remembers its algorithm.
+    // Per-file calls take the path as built by the caller (e.g. in a
+    // StaticString); the String overloads forward to them.
+    bool hasFileChanged(fs::FS &sd, const char* filePath);
+    void markFileUploaded(const char* filePath, const String& checksum, unsigned long fileSize = 0);
+    bool hasFileChanged(fs::FS &sd, const String& filePath) { return hasFileChanged(sd, filePath.c_str()); }
+    void markFileUploaded(const String& filePath, const String& checksum, unsigned long fileSize = 0) {
+        markFileUploaded(filePath.c_str(), checksum, fileSize);
+    }
+    // The checksum to pass to markFileUploaded(): when another backend's entry
+    // for the path uses a different algorithm, the card's fingerprint in that
+    // algorithm, so a same-size change is told apart from the same content.
+    String fingerprintForRecord(fs::FS &sd, const char* filePath, const String& checksum);
     
     // Folder-based tracking for DATALOG
     bool isFolderCompleted(const String& folderName);
@@ -134,6 +96,19 @@ public:
     int getCompletedFoldersCount() const;
     int getIncompleteFoldersCount() const;
     void setTotalFoldersCount(int count);
+    // Whether a DATALOG folder upload pass may mark the folder completed.
+    // Recent folders: unless a still-open file was deferred (it must stay
+    // incomplete so it is rescanned once it leaves the recent window).
+    // Old folders: only when every file was uploaded.
+    static bool shouldMarkFolderCompleted(bool recent, bool allUploaded, int deferredOpen) {
+        return recent ? deferredOpen == 0 : allUploaded;
+    }
+    // Whether a folder pass counts towards folder quarantine. Files skipped
+    // because they are quarantined themselves are left out (their own backoff
+    // covers them), so one poison file cannot quarantine the files beside it.
+    static bool isFolderPassFailure(int expectedUploads, int uploaded, int skippedQuarantined) {
+        return uploaded < expectedUploads - skippedQuarantined;
+    }
     
     // Pending folder tracking for empty folders
     bool isPendingFolder(const String& folderName);
@@ -150,12 +125,37 @@ public:
     void incrementCurrentRetryCount();
     void clearCurrentRetry();
     
+    // Circuit breaker for this backend (connection-level failures).
+    // Open after repeated failures until the backoff expires; half-open afterwards
+    // (one attempt allowed, success closes it, failure doubles the backoff).
+    bool isBackendAvailable(unsigned long now) const;
+    void recordBackendFailure(unsigned long now);
+    void recordBackendSuccess();
+    unsigned long getBackendRetryAfter() const;
+    
+    // Quarantine for poison folders/files (retry-after timestamps, exponential backoff)
+    bool isFolderQuarantined(const String& folderName, unsigned long now) const;
+    void recordFolderFailure(const String& folderName, unsigned long now);
+    void clearFolderQuarantine(const String& folderName);
+    bool isFileQuarantined(const char* filePath, unsigned long now) const;
+    void recordFileFailure(const char* filePath, unsigned long now);
+    void clearFileQuarantine(const char* filePath);
+    bool isFileQuarantined(const String& filePath, unsigned long now) const {
+        return isFileQuarantined(filePath.c_str(), now);
+    }
+    void recordFileFailure(const String& filePath, unsigned long now) { recordFileFailure(filePath.c_str(), now); }
+    void clearFileQuarantine(const String& filePath) { clearFileQuarantine(filePath.c_str()); }
+    int getQuarantinedCount(unsigned long now) const;  // Folders + files currently blocked
+    
     // Timestamp tracking
     unsigned long getLastUploadTimestamp();
     void setLastUploadTimestamp(unsigned long timestamp);
     
-    // Persistence
+    // Persistence (a shared store is written for all its backends).
+    // save() only appends to the journal; compaction is deferred to compactIfDue().
     bool save(fs::FS &sd);
+    bool isCompactionDue() const;
+    bool compactIfDue(fs::FS &sd);
 };
 
 #endif // UPLOAD_STATE_MANAGER_H
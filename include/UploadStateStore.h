@@ -0,0 +1,260 @@
+#ifndef UPLOAD_STATE_STORE_H
+#define UPLOAD_STATE_STORE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <stdint.h>
+#include "FileFingerprint.h"
+#include "FingerprintIndex.h"
+
+// ============================================================================
+// Upload State Store — one set of state tables shared by all backends
+// ============================================================================
+//
+// In DUAL mode SMB and SleepHQ walk the same folders and files, so two full
+// state copies mostly duplicated each other. The store keeps each folder/file
+// record once and marks which backends it applies to with a bit per backend
+// (bit = 1 << backend). File entries hold one fingerprint for everybody plus
+// the set of backends whose last upload matched it. There is one snapshot and
+// one journal.
+//
+// UploadStateManager is the per-backend view the uploaders use; it owns a
+// private single-backend store unless it is handed a shared one.
+//
+// Persistence is the v2 line format. Lines that apply to anything other than
+// backend 0 alone end in "|b<mask>" (hex); a store with more than one backend
+// writes the header "U2|3|ts" so single-backend files stay byte-identical.
+//
+// File fingerprints live in a sorted index file next to the snapshot (see
+// FingerprintIndex). Changes collect in a small sorted RAM table and are merged
+// into it when the table fills and on every compaction; the journal keeps its
+// F lines so nothing is lost between merges.
+//
+// save() only appends to the journal. When the journal passes a compaction
+// threshold the store marks compaction due; main.cpp runs compactIfDue() from
+// a background task in COOLDOWN/IDLE so the snapshot rewrite and index merge
+// never land in the middle of an upload. A journal far past the threshold
+// (COMPACTION_HARD_LIMIT_BYTES) or one that dropped events because the queue
+// overflowed is still compacted inline: only a snapshot can hold that state.
+// A reboot before the background run is covered by begin(), which compacts.
+// ============================================================================
+
+// Backend slots in the shared store kept by FileUploader
+static const uint8_t UPLOAD_STATE_SMB = 0;
+static const uint8_t UPLOAD_STATE_CLOUD = 1;
+static const uint8_t UPLOAD_STATE_MAX_BACKENDS = 2;
+
+class UploadStateStore {
+public:
+    explicit UploadStateStore(uint8_t backendCount = 1);
+
+    void setPaths(const String& snapshotPath, const String& journalPath);
+    bool begin(fs::FS &sd);
+    bool save(fs::FS &sd);
+
+    // Deferred compaction (see above)
+    bool isCompactionDue() const { return compactionDue; }
+    bool compactIfDue(fs::FS &sd);
+
+    // Merge a per-backend state file pair written by older firmware into
+    // `backend`, then write one snapshot and delete the old files.
+    // Returns false if there was nothing to import.
+    bool importLegacy(fs::FS &sd, const char* snapshotPath, const char* journalPath, uint8_t backend);
+
+    uint8_t getBackendCount() const { return backendCount; }
+
+private:
+    friend class UploadStateManager;
+
+    using DayKey = uint32_t;
+    using UnixTs = uint32_t;
+    using PathHash = uint64_t;
+
+    struct CompletedFolderEntry {
+        DayKey day;
+        uint8_t backends;
+    };
+
+    struct PendingFolderEntry {
+        DayKey day;
+        UnixTs firstSeenTs;
+        uint8_t backends;
+    };
+
+    // uploaded == 0 in the change table marks a removal
+    using FileFingerprintEntry = FingerprintRecord;
+
+    // Resumable fingerprint for append-only EDF files at the card root (STR.edf).
+    // The EDF header is rewritten on every append (record count), so it is
+    // hashed on its own each time; the data records keep the body MD5 state at
+    // the last 64-byte block boundary, so only the bytes past it are read again.
+    static const uint8_t MD5_MIDSTATE_BYTES = 24;  // ROM MD5Context buf[4] + bits[2]
+
+    struct AppendHashEntry {
+        PathHash pathHash;
+        uint32_t headerLen;    // EDF header bytes, hashed in full on every check
+        uint32_t length;       // File length covered by bodyMd5
+        uint8_t headMd5[16];   // MD5 of [0, headerLen)
+        uint8_t bodyMd5[16];   // MD5 of [headerLen, length)
+        uint8_t midstate[MD5_MIDSTATE_BYTES];  // Body state at the last block boundary
+        uint8_t flags;         // APPEND_FLAG_*
+        uint8_t uploaded;      // Backends whose last upload matches this fingerprint
+    };
+
+    // Quarantine / circuit-breaker record. One table holds all three kinds:
+    // the backend itself (key 0), DATALOG folders (key = day) and files (key = path hash).
+    enum class QuarantineKind : uint8_t {
+        Backend = 'B',
+        Folder  = 'D',
+        File    = 'F'
+    };
+
+    struct QuarantineEntry {
+        uint64_t key;
+        UnixTs retryAfterTs;   // 0 = no backoff yet (failures below threshold)
+        QuarantineKind kind;
+        uint8_t failures;      // Consecutive failures
+        uint8_t backend;
+    };
+
+    enum class JournalEventType : uint8_t {
+        SetTimestamp,
+        SetRetry,
+        AddCompleted,
+        RemoveCompleted,
+        AddPending,
+        RemovePending,
+        SetFile,
+        RemoveFile,
+        SetQuarantine,
+        RemoveQuarantine,
+        SetAppend,      // Written from the live AppendHashEntry at flush time
+        RemoveAppend
+    };
+
+    struct JournalEvent {
+        JournalEventType type;
+        DayKey day;
+        UnixTs timestamp;
+        uint16_t retryCount;
+        PathHash pathHash;
+        uint32_t fileSize;
+        uint8_t digest[16];
+        bool hasDigest;
+        FingerprintAlgo algo;
+        QuarantineKind quarantineKind;
+        uint8_t failures;
+        uint8_t backends;       // Bits added/removed, or the record's full set for F
+    };
+
+    static const uint16_t MAX_COMPLETED_FOLDERS = 368;
+    static const uint16_t MAX_PENDING_FOLDERS = 16;
+    static const uint16_t MAX_FILE_CHANGES = 64;
+    static const uint16_t MAX_JOURNAL_EVENTS = 200;
+    static const uint16_t MAX_QUARANTINE_ENTRIES = 16;
+    static const uint8_t MAX_APPEND_ENTRIES = 4;
+    static const uint16_t COMPACTION_LINE_THRESHOLD = 250;
+    static const uint32_t COMPACTION_SIZE_THRESHOLD_BYTES = 8192;
+    static const uint32_t COMPACTION_HARD_LIMIT_BYTES = 32768;  // Compact inline past this
+
+    static const uint8_t FILE_FLAG_ACTIVE = 0x01;
+    static const uint8_t FILE_FLAG_HAS_DIGEST = 0x02;
+
+    static const uint8_t APPEND_FLAG_FRESH = 0x02;     // Read from the card this session (not persisted)
+
+    // Backend set of lines without a "|b" suffix
+    static const uint8_t DEFAULT_BACKENDS = 0x01;
+
+    uint8_t backendCount;
+    String stateSnapshotPath;
+    String stateJournalPath;
+    String stateIndexPath;
+    UnixTs lastUploadTimestamp[UPLOAD_STATE_MAX_BACKENDS];
+
+    CompletedFolderEntry completedFolders[MAX_COMPLETED_FOLDERS];
+    uint16_t completedCount;
+    PendingFolderEntry pendingFolders[MAX_PENDING_FOLDERS];
+    uint16_t pendingCount;
+    FingerprintIndex fileIndex;
+    FileFingerprintEntry fileChanges[MAX_FILE_CHANGES];  // Sorted by path hash, not yet in fileIndex
+    uint16_t fileChangeCount;
+    DayKey currentRetryFolderDay[UPLOAD_STATE_MAX_BACKENDS];
+    int currentRetryCount[UPLOAD_STATE_MAX_BACKENDS];
+    QuarantineEntry quarantineEntries[MAX_QUARANTINE_ENTRIES];
+    uint16_t quarantineCount;
+    AppendHashEntry appendEntries[MAX_APPEND_ENTRIES];
+    uint8_t appendCount;
+    JournalEvent journalEvents[MAX_JOURNAL_EVENTS];
+    uint16_t journalEventCount;
+    uint16_t journalLineCount;
+    bool forceCompaction;
+    bool compactionDue;   // Threshold passed; waiting for compactIfDue()
+    bool eventsDropped;   // Journal queue overflowed: only a snapshot holds the state
+    bool importing;  // Applying a legacy file: file/append lines merge instead of replace
+    int totalFoldersCount[UPLOAD_STATE_MAX_BACKENDS];  // DATALOG folders found (progress only)
+
+    void clearState();
+
+    static bool parseDayKey(const String& text, DayKey& outDay);
+    static void dayKeyToChars(DayKey day, char* out, size_t outLen);
+    static PathHash hashPath(const char* path);
+    static bool parseHexMd5(const char* hex, uint8_t out[16]);
+    static void md5ToHex(const uint8_t md5[16], char out[33]);
+    static bool parseHexBytes(const char* hex, uint8_t* out, size_t len);
+    static void bytesToHex(const uint8_t* bytes, size_t len, char* out);
+    static void appendBackends(char* line, size_t lineLen, uint8_t backends);
+    static uint8_t splitBackends(char* line, uint8_t defaultBackends);
+    static uint8_t backendOf(uint8_t backends);
+
+    int findCompletedIndex(DayKey day) const;
+    int findPendingIndex(DayKey day) const;
+    bool findFile(PathHash pathHash, FileFingerprintEntry& out);
+    uint16_t countCompleted(uint8_t backends) const;
+    uint16_t countPending(uint8_t backends) const;
+
+    int findFileChange(PathHash pathHash, bool& found) const;
+    FileFingerprintEntry* stageFileChange(PathHash pathHash);
+    bool flushFileChanges();
+    bool upsertFileEntry(PathHash pathHash, uint32_t fileSize, const uint8_t* digest, bool hasDigest,
+                         FingerprintAlgo algo, uint8_t uploaded, bool queue);
+    bool recordFileUpload(PathHash pathHash, uint32_t fileSize, const uint8_t* digest, bool hasDigest,
+                          FingerprintAlgo algo, uint8_t backends, bool queue);
+    bool removeFileEntry(PathHash pathHash, uint8_t backends, bool queue);
+
+    int findQuarantineIndex(QuarantineKind kind, uint64_t key, uint8_t backend) const;
+    bool setQuarantineInternal(QuarantineKind kind, uint64_t key, uint8_t backend,
+                               uint8_t failures, UnixTs retryAfterTs, bool queue);
+    bool removeQuarantineInternal(QuarantineKind kind, uint64_t key, uint8_t backend, bool queue);
+    bool applyQuarantineLine(const char* line, uint8_t backends);
+
+    int findAppendIndex(PathHash pathHash) const;
+    AppendHashEntry* upsertAppendEntry(PathHash pathHash);
+    bool removeAppendEntry(PathHash pathHash, bool queue);
+    void queueAppendEvent(PathHash pathHash);
+    bool formatAppendLine(const AppendHashEntry& entry, char* out, size_t outLen) const;
+    bool applyAppendLine(const char* line, uint8_t backends);
+
+    bool addCompletedInternal(DayKey day, uint8_t backends, bool queue);
+    bool removeCompletedInternal(DayKey day, uint8_t backends, bool queue);
+    bool addPendingInternal(DayKey day, UnixTs ts, uint8_t backends, bool queue);
+    bool removePendingInternal(DayKey day, uint8_t backends, bool queue);
+    void setRetryInternal(uint8_t backend, DayKey day, int retryCount, bool queue);
+    void setTimestampInternal(uint8_t backend, UnixTs ts, bool queue);
+
+    void queueEvent(const JournalEvent& event);
+    bool flushJournal(fs::FS &sd);
+    bool appendJournalLine(File& file, const JournalEvent& event);
+    bool applyFileLine(const char* format, const char* line, uint8_t backends);
+    bool applySnapshotLine(const char* line, uint8_t backends);
+    bool applyJournalLine(const char* line, uint8_t backends);
+    bool shouldCompact(fs::FS &sd) const;
+    size_t journalSize(fs::FS &sd) const;
+    bool compactState(fs::FS &sd);
+    bool replayJournal(fs::FS &sd, const String& journalPath, uint8_t defaultBackends, uint16_t& lines);
+    bool loadSnapshot(fs::FS &sd, const String& snapshotPath, uint8_t defaultBackends, bool& loaded);
+
+    bool loadState(fs::FS &sd);
+    bool saveState(fs::FS &sd);
+};
+
+#endif // UPLOAD_STATE_STORE_H
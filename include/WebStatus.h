@@ -1,5 +1,6 @@
 #pragma once
 #include <Arduino.h>
+#include "NetBench.h"
 
 // ============================================================================
 // Zero-heap web data buffers
@@ -43,3 +44,7 @@ struct BackendSummaryStatus {
 
 extern BackendSummaryStatus g_activeBackendStatus;
 extern BackendSummaryStatus g_inactiveBackendStatus;
+
+// Network self-test results — written by the netbench task on Core 0, read by
+// /api/netbench.  Torn reads while RUNNING are harmless.
+extern NetBenchStatus g_netBenchStatus;
@@ -28,6 +28,7 @@ public:
     String getIPAddress() const;
     int getSignalStrength() const;  // Returns RSSI in dBm
     String getSignalQuality() const;  // Returns quality description
+    static uint8_t getLastDisconnectReason() { return _lastDisconnectReason; }  // wifi_err_reason_t, 0 = none
     
     // mDNS support
     bool startMDNS(const String& hostname);
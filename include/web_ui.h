@@ -217,6 +217,15 @@ nav button:hover:not(.act){background:#3a5a7e}
 <div class=row style="border-top:1px solid #2a475e;padding-top:8px;margin-top:2px"><span class=k>Status</span><span id=d-fst class=v></span></div>
 </div>
 </div>
+<div class=cards>
+<div class=card style="grid-column:1/-1"><h2>Last Night <span id=d-n-day style="font-size:.9em;color:#8f98a0;font-weight:400"></span></h2>
+<div class=row><span class=k>Usage</span><span id=d-n-use class=v>—</span></div>
+<div class=row><span class=k>Sessions</span><span id=d-n-ses class=v>—</span></div>
+<div class=row><span class=k>Pressure (cmH2O) min / mean / max</span><span id=d-n-pr class=v>—</span></div>
+<div class=row><span class=k>Leak (L/min) min / mean / max</span><span id=d-n-lk class=v>—</span></div>
+<div class=row><span class=k>Resp. rate (/min) min / mean / max</span><span id=d-n-rr class=v>—</span></div>
+</div>
+</div>
 <div id=d-mode-help style="background:#16213e;border:1px solid #2a475e;border-radius:8px;padding:10px 14px;margin-bottom:14px;font-size:.82em;color:#8f98a0;line-height:1.5"></div>
 <div style="border:1px solid #8b2020;border-radius:10px;padding:15px;margin-bottom:14px">
 <h2 style="font-size:.8em;text-transform:uppercase;letter-spacing:1px;color:#e04030;margin-bottom:10px;border-bottom:1px solid #8b2020;padding-bottom:6px">Danger Zone</h2>
@@ -401,14 +410,16 @@ Recommended <strong style="color:#44ff44">INACTIVITY_SECONDS</strong>: <span id=
 </ul></div>
 <div class=cards>
 <div class=card><h2>Method 1: File Upload</h2>
-<form id=f-up><div class=fg><label>Firmware file (.bin)</label>
-<input type=file id=f-bin name=firmware accept=.bin required></div>
+<form id=f-up><div class=fg><label>Firmware file (.bin, .bin.gz or .cpd.gz delta)</label>
+<input type=file id=f-bin name=firmware accept=.bin,.gz,.cpd required></div>
 <button type=submit class="btn bp">Upload &amp; Install</button>
 <div id=s-up class=sm></div></form>
 </div>
 <div class=card><h2>Method 2: URL Download</h2>
 <form id=f-url><div class=fg><label>Firmware URL</label>
 <input type=url id=f-u name=url placeholder="https://github.com/.../firmware.bin" required></div>
+<div class=fg><label>SHA-256 (optional)</label>
+<input type=text id=f-sha name=sha256 placeholder="64 hex digits from the release" pattern="[0-9a-fA-F]{64}"></div>
 <button type=submit class="btn bp">Download &amp; Install</button>
 <div id=s-url class=sm></div></form>
 </div>
@@ -480,6 +491,7 @@ function tab(t){
     stopLogPoll();
     stopSse();
   }
+  if(t==='dash'){loadNight();}
   if(t==='cfg'){loadCfg();}
   if(t==='mon'){checkMonUploadState();syncMonBtn();}
   if(t==='mem'){updateHeapChart();updateCpuChart();}
@@ -633,6 +645,19 @@ function renderStatus(d){
 }
 
 var statusTimer=null;
+function nightStat(s){return s?s.min.toFixed(1)+' / '+s.mean.toFixed(1)+' / '+s.max.toFixed(1):'—';}
+function loadNight(){
+  _apiFetch('/api/night-summary').then(function(r){return r.json();}).then(function(d){
+    if(!d.available){set('d-n-day','(no data yet)');return;}
+    var day=String(d.day);
+    set('d-n-day',day.substr(0,4)+'-'+day.substr(4,2)+'-'+day.substr(6,2));
+    set('d-n-use',fmtUp(d.usage_sec));
+    set('d-n-ses',String(d.sessions));
+    set('d-n-pr',nightStat(d.pressure));
+    set('d-n-lk',nightStat(d.leak));
+    set('d-n-rr',nightStat(d.resp_rate));
+  }).catch(function(){});
+}
 function pollStatus(){
   _apiFetch('/api/status').then(function(r){return r.json();}).then(function(d){
     renderStatus(d);
@@ -1226,7 +1251,7 @@ document.getElementById('f-url').addEventListener('submit',function(e){
   e.preventDefault();if(otaBusy)return;
   var u=document.getElementById('f-u').value;if(!u)return;
   otaBusy=true;setMsg('s-url','info','Downloading (may take ~1 min)...');
-  var fd=new FormData();fd.append('url',u);
+  var fd=new FormData();fd.append('url',u);fd.append('sha256',document.getElementById('f-sha').value.trim());
   fetch('/ota-url',{method:'POST',body:fd}).then(function(r){return r.json();}).then(function(d){handleOtaResult(d,'s-url');}).catch(function(){otaBusy=false;setMsg('s-url','er','Network error');});
 });
 function handleOtaResult(d,sid){
@@ -1358,6 +1383,7 @@ function handleOtaResult(d,sid){
 
  setTimeout(function(){
    loadCfg();
+   loadNight();
    startStatusPoll();
  },150);
 </script>
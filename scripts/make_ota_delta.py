@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+"""
+Build a compressed delta OTA patch ("CPD1") between two app images.
+
+The device applies the patch against the image in its running partition
+(see include/OtaImage.h for the format). The patch is gzip-compressed by
+default; a rebuilt firmware mostly moves code around, so the diff bytes are
+largely zero and compress far better than the full image.
+
+Usage:
+    python3 scripts/make_ota_delta.py OLD.bin NEW.bin OUT.cpd.gz
+    python3 scripts/make_ota_delta.py --no-gzip OLD.bin NEW.bin OUT.cpd
+    python3 scripts/make_ota_delta.py --gzip-only NEW.bin OUT.bin.gz
+
+OLD.bin must be the exact app image running on the device (for example the
+previous release's firmware-ota-upgrade-*.bin); the device refuses a patch
+whose source CRC does not match its running partition.
+"""
+
+import argparse
+import gzip
+import struct
+import sys
+import zlib
+
+MAGIC = b"CPD1"
+SEED = 8            # Bytes that must match exactly to start a diff run
+MIN_RUN = 24        # Shorter runs are cheaper as extra bytes
+MAX_CANDIDATES = 8  # Source positions remembered per seed
+GIVE_UP = 48        # Stop extending a run after this many net mismatches
+
+
+def build_index(src):
+    """Map each SEED-byte window of the source to a few of its positions."""
+    index = {}
+    for pos in range(len(src) - SEED + 1):
+        positions = index.setdefault(src[pos:pos + SEED], [])
+        if len(positions) < MAX_CANDIDATES:
+            positions.append(pos)
+    return index
+
+
+def extend(src, dst, s, t):
+    """bsdiff-style approximate extension: the run length that maximises
+    matches minus mismatches, so moved code with patched addresses stays in
+    one diff run."""
+    best_len = score = best = 0
+    i = 0
+    limit = min(len(src) - s, len(dst) - t)
+    while i < limit:
+        score += 1 if src[s + i] == dst[t + i] else -1
+        i += 1
+        if score > best:
+            best, best_len = score, i
+        elif score < best - GIVE_UP:
+            break
+    return best_len
+
+
+def find_runs(src, dst):
+    """Greedy scan of the target for (source pos, target pos, length) runs."""
+    index = build_index(src)
+    runs = []
+    t = 0
+    offset = None   # source - target of the previous run
+    while t + SEED <= len(dst):
+        seed = dst[t:t + SEED]
+        candidates = []
+        if offset is not None and 0 <= t + offset <= len(src) - SEED \
+                and src[t + offset:t + offset + SEED] == seed:
+            candidates.append(t + offset)
+        candidates.extend(index.get(seed, ()))
+        best_len, best_src = 0, None
+        for s in candidates:
+            length = extend(src, dst, s, t)
+            if length > best_len:
+                best_len, best_src = length, s
+        if best_len >= MIN_RUN:
+            runs.append((best_src, t, best_len))
+            offset = best_src - t
+            t += best_len
+        else:
+            t += 1
+    return runs
+
+
+def build_patch(src, dst):
+    runs = find_runs(src, dst)
+    out = bytearray(MAGIC)
+    out += struct.pack("<IIII", len(src), zlib.crc32(src) & 0xFFFFFFFF,
+                       len(dst), zlib.crc32(dst) & 0xFFFFFFFF)
+
+    src_pos = 0
+    t = 0
+    # Leading extra bytes before the first run
+    first_t = runs[0][1] if runs else len(dst)
+    if first_t > 0:
+        seek = (runs[0][0] if runs else 0) - src_pos
+        out += struct.pack("<IIi", 0, first_t, seek)
+        out += dst[:first_t]
+        src_pos += seek
+        t = first_t
+
+    for i, (s, rt, length) in enumerate(runs):
+        assert rt == t and s == src_pos
+        next_t = runs[i + 1][1] if i + 1 < len(runs) else len(dst)
+        extra = next_t - (rt + length)
+        next_s = runs[i + 1][0] if i + 1 < len(runs) else s + length
+        seek = next_s - (s + length)
+        diff = bytes((dst[rt + k] - src[s + k]) & 0xFF for k in range(length))
+        out += struct.pack("<IIi", length, extra, seek)
+        out += diff
+        out += dst[rt + length:next_t]
+        src_pos = next_s
+        t = next_t
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    parser.add_argument("--no-gzip", action="store_true", help="write the patch uncompressed")
+    parser.add_argument("--gzip-only", action="store_true",
+                        help="just gzip NEW.bin (no delta): OLD.bin is omitted")
+    parser.add_argument("files", nargs="+")
+    args = parser.parse_args()
+
+    if args.gzip_only:
+        if len(args.files) != 2:
+            parser.error("--gzip-only takes NEW.bin OUT.bin.gz")
+        new_path, out_path = args.files
+        with open(new_path, "rb") as f:
+            dst = f.read()
+        payload = dst
+    else:
+        if len(args.files) != 3:
+            parser.error("expected OLD.bin NEW.bin OUT")
+        old_path, new_path, out_path = args.files
+        with open(old_path, "rb") as f:
+            src = f.read()
+        with open(new_path, "rb") as f:
+            dst = f.read()
+        payload = build_patch(src, dst)
+
+    if not args.no_gzip:
+        # mtime=0 keeps the output reproducible
+        payload = gzip.compress(payload, compresslevel=9, mtime=0)
+
+    with open(out_path, "wb") as f:
+        f.write(payload)
+
+    print("%s: %d bytes (%.1fx smaller than the %d byte image)"
+          % (out_path, len(payload), len(dst) / max(len(payload), 1), len(dst)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
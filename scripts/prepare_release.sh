@@ -101,6 +101,18 @@ echo "Keeping firmware copies in release folder..."
 cp "$TEMP_DIR/firmware-ota.bin" "$RELEASE_DIR/firmware-ota-${VERSION}.bin"
 cp "$TEMP_DIR/firmware-ota-upgrade.bin" "$RELEASE_DIR/firmware-ota-upgrade-${VERSION}.bin"
 
+# Compressed OTA images (decoded on the device while they download).
+# DELTA_FROM=<previous firmware-ota-upgrade-*.bin> also builds a delta patch
+# that devices running exactly that release can install.
+echo "Creating compressed OTA images..."
+python3 scripts/make_ota_delta.py --gzip-only "$FIRMWARE_BIN_OTA" \
+    "$RELEASE_DIR/firmware-ota-upgrade-${VERSION}.bin.gz"
+if [ -n "$DELTA_FROM" ]; then
+    DELTA_BASE=$(basename "$DELTA_FROM" .bin)
+    python3 scripts/make_ota_delta.py "$DELTA_FROM" "$FIRMWARE_BIN_OTA" \
+        "$RELEASE_DIR/firmware-ota-delta-${DELTA_BASE#firmware-ota-upgrade-}-to-${VERSION}.cpd.gz"
+fi
+
 # Copy upload scripts
 echo "Copying upload tools..."
 cp "$RELEASE_DIR/upload.sh" "$TEMP_DIR/"
@@ -128,6 +140,10 @@ echo -e "${GREEN}Release package created: $RELEASE_DIR/$RELEASE_PACKAGE${NC}"
 echo -e "${GREEN}Firmware copies saved in release folder:${NC}"
 echo "  - firmware-ota-${VERSION}.bin (OTA-enabled with web updates)"
 echo "  - firmware-ota-upgrade-${VERSION}.bin (app-only for OTA web updates)"
+echo "  - firmware-ota-upgrade-${VERSION}.bin.gz (same, gzip-compressed for OTA)"
+if [ -n "$DELTA_FROM" ]; then
+    echo "  - firmware-ota-delta-*-to-${VERSION}.cpd.gz (delta OTA from $(basename "$DELTA_FROM"))"
+fi
 echo ""
 echo "Package contents:"
 echo "  - firmware-ota.bin (complete OTA firmware for initial flashing)"
@@ -147,3 +163,4 @@ echo "1. Upload the release package: $RELEASE_DIR/$RELEASE_PACKAGE"
 echo "2. Upload individual firmware files from release/ folder:"
 echo "   - firmware-ota-${VERSION}.bin (for initial flashing)" 
 echo "   - firmware-ota-upgrade-${VERSION}.bin (for OTA web updates)"
+echo "   - firmware-ota-upgrade-${VERSION}.bin.gz (compressed OTA, and any delta .cpd.gz)"
@@ -0,0 +1,96 @@
+#include "AdaptiveChunk.h"
+
+AdaptiveChunkController::AdaptiveChunkController(size_t minChunkSize, size_t maxChunkSize)
+    : minChunk(minChunkSize),
+      maxChunk(maxChunkSize < minChunkSize ? minChunkSize : maxChunkSize),
+      ceiling(maxChunk),
+      chunkSize(minChunkSize),
+      paceMs(0),
+      cleanStreak(0),
+      ewmaBps(0),
+      stallCount(0),
+      initialized(false) {
+}
+
+// Largest power-of-two multiple of minChunk that is <= size, within [minChunk, ceiling].
+size_t AdaptiveChunkController::clampToLadder(size_t size) const {
+    size_t step = minChunk;
+    while (step * 2 <= size && step * 2 <= ceiling) {
+        step *= 2;
+    }
+    return step;
+}
+
+void AdaptiveChunkController::beginFile(size_t heapLimit, int rssi) {
+    ceiling = heapLimit < maxChunk ? heapLimit : maxChunk;
+    if (ceiling < minChunk) {
+        ceiling = minChunk;
+    }
+
+    if (!initialized) {
+        // First file of the session: start from the seeded throughput if it is
+        // conclusive, otherwise from RSSI
+        if (ewmaBps >= SEED_FAST_BPS && rssi >= RSSI_WEAK_DBM) {
+            chunkSize = ceiling;
+        } else if (ewmaBps > 0 && ewmaBps < SEED_SLOW_BPS) {
+            chunkSize = minChunk;
+            paceMs = PACE_STEP_MS;
+        } else if (rssi >= RSSI_STRONG_DBM) {
+            chunkSize = ceiling;
+        } else if (rssi >= RSSI_WEAK_DBM) {
+            chunkSize = ceiling / 2;
+        } else {
+            chunkSize = minChunk;
+            paceMs = PACE_STEP_MS;
+        }
+        initialized = true;
+    } else if (rssi < RSSI_WEAK_DBM && chunkSize > minChunk * 2) {
+        // Link degraded mid-session
+        chunkSize = minChunk * 2;
+    }
+
+    chunkSize = clampToLadder(chunkSize);
+}
+
+void AdaptiveChunkController::seedThroughput(uint32_t bytesPerSec) {
+    if (bytesPerSec > 0) {
+        ewmaBps = bytesPerSec;
+    }
+}
+
+void AdaptiveChunkController::recordChunk(size_t bytes, unsigned long elapsedMs, int eagainRetries) {
+    if (bytes == 0) {
+        return;
+    }
+
+    unsigned long ms = elapsedMs > 0 ? elapsedMs : 1;
+    uint32_t sampleBps = (uint32_t)(((uint64_t)bytes * 1000ULL) / ms);
+    uint32_t msPerKb = (uint32_t)(((uint64_t)ms * 1024ULL) / bytes);
+
+    bool stalled = eagainRetries > 0 || msPerKb > STALL_MS_PER_KB;
+
+    if (stalled) {
+        stallCount++;
+        cleanStreak = 0;
+        if (chunkSize > minChunk) {
+            chunkSize = clampToLadder(chunkSize / 2);
+        }
+        paceMs = (uint16_t)(paceMs + PACE_STEP_MS > PACE_MAX_MS ? PACE_MAX_MS : paceMs + PACE_STEP_MS);
+    } else {
+        // Grow only while throughput keeps up with the running estimate
+        bool keepingUp = ewmaBps == 0 || (uint64_t)sampleBps * 10 >= (uint64_t)ewmaBps * 9;
+        if (keepingUp && ++cleanStreak >= GROW_AFTER_CLEAN_CHUNKS) {
+            cleanStreak = 0;
+            if (paceMs > 0) {
+                paceMs = paceMs > PACE_STEP_MS ? (uint16_t)(paceMs - PACE_STEP_MS) : 0;
+            } else if (chunkSize < ceiling) {
+                chunkSize = clampToLadder(chunkSize * 2);
+            }
+        } else if (!keepingUp) {
+            cleanStreak = 0;
+        }
+    }
+
+    // EWMA, alpha = 1/4
+    ewmaBps = ewmaBps == 0 ? sampleBps : (ewmaBps * 3 + sampleBps) / 4;
+}
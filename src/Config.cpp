@@ -9,6 +9,7 @@ const char* Config::PREFS_KEY_CLOUD_SECRET = "cloud_secret";
 const char* Config::CENSORED_VALUE = "***STORED_IN_FLASH***";
 
 Config::Config() : 
+    smbFolderArchive(false),  // Default: one remote file per SD file
     gmtOffsetHours(0),  // Default: UTC
     saveLogs(false),  // Default: do not persist logs (debugging only)
     debugMode(false),    // Default: suppress verbose pre-flight and heap stats
@@ -29,6 +30,7 @@ Config::Config() :
     exclusiveAccessMinutes(5),
     cooldownMinutes(10),
     enable1BitSdMode(false),  // Default to safer 4-bit mode
+    sdBusAutotune(true),      // Default: use the fastest profile the card proved stable
     minimizeReboots(true),
     flushLogsDuringUpload(false),  // Default: defer log flushes during uploads
     
@@ -191,6 +193,8 @@ void Config::setConfigValue(String key, String value) {
         endpointUser = value;
     } else if (key == "ENDPOINT_PASSWORD") {
         endpointPassword = value;
+    } else if (key == "SMB_FOLDER_ARCHIVE") {
+        smbFolderArchive = (value.equalsIgnoreCase("true") || value.toInt() == 1);
     } else if (key == "GMT_OFFSET_HOURS") {
         gmtOffsetHours = value.toInt();
     } else if (key == "PERSISTENT_LOGS") {
@@ -227,6 +231,8 @@ void Config::setConfigValue(String key, String value) {
         cooldownMinutes = value.toInt();
     } else if (key == "ENABLE_1BIT_SD_MODE") {
         enable1BitSdMode = (value.equalsIgnoreCase("true") || value == "1");
+    } else if (key == "SD_BUS_AUTOTUNE") {
+        sdBusAutotune = (value.equalsIgnoreCase("true") || value.toInt() == 1);
     } else if (key == "CPU_SPEED_MHZ") {
         cpuSpeedMhz = value.toInt();
     } else if (key == "WIFI_TX_PWR") {
@@ -648,8 +654,10 @@ int Config::getInactivitySeconds() const { return inactivitySeconds; }
 int Config::getExclusiveAccessMinutes() const { return exclusiveAccessMinutes; }
 int Config::getCooldownMinutes() const { return cooldownMinutes; }
 bool Config::getEnable1BitSdMode() const { return enable1BitSdMode; }
+bool Config::getSdBusAutotune() const { return sdBusAutotune; }
 bool Config::getMinimizeReboots() const { return minimizeReboots; }
 bool Config::getFlushLogsDuringUpload() const { return flushLogsDuringUpload; }
+bool Config::getSmbFolderArchive() const { return smbFolderArchive; }
 bool Config::isSmartMode() const { return uploadMode == "smart"; }
 
 // Helper methods for enum conversion
@@ -1,25 +1,23 @@
 #include "CpapWebServer.h"
 #include "Logger.h"
 #include "UploadFSM.h"
+#include "FsmEvents.h"
 #include "version.h"
 #include "web_ui.h"
 #include "WebStatus.h"
+#include "EdfSummary.h"
+#include "HeapGovernor.h"
 #include <time.h>
 #include <SD_MMC.h>
 #include <LittleFS.h>
 
-// Global trigger flags
-volatile bool g_triggerUploadFlag = false;
+// Requests to the FSM are posted as events (FsmEvents.h); these carry data only.
+// Force upload outside the scheduled window: recent data only
 volatile bool g_forceRecentOnlyFlag = false;
-volatile bool g_resetStateFlag = false;
-volatile bool g_softRebootFlag = false;
 
-// Monitoring trigger flags
-volatile bool g_monitorActivityFlag = false;
-
-// Cooperative upload abort flag — set when config lock is requested during an active upload
+// Cooperative upload abort flag — set when config lock is requested during an active upload.
+// Read by the upload task between files, not by the FSM.
 volatile bool g_abortUploadFlag = false;
-volatile bool g_stopMonitorFlag = false;
 
 // External FSM state (defined in main.cpp)
 extern UploadState currentState;
@@ -272,6 +270,18 @@ bool CpapWebServer::begin() {
         if (this->redirectToIpIfMdnsRequest()) return;
         this->handleSdActivity();
     });
+    server->on("/api/netbench", [this]() {
+        if (this->redirectToIpIfMdnsRequest()) return;
+        this->handleApiNetBench();
+    });
+    server->on("/api/night-summary", [this]() {
+        if (this->redirectToIpIfMdnsRequest()) return;
+        this->handleApiNightSummary();
+    });
+    server->on("/api/heap", [this]() {
+        if (this->redirectToIpIfMdnsRequest()) return;
+        this->handleApiHeap();
+    });
     // /api/diagnostics removed — cpu0/cpu1 merged into /api/status
     server->on("/reset-state", [this]() {
         if (this->redirectToIpIfMdnsRequest()) return;
@@ -354,6 +364,8 @@ bool CpapWebServer::begin() {
     LOG("[WebServer]   POST /api/config-raw     - Save raw config.txt");
     LOG("[WebServer]   GET  /api/monitor-start  - Start SD activity monitoring");
     LOG("[WebServer]   GET  /api/monitor-stop   - Stop SD activity monitoring");
+    LOG("[WebServer]   GET  /api/netbench       - Network self-test results (?run=1 starts)");
+    LOG("[WebServer]   GET  /api/night-summary  - Last night's usage and signal statistics");
 #ifdef ENABLE_OTA_UPDATES
     LOG("[WebServer]   GET  /ota               - OTA firmware update page");
     LOG("[WebServer]   POST /ota-upload         - Upload firmware binary");
@@ -442,8 +454,8 @@ void CpapWebServer::handleTriggerUpload() {
         }
     }
 
-    // Set global trigger flag — FSM picks this up in the next loop iteration
-    g_triggerUploadFlag = true;
+    // Wake the FSM; it starts the upload once no upload task is running
+    g_fsmEvents.post(FSM_EVT_UPLOAD_TRIGGER);
 
     addCorsHeaders(server);
     server->send(200, "application/json",
@@ -459,15 +471,15 @@ void CpapWebServer::handleSoftReboot() {
     addCorsHeaders(server);
     server->send(200, "application/json",
         "{\"status\":\"success\",\"message\":\"Rebooting now (waits skipped)...\"}");
-    g_softRebootFlag = true;
+    g_fsmEvents.post(FSM_EVT_SOFT_REBOOT);
 }
 
 // GET /reset-state - Clear upload state
 void CpapWebServer::handleResetState() {
     LOG("[WebServer] State reset requested via web interface");
     
-    // Set global reset flag
-    g_resetStateFlag = true;
+    // Handled by the FSM right away, even during an upload
+    g_fsmEvents.post(FSM_EVT_RESET_STATE);
     
     // Add CORS headers
     addCorsHeaders(server);
@@ -1179,8 +1191,8 @@ void CpapWebServer::handleOTAPage() {
         html += "<h2>Method 1: File Upload</h2>";
         html += "<form id='uploadForm' enctype='multipart/form-data'>";
         html += "<div class='form-group'>";
-        html += "<label for='firmwareFile'>Select firmware file (.bin):</label>";
-        html += "<input type='file' id='firmwareFile' name='firmware' accept='.bin' required>";
+        html += "<label for='firmwareFile'>Select firmware file (.bin, .bin.gz or .cpd.gz delta):</label>";
+        html += "<input type='file' id='firmwareFile' name='firmware' accept='.bin,.gz,.cpd' required>";
         html += "</div>";
         html += "<button type='submit' class='btn btn-primary'>Upload & Install</button>";
         html += "<div id='uploadStatus' class='status-msg'></div>";
@@ -1195,6 +1207,10 @@ void CpapWebServer::handleOTAPage() {
         html += "<label for='firmwareURL'>Firmware URL:</label>";
         html += "<input type='url' id='firmwareURL' name='url' placeholder='https://github.com/.../firmware.bin' required>";
         html += "</div>";
+        html += "<div class='form-group'>";
+        html += "<label for='firmwareSHA'>SHA-256 (optional):</label>";
+        html += "<input type='text' id='firmwareSHA' name='sha256' placeholder='64 hex digits from the release' pattern='[0-9a-fA-F]{64}'>";
+        html += "</div>";
         html += "<button type='submit' class='btn btn-primary'>Download & Install</button>";
         html += "<div id='downloadStatus' class='status-msg'></div>";
         html += "</form>";
@@ -1226,7 +1242,7 @@ void CpapWebServer::handleOTAPage() {
     html += "  if (updateInProgress) return;";
     html += "  const url = document.getElementById('firmwareURL').value;";
     html += "  if (!url) { alert('Please enter a URL'); return; }";
-    html += "  downloadFirmware(url);";
+    html += "  downloadFirmware(url, document.getElementById('firmwareSHA').value.trim());";
     html += "});";
     
     // Upload function
@@ -1262,11 +1278,12 @@ void CpapWebServer::handleOTAPage() {
     html += "}";
     
     // Download function
-    html += "function downloadFirmware(url) {";
+    html += "function downloadFirmware(url, sha256) {";
     html += "  updateInProgress = true;";
     html += "  setStatus('downloadStatus', 'info', 'Downloading firmware... (this may take a minute)');";
     html += "  const formData = new FormData();";
     html += "  formData.append('url', url);";
+    html += "  formData.append('sha256', sha256);";
     html += "  fetch('/ota-url', { method: 'POST', body: formData })";
     html += "    .then(response => response.json())";
     html += "    .then(data => handleResult(data, 'downloadStatus'))";
@@ -1396,9 +1413,11 @@ void CpapWebServer::handleOTAURL() {
     }
     
     String url = server->arg("url");
+    String sha256 = server->arg("sha256");  // Optional: empty skips the check
+    sha256.trim();
     LOG_DEBUGF("[OTA] Starting download from URL: %s", url.c_str());
     
-    if (otaManager->updateFromURL(url)) {
+    if (otaManager->updateFromURL(url, sha256)) {
         LOG("[OTA] Update completed successfully, restarting...");
         server->send(200, "application/json", "{\"success\":true,\"message\":\"Update completed! Device will restart in 3 seconds.\"}");
         
@@ -1414,19 +1433,110 @@ void CpapWebServer::handleOTAURL() {
 
 #endif // ENABLE_OTA_UPDATES
 
+// ============================================================================
+// Network Self-Test Handler
+// ============================================================================
+
+void CpapWebServer::handleApiNetBench() {
+    addCorsHeaders(server);
+
+    // ?run=1 queues a run; the main loop starts it once no upload is active
+    if (server->hasArg("run") && g_netBenchStatus.state != NetBenchState::RUNNING) {
+        if (isUploadInProgress()) {
+            server->send(409, "application/json",
+                         "{\"success\":false,\"message\":\"Upload in progress - try again later\"}");
+            return;
+        }
+        g_netBenchStatus.state = NetBenchState::RUNNING;
+        g_fsmEvents.post(FSM_EVT_NETBENCH);
+    }
+
+    const NetBenchStatus& nb = g_netBenchStatus;
+    const char* state = nb.state == NetBenchState::RUNNING ? "running" :
+                        nb.state == NetBenchState::DONE    ? "done"    : "idle";
+
+    char json[768];
+    int n = snprintf(json, sizeof(json),
+                     "{\"state\":\"%s\",\"finished_ts\":%lu,\"duration_ms\":%lu,\"rssi\":%d",
+                     state, (unsigned long)nb.finishedTs, (unsigned long)nb.durationMs, nb.rssi);
+    if (nb.smbTested && n > 0 && n < (int)sizeof(json)) {
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"smb\":{\"ok\":%s,\"tcp_connect_ms\":%lu,\"session_ms\":%lu,"
+                      "\"write_bytes\":%lu,\"write_ms\":%lu,\"write_bps\":%lu}",
+                      nb.smb.ok ? "true" : "false",
+                      (unsigned long)nb.smb.tcpConnectMs, (unsigned long)nb.smb.sessionMs,
+                      (unsigned long)nb.smb.writeBytes, (unsigned long)nb.smb.writeMs,
+                      (unsigned long)netBenchBps(nb.smb.writeBytes, nb.smb.writeMs));
+    }
+    if (nb.cloudTested && n > 0 && n < (int)sizeof(json)) {
+        n += snprintf(json + n, sizeof(json) - n,
+                      ",\"cloud\":{\"ok\":%s,\"dns_ms\":%lu,\"tls_ms\":%lu,\"api_rtt_ms\":%lu,"
+                      "\"post_bytes\":%lu,\"post_ms\":%lu,\"post_bps\":%lu,"
+                      "\"post_response_ms\":%lu,\"post_http_code\":%d}",
+                      nb.cloud.ok ? "true" : "false",
+                      (unsigned long)nb.cloud.dnsMs, (unsigned long)nb.cloud.tlsMs,
+                      (unsigned long)nb.cloud.apiRttMs, (unsigned long)nb.cloud.postBytes,
+                      (unsigned long)nb.cloud.postMs,
+                      (unsigned long)netBenchBps(nb.cloud.postBytes, nb.cloud.postMs),
+                      (unsigned long)nb.cloud.postResponseMs, nb.cloud.postHttpCode);
+    }
+    if (n > 0 && n < (int)sizeof(json) - 1) {
+        json[n++] = '}';
+        json[n] = '\0';
+    }
+
+    server->send(200, "application/json", json);
+}
+
+// ---------------------------------------------------------------------------
+// GET /api/night-summary — newest day reduced from uploaded PLD files
+// ---------------------------------------------------------------------------
+void CpapWebServer::handleApiNightSummary() {
+    addCorsHeaders(server);
+    server->sendHeader("Cache-Control", "no-store, no-cache, must-revalidate");
+
+    NightSummary night;
+    if (!NightSummaryStore::readLatest(LittleFS, night)) {
+        server->send(200, "application/json", "{\"available\":false}");
+        return;
+    }
+
+    char json[512];
+    int n = snprintf(json, sizeof(json),
+                     "{\"available\":true,\"day\":%lu,\"sessions\":%u,\"usage_sec\":%lu",
+                     (unsigned long)night.day, (unsigned)night.sessions,
+                     (unsigned long)night.usageSec);
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT && n > 0 && n < (int)sizeof(json); i++) {
+        const NightSignalStats& s = night.stats[i];
+        if (s.samples == 0) {
+            n += snprintf(json + n, sizeof(json) - n, ",\"%s\":null", nightSignalName(i));
+        } else {
+            n += snprintf(json + n, sizeof(json) - n,
+                          ",\"%s\":{\"min\":%.2f,\"mean\":%.2f,\"max\":%.2f,\"samples\":%lu}",
+                          nightSignalName(i), s.min, s.mean, s.max, (unsigned long)s.samples);
+        }
+    }
+    if (n > 0 && n < (int)sizeof(json) - 1) {
+        json[n++] = '}';
+        json[n] = '\0';
+    }
+
+    server->send(200, "application/json", json);
+}
+
 // ============================================================================
 // SD Activity Monitor Handlers
 // ============================================================================
 
 void CpapWebServer::handleMonitorStart() {
     addCorsHeaders(server);
-    g_monitorActivityFlag = true;
+    g_fsmEvents.post(FSM_EVT_MONITOR_START);
     server->send(200, "application/json", "{\"success\":true,\"message\":\"Monitoring started\"}");
 }
 
 void CpapWebServer::handleMonitorStop() {
     addCorsHeaders(server);
-    g_stopMonitorFlag = true;
+    g_fsmEvents.post(FSM_EVT_MONITOR_STOP);
     server->send(200, "application/json", "{\"success\":true,\"message\":\"Monitoring stopped\"}");
 }
 
@@ -1438,9 +1548,10 @@ void CpapWebServer::handleSdActivity() {
         return;
     }
 
-    // During uploads return a compact payload with no sample history.
+    // During uploads, or when the heap governor has no room for the ~2KB
+    // sample history, return a compact payload with no sample history.
     // This keeps the endpoint alive for UI health checks while avoiding heavy String churn.
-    if (isUploadInProgress()) {
+    if (isUploadInProgress() || !g_heapGovernor.hasRoom(HeapBudget::WebResponse, 2048)) {
         static unsigned long lastCompactRefreshMs = 0;
         static char compactJson[256] = {0};
         const unsigned long now = millis();
@@ -1502,6 +1613,21 @@ void CpapWebServer::handleSdActivity() {
 
 // handleApiDiagnostics() removed — cpu0/cpu1 merged into /api/status
 
+// GET /api/heap — heap governor budgets and recent grant/deny/release history
+void CpapWebServer::handleApiHeap() {
+    addCorsHeaders(server);
+    server->sendHeader("Cache-Control", "no-store, no-cache, must-revalidate");
+
+    // Static: the worst case (all 16 history entries) is ~2.5KB, and this
+    // endpoint is read exactly when the heap is suspect.
+    static char json[3072];
+    if (g_heapGovernor.toJson(json, sizeof(json)) == 0) {
+        server->send(500, "application/json", "{\"error\":\"heap report too large\"}");
+        return;
+    }
+    server->send(200, "application/json", json);
+}
+
 void CpapWebServer::handleMonitorPage() {
     server->sendHeader("Cache-Control", "no-store, no-cache, must-revalidate, max-age=0");
     server->sendHeader("Connection", "close");
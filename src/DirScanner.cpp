@@ -0,0 +1,89 @@
+#include "DirScanner.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+DirScanner::DirScanner(const char* mountPoint) :
+    mountPoint(mountPoint ? mountPoint : ""),
+    dir(nullptr),
+    entry(nullptr),
+    entryType(DT_UNKNOWN) {
+    dirPath[0] = '\0';
+}
+
+DirScanner::~DirScanner() {
+    close();
+}
+
+bool DirScanner::open(const char* path) {
+    close();
+    int n = snprintf(dirPath, sizeof(dirPath), "%s%s", mountPoint, path ? path : "");
+    if (n <= 0 || (size_t)n >= sizeof(dirPath)) {
+        dirPath[0] = '\0';
+        return false;
+    }
+    // opendir() fails with ENOTDIR for regular files
+    dir = opendir(dirPath);
+    return dir != nullptr;
+}
+
+void DirScanner::close() {
+    if (dir) {
+        closedir(dir);
+        dir = nullptr;
+    }
+    entry = nullptr;
+    entryType = DT_UNKNOWN;
+}
+
+bool DirScanner::next() {
+    if (!dir) return false;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* n = entry->d_name;
+        if (n[0] == '.' && (n[1] == '\0' || (n[1] == '.' && n[2] == '\0'))) {
+            continue;
+        }
+        entryType = entry->d_type;
+        if (entryType == DT_UNKNOWN) {
+            // Filesystem did not report the type: fall back to stat()
+            char full[MAX_PATH_LEN];
+            struct stat st;
+            if (buildEntryPath(full, sizeof(full)) && ::stat(full, &st) == 0) {
+                entryType = S_ISDIR(st.st_mode) ? DT_DIR : DT_REG;
+            }
+        }
+        return true;
+    }
+    entryType = DT_UNKNOWN;
+    return false;
+}
+
+const char* DirScanner::name() const {
+    return entry ? entry->d_name : "";
+}
+
+bool DirScanner::isDirectory() const {
+    return entry && entryType == DT_DIR;
+}
+
+bool DirScanner::isFile() const {
+    return entry && entryType == DT_REG;
+}
+
+bool DirScanner::stat(uint32_t& size, time_t& mtime) {
+    char full[MAX_PATH_LEN];
+    if (!entry || !buildEntryPath(full, sizeof(full))) return false;
+    struct stat st;
+    if (::stat(full, &st) != 0) return false;
+    size = (uint32_t)st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+bool DirScanner::buildEntryPath(char* buf, size_t len) const {
+    if (!entry) return false;
+    size_t dirLen = strlen(dirPath);
+    const char* sep = (dirLen > 0 && dirPath[dirLen - 1] == '/') ? "" : "/";
+    int n = snprintf(buf, len, "%s%s%s", dirPath, sep, entry->d_name);
+    return n > 0 && (size_t)n < len;
+}
@@ -0,0 +1,170 @@
+#include "EdfHeader.h"
+#include <string.h>
+
+bool parseEdfNumber(const uint8_t* field, size_t len, int32_t scale, int32_t& out) {
+    size_t i = 0;
+    while (i < len && field[i] == ' ') i++;
+
+    bool negative = false;
+    if (i < len && field[i] == '-') {
+        negative = true;
+        i++;
+    }
+
+    int64_t whole = 0;
+    int64_t frac = 0;
+    int64_t fracScale = 1;
+    bool digits = false;
+    bool dot = false;
+    for (; i < len && field[i] != ' '; i++) {
+        char c = (char)field[i];
+        if (c == '.' && !dot) {
+            dot = true;
+            continue;
+        }
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        digits = true;
+        if (!dot) {
+            whole = whole * 10 + (c - '0');
+            if (whole > 0x7FFFFFFF) return false;
+        } else if (fracScale < scale) {
+            frac = frac * 10 + (c - '0');
+            fracScale *= 10;
+        }
+    }
+    for (; i < len; i++) {
+        if (field[i] != ' ') return false;
+    }
+    if (!digits) {
+        return false;
+    }
+
+    int64_t value = whole * scale + (frac * scale) / fracScale;
+    if (value > 0x7FFFFFFF) {
+        return false;
+    }
+    out = negative ? -(int32_t)value : (int32_t)value;
+    return true;
+}
+
+namespace {
+bool parseTwoDigits(const uint8_t* p, uint8_t& out) {
+    if (p[0] < '0' || p[0] > '9' || p[1] < '0' || p[1] > '9') {
+        return false;
+    }
+    out = (uint8_t)((p[0] - '0') * 10 + (p[1] - '0'));
+    return true;
+}
+}
+
+bool parseEdfFixedHeader(const uint8_t* header, size_t len, EdfHeaderInfo& out) {
+    memset(&out, 0, sizeof(out));
+    if (!header || len < EDF_FIXED_HEADER_BYTES) {
+        return false;
+    }
+
+    int32_t headerBytes = 0;
+    int32_t records = 0;
+    int32_t durationMs = 0;
+    int32_t signals = 0;
+    if (!parseEdfNumber(header + 184, 8, 1, headerBytes) ||
+        !parseEdfNumber(header + 236, 8, 1, records) ||
+        !parseEdfNumber(header + 244, 8, 1000, durationMs) ||
+        !parseEdfNumber(header + 252, 4, 1, signals)) {
+        return false;
+    }
+
+    if (signals <= 0 || signals > EDF_MAX_SIGNALS ||
+        headerBytes != (int32_t)(EDF_FIXED_HEADER_BYTES * (signals + 1)) ||
+        records < -1 || durationMs < 0) {
+        return false;
+    }
+
+    out.headerBytes = (uint32_t)headerBytes;
+    out.dataRecords = records;
+    out.recordDurationMs = (uint32_t)durationMs;
+    out.signals = (uint16_t)signals;
+
+    // "dd.mm.yy" and "hh.mm.ss"; EDF clipping date: yy >= 85 is 19yy
+    uint8_t dd, mm, yy, hh, mi, ss;
+    if (parseTwoDigits(header + 168, dd) && parseTwoDigits(header + 171, mm) &&
+        parseTwoDigits(header + 174, yy) && parseTwoDigits(header + 176, hh) &&
+        parseTwoDigits(header + 179, mi) && parseTwoDigits(header + 182, ss)) {
+        out.startYear = (uint16_t)(yy >= 85 ? 1900 + yy : 2000 + yy);
+        out.startMonth = mm;
+        out.startDay = dd;
+        out.startHour = hh;
+        out.startMinute = mi;
+        out.startSecond = ss;
+    }
+    return true;
+}
+
+bool readEdfHeader(fs::File& file, EdfHeaderInfo& out) {
+    uint8_t buffer[EDF_FIXED_HEADER_BYTES];
+    if (!file.seek(0) || file.read(buffer, sizeof(buffer)) != sizeof(buffer)) {
+        return false;
+    }
+    if (!parseEdfFixedHeader(buffer, sizeof(buffer), out)) {
+        return false;
+    }
+
+    // Samples per record: 8 bytes per signal after labels (16), transducer (80),
+    // physical dimension, min/max and digital min/max (8 each), prefilter (80)
+    uint32_t samplesOffset = EDF_FIXED_HEADER_BYTES + (uint32_t)out.signals * 216;
+    if (!file.seek(samplesOffset)) {
+        return false;
+    }
+
+    uint32_t samples = 0;
+    uint16_t remaining = out.signals;
+    while (remaining > 0) {
+        uint16_t batch = remaining < 32 ? remaining : 32;
+        if (file.read(buffer, batch * 8) != (size_t)(batch * 8)) {
+            return false;
+        }
+        for (uint16_t i = 0; i < batch; i++) {
+            int32_t n = 0;
+            if (!parseEdfNumber(buffer + i * 8, 8, 1, n) || n < 0) {
+                return false;
+            }
+            samples += (uint32_t)n;
+        }
+        remaining -= batch;
+    }
+
+    out.recordBytes = samples * 2;
+    return true;
+}
+
+EdfFileState classifyEdf(const EdfHeaderInfo& info, uint32_t fileSize) {
+    if (info.headerBytes == 0 || info.recordBytes == 0) {
+        return EdfFileState::Unknown;
+    }
+    if (info.dataRecords < 0) {
+        return EdfFileState::Open;
+    }
+    uint64_t expected = (uint64_t)info.headerBytes + (uint64_t)info.dataRecords * info.recordBytes;
+    return expected == fileSize ? EdfFileState::Closed : EdfFileState::Open;
+}
+
+EdfFileState classifyEdfFile(fs::FS &sd, const char* path, uint32_t fileSize) {
+    fs::File file = sd.open(path, FILE_READ);
+    if (!file) {
+        return EdfFileState::Unknown;
+    }
+    EdfHeaderInfo info;
+    bool ok = readEdfHeader(file, info);
+    file.close();
+    return ok ? classifyEdf(info, fileSize) : EdfFileState::Unknown;
+}
+
+const char* edfFileStateName(EdfFileState state) {
+    switch (state) {
+        case EdfFileState::Closed: return "closed";
+        case EdfFileState::Open:   return "open";
+        default:                   return "unknown";
+    }
+}
@@ -0,0 +1,486 @@
+#include "EdfSummary.h"
+#include "Logger.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+namespace {
+// Signal header columns that are captured, in units of `signals`: each column
+// holds one `width`-byte field per signal, starting at 256 + start * signals
+struct SignalColumn {
+    uint16_t start;
+    uint8_t width;
+};
+
+enum : uint8_t { COL_LABEL, COL_PHYS_MIN, COL_PHYS_MAX, COL_DIG_MIN, COL_DIG_MAX, COL_SAMPLES };
+
+const SignalColumn SIGNAL_COLUMNS[] = {
+    {0, 16},    // label
+    {104, 8},   // physical minimum
+    {112, 8},   // physical maximum
+    {120, 8},   // digital minimum
+    {128, 8},   // digital maximum
+    {216, 8},   // samples per data record
+};
+const uint8_t SIGNAL_COLUMN_COUNT = sizeof(SIGNAL_COLUMNS) / sizeof(SIGNAL_COLUMNS[0]);
+
+// Label prefix (before ".2s") and display scale for each NightSignal
+struct NightSignalDef {
+    const char* label;
+    float scale;
+};
+
+const NightSignalDef NIGHT_SIGNALS[NIGHT_SIGNAL_COUNT] = {
+    {"Press", 1.0f},
+    {"Leak", 60.0f},      // L/s -> L/min
+    {"RespRate", 1.0f},
+};
+
+bool summaryLabelMatches(const uint8_t* field, size_t width, const char* label) {
+    size_t n = strlen(label);
+    if (n > width || memcmp(field, label, n) != 0) {
+        return false;
+    }
+    return n == width || field[n] == '.' || field[n] == ' ';
+}
+
+bool readSummaryLine(fs::File& file, char* buffer, size_t bufferLen) {
+    size_t idx = 0;
+    while (file.available()) {
+        int ch = file.read();
+        if (ch < 0 || ch == '\n') {
+            break;
+        }
+        if (ch != '\r' && idx + 1 < bufferLen) {
+            buffer[idx++] = (char)ch;
+        }
+    }
+    buffer[idx] = '\0';
+    return idx > 0 || file.available();
+}
+}
+
+const char* nightSignalName(uint8_t signal) {
+    switch (signal) {
+        case NIGHT_PRESSURE:  return "pressure";
+        case NIGHT_LEAK:      return "leak";
+        case NIGHT_RESP_RATE: return "resp_rate";
+        default:              return "unknown";
+    }
+}
+
+// ============================================================================
+// EdfStreamReducer
+// ============================================================================
+
+EdfStreamReducer::EdfStreamReducer() : state(State::Idle), day(0) {
+    restart();
+    state = State::Idle;
+}
+
+bool EdfStreamReducer::begin(const char* path) {
+    state = State::Idle;
+    // /DATALOG/YYYYMMDD/<name>_PLD.edf
+    static const char PREFIX[] = "/DATALOG/";
+    const size_t prefixLen = sizeof(PREFIX) - 1;
+    if (!path || strncmp(path, PREFIX, prefixLen) != 0) {
+        return false;
+    }
+    const char* folder = path + prefixLen;
+    uint32_t folderDay = 0;
+    for (int i = 0; i < 8; i++) {
+        if (folder[i] < '0' || folder[i] > '9') {
+            return false;
+        }
+        folderDay = folderDay * 10 + (uint32_t)(folder[i] - '0');
+    }
+    if (folder[8] != '/') {
+        return false;
+    }
+    size_t len = strlen(folder);
+    if (len < 9 + 8 || strcasecmp(folder + len - 8, "_PLD.edf") != 0) {
+        return false;
+    }
+
+    day = folderDay;
+    restart();
+    return true;
+}
+
+void EdfStreamReducer::restart() {
+    state = State::FixedHeader;
+    offset = 0;
+    recordPos = 0;
+    records = 0;
+    memset(&info, 0, sizeof(info));
+    memset(samples, 0, sizeof(samples));
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+        Tracked& t = tracked[i];
+        memset(&t, 0, sizeof(t));
+        t.signal = -1;
+        t.lo = INT16_MAX;
+        t.hi = INT16_MIN;
+    }
+}
+
+void EdfStreamReducer::end() {
+    state = State::Idle;
+}
+
+void EdfStreamReducer::feed(const uint8_t* data, size_t len) {
+    if (!isActive() || !data) {
+        return;
+    }
+    if (state != State::Records) {
+        feedHeader(data, len);
+    }
+    if (state == State::Records && len > 0) {
+        feedRecords(data, len);
+    }
+}
+
+void EdfStreamReducer::feedHeader(const uint8_t*& data, size_t& len) {
+    while (len > 0 && (state == State::FixedHeader || state == State::SignalHeaders)) {
+        if (state == State::FixedHeader) {
+            size_t take = EDF_FIXED_HEADER_BYTES - offset;
+            if (take > len) take = len;
+            memcpy(fixed + offset, data, take);
+            offset += take;
+            data += take;
+            len -= take;
+            if (offset == EDF_FIXED_HEADER_BYTES) {
+                if (!parseEdfFixedHeader(fixed, sizeof(fixed), info) || info.signals > MAX_SIGNALS) {
+                    state = State::Failed;
+                    return;
+                }
+                state = State::SignalHeaders;
+            }
+            continue;
+        }
+
+        // Either inside a captured column (copy into `field`) or in one of the
+        // ignored columns (skip to the start of the next captured one)
+        const uint32_t ns = info.signals;
+        const uint32_t rel = offset - EDF_FIXED_HEADER_BYTES;
+        uint32_t next = (uint32_t)EDF_FIXED_HEADER_BYTES * ns;
+        size_t take = 0;
+        for (uint8_t c = 0; c < SIGNAL_COLUMN_COUNT; c++) {
+            const uint32_t begin = SIGNAL_COLUMNS[c].start * ns;
+            const uint32_t width = SIGNAL_COLUMNS[c].width;
+            if (rel < begin) {
+                next = begin;
+                break;
+            }
+            if (rel < begin + width * ns) {
+                uint32_t within = (rel - begin) % width;
+                take = width - within;
+                if (take > len) take = len;
+                memcpy(field + within, data, take);
+                if (within + take == width) {
+                    onSignalField(c, (uint16_t)((rel - begin) / width));
+                }
+                break;
+            }
+        }
+        if (take == 0) {
+            take = next - rel;
+            if (take > len) take = len;
+        }
+        offset += take;
+        data += take;
+        len -= take;
+
+        if (state == State::SignalHeaders && offset == info.headerBytes && !finishHeader()) {
+            state = State::Failed;
+        }
+    }
+}
+
+void EdfStreamReducer::onSignalField(uint8_t column, uint16_t signal) {
+    if (column == COL_LABEL) {
+        for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+            if (tracked[i].signal < 0 && summaryLabelMatches(field, 16, NIGHT_SIGNALS[i].label)) {
+                tracked[i].signal = (int16_t)signal;
+            }
+        }
+        return;
+    }
+    if (column == COL_SAMPLES) {
+        int32_t n = 0;
+        if (!parseEdfNumber(field, 8, 1, n) || n < 0 || n > 0xFFFF) {
+            state = State::Failed;
+            return;
+        }
+        samples[signal] = (uint16_t)n;
+        return;
+    }
+
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+        Tracked& t = tracked[i];
+        if (t.signal != (int16_t)signal) continue;
+        bool physical = column == COL_PHYS_MIN || column == COL_PHYS_MAX;
+        int32_t value = 0;
+        if (!parseEdfNumber(field, 8, physical ? 1000 : 1, value)) {
+            t.signal = -1;   // Unusable scaling: drop the signal, keep the rest
+            continue;
+        }
+        switch (column) {
+            case COL_PHYS_MIN: t.physMin = value; break;
+            case COL_PHYS_MAX: t.physMax = value; break;
+            case COL_DIG_MIN:  t.digMin = value; break;
+            case COL_DIG_MAX:  t.digMax = value; break;
+        }
+    }
+}
+
+bool EdfStreamReducer::finishHeader() {
+    uint32_t cumulative = 0;
+    for (uint16_t s = 0; s < info.signals; s++) {
+        for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+            Tracked& t = tracked[i];
+            if (t.signal != (int16_t)s) continue;
+            t.recordStart = cumulative * 2;
+            t.recordEnd = (cumulative + samples[s]) * 2;
+            if (t.digMax <= t.digMin) {
+                t.signal = -1;
+            }
+        }
+        cumulative += samples[s];
+    }
+    info.recordBytes = cumulative * 2;
+    if (info.recordBytes == 0) {
+        return false;
+    }
+    state = State::Records;
+    return true;
+}
+
+void EdfStreamReducer::feedRecords(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        uint32_t take = info.recordBytes - recordPos;
+        if (take > len) take = (uint32_t)len;
+
+        // Only the byte ranges of tracked signals are touched (int16 LE samples)
+        for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+            Tracked& t = tracked[i];
+            if (t.signal < 0) continue;
+            uint32_t from = t.recordStart > recordPos ? t.recordStart : recordPos;
+            uint32_t to = t.recordEnd < recordPos + take ? t.recordEnd : recordPos + take;
+            for (uint32_t p = from; p < to; p++) {
+                uint8_t b = data[p - recordPos];
+                if (((p - t.recordStart) & 1) == 0) {
+                    t.pendingLow = b;
+                } else {
+                    addSample(t, (int16_t)(uint16_t)(t.pendingLow | ((uint16_t)b << 8)));
+                }
+            }
+        }
+
+        recordPos += take;
+        offset += take;
+        data += take;
+        len -= take;
+        if (recordPos == info.recordBytes) {
+            recordPos = 0;
+            records++;
+        }
+    }
+}
+
+void EdfStreamReducer::addSample(Tracked& t, int16_t value) {
+    if (value < t.digMin || value > t.digMax) {
+        return;   // Outside the declared range: gap / invalid marker
+    }
+    if (value < t.lo) t.lo = value;
+    if (value > t.hi) t.hi = value;
+    t.sum += value;
+    t.count++;
+}
+
+bool EdfStreamReducer::finish(NightSession& out) const {
+    memset(&out, 0, sizeof(out));
+    if (state != State::Records || records == 0) {
+        return false;
+    }
+
+    out.day = day;
+    out.startTime = (uint32_t)info.startHour * 10000 + (uint32_t)info.startMinute * 100 + info.startSecond;
+    out.usageSec = (uint32_t)(((uint64_t)records * info.recordDurationMs) / 1000);
+
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+        const Tracked& t = tracked[i];
+        if (t.signal < 0 || t.count == 0) continue;
+        // physical = physMin + (digital - digMin) * gain
+        double gain = ((double)t.physMax - t.physMin) / 1000.0 / ((double)t.digMax - t.digMin);
+        double base = t.physMin / 1000.0;
+        double scale = NIGHT_SIGNALS[i].scale;
+        double mean = (double)t.sum / t.count;
+        NightSignalStats& s = out.stats[i];
+        s.min = (float)((base + (t.lo - t.digMin) * gain) * scale);
+        s.max = (float)((base + (t.hi - t.digMin) * gain) * scale);
+        s.mean = (float)((base + (mean - t.digMin) * gain) * scale);
+        s.samples = t.count;
+    }
+    return true;
+}
+
+// ============================================================================
+// NightSummaryStore
+// ============================================================================
+
+const char* const NightSummaryStore::PATH = "/.night_summary";
+
+NightSummaryStore::NightSummaryStore() : sessionCount(0), dirty(false) {
+    memset(sessions, 0, sizeof(sessions));
+}
+
+bool NightSummaryStore::parseLine(const char* line, NightSession& out) {
+    unsigned long day = 0, start = 0, usage = 0;
+    unsigned long count[NIGHT_SIGNAL_COUNT] = {0};
+    memset(&out, 0, sizeof(out));
+    NightSignalStats* s = out.stats;
+    int n = sscanf(line, "N|%lu|%lu|%lu|%f,%f,%f,%lu|%f,%f,%f,%lu|%f,%f,%f,%lu",
+                   &day, &start, &usage,
+                   &s[0].min, &s[0].max, &s[0].mean, &count[0],
+                   &s[1].min, &s[1].max, &s[1].mean, &count[1],
+                   &s[2].min, &s[2].max, &s[2].mean, &count[2]);
+    if (n != 3 + 4 * NIGHT_SIGNAL_COUNT) {
+        return false;
+    }
+    out.day = (uint32_t)day;
+    out.startTime = (uint32_t)start;
+    out.usageSec = (uint32_t)usage;
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+        s[i].samples = (uint32_t)count[i];
+    }
+    return true;
+}
+
+bool NightSummaryStore::load(fs::FS &fs) {
+    sessionCount = 0;
+    dirty = false;
+    if (!fs.exists(PATH)) {
+        return true;
+    }
+    fs::File file = fs.open(PATH, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    char line[192];
+    while (sessionCount < MAX_SESSIONS && readSummaryLine(file, line, sizeof(line))) {
+        if (parseLine(line, sessions[sessionCount])) {
+            sessionCount++;
+        }
+    }
+    file.close();
+    return true;
+}
+
+bool NightSummaryStore::save(fs::FS &fs) {
+    if (!dirty) {
+        return true;
+    }
+    String tempPath = String(PATH) + ".tmp";
+    fs::File file = fs.open(tempPath, FILE_WRITE);
+    if (!file) {
+        LOG_ERROR("[NightSummary] Failed to open summary file for writing");
+        return false;
+    }
+    char line[192];
+    for (uint8_t i = 0; i < sessionCount; i++) {
+        const NightSession& ns = sessions[i];
+        int n = snprintf(line, sizeof(line), "N|%lu|%06lu|%lu",
+                         (unsigned long)ns.day, (unsigned long)ns.startTime, (unsigned long)ns.usageSec);
+        for (uint8_t k = 0; k < NIGHT_SIGNAL_COUNT && n > 0 && n < (int)sizeof(line); k++) {
+            const NightSignalStats& s = ns.stats[k];
+            n += snprintf(line + n, sizeof(line) - n, "|%.2f,%.2f,%.2f,%lu",
+                          s.min, s.max, s.mean, (unsigned long)s.samples);
+        }
+        if (file.println(line) == 0) {
+            file.close();
+            fs.remove(tempPath);
+            return false;
+        }
+    }
+    file.close();
+
+    fs.remove(PATH);
+    if (!fs.rename(tempPath, PATH)) {
+        fs.remove(tempPath);
+        LOG_ERROR("[NightSummary] Failed to replace summary file");
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+void NightSummaryStore::record(const NightSession& session) {
+    // Newest first: (day, startTime) descending
+    uint8_t pos = 0;
+    while (pos < sessionCount) {
+        const NightSession& s = sessions[pos];
+        if (s.day == session.day && s.startTime == session.startTime) {
+            sessions[pos] = session;
+            dirty = true;
+            return;
+        }
+        if (s.day < session.day || (s.day == session.day && s.startTime < session.startTime)) {
+            break;
+        }
+        pos++;
+    }
+    if (pos >= MAX_SESSIONS) {
+        return;   // Older than everything kept
+    }
+    uint8_t last = sessionCount < MAX_SESSIONS ? sessionCount : MAX_SESSIONS - 1;
+    for (uint8_t i = last; i > pos; i--) {
+        sessions[i] = sessions[i - 1];
+    }
+    sessions[pos] = session;
+    if (sessionCount < MAX_SESSIONS) sessionCount++;
+    dirty = true;
+}
+
+void NightSummaryStore::addToSummary(NightSummary& summary, const NightSession& session) {
+    summary.day = session.day;
+    summary.sessions++;
+    summary.usageSec += session.usageSec;
+    for (uint8_t i = 0; i < NIGHT_SIGNAL_COUNT; i++) {
+        const NightSignalStats& s = session.stats[i];
+        NightSignalStats& agg = summary.stats[i];
+        if (s.samples == 0) continue;
+        if (agg.samples == 0) {
+            agg = s;
+            continue;
+        }
+        if (s.min < agg.min) agg.min = s.min;
+        if (s.max > agg.max) agg.max = s.max;
+        uint32_t total = agg.samples + s.samples;
+        agg.mean = (float)(((double)agg.mean * agg.samples + (double)s.mean * s.samples) / total);
+        agg.samples = total;
+    }
+}
+
+bool NightSummaryStore::readLatest(fs::FS &fs, NightSummary& out) {
+    memset(&out, 0, sizeof(out));
+    if (!fs.exists(PATH)) {
+        return false;
+    }
+    fs::File file = fs.open(PATH, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    char line[192];
+    NightSession session;
+    while (readSummaryLine(file, line, sizeof(line))) {
+        if (!parseLine(line, session)) continue;
+        if (out.sessions == 0 || session.day > out.day) {
+            memset(&out, 0, sizeof(out));
+        } else if (session.day < out.day) {
+            continue;
+        }
+        addToSummary(out, session);
+    }
+    file.close();
+    return out.sessions > 0;
+}
@@ -0,0 +1,104 @@
+#include "FileFingerprint.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef UNIT_TEST
+#include "MockCRC.h"
+#else
+#include <esp_rom_crc.h>
+#endif
+
+namespace {
+const char CRC32_TAG[] = "crc32:";
+const size_t CRC32_TAG_LEN = sizeof(CRC32_TAG) - 1;
+
+int hexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+bool parseHexDigest(const char* hex, size_t hexLen, uint8_t* out) {
+    if (strlen(hex) != hexLen) {
+        return false;
+    }
+    for (size_t i = 0; i < hexLen / 2; ++i) {
+        int hi = hexDigitValue(hex[i * 2]);
+        int lo = hexDigitValue(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return true;
+}
+}
+
+FileFingerprint::FileFingerprint(FingerprintAlgo algo) :
+    algorithm(algo),
+    crc(0) {
+    reset();
+}
+
+void FileFingerprint::reset() {
+    crc = 0;
+    if (algorithm == FingerprintAlgo::Md5) {
+        esp_rom_md5_init(&md5);
+    }
+}
+
+void FileFingerprint::update(const uint8_t* data, size_t len) {
+    if (algorithm == FingerprintAlgo::Crc32) {
+        crc = esp_rom_crc32_le(crc, data, (uint32_t)len);
+    } else {
+        esp_rom_md5_update(&md5, data, (uint32_t)len);
+    }
+}
+
+size_t FileFingerprint::finish(uint8_t out[MAX_DIGEST_LEN]) {
+    if (algorithm == FingerprintAlgo::Crc32) {
+        out[0] = (uint8_t)(crc >> 24);
+        out[1] = (uint8_t)(crc >> 16);
+        out[2] = (uint8_t)(crc >> 8);
+        out[3] = (uint8_t)crc;
+        return 4;
+    }
+    esp_rom_md5_final(out, &md5);
+    return 16;
+}
+
+void FileFingerprint::finishText(char* out) {
+    uint8_t digest[MAX_DIGEST_LEN];
+    finish(digest);
+    format(algorithm, digest, out);
+}
+
+size_t FileFingerprint::digestLen(FingerprintAlgo algo) {
+    return algo == FingerprintAlgo::Crc32 ? 4 : 16;
+}
+
+void FileFingerprint::format(FingerprintAlgo algo, const uint8_t* digest, char* out) {
+    size_t pos = 0;
+    if (algo == FingerprintAlgo::Crc32) {
+        memcpy(out, CRC32_TAG, CRC32_TAG_LEN);
+        pos = CRC32_TAG_LEN;
+    }
+    size_t len = digestLen(algo);
+    for (size_t i = 0; i < len; ++i) {
+        snprintf(out + pos + i * 2, 3, "%02x", digest[i]);
+    }
+    out[pos + len * 2] = '\0';
+}
+
+bool FileFingerprint::parse(const char* text, FingerprintAlgo& algo, uint8_t out[MAX_DIGEST_LEN]) {
+    if (!text) {
+        return false;
+    }
+    if (strncmp(text, CRC32_TAG, CRC32_TAG_LEN) == 0) {
+        algo = FingerprintAlgo::Crc32;
+        return parseHexDigest(text + CRC32_TAG_LEN, 8, out);
+    }
+    algo = FingerprintAlgo::Md5;
+    return parseHexDigest(text, 32, out);
+}
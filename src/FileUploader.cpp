@@ -1,10 +1,16 @@
 #include "FileUploader.h"
 #include "Logger.h"
 #include "WebStatus.h"
+#include "DirScanner.h"
+#include "EdfHeader.h"
+#include "StaticString.h"
+#include "IoBufferPool.h"
 #include <SD_MMC.h>
 #include <LittleFS.h>
+#include <Preferences.h>
 #include <functional>
 #include <time.h>
+#include <errno.h>
 
 #ifdef ENABLE_WEBSERVER
 #include "CpapWebServer.h"
@@ -13,9 +19,14 @@
 // Cooperative abort flag — set by web server when config lock is requested during upload
 extern volatile bool g_abortUploadFlag;
 
+// Per-file SD paths (/DATALOG/YYYYMMDD/<name>) are built in place, not by
+// String concatenation
+typedef StaticString<96> SdPath;
+
 // Constructor
 FileUploader::FileUploader(Config* cfg, WiFiManager* wifiManager) 
     : config(cfg),
+      stateStore(nullptr),
       smbStateManager(nullptr),
       cloudStateManager(nullptr),
       scheduleManager(nullptr),
@@ -24,9 +35,12 @@ FileUploader::FileUploader(Config* cfg, WiFiManager* wifiManager)
 #ifdef ENABLE_WEBSERVER
       webServer(nullptr),
 #endif
+      smbConnectFailed(false),
       cloudImportCreated(false),
       cloudImportFailed(false),
-      cloudDatalogFilesUploaded(0)
+      cloudDatalogFilesUploaded(0),
+      metaCache(nullptr),
+      nightStoreLoaded(false)
 #ifdef ENABLE_SMB_UPLOAD
       , smbUploader(nullptr)
 #endif
@@ -40,6 +54,7 @@ FileUploader::FileUploader(Config* cfg, WiFiManager* wifiManager)
 FileUploader::~FileUploader() {
     if (smbStateManager)   delete smbStateManager;
     if (cloudStateManager) delete cloudStateManager;
+    if (stateStore)        delete stateStore;
     if (scheduleManager)   delete scheduleManager;
 #ifdef ENABLE_SMB_UPLOAD
     if (smbUploader) delete smbUploader;
@@ -59,37 +74,37 @@ FileUploader::~FileUploader() {
 // of whether to create the upload task and connect TLS at all.
 
 FileUploader::WorkProbeResult FileUploader::hasWorkToUpload(fs::FS &sd) {
-    WorkProbeResult result = {false, false};
+    WorkProbeResult result = {false, false, false};
     fs::FS &stateFs = LittleFS;
 
-    // Lambda: check if a folder has any .edf file (streaming, no vector)
-    auto folderHasEdf = [&](const String& folderPath) -> bool {
-        File folder = sd.open(folderPath);
-        if (!folder || !folder.isDirectory()) return false;
-        File f = folder.openNextFile();
-        while (f) {
-            if (!f.isDirectory()) {
-                const char* name = f.name();
-                size_t len = strlen(name);
-                if (len >= 4) {
-                    const char* ext = name + len - 4;
-                    if (strcasecmp(ext, ".edf") == 0) {
-                        f.close();
-                        folder.close();
-                        return true;
-                    }
-                }
-            }
-            f.close();
-            f = folder.openNextFile();
+    auto isEdfName = [](const char* name) -> bool {
+        size_t len = strlen(name);
+        return len >= 4 && strcasecmp(name + len - 4, ".edf") == 0;
+    };
+
+    // Lambda: check if a folder has any .edf file (streaming, no vector).
+    // With a state manager, only a .edf that changed since its last upload and
+    // that the CPAP has finished writing counts (open files are deferred).
+    auto folderHasEdf = [&](const char* folderPath, UploadStateManager* changedIn) -> bool {
+        DirScanner folder(SD_MOUNT_POINT);
+        if (!folder.open(folderPath)) return false;
+        while (folder.next()) {
+            if (!folder.isFile() || !isEdfName(folder.name())) continue;
+            if (!changedIn) return true;
+            char fullPath[80];
+            snprintf(fullPath, sizeof(fullPath), "%s/%s", folderPath, folder.name());
+            if (!changedIn->hasFileChanged(sd, fullPath)) continue;
+            unsigned long size = 0;
+            if (getSdFileSize(sd, fullPath, size) &&
+                classifyEdfFile(sd, fullPath, (uint32_t)size) == EdfFileState::Open) continue;
+            return true;
         }
-        folder.close();
         return false;
     };
 
     // Lambda: probe one backend's state manager for pending work
-    auto probeBackend = [&](UploadStateManager* sm) -> bool {
-        if (!sm) return false;
+    auto scanBackend = [&](UploadStateManager* sm) -> bool {
+        unsigned long probeNow = time(NULL);
 
         bool canUploadOld = !scheduleManager || scheduleManager->canUploadOldData();
 
@@ -109,85 +124,59 @@ FileUploader::WorkProbeResult FileUploader::hasWorkToUpload(fs::FS &sd) {
             }
         }
 
-        File root = sd.open("/DATALOG");
-        if (!root || !root.isDirectory()) return false;
-
-        File entry = root.openNextFile();
-        while (entry) {
-            if (entry.isDirectory()) {
-                // Extract folder name from path (last component)
-                const char* rawName = entry.name();
-                const char* slash = strrchr(rawName, '/');
-                const char* folderName = slash ? slash + 1 : rawName;
-
-                // Apply MAX_DAYS filter (folder names are YYYYMMDD)
-                if (!maxDaysCutoff.isEmpty() && String(folderName) < maxDaysCutoff) {
-                    entry.close();
-                    entry = root.openNextFile();
-                    continue;
-                }
+        DirScanner root(SD_MOUNT_POINT);
+        if (!root.open("/DATALOG")) return false;
 
-                bool completed = sm->isFolderCompleted(String(folderName));
-                bool recent = isRecentFolder(String(folderName));
+        while (root.next()) {
+            if (!root.isDirectory()) continue;
+            const char* folderName = root.name();
 
-                // Skip old folders when outside upload window
-                if (!recent && !canUploadOld) {
-                    entry.close();
-                    entry = root.openNextFile();
-                    continue;
-                }
+            // Apply MAX_DAYS filter (folder names are YYYYMMDD)
+            if (!maxDaysCutoff.isEmpty() && strcmp(folderName, maxDaysCutoff.c_str()) < 0) {
+                continue;
+            }
 
-                if (!completed) {
-                    // Incomplete folder — check for any .edf
-                    char path[64];
-                    snprintf(path, sizeof(path), "/DATALOG/%s", folderName);
-                    if (folderHasEdf(String(path))) {
-                        LOG_DEBUGF("[WorkProbe] WORK found: %s has .edf files", folderName);
-                        entry.close();
-                        root.close();
-                        return true;
-                    }
-                } else if (completed && recent) {
-                    // Completed+recent: could have changed files — worth checking
-                    char path[64];
-                    snprintf(path, sizeof(path), "/DATALOG/%s", folderName);
-                    // Quick check: any .edf exists (actual change detection happens in full scan)
-                    if (folderHasEdf(String(path))) {
-                        // Check if any file actually changed
-                        File folder = sd.open(String(path));
-                        if (folder && folder.isDirectory()) {
-                            File f = folder.openNextFile();
-                            while (f) {
-                                if (!f.isDirectory()) {
-                                    const char* fname = f.name();
-                                    size_t flen = strlen(fname);
-                                    if (flen >= 4 && strcasecmp(fname + flen - 4, ".edf") == 0) {
-                                        String fullPath = String(path) + "/" + (strrchr(fname, '/') ? strrchr(fname, '/') + 1 : fname);
-                                        if (sm->hasFileChanged(sd, fullPath)) {
-                                            LOG_DEBUGF("[WorkProbe] WORK found: changed file in completed+recent %s", folderName);
-                                            f.close();
-                                            folder.close();
-                                            entry.close();
-                                            root.close();
-                                            return true;
-                                        }
-                                    }
-                                }
-                                f.close();
-                                f = folder.openNextFile();
-                            }
-                            folder.close();
-                        }
-                    }
+            bool completed = sm->isFolderCompleted(String(folderName));
+            bool recent = isRecentFolder(String(folderName));
+
+            // Skip old folders when outside upload window, and quarantined folders
+            if ((!recent && !canUploadOld) || sm->isFolderQuarantined(String(folderName), probeNow)) {
+                continue;
+            }
+
+            char path[64];
+            snprintf(path, sizeof(path), "/DATALOG/%s", folderName);
+            if (recent) {
+                // Recent (completed, or held incomplete by a deferred open file):
+                // one pass checks each .edf against its recorded state
+                if (folderHasEdf(path, sm)) {
+                    LOG_DEBUGF("[WorkProbe] WORK found: changed file in recent %s", folderName);
+                    return true;
+                }
+            } else if (!completed) {
+                // Incomplete old folder — check for any .edf
+                if (folderHasEdf(path, nullptr)) {
+                    LOG_DEBUGF("[WorkProbe] WORK found: %s has .edf files", folderName);
+                    return true;
                 }
             }
-            entry.close();
-            entry = root.openNextFile();
         }
-        root.close();
         return false;
     };
 
+    // Work behind an open breaker is reported as deferred, not as "no work",
+    // so the cycle is retried after cooldown instead of being suppressed
+    auto probeBackend = [&](UploadStateManager* sm) -> bool {
+        if (!sm || !scanBackend(sm)) return false;
+        if (!sm->isBackendAvailable(time(NULL))) {
+            LOGF("[WorkProbe] Work pending but backend circuit open until %lu — deferred",
+                 sm->getBackendRetryAfter());
+            result.backendDeferred = true;
+            return false;
+        }
+        return true;
+    };
+
 #ifdef ENABLE_SLEEPHQ_UPLOAD
     if (config->hasCloudEndpoint()) {
         result.hasCloudWork = probeBackend(cloudStateManager);
@@ -199,12 +188,121 @@ FileUploader::WorkProbeResult FileUploader::hasWorkToUpload(fs::FS &sd) {
     }
 #endif
 
-    LOGF("[WorkProbe] Result: cloud=%d smb=%d (fh=%u ma=%u)",
-         result.hasCloudWork, result.hasSmbWork,
+    LOGF("[WorkProbe] Result: cloud=%d smb=%d deferred=%d (fh=%u ma=%u)",
+         result.hasCloudWork, result.hasSmbWork, result.backendDeferred,
          (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
     return result;
 }
 
+// Predictive pre-warm (smart mode): warm network backends ahead of the learned
+// therapy-end time.  Never touches the SD card — the CPAP still owns it.
+void FileUploader::preWarmBackends() {
+    LOGF("[FileUploader] Pre-warm: heap fh=%u ma=%u",
+         (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+
+    // SMB first: libsmb2 must not open its socket while a TLS socket lingers.
+    // The session is only probed, not held — an idle SMB session can be dropped
+    // by the server long before bus silence confirms the session end.
+#ifdef ENABLE_SMB_UPLOAD
+    if (smbUploader && config->hasSmbEndpoint() && !smbUploader->isConnected()) {
+        if (smbUploader->begin()) {
+            LOG("[FileUploader] Pre-warm: SMB server reachable");
+            smbUploader->end();
+        } else {
+            LOG_WARN("[FileUploader] Pre-warm: SMB connect failed (non-fatal)");
+        }
+    }
+#endif
+
+#ifdef ENABLE_SLEEPHQ_UPLOAD
+    if (sleephqUploader && config->hasCloudEndpoint()) {
+        sleephqUploader->preWarm();
+    }
+#endif
+}
+
+// Deferred state compaction (snapshot rewrite + fingerprint index merge).
+// Runs outside the upload session, so it never holds up the SD card.
+bool FileUploader::compactStateIfDue() {
+    if (!stateStore || !stateStore->isCompactionDue()) {
+        return true;
+    }
+    fs::FS &stateFs = LittleFS;
+    return stateStore->compactIfDue(stateFs);
+}
+
+// Network self-test: bounded per-backend measurements, network only.
+// SMB runs first for the same reason as pre-warm (no lingering TLS socket).
+// Measured throughput is persisted and seeds the chunk tuners immediately.
+void FileUploader::runNetBench(NetBenchStatus& status) {
+    unsigned long startedAt = millis();
+    status.rssi = WiFi.RSSI();
+    status.smbTested = false;
+    status.cloudTested = false;
+    memset(&status.smb, 0, sizeof(status.smb));
+    memset(&status.cloud, 0, sizeof(status.cloud));
+
+    LOGF("[NetBench] Starting (rssi=%d fh=%u ma=%u)", status.rssi,
+         (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+
+    Preferences netPrefs;
+    bool prefsOpen = netPrefs.begin(NETBENCH_PREFS_NAMESPACE, false);
+
+#ifdef ENABLE_SMB_UPLOAD
+    if (smbUploader && config->hasSmbEndpoint()) {
+        status.smbTested = true;
+        if (smbUploader->runNetBench(NETBENCH_SMB_WRITE_BYTES, status.smb)) {
+            uint32_t bps = netBenchBps(status.smb.writeBytes, status.smb.writeMs);
+            smbUploader->seedThroughput(bps);
+            if (prefsOpen) netPrefs.putUInt(NETBENCH_PREFS_SMB_BPS, bps);
+        }
+    }
+#endif
+
+#ifdef ENABLE_SLEEPHQ_UPLOAD
+    if (sleephqUploader && config->hasCloudEndpoint()) {
+        status.cloudTested = true;
+        if (sleephqUploader->runNetBench(NETBENCH_CLOUD_POST_BYTES, status.cloud)) {
+            uint32_t bps = netBenchBps(status.cloud.postBytes, status.cloud.postMs);
+            sleephqUploader->seedThroughput(bps);
+            if (prefsOpen) netPrefs.putUInt(NETBENCH_PREFS_CLOUD_BPS, bps);
+        }
+    }
+#endif
+
+    if (prefsOpen) netPrefs.end();
+
+    status.durationMs = millis() - startedAt;
+    time_t now = time(nullptr);
+    status.finishedTs = now > 1000000000 ? (uint32_t)now : 0;
+    LOGF("[NetBench] Finished in %lu ms (smb=%s cloud=%s)", (unsigned long)status.durationMs,
+         !status.smbTested ? "n/a" : status.smb.ok ? "ok" : "failed",
+         !status.cloudTested ? "n/a" : status.cloud.ok ? "ok" : "failed");
+}
+
+// One state store for both backends. Firmware before the shared store kept a
+// snapshot/journal pair per backend; whichever of those is still on flash is
+// merged in once (also for a backend that is not configured right now, so its
+// history survives a mode change) and then deleted.
+void FileUploader::openStateStore(fs::FS &stateFs) {
+    if (stateStore) {
+        return;
+    }
+
+    stateStore = new UploadStateStore(UPLOAD_STATE_MAX_BACKENDS);
+    stateStore->setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    stateStore->begin(stateFs);
+
+    if (stateStore->importLegacy(stateFs, "/.upload_state.v2.smb", "/.upload_state.v2.smb.log",
+                                 UPLOAD_STATE_SMB)) {
+        LOG("[FileUploader] Migrated SMB upload state into the shared store");
+    }
+    if (stateStore->importLegacy(stateFs, "/.upload_state.v2.cloud", "/.upload_state.v2.cloud.log",
+                                 UPLOAD_STATE_CLOUD)) {
+        LOG("[FileUploader] Migrated Cloud upload state into the shared store");
+    }
+}
+
 // Initialize all components and load upload state
 bool FileUploader::begin() {
     LOG("[FileUploader] Initializing components...");
@@ -226,11 +324,8 @@ bool FileUploader::begin() {
         );
         LOG("[FileUploader] SMBUploader created (will connect during upload)");
 
-        smbStateManager = new UploadStateManager();
-        smbStateManager->setPaths("/.upload_state.v2.smb", "/.upload_state.v2.smb.log");
-        if (!smbStateManager->begin(stateFs)) {
-            LOG("[FileUploader] WARNING: SMB state load failed, starting fresh");
-        }
+        openStateStore(stateFs);
+        smbStateManager = new UploadStateManager(stateStore, UPLOAD_STATE_SMB);
         anyBackendCreated = true;
     }
 #endif
@@ -241,11 +336,8 @@ bool FileUploader::begin() {
         sleephqUploader = new SleepHQUploader(config);
         LOG("[FileUploader] SleepHQUploader created (will connect during upload)");
 
-        cloudStateManager = new UploadStateManager();
-        cloudStateManager->setPaths("/.upload_state.v2.cloud", "/.upload_state.v2.cloud.log");
-        if (!cloudStateManager->begin(stateFs)) {
-            LOG("[FileUploader] WARNING: Cloud state load failed, starting fresh");
-        }
+        openStateStore(stateFs);
+        cloudStateManager = new UploadStateManager(stateStore, UPLOAD_STATE_CLOUD);
         anyBackendCreated = true;
     }
 #endif
@@ -255,6 +347,20 @@ bool FileUploader::begin() {
         return false;
     }
 
+    // Seed adaptive chunk sizing from the last network self-test, if any
+    {
+        Preferences netPrefs;
+        if (netPrefs.begin(NETBENCH_PREFS_NAMESPACE, true)) {
+#ifdef ENABLE_SMB_UPLOAD
+            if (smbUploader) smbUploader->seedThroughput(netPrefs.getUInt(NETBENCH_PREFS_SMB_BPS, 0));
+#endif
+#ifdef ENABLE_SLEEPHQ_UPLOAD
+            if (sleephqUploader) sleephqUploader->seedThroughput(netPrefs.getUInt(NETBENCH_PREFS_CLOUD_BPS, 0));
+#endif
+            netPrefs.end();
+        }
+    }
+
     // Populate GUI backend status
     const char* mode = hasBothBackends() ? "DUAL" :
                        hasCloudBackend() ? "CLOUD" :
@@ -331,6 +437,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
     // ── Pre-flight: check every configured backend for pending work ──────────
     bool smbWork   = false;
     bool cloudWork = false;
+    bool backendDeferred = false;  // A backend's circuit breaker is open — day is not complete
     {
         // Compute once: can we process old (non-recent) folders this session?
         // When false (smart mode outside upload window), skip old folders entirely
@@ -356,19 +463,18 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
         }
 
         auto preflightFolderHasWork = [&](UploadStateManager* sm) -> bool {
-            File root = sd.open("/DATALOG");
-            if (!root || !root.isDirectory()) return false;
-            File entry = root.openNextFile();
-            while (entry) {
-                if (entry.isDirectory()) {
-                    String name = String(entry.name());
-                    int sl = name.lastIndexOf('/');
-                    if (sl >= 0) name = name.substring(sl + 1);
+            DirScanner root(SD_MOUNT_POINT);
+            if (!root.open("/DATALOG")) return false;
+            while (root.next()) {
+                if (root.isDirectory()) {
+                    String name = String(root.name());
 
                     // Apply MAX_DAYS filter (folder names are YYYYMMDD)
                     if (!maxDaysCutoff.isEmpty() && name < maxDaysCutoff) {
-                        entry.close();
-                        entry = root.openNextFile();
+                        continue;
+                    }
+
+                    if (sm->isFolderQuarantined(name, time(NULL))) {
                         continue;
                     }
 
@@ -391,8 +497,6 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                                      name.c_str());
                             }
                         }
-                        entry.close();
-                        entry = root.openNextFile();
                         continue;
                     }
 
@@ -405,9 +509,12 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                         String folderPath = "/DATALOG/" + name;
                         auto files = scanFolderFiles(sd, folderPath);
                         if (!files.empty()) {
-                            LOGF("[FileUploader] Pre-flight: WORK — folder %s has %d file(s)",
-                                 name.c_str(), (int)files.size());
-                            entry.close(); root.close(); return true;
+                            // Recent folders fall through to the per-file check below
+                            if (!recent) {
+                                LOGF("[FileUploader] Pre-flight: WORK — folder %s has %d file(s)",
+                                     name.c_str(), (int)files.size());
+                                return true;
+                            }
                         } else {
                             unsigned long currentTime = time(NULL);
                             if (currentTime >= 1000000000) {
@@ -424,7 +531,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                         if (!pendingFiles.empty()) {
                             LOGF("[FileUploader] Pre-flight: WORK — pending folder %s now has files",
                                      name.c_str());
-                            entry.close(); root.close(); return true;
+                            return true;
                         } else {
                             unsigned long currentTime = time(NULL);
                             if (currentTime >= 1000000000 &&
@@ -436,28 +543,38 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                             }
                         }
                     }
-                    if (completed && recent) {
+                    if (recent && !pending) {
                         String folderPath = "/DATALOG/" + name;
                         auto files = scanFolderFiles(sd, folderPath);
                         for (const String& fp : files) {
-                            String fullPath = folderPath + "/" + fp;
-                            if (sm->hasFileChanged(sd, fullPath)) {
+                            SdPath fullPath;
+                            fullPath.format("%s/%s", folderPath.c_str(), fp.c_str());
+                            if (sm->hasFileChanged(sd, fullPath.c_str())) {
+                                unsigned long size = 0;
+                                if (getSdFileSize(sd, fullPath.c_str(), size) &&
+                                        classifyEdfFile(sd, fullPath.c_str(), (uint32_t)size) == EdfFileState::Open) {
+                                    continue;  // Still being written — deferred
+                                }
                                 LOGF("[FileUploader] Pre-flight: WORK — file changed: %s",
                                      fullPath.c_str());
-                                entry.close(); root.close(); return true;
+                                return true;
                             }
                         }
                     }
                 }
-                entry.close();
-                entry = root.openNextFile();
             }
-            root.close();
             return false;
         };
 
         auto checkHasWork = [&](UploadStateManager* sm) -> bool {
             if (!sm) return false;
+            unsigned long nowTs = time(NULL);
+            if (!sm->isBackendAvailable(nowTs)) {
+                LOGF("[FileUploader] Pre-flight: backend circuit open until %lu — skipping",
+                     sm->getBackendRetryAfter());
+                backendDeferred = true;
+                return false;
+            }
             return preflightFolderHasWork(sm);
         };
 
@@ -470,6 +587,10 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
     }
 
     if (!smbWork && !cloudWork) {
+        if (backendDeferred) {
+            LOG("[FileUploader] Pre-flight: backend circuit open — retry after cooldown");
+            return UploadResult::BACKEND_DEFERRED;
+        }
         LOG("[FileUploader] Pre-flight: no work for any backend — skipping session");
         return UploadResult::NOTHING_TO_DO;
     }
@@ -478,6 +599,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
 
     cloudImportCreated = false;
     cloudImportFailed  = false;
+    smbConnectFailed   = false;
 
     bool timerExpired = false;
     bool sessionHadFailure = false;  // Track if any folder upload failed this session
@@ -533,8 +655,10 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                 if (!sleephqUploader->begin()) {
                     LOG_ERROR("[FileUploader] Cloud init failed — skipping cloud phase");
                     cloudImportFailed = true;
+                    cloudStateManager->recordBackendFailure(time(NULL));
                 } else {
                     cloudImportCreated = true;
+                    cloudStateManager->recordBackendSuccess();
                     LOGF("[FileUploader] Cloud session ready — heap: fh=%u ma=%u",
                          (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
                 }
@@ -620,15 +744,11 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
         strncpy(g_activeBackendStatus.name, "SMB", sizeof(g_activeBackendStatus.name) - 1);
         LOG("[FileUploader] === Phase 2: SMB Session ===");
 
-        // Allocate SMB buffer dynamically based on current heap state.
-        // With ma=36852 being the safe floor (due to TLS/lwIP pegging), we can
-        // comfortably allocate 8KB out of the 36KB block for faster SMB speeds.
-        uint32_t currentMa = ESP.getMaxAllocHeap();
-        size_t smbBufSize = (currentMa > 30000) ? 8192 :
-                            (currentMa > 20000) ? 4096 :
-                            (currentMa > 15000) ? 2048 : 1024;
+        // The SMB buffer is the I/O pool's 8KB .bss slot — no heap involved,
+        // so it is the full size regardless of fragmentation.
+        size_t smbBufSize = IoBufferPool::largestSlot();
         LOGF("[FileUploader] SMB phase heap: fh=%u ma=%u, buffer=%u",
-             (unsigned)ESP.getFreeHeap(), (unsigned)currentMa, (unsigned)smbBufSize);
+             (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap(), (unsigned)smbBufSize);
         if (!smbUploader->allocateBuffer(smbBufSize)) {
             LOG_ERROR("[FileUploader] Failed to allocate SMB buffer — skipping SMB phase");
             smbStateManager->save(stateFs);
@@ -651,7 +771,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                     "/Identification.tgt",  "/STR.edf"
                 };
                 for (const char* p : rootPaths) {
-                    if (sd.exists(p) && smbStateManager->hasFileChanged(sd, String(p))) {
+                    if (smbStateManager->hasFileChanged(sd, p)) {  // false if absent
                         mandatoryChanged = true; break;
                     }
                 }
@@ -677,6 +797,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                     LOG("[FileUploader] SMB: Fresh DATALOG folders");
                     for (const String& folder : freshFolders) {
                         if (isTimerExpired()) { timerExpired = true; break; }
+                        if (smbConnectFailed) break;
                         if (!uploadDatalogFolderSmb(sdManager, folder)) sessionHadFailure = true;
 #ifdef ENABLE_WEBSERVER
                         if (webServer) webServer->handleClient();
@@ -687,6 +808,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
                     LOG("[FileUploader] SMB: Old DATALOG folders");
                     for (const String& folder : oldFolders) {
                         if (isTimerExpired()) { timerExpired = true; break; }
+                        if (smbConnectFailed) break;
                         if (!uploadDatalogFolderSmb(sdManager, folder)) sessionHadFailure = true;
 #ifdef ENABLE_WEBSERVER
                         if (webServer) webServer->handleClient();
@@ -697,7 +819,7 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
             }
             smbStateManager->save(stateFs);
 
-            // Free SMB buffer to recover heap for next session
+            // Return the SMB buffer to the pool (the logger and checksums share it)
             smbUploader->freeBuffer();
         }
 
@@ -720,13 +842,14 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
     UBaseType_t hwm = uxTaskGetStackHighWaterMark(NULL);
     LOGF("[FileUploader] Session ended: %lu seconds, stack HWM=%u bytes free",
          elapsed / 1000, (unsigned)(hwm * sizeof(StackType_t)));
+    IoBufferPool::logStatus();
 
     if (timerExpired && hasIncompleteFolders()) {
         LOG("[FileUploader] Timer expired with incomplete folders (TIMEOUT)");
         return UploadResult::TIMEOUT;
     }
 
-    if (!hasIncompleteFolders() && !sessionHadFailure) {
+    if (!hasIncompleteFolders() && !sessionHadFailure && !backendDeferred) {
         time_t endNow; time(&endNow);
         UploadStateManager* sm = primaryStateManager();
         if (sm) sm->setLastUploadTimestamp((unsigned long)endNow);
@@ -738,6 +861,9 @@ UploadResult FileUploader::runFullSession(SDCardManager* sdManager, int maxMinut
     if (sessionHadFailure) {
         LOG("[FileUploader] Session had folder upload failure(s) — not marking day complete");
     }
+    if (backendDeferred) {
+        LOG("[FileUploader] Backend circuit open — not marking day complete");
+    }
 
     return UploadResult::TIMEOUT;
 }
@@ -749,20 +875,15 @@ std::vector<String> FileUploader::scanDatalogFolders(fs::FS &sd, UploadStateMana
     std::vector<String> folders;
     int eligibleFolderCount = 0;
     
-    File root = sd.open("/DATALOG");
-    if (!root) {
+    unsigned long scanStart = millis();
+    DirScanner root(SD_MOUNT_POINT);
+    if (!root.open("/DATALOG")) {
         LOG_ERROR("[FileUploader] Cannot open /DATALOG folder");
         LOG_ERROR("[FileUploader] SD card may be in use by CPAP or not properly mounted");
         LOG_ERROR("[FileUploader] If DATALOG exists, this scan will be retried");
         return folders;  // Return empty - indicates scan failure
     }
     
-    if (!root.isDirectory()) {
-        LOG_ERROR("[FileUploader] /DATALOG exists but is not a directory");
-        root.close();
-        return folders;
-    }
-    
     // Calculate MAX_DAYS cutoff date if configured
     String maxDaysCutoff = "";
     int maxDays = config->getMaxDays();
@@ -782,29 +903,27 @@ std::vector<String> FileUploader::scanDatalogFolders(fs::FS &sd, UploadStateMana
         }
     }
     
-    // Scan for folders
-    File file = root.openNextFile();
-    while (file) {
-        if (file.isDirectory()) {
-            String folderName = String(file.name());
-            
-            // Extract just the folder name (remove path prefix if present)
-            int lastSlash = folderName.lastIndexOf('/');
-            if (lastSlash >= 0) {
-                folderName = folderName.substring(lastSlash + 1);
-            }
+    // Scan for folders (names and types straight from the directory stream)
+    while (root.next()) {
+        if (root.isDirectory()) {
+            String folderName = String(root.name());
             
             // Apply MAX_DAYS filter (folder names are in YYYYMMDD format)
             if (!maxDaysCutoff.isEmpty() && folderName < maxDaysCutoff) {
                 LOG_DEBUGF("[FileUploader] Skipping old folder (MAX_DAYS): %s", folderName.c_str());
-                file.close();
-                file = root.openNextFile();
                 continue;
             }
 
             // Count all eligible DATALOG folders (completed, incomplete, and empty-pending)
             // so progress can report remaining data folders across cooldown cycles.
             eligibleFolderCount++;
+
+            // Quarantined folders are left out until their backoff expires so a
+            // poison folder cannot block the rest of the session.
+            if (sm->isFolderQuarantined(folderName, time(NULL))) {
+                LOGF("[FileUploader] Skipping quarantined folder: %s", folderName.c_str());
+                continue;
+            }
             
             // Check if folder is already completed
             if (sm->isFolderCompleted(folderName)) {
@@ -849,10 +968,9 @@ std::vector<String> FileUploader::scanDatalogFolders(fs::FS &sd, UploadStateMana
                 LOG_DEBUGF("[FileUploader] Found incomplete DATALOG folder: %s", folderName.c_str());
             }
         }
-        file.close();
-        file = root.openNextFile();
     }
     root.close();
+    LOG_DEBUGF("[FileUploader] DATALOG scan took %lu ms", millis() - scanStart);
     
     // Sort folders by date (newest first) - folders are in YYYYMMDD format
     std::sort(folders.begin(), folders.end(), [](const String& a, const String& b) {
@@ -876,39 +994,22 @@ std::vector<String> FileUploader::scanDatalogFolders(fs::FS &sd, UploadStateMana
 std::vector<String> FileUploader::scanFolderFiles(fs::FS &sd, const String& folderPath) {
     std::vector<String> files;
     
-    File folder = sd.open(folderPath);
-    if (!folder) {
-        LOG_ERRORF("[FileUploader] Failed to open folder: %s", folderPath.c_str());
+    DirScanner folder(SD_MOUNT_POINT);
+    if (!folder.open(folderPath.c_str())) {
+        LOG_ERRORF("[FileUploader] Failed to open folder: %s (errno %d)", folderPath.c_str(), errno);
         LOG_ERROR("[FileUploader] SD card may be in use by CPAP or experiencing read errors");
         LOG_ERROR("[FileUploader] This folder will be retried in the next upload session");
         return files;  // Return empty - caller should treat as error
     }
     
-    if (!folder.isDirectory()) {
-        LOG_ERRORF("[FileUploader] Path exists but is not a directory: %s", folderPath.c_str());
-        folder.close();
-        return files;
-    }
-    
-    // Scan for .edf files
-    File file = folder.openNextFile();
-    while (file) {
-        if (!file.isDirectory()) {
-            String fileName = String(file.name());
-            
-            // Extract just the file name (remove path prefix if present)
-            int lastSlash = fileName.lastIndexOf('/');
-            if (lastSlash >= 0) {
-                fileName = fileName.substring(lastSlash + 1);
-            }
-            
-            // Check if it's an .edf file
-            if (fileName.endsWith(".edf") || fileName.endsWith(".EDF")) {
-                files.push_back(fileName);
-            }
+    // Scan for .edf files — names only, no per-entry open
+    while (folder.next()) {
+        if (!folder.isFile()) continue;
+        const char* name = folder.name();
+        size_t len = strlen(name);
+        if (len >= 4 && (strcmp(name + len - 4, ".edf") == 0 || strcmp(name + len - 4, ".EDF") == 0)) {
+            files.push_back(String(name));
         }
-        file.close();
-        file = folder.openNextFile();
     }
     folder.close();
     
@@ -920,24 +1021,77 @@ std::vector<String> FileUploader::scanFolderFiles(fs::FS &sd, const String& fold
 // Scan all SETTINGS files (change-checking is left to the upload method)
 std::vector<String> FileUploader::scanSettingsFiles(fs::FS &sd) {
     std::vector<String> files;
-    File settingsDir = sd.open("/SETTINGS");
-    if (settingsDir && settingsDir.isDirectory()) {
-        File settingsFile = settingsDir.openNextFile();
-        while (settingsFile) {
-            if (!settingsFile.isDirectory()) {
-                String name = String(settingsFile.name());
-                int lastSlash = name.lastIndexOf('/');
-                if (lastSlash >= 0) name = name.substring(lastSlash + 1);
-                files.push_back("/SETTINGS/" + name);
+    DirScanner settingsDir(SD_MOUNT_POINT);
+    if (settingsDir.open("/SETTINGS")) {
+        while (settingsDir.next()) {
+            if (settingsDir.isFile()) {
+                files.push_back("/SETTINGS/" + String(settingsDir.name()));
             }
-            settingsFile.close();
-            settingsFile = settingsDir.openNextFile();
         }
         settingsDir.close();
     }
     return files;
 }
 
+// Size of an SD file. With the metadata cache attached this is a lookup (or
+// one stat() the first time the file is seen this hold) instead of an open.
+bool FileUploader::getSdFileSize(fs::FS &sd, const char* path, unsigned long& size) {
+    if (metaCache) {
+        SdFileMeta meta;
+        if (!metaCache->get(path, meta) || (meta.attr & SD_META_DIR)) return false;
+        size = meta.size;
+        return true;
+    }
+    File f = sd.open(path);
+    if (!f) return false;
+    size = f.size();
+    f.close();
+    return true;
+}
+
+void FileUploader::setMetaCache(SdMetaCache* cache) {
+    metaCache = cache;
+    if (smbStateManager)   smbStateManager->setMetaCache(cache);
+    if (cloudStateManager) cloudStateManager->setMetaCache(cache);
+}
+
+// ============================================================================
+// Night summary tap
+// ============================================================================
+EdfStreamReducer* FileUploader::armNightTap(const char* localPath) {
+    return nightReducer.begin(localPath) ? &nightReducer : nullptr;
+}
+
+void FileUploader::collectNightTap(bool uploaded, std::vector<NightSession>* held) {
+    NightSession session;
+    if (uploaded && nightReducer.finish(session)) {
+        if (held) {
+            held->push_back(session);
+        } else {
+            recordNightSessions(std::vector<NightSession>(1, session));
+        }
+    }
+    nightReducer.end();
+}
+
+void FileUploader::recordNightSessions(const std::vector<NightSession>& sessions) {
+    if (sessions.empty()) return;
+    fs::FS &stateFs = LittleFS;
+    if (!nightStoreLoaded) {
+        nightStoreLoaded = nightStore.load(stateFs);
+    }
+    for (const NightSession& session : sessions) {
+        // The second backend re-reduces the same file; record() replaces it
+        nightStore.record(session);
+        LOG_DEBUGF("[FileUploader] Night summary: %lu session %06lu, %lu s",
+                   (unsigned long)session.day, (unsigned long)session.startTime,
+                   (unsigned long)session.usageSec);
+    }
+    if (!nightStore.save(stateFs)) {
+        LOG_WARN("[FileUploader] Failed to save night summary");
+    }
+}
+
 // Check if a DATALOG folder name (YYYYMMDD) is within the recent window
 bool FileUploader::isRecentFolder(const String& folderName) const {
     int recentDays = config->getRecentFolderDays();
@@ -970,8 +1124,10 @@ bool FileUploader::ensureCloudImport() {
             LOG_ERROR("[FileUploader] Failed to initialize cloud uploader");
             LOG_WARN("[FileUploader] Cloud uploads will be skipped this session");
             cloudImportFailed = true;
+            if (cloudStateManager) cloudStateManager->recordBackendFailure(time(NULL));
             return false;
         }
+        if (cloudStateManager) cloudStateManager->recordBackendSuccess();
     }
     if (sleephqUploader->isConnected()) {
         if (!sleephqUploader->createImport()) {
@@ -1000,7 +1156,7 @@ void FileUploader::finalizeCloudImport(SDCardManager* sdManager, fs::FS &sd) {
         "/Identification.json", "/Identification.crc", "/Identification.tgt", "/STR.edf"
     };
     for (const char* path : rootPaths) {
-        if (sd.exists(path)) uploadSingleFileCloud(sdManager, String(path), true);
+        uploadSingleFileCloud(sdManager, String(path), true);  // absent files are skipped
     }
     std::vector<String> settingsFiles = scanSettingsFiles(sd);
     for (const String& filePath : settingsFiles) {
@@ -1092,12 +1248,16 @@ bool FileUploader::uploadDatalogFolderSmb(SDCardManager* sdManager, const String
     std::vector<String> files;
     if (!handleFolderScan(sd, stateFs, folderName, folderPath, smbStateManager, files,
             [this](fs::FS& sd2, const String& fp) { return scanFolderFiles(sd2, fp); })) {
+        smbStateManager->recordFolderFailure(folderName, time(NULL));
+        smbStateManager->save(stateFs);
         return false;
     }
     if (files.empty()) return true;  // empty folder handled
 
     bool isRecent     = isRecentFolder(folderName);
-    bool isRescan     = smbStateManager->isFolderCompleted(folderName) && isRecent;
+    // Recent folders record every upload per file, so they are always checked
+    // per file — also while a deferred still-open file keeps them incomplete
+    bool isRescan     = isRecent;
 
     g_smbSessionStatus.uploadActive = true;
     strncpy((char*)g_smbSessionStatus.currentFolder, folderName.c_str(),
@@ -1109,41 +1269,89 @@ bool FileUploader::uploadDatalogFolderSmb(SDCardManager* sdManager, const String
     int uploadedCount    = 0;
     int skippedUnchanged = 0;
     int skippedEmpty     = 0;
+    int skippedQuarantined = 0;  // Not uploaded — folder stays unsuccessful
+    int skippedOpen      = 0;    // Still being written — retried on the next re-scan
+    unsigned long now = time(NULL);
+
+    // Archive mode collects the folder here and sends it as one tar after the
+    // loop. Unchanged files are kept too: a re-scan rewrites the whole night.
+    const bool archiveMode = config->getSmbFolderArchive();
+    std::vector<SmbArchiveMember> archiveMembers;
 
+    SdPath localPath;
     for (const String& fileName : files) {
-        String localPath  = folderPath + "/" + fileName;
+        localPath.format("%s/%s", folderPath.c_str(), fileName.c_str());
+        if (localPath.truncated()) {
+            LOG_ERRORF("[FileUploader] [SMB] Path too long, skipping: %s/%s", folderPath.c_str(), fileName.c_str());
+            continue;
+        }
+        if (smbStateManager->isFileQuarantined(localPath.c_str(), now)) {
+            LOGF("[FileUploader] [SMB] Skipping quarantined file: %s", localPath.c_str());
+            skippedQuarantined++;
+            continue;
+        }
         if (isRescan) {
-            if (!smbStateManager->hasFileChanged(sd, localPath)) { skippedUnchanged++; continue; }
+            if (!smbStateManager->hasFileChanged(sd, localPath.c_str())) {
+                skippedUnchanged++;
+                unsigned long unchangedSize = 0;
+                if (archiveMode && getSdFileSize(sd, localPath.c_str(), unchangedSize) && unchangedSize > 0) {
+                    archiveMembers.push_back({localPath.c_str(), (uint32_t)unchangedSize, false});
+                }
+                continue;
+            }
             LOG_DEBUGF("[FileUploader] [SMB] File changed: %s", fileName.c_str());
         }
-        File f = sd.open(localPath);
-        if (!f) { LOG_ERRORF("[FileUploader] [SMB] Cannot open: %s", localPath.c_str()); continue; }
-        unsigned long fileSize = f.size();
+        unsigned long fileSize = 0;
+        if (!getSdFileSize(sd, localPath.c_str(), fileSize)) {
+            LOG_ERRORF("[FileUploader] [SMB] Cannot open: %s", localPath.c_str());
+            smbStateManager->recordFileFailure(localPath.c_str(), now);
+            continue;
+        }
         if (fileSize == 0) {
-            f.close();
-            smbStateManager->markFileUploaded(localPath, "empty_file", 0);
+            smbStateManager->markFileUploaded(localPath.c_str(), "empty_file", 0);
             skippedEmpty++;
             continue;
         }
-        f.close();
+        // Tonight's files are still being appended to: send them once the CPAP
+        // has closed them rather than the whole file again every cycle
+        if (isRecent && classifyEdfFile(sd, localPath.c_str(), (uint32_t)fileSize) == EdfFileState::Open) {
+            LOGF("[FileUploader] [SMB] Deferring still-open file: %s", fileName.c_str());
+            skippedOpen++;
+            continue;
+        }
+        if (archiveMode) {
+            archiveMembers.push_back({localPath.c_str(), (uint32_t)fileSize, true});
+            continue;
+        }
 
         LOGF("[FileUploader] Uploading file: %s (%lu bytes)", fileName.c_str(), fileSize);
 
-        if (!smbUploader->isConnected()) {
-            if (!smbUploader->begin()) {
-                LOG_ERROR("[FileUploader] [SMB] Failed to connect");
-                smbStateManager->save(stateFs);
-                return false;
-            }
+        if (!connectSmb()) {
+            LOG_ERROR("[FileUploader] [SMB] Failed to connect");
+            smbStateManager->save(stateFs);
+            return false;
         }
         unsigned long smbBytes = 0;
-        if (!smbUploader->upload(localPath, localPath, sd, smbBytes)) {
+        smbUploader->setReadTap(armNightTap(localPath.c_str()));
+        bool smbOk = smbUploader->upload(localPath.c_str(), localPath.c_str(), sd, smbBytes);
+        smbUploader->setReadTap(nullptr);
+        collectNightTap(smbOk);
+        if (!smbOk) {
             LOG_ERRORF("[FileUploader] [SMB] Upload failed: %s", localPath.c_str());
             LOGF("[FileUploader] Successfully uploaded %d files before failure", uploadedCount);
+            if (!smbUploader->isConnected()) {
+                // Transport failure (the uploader dropped the session): the
+                // NAS/link is at fault, not this file — breaker, no quarantine
+                smbStateManager->recordBackendFailure(now);
+            } else {
+                smbStateManager->recordFileFailure(localPath.c_str(), now);
+                smbStateManager->recordFolderFailure(folderName, now);
+            }
             smbStateManager->save(stateFs);
             return false;
         }
-        if (isRecent) smbStateManager->markFileUploaded(localPath, "", fileSize);
+        smbStateManager->clearFileQuarantine(localPath.c_str());
+        if (isRecent) smbStateManager->markFileUploaded(localPath.c_str(), "", fileSize);
         uploadedCount++;
         g_smbSessionStatus.filesUploaded = uploadedCount;
         if (g_debugMode) LOGF("[FileUploader] Uploaded: %s (%lu bytes)", fileName.c_str(), smbBytes);
@@ -1157,6 +1365,54 @@ bool FileUploader::uploadDatalogFolderSmb(SDCardManager* sdManager, const String
         }
     }
 
+    int archiveChanged = 0;
+    for (const SmbArchiveMember& m : archiveMembers) {
+        if (m.changed) archiveChanged++;
+    }
+    if (archiveChanged > 0) {
+        String archivePath = folderPath + ".tar";
+        LOGF("[FileUploader] [SMB] Archiving %d files (%d changed) to %s",
+             (int)archiveMembers.size(), archiveChanged, archivePath.c_str());
+        if (!connectSmb()) {
+            LOG_ERROR("[FileUploader] [SMB] Failed to connect");
+            smbStateManager->save(stateFs);
+            return false;
+        }
+        unsigned long archiveBytes = 0;
+        // A member read in full is only staged in the tar buffer: its session
+        // is held until the whole archive has been written
+        std::vector<NightSession> archiveSessions;
+        bool archiveOk = smbUploader->uploadArchive(archiveMembers, "/DATALOG/", archivePath, sd, archiveBytes,
+            [this, &archiveSessions](const String& path, bool done) {
+                if (!done) {
+                    smbUploader->setReadTap(armNightTap(path.c_str()));
+                } else {
+                    smbUploader->setReadTap(nullptr);
+                    collectNightTap(true, &archiveSessions);
+                }
+            });
+        smbUploader->setReadTap(nullptr);
+        collectNightTap(false);
+        if (!archiveOk) {
+            LOG_ERRORF("[FileUploader] [SMB] Archive upload failed: %s", archivePath.c_str());
+            if (!smbUploader->isConnected()) {
+                smbStateManager->recordBackendFailure(now);  // Transport, as above
+            } else {
+                smbStateManager->recordFolderFailure(folderName, now);
+            }
+            smbStateManager->save(stateFs);
+            return false;
+        }
+        recordNightSessions(archiveSessions);
+        for (const SmbArchiveMember& m : archiveMembers) {
+            if (!m.changed) continue;
+            smbStateManager->clearFileQuarantine(m.localPath);
+            if (isRecent) smbStateManager->markFileUploaded(m.localPath, "", m.size);
+            uploadedCount++;
+        }
+        g_smbSessionStatus.filesUploaded = uploadedCount;
+    }
+
     if (isRescan) {
         LOGF("[FileUploader] [SMB] Re-scan complete: %d uploaded, %d unchanged", uploadedCount, skippedUnchanged);
     } else {
@@ -1166,19 +1422,30 @@ bool FileUploader::uploadDatalogFolderSmb(SDCardManager* sdManager, const String
     // Per-folder disconnect (not per-file — avoids socket exhaustion)
     if (smbUploader->isConnected()) smbUploader->end();
 
-    bool uploadSuccess = (uploadedCount == (int)files.size() - skippedUnchanged - skippedEmpty);
-    LOGF("[FileUploader] [SMB] Folder %s: %d/%d files, %d unchanged, %d empty — success=%s",
+    int expectedUploads = (int)files.size() - skippedUnchanged - skippedEmpty - skippedOpen;
+    bool uploadSuccess = (uploadedCount == expectedUploads);
+    LOGF("[FileUploader] [SMB] Folder %s: %d/%d files, %d unchanged, %d empty, %d open, %d quarantined — success=%s",
          folderName.c_str(), uploadedCount, (int)files.size(), skippedUnchanged, skippedEmpty,
-         uploadSuccess ? "yes" : "no");
+         skippedOpen, skippedQuarantined, uploadSuccess ? "yes" : "no");
+
+    // A quarantined file keeps the folder unsuccessful (not complete) but is
+    // not a folder failure: only other misses escalate to folder quarantine
+    if (!UploadStateManager::isFolderPassFailure(expectedUploads, uploadedCount, skippedQuarantined)) {
+        smbStateManager->clearFolderQuarantine(folderName);
+    } else {
+        smbStateManager->recordFolderFailure(folderName, now);
+    }
 
     // Mark-complete strategy:
-    //   Recent folders — always mark complete so the next scan uses the isRescan path
-    //   (per-file size entries track which files need re-upload).
+    //   Recent folders — mark complete unless a still-open file was deferred; the
+    //   next scan checks files individually either way (per-file size entries
+    //   track which files need re-upload).
     //   Old folders — only mark complete when every file was uploaded (enables full retry
     //   of partially-uploaded old folders on the next session).
-    if (isRecent) {
-        smbStateManager->markFolderCompleted(folderName);
-    } else if (uploadSuccess) {
+    //   A folder left incomplete by a file that never closes (power cut mid-session)
+    //   is picked up as an old folder once it leaves the recent window, and then
+    //   uploaded regardless of the file's EDF state.
+    if (UploadStateManager::shouldMarkFolderCompleted(isRecent, uploadSuccess, skippedOpen)) {
         smbStateManager->markFolderCompleted(folderName);
     }
 
@@ -1187,6 +1454,25 @@ bool FileUploader::uploadDatalogFolderSmb(SDCardManager* sdManager, const String
 #endif
 }
 
+// ── SMB: connect through the circuit breaker ─────────────────────────────────
+// One failed connect per session is enough — later folders don't retry it.
+bool FileUploader::connectSmb() {
+#ifndef ENABLE_SMB_UPLOAD
+    return false;
+#else
+    if (smbUploader->isConnected()) return true;
+    if (smbConnectFailed) return false;  // Already failed this session, don't retry
+
+    if (!smbUploader->begin()) {
+        smbConnectFailed = true;
+        if (smbStateManager) smbStateManager->recordBackendFailure(time(NULL));
+        return false;
+    }
+    if (smbStateManager) smbStateManager->recordBackendSuccess();
+    return true;
+#endif
+}
+
 // ── SMB: upload a single root/SETTINGS file ──────────────────────────────────
 bool FileUploader::uploadSingleFileSmb(SDCardManager* sdManager, const String& filePath, bool force) {
 #ifndef ENABLE_SMB_UPLOAD
@@ -1195,13 +1481,8 @@ bool FileUploader::uploadSingleFileSmb(SDCardManager* sdManager, const String& f
     if (!smbUploader || !smbStateManager) return false;
     fs::FS &sd = sdManager->getFS();
 
-    if (!sd.exists(filePath)) return true;  // file absent — not an error
-
-    File f = sd.open(filePath);
-    if (!f) { LOG_ERRORF("[FileUploader] [SMB] Cannot open: %s", filePath.c_str()); return false; }
-    unsigned long fileSize = f.size();
-    f.close();
-
+    unsigned long fileSize = 0;
+    if (!getSdFileSize(sd, filePath.c_str(), fileSize)) return true;  // file absent — not an error
     if (fileSize == 0) return true;
 
     if (!force && !smbStateManager->hasFileChanged(sd, filePath)) {
@@ -1211,17 +1492,20 @@ bool FileUploader::uploadSingleFileSmb(SDCardManager* sdManager, const String& f
 
     LOGF("[FileUploader] Uploading single file: %s", filePath.c_str());
 
-    if (!smbUploader->isConnected() && !smbUploader->begin()) {
+    if (!connectSmb()) {
         LOG_ERROR("[FileUploader] [SMB] Connection failed");
         return false;
     }
     unsigned long smbBytes = 0;
-    if (!smbUploader->upload(filePath, filePath, sd, smbBytes)) {
+    String checksum = "";
+    if (!smbUploader->upload(filePath.c_str(), filePath.c_str(), sd, smbBytes, &checksum)) {
         LOG_ERRORF("[FileUploader] [SMB] Upload failed: %s", filePath.c_str());
         return false;
     }
-    String checksum = smbStateManager->calculateChecksum(sd, filePath);
-    if (!checksum.isEmpty()) smbStateManager->markFileUploaded(filePath, checksum, fileSize);
+    // Digest and size of the bytes actually sent — the card is only read again
+    // if another backend's entry uses a different algorithm
+    checksum = smbStateManager->fingerprintForRecord(sd, filePath.c_str(), checksum);
+    if (!checksum.isEmpty()) smbStateManager->markFileUploaded(filePath, checksum, smbBytes);
 
     LOGF("[FileUploader] Successfully uploaded: %s (%lu bytes)", filePath.c_str(), smbBytes);
     return true;
@@ -1240,7 +1524,7 @@ bool FileUploader::uploadMandatoryFilesSmb(SDCardManager* sdManager, fs::FS &sd)
         "/Identification.json", "/Identification.crc", "/Identification.tgt", "/STR.edf"
     };
     for (const char* path : rootPaths) {
-        if (sd.exists(path)) uploadSingleFileSmb(sdManager, String(path), false);
+        uploadSingleFileSmb(sdManager, String(path), false);  // absent files are skipped
     }
     std::vector<String> settingsFiles = scanSettingsFiles(sd);
     for (const String& fp : settingsFiles) {
@@ -1268,12 +1552,14 @@ bool FileUploader::uploadDatalogFolderCloud(SDCardManager* sdManager, const Stri
     std::vector<String> files;
     if (!handleFolderScan(sd, stateFs, folderName, folderPath, cloudStateManager, files,
             [this](fs::FS& sd2, const String& fp) { return scanFolderFiles(sd2, fp); })) {
+        cloudStateManager->recordFolderFailure(folderName, time(NULL));
+        cloudStateManager->save(stateFs);
         return false;
     }
     if (files.empty()) return true;
 
     bool isRecent = isRecentFolder(folderName);
-    bool isRescan = cloudStateManager->isFolderCompleted(folderName) && isRecent;
+    bool isRescan = isRecent;  // Per-file check, as for SMB
 
     g_cloudSessionStatus.uploadActive = true;
     strncpy((char*)g_cloudSessionStatus.currentFolder, folderName.c_str(),
@@ -1285,6 +1571,9 @@ bool FileUploader::uploadDatalogFolderCloud(SDCardManager* sdManager, const Stri
     int uploadedCount    = 0;
     int skippedUnchanged = 0;
     int skippedEmpty     = 0;
+    int skippedQuarantined = 0;  // Not uploaded — folder stays unsuccessful
+    int skippedOpen      = 0;    // Still being written — retried on the next re-scan
+    unsigned long now = time(NULL);
 
     // Import was created eagerly in begin() before this folder loop starts
     if (cloudImportFailed || sleephqUploader->getCurrentImportId().isEmpty()) {
@@ -1292,38 +1581,70 @@ bool FileUploader::uploadDatalogFolderCloud(SDCardManager* sdManager, const Stri
         return true;
     }
 
+    SdPath localPath;
     for (const String& fileName : files) {
-        String localPath = folderPath + "/" + fileName;
+        localPath.format("%s/%s", folderPath.c_str(), fileName.c_str());
+        if (localPath.truncated()) {
+            LOG_ERRORF("[FileUploader] [Cloud] Path too long, skipping: %s/%s", folderPath.c_str(), fileName.c_str());
+            continue;
+        }
+        if (cloudStateManager->isFileQuarantined(localPath.c_str(), now)) {
+            LOGF("[FileUploader] [Cloud] Skipping quarantined file: %s", localPath.c_str());
+            skippedQuarantined++;
+            continue;
+        }
         if (isRescan) {
-            if (!cloudStateManager->hasFileChanged(sd, localPath)) { skippedUnchanged++; continue; }
+            if (!cloudStateManager->hasFileChanged(sd, localPath.c_str())) { skippedUnchanged++; continue; }
             LOG_DEBUGF("[FileUploader] [Cloud] File changed: %s", fileName.c_str());
         }
-        File f = sd.open(localPath);
-        if (!f) { LOG_ERRORF("[FileUploader] [Cloud] Cannot open: %s", localPath.c_str()); continue; }
-        unsigned long fileSize = f.size();
-        f.close();
+        unsigned long fileSize = 0;
+        if (!getSdFileSize(sd, localPath.c_str(), fileSize)) {
+            LOG_ERRORF("[FileUploader] [Cloud] Cannot open: %s", localPath.c_str());
+            cloudStateManager->recordFileFailure(localPath.c_str(), now);
+            continue;
+        }
         if (fileSize == 0) {
-            cloudStateManager->markFileUploaded(localPath, "empty_file", 0);
+            cloudStateManager->markFileUploaded(localPath.c_str(), "empty_file", 0);
             skippedEmpty++;
             continue;
         }
+        // Tonight's files are still being appended to: send them once the CPAP
+        // has closed them rather than the whole file again every cycle
+        if (isRecent && classifyEdfFile(sd, localPath.c_str(), (uint32_t)fileSize) == EdfFileState::Open) {
+            LOGF("[FileUploader] [Cloud] Deferring still-open file: %s", fileName.c_str());
+            skippedOpen++;
+            continue;
+        }
 
         LOGF("[FileUploader] Uploading file: %s (%lu bytes)", fileName.c_str(), fileSize);
 
         if (!sleephqUploader->isConnected() && !sleephqUploader->begin()) {
             LOG_ERROR("[FileUploader] [Cloud] Connection failed");
+            cloudStateManager->recordBackendFailure(now);
             cloudStateManager->save(stateFs);
             return false;
         }
         unsigned long cloudBytes = 0;
         String cloudChecksum = "";
-        if (!sleephqUploader->upload(localPath, localPath, sd, cloudBytes, cloudChecksum)) {
+        sleephqUploader->setReadTap(armNightTap(localPath.c_str()));
+        bool cloudOk = sleephqUploader->upload(localPath.c_str(), localPath.c_str(), sd, cloudBytes, cloudChecksum);
+        sleephqUploader->setReadTap(nullptr);
+        collectNightTap(cloudOk);
+        if (!cloudOk) {
             LOG_ERRORF("[FileUploader] [Cloud] Upload failed: %s", localPath.c_str());
             LOGF("[FileUploader] Successfully uploaded %d files before failure", uploadedCount);
+            if (sleephqUploader->hadTransportError()) {
+                // Link, auth or server failure — breaker, no quarantine (see SMB)
+                cloudStateManager->recordBackendFailure(now);
+            } else {
+                cloudStateManager->recordFileFailure(localPath.c_str(), now);
+                cloudStateManager->recordFolderFailure(folderName, now);
+            }
             cloudStateManager->save(stateFs);
             return false;
         }
-        if (isRecent) cloudStateManager->markFileUploaded(localPath, "", fileSize);
+        cloudStateManager->clearFileQuarantine(localPath.c_str());
+        if (isRecent) cloudStateManager->markFileUploaded(localPath.c_str(), "", fileSize);
         uploadedCount++;
         cloudDatalogFilesUploaded++;
         g_cloudSessionStatus.filesUploaded = uploadedCount;
@@ -1344,15 +1665,23 @@ bool FileUploader::uploadDatalogFolderCloud(SDCardManager* sdManager, const Stri
         LOGF("[FileUploader] [Cloud] Folder complete: %d files", uploadedCount);
     }
 
-    bool uploadSuccess = (uploadedCount == (int)files.size() - skippedUnchanged - skippedEmpty);
-    LOGF("[FileUploader] [Cloud] Folder %s: %d/%d files, %d unchanged, %d empty — success=%s",
+    int expectedUploads = (int)files.size() - skippedUnchanged - skippedEmpty - skippedOpen;
+    bool uploadSuccess = (uploadedCount == expectedUploads);
+    LOGF("[FileUploader] [Cloud] Folder %s: %d/%d files, %d unchanged, %d empty, %d open, %d quarantined — success=%s",
          folderName.c_str(), uploadedCount, (int)files.size(), skippedUnchanged, skippedEmpty,
-         uploadSuccess ? "yes" : "no");
+         skippedOpen, skippedQuarantined, uploadSuccess ? "yes" : "no");
 
-    // Mark-complete strategy: same as SMB — recent always, old only on full success.
-    if (isRecent) {
-        cloudStateManager->markFolderCompleted(folderName);
-    } else if (uploadSuccess) {
+    // A quarantined file keeps the folder unsuccessful (not complete) but is
+    // not a folder failure: only other misses escalate to folder quarantine
+    if (!UploadStateManager::isFolderPassFailure(expectedUploads, uploadedCount, skippedQuarantined)) {
+        cloudStateManager->clearFolderQuarantine(folderName);
+    } else {
+        cloudStateManager->recordFolderFailure(folderName, now);
+    }
+
+    // Mark-complete strategy: same as SMB — recent unless a file was deferred,
+    // old only on full success.
+    if (UploadStateManager::shouldMarkFolderCompleted(isRecent, uploadSuccess, skippedOpen)) {
         cloudStateManager->markFolderCompleted(folderName);
     }
 
@@ -1369,12 +1698,8 @@ bool FileUploader::uploadSingleFileCloud(SDCardManager* sdManager, const String&
     if (!sleephqUploader || !cloudStateManager) return false;
     fs::FS &sd = sdManager->getFS();
 
-    if (!sd.exists(filePath)) return true;
-
-    File f = sd.open(filePath);
-    if (!f) return false;
-    unsigned long fileSize = f.size();
-    f.close();
+    unsigned long fileSize = 0;
+    if (!getSdFileSize(sd, filePath.c_str(), fileSize)) return true;  // file absent — not an error
     if (fileSize == 0) return true;
 
     if (!force && !cloudStateManager->hasFileChanged(sd, filePath)) {
@@ -1390,13 +1715,13 @@ bool FileUploader::uploadSingleFileCloud(SDCardManager* sdManager, const String&
     }
     unsigned long cloudBytes = 0;
     String cloudChecksum = "";
-    if (!sleephqUploader->upload(filePath, filePath, sd, cloudBytes, cloudChecksum)) {
+    if (!sleephqUploader->upload(filePath.c_str(), filePath.c_str(), sd, cloudBytes, cloudChecksum)) {
         LOG_ERRORF("[FileUploader] [Cloud] Upload failed: %s", filePath.c_str());
         return false;
     }
     String checksum = cloudChecksum.isEmpty()
-        ? cloudStateManager->calculateChecksum(sd, filePath)
-        : cloudChecksum;
+        ? cloudStateManager->calculateFingerprint(sd, filePath.c_str(), LOCAL_FINGERPRINT_ALGO)
+        : cloudStateManager->fingerprintForRecord(sd, filePath.c_str(), cloudChecksum);
     if (!checksum.isEmpty()) cloudStateManager->markFileUploaded(filePath, checksum, fileSize);
 
     LOGF("[FileUploader] Successfully uploaded: %s (%lu bytes)", filePath.c_str(), cloudBytes);
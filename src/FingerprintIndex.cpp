@@ -0,0 +1,369 @@
+#include "FingerprintIndex.h"
+#include "Logger.h"
+#include <string.h>
+
+static_assert(sizeof(FingerprintRecord) == 32, "Fingerprint records are 32 bytes on flash");
+
+namespace {
+const char INDEX_MAGIC[4] = {'F', 'P', 'I', '1'};
+}
+
+FingerprintIndex::FingerprintIndex()
+    : indexFs(nullptr),
+      recordCount(0),
+      generation(0),
+      useClock(0) {
+    memset(&indexStats, 0, sizeof(indexStats));
+    invalidateCache();
+}
+
+void FingerprintIndex::invalidateCache() {
+    for (uint8_t i = 0; i < CACHE_PAGES; ++i) {
+        cache[i].page = -1;
+        cache[i].count = 0;
+        cache[i].lastUse = 0;
+    }
+}
+
+void FingerprintIndex::reset() {
+    recordCount = 0;
+    invalidateCache();
+}
+
+bool FingerprintIndex::open(fs::FS &sd, const String& path) {
+    indexFs = &sd;
+    indexPath = path;
+    reset();
+
+    if (!sd.exists(path)) {
+        return true;
+    }
+
+    fs::File file = sd.open(path, FILE_READ);
+    if (!file) {
+        LOG_ERRORF("[FingerprintIndex] Failed to open %s", path.c_str());
+        return false;
+    }
+
+    Header header;
+    size_t size = file.size();
+    bool valid = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                 header.recordSize == sizeof(FingerprintRecord) &&
+                 header.count <= MAX_RECORDS &&
+                 size == sizeof(Header) + (size_t)header.count * sizeof(FingerprintRecord);
+    if (valid) {
+        recordCount = header.count;
+        valid = readPageKeys(file);
+    }
+    file.close();
+
+    if (!valid) {
+        // Files then look new and are checked again; nothing is skipped wrongly
+        recordCount = 0;
+        LOG_WARNF("[FingerprintIndex] Ignoring damaged index %s (%u bytes)", path.c_str(), (unsigned)size);
+        return false;
+    }
+
+    generation = header.generation;
+    return true;
+}
+
+bool FingerprintIndex::readPageKeys(fs::File& file) {
+    uint32_t pages = (recordCount + PAGE_RECORDS - 1) / PAGE_RECORDS;
+    for (uint32_t p = 0; p < pages; ++p) {
+        uint32_t offset = sizeof(Header) + p * PAGE_RECORDS * sizeof(FingerprintRecord);
+        if (!file.seek(offset) ||
+            file.read((uint8_t*)&pageKeys[p], sizeof(pageKeys[p])) != sizeof(pageKeys[p])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Lookup
+// ============================================================================
+
+const FingerprintIndex::CachePage* FingerprintIndex::loadPage(uint32_t page) {
+    useClock++;
+
+    uint8_t victim = 0;
+    for (uint8_t i = 0; i < CACHE_PAGES; ++i) {
+        if (cache[i].page == (int32_t)page) {
+            cache[i].lastUse = useClock;
+            indexStats.pageHits++;
+            return &cache[i];
+        }
+        if (cache[i].lastUse < cache[victim].lastUse) {
+            victim = i;
+        }
+    }
+
+    fs::File file = indexFs->open(indexPath, FILE_READ);
+    if (!file) {
+        LOG_ERRORF("[FingerprintIndex] Failed to open %s", indexPath.c_str());
+        return nullptr;
+    }
+
+    uint32_t first = page * PAGE_RECORDS;
+    uint32_t left = recordCount - first;
+    uint16_t n = left < PAGE_RECORDS ? (uint16_t)left : PAGE_RECORDS;
+    size_t bytes = n * sizeof(FingerprintRecord);
+
+    CachePage& slot = cache[victim];
+    bool ok = file.seek(sizeof(Header) + first * sizeof(FingerprintRecord)) &&
+              file.read((uint8_t*)slot.records, bytes) == bytes;
+    file.close();
+
+    if (!ok) {
+        slot.page = -1;
+        slot.lastUse = 0;
+        LOG_ERRORF("[FingerprintIndex] Short read of page %lu", (unsigned long)page);
+        return nullptr;
+    }
+
+    slot.page = (int32_t)page;
+    slot.count = n;
+    slot.lastUse = useClock;
+    indexStats.pageReads++;
+    return &slot;
+}
+
+bool FingerprintIndex::find(uint64_t pathHash, FingerprintRecord& out) {
+    indexStats.lookups++;
+    if (!indexFs || recordCount == 0) {
+        return false;
+    }
+
+    if (pathHash < pageKeys[0]) {
+        return false;
+    }
+
+    // Last page whose first key is <= pathHash
+    uint32_t lo = 0;
+    uint32_t hi = (recordCount - 1) / PAGE_RECORDS;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo + 1) / 2;
+        if (pageKeys[mid] <= pathHash) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    const CachePage* page = loadPage(lo);
+    if (!page) {
+        return false;
+    }
+
+    int l = 0;
+    int h = (int)page->count - 1;
+    while (l <= h) {
+        int m = (l + h) / 2;
+        uint64_t key = page->records[m].pathHash;
+        if (key == pathHash) {
+            out = page->records[m];
+            return true;
+        }
+        if (key < pathHash) {
+            l = m + 1;
+        } else {
+            h = m - 1;
+        }
+    }
+    return false;
+}
+
+// ============================================================================
+// Merge (rewrite into a new file)
+// ============================================================================
+
+bool FingerprintIndex::mergePass(const FingerprintRecord* changes,
+                                 uint16_t changeCount,
+                                 uint8_t newGeneration,
+                                 fs::File* out,
+                                 uint8_t dropAge,
+                                 uint32_t dropAtAge,
+                                 uint32_t& kept,
+                                 uint32_t ageCounts[AGE_BUCKETS]) {
+    kept = 0;
+    memset(ageCounts, 0, sizeof(uint32_t) * AGE_BUCKETS);
+
+    fs::File in;
+    if (recordCount > 0) {
+        in = indexFs->open(indexPath, FILE_READ);
+        if (!in || !in.seek(sizeof(Header))) {
+            LOG_ERRORF("[FingerprintIndex] Failed to read %s", indexPath.c_str());
+            return false;
+        }
+    }
+
+    // Two cache pages serve as the read and write buffers
+    invalidateCache();
+    FingerprintRecord* inBuf = cache[0].records;
+    FingerprintRecord* outBuf = cache[1].records;
+    uint16_t inPos = 0;
+    uint16_t inLen = 0;
+    uint16_t outLen = 0;
+    uint32_t oldRead = 0;
+    uint32_t droppedAtAge = 0;
+    uint16_t c = 0;
+    bool ok = true;
+
+    while (ok) {
+        if (inPos == inLen && oldRead < recordCount) {
+            uint32_t left = recordCount - oldRead;
+            inLen = left < PAGE_RECORDS ? (uint16_t)left : PAGE_RECORDS;
+            size_t bytes = inLen * sizeof(FingerprintRecord);
+            if (in.read((uint8_t*)inBuf, bytes) != bytes) {
+                LOG_ERRORF("[FingerprintIndex] Short read of %s", indexPath.c_str());
+                ok = false;
+                break;
+            }
+            oldRead += inLen;
+            inPos = 0;
+        }
+
+        bool haveOld = inPos < inLen;
+        bool haveChange = c < changeCount;
+        if (!haveOld && !haveChange) {
+            break;
+        }
+
+        FingerprintRecord rec;
+        uint8_t age = 0;
+        if (haveChange && (!haveOld || changes[c].pathHash <= inBuf[inPos].pathHash)) {
+            if (haveOld && changes[c].pathHash == inBuf[inPos].pathHash) {
+                inPos++;  // Replaced
+            }
+            rec = changes[c++];
+            if (rec.uploaded == 0) {
+                continue;  // Removed
+            }
+            rec.generation = newGeneration;
+        } else {
+            rec = inBuf[inPos++];
+            age = (uint8_t)(newGeneration - rec.generation);
+            if (age >= AGE_BUCKETS) {
+                // Pin at the oldest age so the 8-bit generation never wraps around it
+                age = AGE_BUCKETS - 1;
+                rec.generation = (uint8_t)(newGeneration - age);
+            }
+        }
+
+        if (age > dropAge || (age == dropAge && droppedAtAge < dropAtAge)) {
+            if (age == dropAge) {
+                droppedAtAge++;
+            }
+            continue;
+        }
+
+        if (out && kept % PAGE_RECORDS == 0 && kept / PAGE_RECORDS < MAX_PAGES) {
+            pageKeys[kept / PAGE_RECORDS] = rec.pathHash;
+        }
+        ageCounts[age]++;
+        kept++;
+        if (out) {
+            outBuf[outLen++] = rec;
+            if (outLen == PAGE_RECORDS) {
+                ok = out->write((const uint8_t*)outBuf, sizeof(outBuf[0]) * outLen) == sizeof(outBuf[0]) * outLen;
+                outLen = 0;
+            }
+        }
+    }
+
+    if (ok && out && outLen > 0) {
+        ok = out->write((const uint8_t*)outBuf, sizeof(outBuf[0]) * outLen) == sizeof(outBuf[0]) * outLen;
+    }
+
+    if (in) {
+        in.close();
+    }
+    return ok;
+}
+
+bool FingerprintIndex::merge(const FingerprintRecord* changes, uint16_t changeCount) {
+    if (!indexFs) {
+        return false;
+    }
+    if (changeCount == 0) {
+        return true;
+    }
+
+    uint8_t newGeneration = (uint8_t)(generation + 1);
+    uint32_t ageCounts[AGE_BUCKETS];
+    uint32_t total = 0;
+
+    // Pass 1 sizes the result, pass 2 writes it
+    if (!mergePass(changes, changeCount, newGeneration, nullptr, AGE_BUCKETS, 0, total, ageCounts)) {
+        return false;
+    }
+
+    // Over capacity: drop the oldest records, never this merge's own changes
+    uint8_t dropAge = AGE_BUCKETS;
+    uint32_t dropAtAge = 0;
+    uint32_t evicted = 0;
+    if (total > MAX_RECORDS) {
+        uint32_t excess = total - MAX_RECORDS;
+        for (uint8_t age = AGE_BUCKETS - 1; age > 0; --age) {
+            dropAge = age;
+            if (ageCounts[age] >= excess) {
+                dropAtAge = excess;
+                evicted += excess;
+                break;
+            }
+            dropAtAge = ageCounts[age];
+            evicted += ageCounts[age];
+            excess -= ageCounts[age];
+        }
+    }
+
+    String tempPath = indexPath + ".tmp";
+    fs::File out = indexFs->open(tempPath, FILE_WRITE);
+    if (!out) {
+        LOG_ERRORF("[FingerprintIndex] Failed to create %s", tempPath.c_str());
+        return false;
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.recordSize = sizeof(FingerprintRecord);
+    header.count = total - evicted;
+    header.generation = newGeneration;
+
+    uint32_t written = 0;
+    bool ok = out.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+              mergePass(changes, changeCount, newGeneration, &out, dropAge, dropAtAge, written, ageCounts) &&
+              written == header.count;
+    out.close();
+
+    if (!ok) {
+        indexFs->remove(tempPath);
+        LOG_ERRORF("[FingerprintIndex] Failed to write %s", tempPath.c_str());
+        open(*indexFs, indexPath);  // Page keys were overwritten; the old file is intact
+        return false;
+    }
+
+    if (!indexFs->rename(tempPath, indexPath)) {
+        // Filesystems that refuse to rename over an existing file
+        indexFs->remove(indexPath);
+        if (!indexFs->rename(tempPath, indexPath)) {
+            indexFs->remove(tempPath);
+            recordCount = 0;
+            LOG_ERRORF("[FingerprintIndex] Failed to replace %s", indexPath.c_str());
+            return false;
+        }
+    }
+
+    recordCount = header.count;
+    generation = newGeneration;
+    indexStats.merges++;
+    if (evicted > 0) {
+        indexStats.evicted += evicted;
+        LOG_WARNF("[FingerprintIndex] Full (%lu records): dropped %lu oldest",
+                  (unsigned long)MAX_RECORDS, (unsigned long)evicted);
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+#include "FsmEvents.h"
+#include <esp_attr.h>
+
+FsmEventQueue g_fsmEvents;
+
+FsmEventQueue::FsmEventQueue()
+    : fsmTask(nullptr),
+      earlyEvents(0),
+      pending(0),
+      eventWakeups(0),
+      timeoutWakeups(0) {
+}
+
+void FsmEventQueue::begin() {
+    fsmTask = xTaskGetCurrentTaskHandle();
+    pending |= earlyEvents;
+    earlyEvents = 0;
+}
+
+void FsmEventQueue::post(uint32_t events) {
+    if (!fsmTask) {
+        // Only setup() runs this early; nothing else can race it
+        earlyEvents |= events;
+        return;
+    }
+    xTaskNotify(fsmTask, events, eSetBits);
+}
+
+bool IRAM_ATTR FsmEventQueue::postFromISR(uint32_t events) {
+    if (!fsmTask) {
+        return false;
+    }
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(fsmTask, events, eSetBits, &woken);
+    return woken == pdTRUE;
+}
+
+// Move whatever was posted since the last look into `pending`
+void FsmEventQueue::collect() {
+    uint32_t events = 0;
+    if (fsmTask && xTaskNotifyWait(0, UINT32_MAX, &events, 0) == pdTRUE) {
+        pending |= events;
+    }
+}
+
+bool FsmEventQueue::take(uint32_t events) {
+    collect();
+    bool had = (pending & events) != 0;
+    pending &= ~events;
+    return had;
+}
+
+bool FsmEventQueue::isPending(uint32_t events) {
+    collect();
+    return (pending & events) != 0;
+}
+
+void FsmEventQueue::clear(uint32_t events) {
+    collect();
+    pending &= ~events;
+}
+
+void FsmEventQueue::wait(uint32_t timeoutMs) {
+    uint32_t events = 0;
+    TickType_t ticks = pdMS_TO_TICKS(timeoutMs);
+    if (ticks == 0) {
+        ticks = 1;  // Still yield so IDLE runs (DFS, task watchdog)
+    }
+    if (xTaskNotifyWait(0, UINT32_MAX, &events, ticks) == pdTRUE) {
+        pending |= events;
+        eventWakeups++;
+    } else {
+        timeoutWakeups++;
+    }
+}
@@ -0,0 +1,166 @@
+#include "HeapGovernor.h"
+#include "Logger.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef UNIT_TEST
+#include <Arduino.h>
+static uint32_t defaultLargestBlock() { return ESP.getMaxAllocHeap(); }
+static uint32_t governorMillis() { return millis(); }
+#else
+static uint32_t defaultLargestBlock() { return 0; }
+static uint32_t governorMillis() { return 0; }
+#endif
+
+HeapGovernor g_heapGovernor;
+
+// Floors: contiguous heap that must still be free after the budget's own
+// allocation. These are the limits the modules used to check on their own
+// (see docs/specs/heap-governor.md).
+static const struct {
+    const char* name;
+    uint32_t floor;
+} BUDGETS[HEAP_BUDGET_COUNT] = {
+    {"sd_mount",     16384},  // FATFS buffers + first scans; mount fails below this
+    {"tls",          36000},  // Handshake: certificate chain, bignum temporaries
+    {"smb",          20000},  // libsmb2 PDU allocations fail below this
+    {"cloud_buffer", 33000},  // TLS records + lwIP pbufs while streaming
+    {"web_response", 20000},  // In-memory JSON must not starve the upload phase
+};
+
+HeapGovernor::HeapGovernor() : probe(defaultLargestBlock) {
+    reset();
+}
+
+void HeapGovernor::reset() {
+    memset(budgets, 0, sizeof(budgets));
+    memset(ring, 0, sizeof(ring));
+    ringHead = 0;
+    ringCount = 0;
+}
+
+uint32_t HeapGovernor::floorOf(HeapBudget budget) {
+    return BUDGETS[(uint8_t)budget].floor;
+}
+
+const char* HeapGovernor::budgetName(HeapBudget budget) {
+    return (uint8_t)budget < HEAP_BUDGET_COUNT ? BUDGETS[(uint8_t)budget].name : "?";
+}
+
+bool HeapGovernor::hasRoom(HeapBudget budget, size_t bytes) const {
+    return probe() >= floorOf(budget) + bytes;
+}
+
+size_t HeapGovernor::reserve(HeapBudget budget, size_t preferred, size_t minimum) {
+    uint32_t largest = probe();
+    uint32_t floor = floorOf(budget);
+    HeapBudgetState& s = budgets[(uint8_t)budget];
+
+    // Halve until it fits, but not below minimum
+    size_t size = preferred;
+    while (size + floor > largest && size / 2 >= minimum && size / 2 > 0) {
+        size /= 2;
+    }
+    if (size < minimum || size + floor > largest) {
+        s.denials++;
+        record(budget, HeapOp::Deny, preferred, 0, largest);
+        LOG_WARNF("[Heap] %s: denied %u bytes (ma=%u, floor=%u)",
+                  budgetName(budget), (unsigned)minimum, (unsigned)largest, (unsigned)floor);
+        return 0;
+    }
+
+    s.held = size;
+    s.active = true;
+    s.grants++;
+    if (size > s.peak) {
+        s.peak = size;
+    }
+    record(budget, HeapOp::Grant, preferred, size, largest);
+    LOG_DEBUGF("[Heap] %s: granted %u of %u bytes (ma=%u)",
+               budgetName(budget), (unsigned)size, (unsigned)preferred, (unsigned)largest);
+    return size;
+}
+
+bool HeapGovernor::admit(HeapBudget budget) {
+    uint32_t largest = probe();
+    HeapBudgetState& s = budgets[(uint8_t)budget];
+    if (largest < floorOf(budget)) {
+        s.denials++;
+        record(budget, HeapOp::Deny, 0, 0, largest);
+        LOG_WARNF("[Heap] %s: not admitted (ma=%u, floor=%u)",
+                  budgetName(budget), (unsigned)largest, (unsigned)floorOf(budget));
+        return false;
+    }
+    s.held = 0;
+    s.active = true;
+    s.grants++;
+    record(budget, HeapOp::Grant, 0, 0, largest);
+    return true;
+}
+
+void HeapGovernor::release(HeapBudget budget) {
+    HeapBudgetState& s = budgets[(uint8_t)budget];
+    if (!s.active) {
+        return;
+    }
+    record(budget, HeapOp::Release, 0, s.held, probe());
+    s.held = 0;
+    s.active = false;
+}
+
+void HeapGovernor::record(HeapBudget budget, HeapOp op, uint32_t requested, uint32_t granted, uint32_t largest) {
+    HeapDecision& d = ring[ringHead];
+    d.ms = governorMillis();
+    d.budget = budget;
+    d.op = op;
+    d.requested = requested;
+    d.granted = granted;
+    d.largest = largest;
+    ringHead = (ringHead + 1) % HEAP_HISTORY_SIZE;
+    if (ringCount < HEAP_HISTORY_SIZE) {
+        ringCount++;
+    }
+}
+
+bool HeapGovernor::history(uint8_t i, HeapDecision& out) const {
+    if (i >= ringCount) {
+        return false;
+    }
+    out = ring[(ringHead + HEAP_HISTORY_SIZE - 1 - i) % HEAP_HISTORY_SIZE];
+    return true;
+}
+
+size_t HeapGovernor::toJson(char* out, size_t outLen) const {
+    static const char* opNames[] = {"grant", "deny", "release"};
+    size_t n = 0;
+#define HEAP_JSON(...)                                                          \
+    do {                                                                        \
+        int w = snprintf(out + n, outLen - n, __VA_ARGS__);                     \
+        if (w < 0 || (size_t)w >= outLen - n) return 0;                         \
+        n += (size_t)w;                                                         \
+    } while (0)
+
+    if (outLen == 0) {
+        return 0;
+    }
+    HEAP_JSON("{\"largest\":%u,\"budgets\":[", (unsigned)probe());
+    for (uint8_t b = 0; b < HEAP_BUDGET_COUNT; b++) {
+        const HeapBudgetState& s = budgets[b];
+        HEAP_JSON("%s{\"name\":\"%s\",\"floor\":%u,\"active\":%s,\"held\":%u,\"peak\":%u,"
+                  "\"grants\":%u,\"denials\":%u}",
+                  b ? "," : "", BUDGETS[b].name, (unsigned)BUDGETS[b].floor,
+                  s.active ? "true" : "false", (unsigned)s.held, (unsigned)s.peak,
+                  (unsigned)s.grants, (unsigned)s.denials);
+    }
+    HEAP_JSON("],\"history\":[");
+    HeapDecision d;
+    for (uint8_t i = 0; history(i, d); i++) {
+        HEAP_JSON("%s{\"ms\":%lu,\"budget\":\"%s\",\"op\":\"%s\",\"requested\":%u,"
+                  "\"granted\":%u,\"largest\":%u}",
+                  i ? "," : "", (unsigned long)d.ms, budgetName(d.budget), opNames[(uint8_t)d.op],
+                  (unsigned)d.requested, (unsigned)d.granted, (unsigned)d.largest);
+    }
+    HEAP_JSON("]}");
+#undef HEAP_JSON
+    return n;
+}
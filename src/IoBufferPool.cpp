@@ -0,0 +1,108 @@
+#include "IoBufferPool.h"
+#include "Logger.h"
+#include <stdlib.h>
+
+#ifndef UNIT_TEST
+#include <freertos/FreeRTOS.h>
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+#define POOL_LOCK()   portENTER_CRITICAL(&poolMux)
+#define POOL_UNLOCK() portEXIT_CRITICAL(&poolMux)
+#else
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+// ============================================================================
+// Pool Storage
+// ============================================================================
+//
+// 16KB in .bss. The 8KB slot replaces the per-session SMB malloc (its size is
+// the SMB write chunk ceiling); the two 4KB slots cover a checksum running
+// while the logger flushes. Largest first, so slot 0 is the SMB buffer.
+
+static const size_t SLOT_SIZES[IO_POOL_SLOT_COUNT] = {8192, 4096, 4096};
+
+static uint8_t slot0[8192] __attribute__((aligned(4)));
+static uint8_t slot1[4096] __attribute__((aligned(4)));
+static uint8_t slot2[4096] __attribute__((aligned(4)));
+static uint8_t* const slotData[IO_POOL_SLOT_COUNT] = {slot0, slot1, slot2};
+
+static const char* slotOwners[IO_POOL_SLOT_COUNT] = {nullptr, nullptr, nullptr};
+static IoPoolStats poolStats = {0, 0, 0, 0, 0};
+
+size_t IoBufferPool::slotSize(uint8_t i) {
+    return i < IO_POOL_SLOT_COUNT ? SLOT_SIZES[i] : 0;
+}
+
+uint8_t* IoBufferPool::checkout(size_t size, const char* owner) {
+    if (size == 0) {
+        return nullptr;
+    }
+
+    POOL_LOCK();
+    // Smallest free slot that fits: scan from the small end
+    for (int i = IO_POOL_SLOT_COUNT - 1; i >= 0; i--) {
+        if (slotOwners[i] == nullptr && SLOT_SIZES[i] >= size) {
+            slotOwners[i] = owner ? owner : "?";
+            poolStats.checkouts++;
+            poolStats.inUse++;
+            if (poolStats.inUse > poolStats.peakInUse) {
+                poolStats.peakInUse = poolStats.inUse;
+            }
+            POOL_UNLOCK();
+            return slotData[i];
+        }
+    }
+    poolStats.heapFallbacks++;
+    POOL_UNLOCK();
+
+    // No logging here: the logger itself checks out buffers
+    uint8_t* buf = (uint8_t*)malloc(size);
+    if (!buf) {
+        POOL_LOCK();
+        poolStats.failures++;
+        POOL_UNLOCK();
+    }
+    return buf;
+}
+
+void IoBufferPool::give(uint8_t* buf) {
+    if (!buf) {
+        return;
+    }
+    for (uint8_t i = 0; i < IO_POOL_SLOT_COUNT; i++) {
+        if (buf == slotData[i]) {
+            POOL_LOCK();
+            if (slotOwners[i]) {
+                slotOwners[i] = nullptr;
+                poolStats.inUse--;
+            }
+            POOL_UNLOCK();
+            return;
+        }
+    }
+    free(buf);  // Heap fallback
+}
+
+IoPoolStats IoBufferPool::stats() {
+    POOL_LOCK();
+    IoPoolStats s = poolStats;
+    POOL_UNLOCK();
+    return s;
+}
+
+const char* IoBufferPool::slotOwner(uint8_t i) {
+    return i < IO_POOL_SLOT_COUNT ? slotOwners[i] : nullptr;
+}
+
+void IoBufferPool::logStatus() {
+    IoPoolStats s = stats();
+    LOGF("[IoPool] checkouts=%lu heap_fallbacks=%lu failures=%lu in_use=%u peak=%u",
+         (unsigned long)s.checkouts, (unsigned long)s.heapFallbacks,
+         (unsigned long)s.failures, (unsigned)s.inUse, (unsigned)s.peakInUse);
+    for (uint8_t i = 0; i < IO_POOL_SLOT_COUNT; i++) {
+        const char* owner = slotOwner(i);
+        LOG_DEBUGF("[IoPool]   slot %u (%u bytes): %s", (unsigned)i, (unsigned)SLOT_SIZES[i],
+                   owner ? owner : "free");
+    }
+}
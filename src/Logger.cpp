@@ -1,7 +1,9 @@
 #include "Logger.h"
+#include "StaticString.h"
 
 #ifndef UNIT_TEST
 #include "SDCardManager.h"
+#include "IoBufferPool.h"
 #include <WiFi.h>
 #include <LittleFS.h>
 
@@ -15,6 +17,12 @@
 #include <time.h>
 #include "version.h"
 
+// Longest line log() builds: timestamp + a logf() message (255) + resource suffix
+static const size_t LOG_LINE_MAX = 320;
+
+// Periodic flush copy-out buffer (from the I/O pool); also holds the gap notice
+static const size_t LOG_FLUSH_CHUNK = 1024;
+
 #ifndef UNIT_TEST
 #ifdef ENABLE_LOG_RESOURCE_SUFFIX
 namespace {
@@ -93,24 +101,19 @@ Logger::~Logger() {
     buffer = nullptr;
 }
 
-// Get current timestamp as string (HH:MM:SS format)
-String Logger::getTimestamp() {
+// Write the current timestamp (HH:MM:SS format)
+void Logger::getTimestamp(char* out, size_t outLen) {
     time_t now = time(nullptr);
+    struct tm timeinfo;
     
     // Check if time is synchronized (timestamp > Jan 1, 2000)
-    if (now < 946684800) {
-        return "[--:--:--] ";
-    }
-    
-    struct tm timeinfo;
-    if (!localtime_r(&now, &timeinfo)) {
-        return "[--:--:--] ";
+    if (now < 946684800 || !localtime_r(&now, &timeinfo)) {
+        snprintf(out, outLen, "[--:--:--] ");
+        return;
     }
     
-    char buffer[16];
-    snprintf(buffer, sizeof(buffer), "[%02d:%02d:%02d] ", 
+    snprintf(out, outLen, "[%02d:%02d:%02d] ", 
              timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
-    return String(buffer);
 }
 
 // Log a C-string message
@@ -119,8 +122,12 @@ void Logger::log(const char* message) {
         return;
     }
 
-    // Prepend timestamp
-    String timestampedMsg = getTimestamp() + String(message);
+    // Prepend timestamp. The line is built on the stack: a heap String per
+    // line would churn the heap on every log call.
+    char timestamp[16];
+    getTimestamp(timestamp, sizeof(timestamp));
+    StaticString<LOG_LINE_MAX> line(timestamp);
+    line.append(message);
 
 #ifndef UNIT_TEST
 #ifdef ENABLE_LOG_RESOURCE_SUFFIX
@@ -129,16 +136,18 @@ void Logger::log(const char* message) {
         const uint32_t maxAllocHeap = ESP.getMaxAllocHeap();
         const int freeFdCount = getFreeFileDescriptorCount();
 
-        timestampedMsg += " [res fh=" + String(freeHeap) +
-                          " ma=" + String(maxAllocHeap) +
-                          " fd=" + (freeFdCount >= 0 ? String(freeFdCount) : String("?")) +
-                          "]";
+        line.appendf(" [res fh=%u ma=%u fd=", (unsigned)freeHeap, (unsigned)maxAllocHeap);
+        if (freeFdCount >= 0) {
+            line.appendf("%d]", freeFdCount);
+        } else {
+            line.append("?]");
+        }
     }
 #endif
 #endif
 
-    const char* finalMsg = timestampedMsg.c_str();
-    size_t len = timestampedMsg.length();
+    const char* finalMsg = line.c_str();
+    size_t len = line.length();
     
     // Write to serial (outside critical section - Serial is thread-safe on ESP32)
     writeToSerial(finalMsg, len);
@@ -562,6 +571,14 @@ bool Logger::dumpSavedLogsPeriodic(SDCardManager* sdManager, bool forceFlush) {
     if (newBytes == 0) {
         return false;
     }
+
+    // Gap notice and copy-out chunk share one pooled buffer (checked out
+    // before touching the read pointer, so a failure loses nothing)
+    IoBuffer io(LOG_FLUSH_CHUNK, "logger");
+    if (!io) {
+        return false;
+    }
+    char* chunk = (char*)io.data();
     
     // Acquire mutex again for reading buffer content
     if (xSemaphoreTake(mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
@@ -606,10 +623,10 @@ bool Logger::dumpSavedLogsPeriodic(SDCardManager* sdManager, bool forceFlush) {
     }
 
     if (gapBytes > 0) {
-        char gapMessage[448];
+        char* gapMessage = chunk;
         int gapLen = snprintf(
             gapMessage,
-            sizeof(gapMessage),
+            LOG_FLUSH_CHUNK,
             "=== LOG NOTICE ===\n"
             "Some detailed log lines were skipped before they could be saved to internal storage.\n"
             "Approximate bytes skipped: %lu\n"
@@ -621,19 +638,18 @@ bool Logger::dumpSavedLogsPeriodic(SDCardManager* sdManager, bool forceFlush) {
         );
         if (gapLen > 0) {
             size_t bytesToWrite = (size_t)gapLen;
-            if (bytesToWrite >= sizeof(gapMessage)) {
-                bytesToWrite = sizeof(gapMessage) - 1;
+            if (bytesToWrite >= LOG_FLUSH_CHUNK) {
+                bytesToWrite = LOG_FLUSH_CHUNK - 1;
             }
             logFile.write((const uint8_t*)gapMessage, bytesToWrite);
         }
     }
     
-    char chunk[256];
     size_t chunkPos = 0;
     for (uint32_t i = 0; i < bytesToDump; i++) {
         size_t physicalPos = (dumpStart + i) % bufferSize;
         chunk[chunkPos++] = buffer[physicalPos];
-        if (chunkPos == sizeof(chunk)) {
+        if (chunkPos == LOG_FLUSH_CHUNK) {
             logFile.write((const uint8_t*)chunk, chunkPos);
             chunkPos = 0;
         }
@@ -1,7 +1,16 @@
 #include "NetworkRecovery.h"
 #include "Logger.h"
+#include "WiFiManager.h"
 #include <WiFi.h>
 #include <esp_task_wdt.h>
+#include <esp_wifi.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/tcpip.h>
+#include <lwip/etharp.h>
+#include <lwip/dhcp.h>
+#include <errno.h>
+#include <string.h>
 
 volatile bool g_wifiCyclingActive = false;
 volatile unsigned long g_lastWifiCycleMs = 0;
@@ -73,3 +82,233 @@ bool tryCoordinatedWifiCycle(bool feedWatchdog) {
     LOG_ERROR("[NetRecovery] WiFi cycle complete but failed to reconnect");
     return false;
 }
+
+// ============================================================================
+// Failure-classifying escalating recovery
+// ============================================================================
+
+static NetRecoveryStep s_lastRecoveryStep = NetRecoveryStep::None;
+static unsigned long s_lastRecoveryMs = 0;
+static unsigned long s_lastReassocMs = 0;
+
+const char* netFailureClassName(NetFailureClass failure) {
+    switch (failure) {
+        case NetFailureClass::Dns:             return "DNS";
+        case NetFailureClass::HostUnreachable: return "HOST_UNREACHABLE";
+        case NetFailureClass::ConnReset:       return "CONN_RESET";
+        case NetFailureClass::Timeout:         return "TIMEOUT";
+        case NetFailureClass::Tls:             return "TLS";
+        case NetFailureClass::LinkLost:        return "LINK_LOST";
+        default:                               return "UNKNOWN";
+    }
+}
+
+const char* netRecoveryStepName(NetRecoveryStep step) {
+    switch (step) {
+        case NetRecoveryStep::SocketReset: return "socket-reset";
+        case NetRecoveryStep::ArpRefresh:  return "arp-refresh";
+        case NetRecoveryStep::DhcpRenew:   return "dhcp-renew";
+        case NetRecoveryStep::Reassociate: return "reassociate";
+        case NetRecoveryStep::FullCycle:   return "full-cycle";
+        default:                           return "none";
+    }
+}
+
+static inline bool containsText(const char* haystack, const char* needle) {
+    return haystack && strstr(haystack, needle) != nullptr;
+}
+
+NetFailureClass classifyNetworkFailure(int errorCode, const char* detail) {
+    if (WiFi.status() != WL_CONNECTED) {
+        return NetFailureClass::LinkLost;
+    }
+
+    if (errorCode == EHOSTUNREACH ||
+        containsText(detail, "unreachable") || containsText(detail, "(113)")) {
+        return NetFailureClass::HostUnreachable;
+    }
+    if (containsText(detail, "getaddrinfo") || containsText(detail, "resolve") ||
+        containsText(detail, "DNS") || containsText(detail, "hostByName")) {
+        return NetFailureClass::Dns;
+    }
+    if (errorCode == ECONNRESET || errorCode == EPIPE || errorCode == ENOTCONN ||
+        containsText(detail, "reset") || containsText(detail, "Connection reset") ||
+        containsText(detail, "EOF")) {
+        return NetFailureClass::ConnReset;
+    }
+    if (containsText(detail, "SSL") || containsText(detail, "X509") ||
+        containsText(detail, "TLS") || containsText(detail, "alert")) {
+        return NetFailureClass::Tls;
+    }
+    if (errorCode == ETIMEDOUT ||
+        containsText(detail, "timed out") || containsText(detail, "TIMEOUT")) {
+        return NetFailureClass::Timeout;
+    }
+    return NetFailureClass::Unknown;
+}
+
+// Cheapest step that can fix this class of failure.
+static NetRecoveryStep firstStepFor(NetFailureClass failure) {
+    switch (failure) {
+        case NetFailureClass::HostUnreachable:
+            return NetRecoveryStep::ArpRefresh;
+        case NetFailureClass::Dns:
+            return NetRecoveryStep::DhcpRenew;
+        case NetFailureClass::LinkLost: {
+            // Credential / AP-side rejections need the full cycle; everything
+            // else (beacon loss, deauth, leave, handshake timeout) reassociates.
+            uint8_t reason = WiFiManager::getLastDisconnectReason();
+            if (reason == WIFI_REASON_AUTH_FAIL || reason == WIFI_REASON_ASSOC_FAIL ||
+                reason == WIFI_REASON_802_1X_AUTH_FAILED) {
+                return NetRecoveryStep::FullCycle;
+            }
+            return NetRecoveryStep::Reassociate;
+        }
+        default:
+            return NetRecoveryStep::SocketReset;
+    }
+}
+
+static struct netif* staNetif() {
+    esp_netif_t* handle = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    return handle ? (struct netif*)esp_netif_get_netif_impl(handle) : nullptr;
+}
+
+// lwIP core calls must run in the tcpip thread.
+static void arpRefreshCallback(void* ctx) {
+    struct netif* nif = (struct netif*)ctx;
+    etharp_cleanup_netif(nif);
+    etharp_gratuitous(nif);
+}
+
+static void dhcpRenewCallback(void* ctx) {
+    dhcp_renew((struct netif*)ctx);
+}
+
+// DHCP client state as last read on the tcpip thread (-1 = not read yet).
+// Static rather than per call: a probe still queued when the caller gives up
+// must not write into a dead stack frame. Only the upload task recovers.
+static volatile int s_dhcpState = -1;
+
+static void dhcpStateCallback(void* ctx) {
+    struct dhcp* dhcp = netif_dhcp_data((struct netif*)ctx);
+    s_dhcpState = dhcp ? dhcp->state : DHCP_STATE_OFF;
+}
+
+static bool waitForLink(unsigned long timeoutMs, bool feedWatchdog) {
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs) {
+        if (WiFi.status() == WL_CONNECTED && (uint32_t)WiFi.localIP() != 0) {
+            return true;
+        }
+        feedAll(feedWatchdog);
+        delay(50);
+    }
+    return WiFi.status() == WL_CONNECTED && (uint32_t)WiFi.localIP() != 0;
+}
+
+static bool runRecoveryStep(NetRecoveryStep step, bool feedWatchdog) {
+    switch (step) {
+        case NetRecoveryStep::SocketReset:
+            // The caller has already closed/reset its socket; give lwIP a
+            // moment to reap the PCB so the next connect gets a clean fd.
+            delay(50);
+            return WiFi.status() == WL_CONNECTED;
+
+        case NetRecoveryStep::ArpRefresh: {
+            struct netif* nif = staNetif();
+            if (!nif || tcpip_callback(arpRefreshCallback, nif) != ERR_OK) {
+                return false;
+            }
+            delay(100);
+            return WiFi.status() == WL_CONNECTED;
+        }
+
+        case NetRecoveryStep::DhcpRenew: {
+            struct netif* nif = staNetif();
+            if (!nif || tcpip_callback(dhcpRenewCallback, nif) != ERR_OK) {
+                return false;
+            }
+            // Renewal keeps the current address (dhcp_supplied_address() stays
+            // true throughout), so wait briefly for the client to get its ACK
+            // and return to BOUND. Probes queue behind the renew request.
+            unsigned long start = millis();
+            while (millis() - start < 2000) {
+                s_dhcpState = -1;
+                if (tcpip_callback(dhcpStateCallback, nif) != ERR_OK) break;
+                while (s_dhcpState < 0 && millis() - start < 2000) {
+                    delay(5);
+                }
+                if (s_dhcpState == DHCP_STATE_BOUND) break;
+                feedAll(feedWatchdog);
+                delay(50);
+            }
+            if (s_dhcpState != DHCP_STATE_BOUND) {
+                LOG_WARNF("[NetRecovery] DHCP renew not acknowledged (state %d)", s_dhcpState);
+            }
+            return waitForLink(500, feedWatchdog);
+        }
+
+        case NetRecoveryStep::Reassociate: {
+            if (g_smbConnectionActive || g_wifiCyclingActive) {
+                return WiFi.status() == WL_CONNECTED;
+            }
+            if (s_lastReassocMs > 0 && millis() - s_lastReassocMs < NET_REASSOC_COOLDOWN_MS) {
+                LOG_WARN("[NetRecovery] Reassociation skipped — cooldown active");
+                return waitForLink(2000, feedWatchdog);
+            }
+            g_wifiCyclingActive = true;
+            if (WiFi.status() != WL_CONNECTED) {
+                // The driver may already be reconnecting on its own.
+                if (!waitForLink(1000, feedWatchdog)) {
+                    esp_wifi_connect();
+                }
+            } else {
+                WiFi.reconnect();
+            }
+            bool ok = waitForLink(5000, feedWatchdog);
+            s_lastReassocMs = millis();
+            g_wifiCyclingActive = false;
+            return ok;
+        }
+
+        case NetRecoveryStep::FullCycle:
+            return tryCoordinatedWifiCycle(feedWatchdog);
+
+        default:
+            return WiFi.status() == WL_CONNECTED;
+    }
+}
+
+bool recoverNetwork(NetFailureClass failure, bool feedWatchdog) {
+    NetRecoveryStep step = firstStepFor(failure);
+
+    // Escalate past the previous step if we are still failing shortly after it.
+    if (s_lastRecoveryStep != NetRecoveryStep::None &&
+        millis() - s_lastRecoveryMs < NET_RECOVERY_ESCALATION_WINDOW_MS &&
+        (uint8_t)s_lastRecoveryStep >= (uint8_t)step) {
+        uint8_t next = (uint8_t)s_lastRecoveryStep + 1;
+        if (next > (uint8_t)NetRecoveryStep::FullCycle) {
+            next = (uint8_t)NetRecoveryStep::FullCycle;
+        }
+        step = (NetRecoveryStep)next;
+    }
+
+    LOG_WARNF("[NetRecovery] Failure class %s (disconnect reason %u) — step: %s",
+              netFailureClassName(failure),
+              (unsigned)WiFiManager::getLastDisconnectReason(),
+              netRecoveryStepName(step));
+
+    unsigned long start = millis();
+    bool ok = runRecoveryStep(step, feedWatchdog);
+    s_lastRecoveryStep = step;
+    s_lastRecoveryMs = millis();
+
+    LOGF("[NetRecovery] Step %s %s in %lu ms",
+         netRecoveryStepName(step), ok ? "done" : "failed", millis() - start);
+    return ok;
+}
+
+void noteNetworkHealthy() {
+    s_lastRecoveryStep = NetRecoveryStep::None;
+}
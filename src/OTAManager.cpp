@@ -1,13 +1,81 @@
 #include "OTAManager.h"
 #include "Logger.h"
-#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <soc/soc_caps.h>
+#include <LittleFS.h>
+#include <string.h>
+
+// URL download retry policy: attempts in a row that make no progress, and how
+// long a connection may deliver nothing before it is dropped and resumed
+static const uint8_t OTA_DOWNLOAD_ATTEMPTS = 5;
+static const uint32_t OTA_STALL_TIMEOUT_MS = 15000;
+
+namespace {
+// The transfer hash runs on the SHA engine. The ESP32 engine cannot load a
+// saved digest, so a hash resumed after a reboot continues in software from
+// the saved midstate (fields of the mbedtls ESP32 port context).
+#if defined(MBEDTLS_SHA256_ALT) && SOC_SHA_SUPPORT_PARALLEL_ENG
+bool exportShaMidstate(const mbedtls_sha256_context& ctx, uint32_t state[8]) {
+    mbedtls_sha256_context copy;
+    mbedtls_sha256_init(&copy);
+    mbedtls_sha256_clone(&copy, &ctx);  // Reads the digest back out of the engine
+    memcpy(state, copy.state, sizeof(copy.state));
+    mbedtls_sha256_free(&copy);
+    return true;
+}
+
+bool importShaMidstate(mbedtls_sha256_context& ctx, const uint32_t state[8], uint32_t bytes) {
+    mbedtls_sha256_starts(&ctx, 0);
+    memcpy(ctx.state, state, sizeof(ctx.state));
+    ctx.total[0] = bytes;
+    ctx.total[1] = 0;
+    ctx.mode = ESP_MBEDTLS_SHA256_SOFTWARE;
+    return true;
+}
+#else
+bool exportShaMidstate(const mbedtls_sha256_context&, uint32_t*) { return false; }
+bool importShaMidstate(mbedtls_sha256_context&, const uint32_t*, uint32_t) { return false; }
+#endif
+
+// Backing store for a formatted HTTP failure reported by getLastError()
+char downloadError[64];
+
+String httpErrorText(int httpCode) {
+    switch (httpCode) {
+        case HTTPC_ERROR_CONNECTION_REFUSED:  return "Connection refused";
+        case HTTPC_ERROR_SEND_HEADER_FAILED:  return "Send header failed";
+        case HTTPC_ERROR_SEND_PAYLOAD_FAILED: return "Send payload failed";
+        case HTTPC_ERROR_NOT_CONNECTED:       return "Not connected";
+        case HTTPC_ERROR_CONNECTION_LOST:     return "Connection lost";
+        case HTTPC_ERROR_NO_STREAM:           return "No stream";
+        case HTTPC_ERROR_NO_HTTP_SERVER:      return "No HTTP server";
+        case HTTPC_ERROR_TOO_LESS_RAM:        return "Too less RAM";
+        case HTTPC_ERROR_ENCODING:            return "Encoding error";
+        case HTTPC_ERROR_STREAM_WRITE:        return "Stream write error";
+        case HTTPC_ERROR_READ_TIMEOUT:        return "Read timeout";
+        default:
+            if (httpCode > 0) {
+                return "HTTP " + String(httpCode);
+            }
+            return "Network error " + String(httpCode);
+    }
+}
+}
 
 OTAManager::OTAManager() 
     : updateInProgress(false), 
       totalSize(0), 
       writtenSize(0),
       currentVersion("unknown"),
+      targetPartition(nullptr),
+      otaError(nullptr),
+      imageWritten(0),
+      imageHeadLen(0),
+      hashing(false),
+      tlsClient(nullptr),
       progressCallback(nullptr) {
+    mbedtls_sha256_init(&sha);
+    memset(&resume, 0, sizeof(resume));
 }
 
 bool OTAManager::begin() {
@@ -67,66 +135,111 @@ bool OTAManager::validateFirmware(const uint8_t* data, size_t length) {
     return true;
 }
 
+bool OTAManager::fail(const char* reason) {
+    if (!otaError) {
+        otaError = reason;
+    }
+    return false;
+}
+
+// Open the update partition for writing: from the start or, for a resumed
+// download, at `resumeOffset`. Sectors are erased ahead of the writes.
+bool OTAManager::beginPartition(uint32_t resumeOffset) {
+    targetPartition = esp_ota_get_next_update_partition(nullptr);
+    if (!targetPartition) {
+        LOG_ERROR("[OTA] No OTA update partition");
+        return fail("No OTA update partition");
+    }
+    LOG_DEBUGF("[OTA] Target partition: %s (%u bytes)", targetPartition->label, (unsigned)targetPartition->size);
+    
+    if (!flash.begin(targetPartition, resumeOffset)) {
+        LOG_ERROR("[OTA] Failed to begin update");
+        LOG_DEBUGF("[OTA] Update error: %s", esp_err_to_name(flash.lastError()));
+        return fail(esp_err_to_name(flash.lastError()));
+    }
+    return true;
+}
+
 bool OTAManager::startUpdate(size_t firmwareSize) {
     if (updateInProgress) {
         LOG_ERROR("[OTA] Update already in progress");
-        return false;
+        return fail("Update already in progress");
     }
+    otaError = nullptr;
     
     const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
     size_t maxUpdateSize = target ? target->size : ESP.getFreeSketchSpace();
-    if (target) {
-        LOG_DEBUGF("[OTA] Target partition: %s (%u bytes)", target->label, (unsigned)target->size);
-    }
     
     // Allow size 0 for chunked uploads - we'll determine the actual size later
     if (firmwareSize > maxUpdateSize) {
         LOG_ERROR("[OTA] Firmware size too large");
         LOG_DEBUGF("[OTA] Firmware size %u exceeds partition size %u", (unsigned)firmwareSize, (unsigned)maxUpdateSize);
-        return false;
+        return fail("Firmware size too large");
     }
     
     LOG_DEBUGF("[OTA] Starting update, firmware size: %u bytes", firmwareSize);
     
-    // For chunked uploads (size 0), use the OTA partition size as default
-    size_t updateSize = (firmwareSize == 0) ? maxUpdateSize : firmwareSize;
-    
-    if (!Update.begin(updateSize)) {
-        LOG_ERROR("[OTA] Failed to begin update");
-        LOG_DEBUGF("[OTA] Update error: %s", Update.errorString());
+    // The partition is about to be overwritten: any saved download checkpoint
+    // no longer describes its contents. The transfer may be gzip or a delta
+    // patch, so its size says nothing about the image size: sectors are only
+    // erased as the image reaches them.
+    OtaResumeStore::clear(LittleFS);
+    memset(&resume, 0, sizeof(resume));
+    if (!beginPartition(0)) {
         return false;
     }
     
     updateInProgress = true;
     totalSize = firmwareSize;  // Keep original size (may be 0)
     writtenSize = 0;
+    imageWritten = 0;
+    imageHeadLen = 0;
+    hashing = false;
+    decoder.begin(imageSink, this, readRunningImage, nullptr);
     
     LOG("[OTA] Update started successfully");
     return true;
 }
 
+// Reopen the partition at a saved checkpoint of a raw image download
+bool OTAManager::resumeUpdate(const OtaResumeState& saved) {
+    otaError = nullptr;
+    if (!importShaMidstate(sha, saved.shaState, saved.offset) || !beginPartition(saved.offset)) {
+        otaError = nullptr;
+        return false;
+    }
+    updateInProgress = true;
+    totalSize = saved.totalSize;
+    writtenSize = saved.offset;
+    imageWritten = saved.offset;
+    imageHeadLen = 0;
+    hashing = true;
+    resume = saved;
+    decoder.begin(imageSink, this, readRunningImage, nullptr);
+    decoder.resumeRaw(saved.offset);
+    return true;
+}
+
 bool OTAManager::writeChunk(const uint8_t* data, size_t length) {
     if (!updateInProgress) {
         LOG_ERROR("[OTA] No update in progress");
-        return false;
+        return fail("No update in progress");
     }
     
-    // Validate first chunk (firmware header)
-    if (writtenSize == 0 && !validateFirmware(data, length)) {
+    bool firstChunk = (writtenSize == 0);
+    if (!decoder.write(data, length)) {
+        if (decoder.error()) {
+            LOG_ERRORF("[OTA] %s", decoder.error());
+        }
+        fail(decoder.error() ? decoder.error() : otaError ? otaError : "Invalid firmware image");
         abortUpdate();
         return false;
     }
-    
-    size_t written = Update.write(const_cast<uint8_t*>(data), length);
-    if (written != length) {
-        LOG_ERROR("[OTA] Failed to write chunk");
-        LOG_DEBUGF("[OTA] Expected %u bytes, wrote %u bytes", length, written);
-        LOG_DEBUGF("[OTA] Update error: %s", Update.errorString());
-        abortUpdate();
-        return false;
+    if (firstChunk && decoder.transferFormat() != OtaImageFormat::Unknown) {
+        LOGF("[OTA] Transfer format: %s", otaImageFormatName(decoder.transferFormat()));
     }
     
-    writtenSize += written;
+    writtenSize += length;
     
     // Call progress callback if set
     if (progressCallback) {
@@ -134,21 +247,82 @@ bool OTAManager::writeChunk(const uint8_t* data, size_t length) {
     }
     
     LOG_DEBUGF("[OTA] Wrote %u bytes, total: %u/%u (%.1f%%)", 
-               written, writtenSize, totalSize, getProgress());
+               length, writtenSize, totalSize, getProgress());
     
     return true;
 }
 
+// Decoded image bytes. A decoded stream can hand over the image header in
+// pieces, so the first 32 bytes are held back until they can be validated.
+bool OTAManager::writeImage(const uint8_t* data, size_t length) {
+    if (imageWritten == 0) {
+        if (imageHeadLen == 0 && length >= sizeof(imageHead)) {
+            if (!validateFirmware(data, length)) {
+                return false;
+            }
+        } else {
+            size_t take = sizeof(imageHead) - imageHeadLen;
+            if (take > length) take = length;
+            memcpy(imageHead + imageHeadLen, data, take);
+            imageHeadLen += take;
+            data += take;
+            length -= take;
+            if (imageHeadLen < sizeof(imageHead)) {
+                return true;
+            }
+            if (!validateFirmware(imageHead, imageHeadLen) || !flashImage(imageHead, imageHeadLen)) {
+                return false;
+            }
+        }
+    }
+    return length == 0 || flashImage(data, length);
+}
+
+bool OTAManager::flashImage(const uint8_t* data, size_t length) {
+    if (!flash.write(data, length)) {
+        LOG_ERROR("[OTA] Failed to write chunk");
+        LOG_DEBUGF("[OTA] Update error: %s", esp_err_to_name(flash.lastError()));
+        return fail(esp_err_to_name(flash.lastError()));
+    }
+    imageWritten += length;
+    return true;
+}
+
+bool OTAManager::imageSink(void* ctx, const uint8_t* data, size_t length) {
+    return static_cast<OTAManager*>(ctx)->writeImage(data, length);
+}
+
+// Delta patches are applied against the image in the running partition
+bool OTAManager::readRunningImage(void* ctx, uint32_t offset, uint8_t* out, size_t length) {
+    (void)ctx;
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    if (!running || offset + length > running->size) {
+        return false;
+    }
+    return esp_partition_read(running, offset, out, length) == ESP_OK;
+}
+
 bool OTAManager::finishUpdate() {
     if (!updateInProgress) {
         LOG_ERROR("[OTA] No update in progress");
-        return false;
+        return fail("No update in progress");
     }
     
     // For chunked uploads, we might not know the total size upfront
     if (totalSize > 0 && writtenSize != totalSize) {
         LOG_ERROR("[OTA] Incomplete update");
         LOG_DEBUGF("[OTA] Expected %u bytes, got %u bytes", totalSize, writtenSize);
+        fail("Incomplete update");
+        abortUpdate();
+        return false;
+    }
+    
+    // Every layer of the transfer must have ended cleanly (gzip trailer,
+    // complete delta target, validated image header)
+    if (!decoder.finish() || imageWritten == 0) {
+        LOG_ERRORF("[OTA] Incomplete firmware image: %s",
+                   decoder.error() ? decoder.error() : "image header missing");
+        fail(decoder.error() ? decoder.error() : "Incomplete firmware image");
         abortUpdate();
         return false;
     }
@@ -159,14 +333,29 @@ bool OTAManager::finishUpdate() {
         LOG_DEBUGF("[OTA] Final firmware size: %u bytes", totalSize);
     }
     
-    if (!Update.end(true)) {
-        LOG_ERROR("[OTA] Failed to finish update");
-        LOG_DEBUGF("[OTA] Update error: %s", Update.errorString());
-        updateInProgress = false;
-        return false;
+    if (decoder.transferFormat() != OtaImageFormat::Raw) {
+        const char* kind = decoder.imageFormat() != OtaImageFormat::Delta ? "gzip" :
+                           decoder.transferFormat() == OtaImageFormat::Gzip ? "gzip delta" : "delta";
+        LOGF("[OTA] %u byte image from %u byte %s transfer (%.1fx smaller)",
+             (unsigned)imageWritten, (unsigned)writtenSize, kind,
+             (float)imageWritten / (float)writtenSize);
     }
     
+    // Everything must be in flash before esp_ota_set_boot_partition() verifies
+    // the image (segments, checksum, appended SHA-256) and makes it bootable
+    esp_err_t err = flash.flush() ? ESP_OK : flash.lastError();
+    flash.end();
+    if (err == ESP_OK) {
+        err = esp_ota_set_boot_partition(targetPartition);
+    }
     updateInProgress = false;
+    OtaResumeStore::clear(LittleFS);
+    if (err != ESP_OK) {
+        LOG_ERROR("[OTA] Failed to finish update");
+        LOG_DEBUGF("[OTA] Update error: %s", esp_err_to_name(err));
+        return fail(err == ESP_ERR_OTA_VALIDATE_FAILED ? "Firmware image validation failed" : esp_err_to_name(err));
+    }
+    
     LOG("[OTA] Update completed successfully!");
     LOG("[OTA] Device will restart in 3 seconds...");
     
@@ -174,152 +363,294 @@ bool OTAManager::finishUpdate() {
 }
 
 void OTAManager::abortUpdate() {
+    decoder.end();
+    releaseHash();
     if (updateInProgress) {
-        Update.abort();
+        flash.end();
         updateInProgress = false;
+        fail("Update aborted");
         LOG("[OTA] Update aborted");
     }
 }
 
 void OTAManager::forceReset() {
     LOG("[OTA] Force resetting OTA state");
-    if (updateInProgress) {
-        Update.abort();
-    }
+    flash.end();
+    decoder.end();
+    releaseHash();
+    otaError = nullptr;
     updateInProgress = false;
     totalSize = 0;
     writtenSize = 0;
+    imageWritten = 0;
+    imageHeadLen = 0;
     LOG("[OTA] OTA state reset complete");
 }
 
-bool OTAManager::updateFromURL(const String& url) {
-    if (updateInProgress) {
-        LOG_ERROR("[OTA] Update already in progress");
-        return false;
+// ============================================================================
+// URL downloads
+// ============================================================================
+
+void OTAManager::releaseHash() {
+    // An ESP32 SHA context holds the hardware engine until it is freed
+    if (hashing) {
+        mbedtls_sha256_free(&sha);
+        mbedtls_sha256_init(&sha);
+        hashing = false;
     }
-    
-    LOG_DEBUGF("[OTA] Starting download from: %s", url.c_str());
-    
-    HTTPClient http;
-    http.begin(url);
+}
+
+// GET the rest of the transfer. Past the first byte this is a Range request;
+// with If-Range the server answers 200 with the whole file instead of 206 if
+// the file changed since the checkpoint's validator was taken.
+int OTAManager::requestDownload(HTTPClient& http, WiFiClient& client, const String& url) {
+    static const char* headerKeys[] = {"ETag", "Last-Modified", "Content-Range"};
+
+    http.begin(client, url);
     http.setTimeout(30000);  // 30 second timeout
-    
+
     // Add user agent and connection details for better compatibility
     http.addHeader("User-Agent", "ESP32-OTA-Updater/1.0");
     http.setFollowRedirects(HTTPC_STRICT_FOLLOW_REDIRECTS);
-    
-    LOG_DEBUG("[OTA] Sending HTTP GET request...");
-    
-    int httpCode = http.GET();
-    if (httpCode != HTTP_CODE_OK) {
-        LOG_ERROR("[OTA] HTTP request failed");
-        LOG_DEBUGF("[OTA] HTTP code: %d", httpCode);
-        
-        // Provide more detailed error information
-        String errorMsg = "Unknown error";
-        switch (httpCode) {
-            case HTTPC_ERROR_CONNECTION_REFUSED:
-                errorMsg = "Connection refused";
-                break;
-            case HTTPC_ERROR_SEND_HEADER_FAILED:
-                errorMsg = "Send header failed";
-                break;
-            case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
-                errorMsg = "Send payload failed";
-                break;
-            case HTTPC_ERROR_NOT_CONNECTED:
-                errorMsg = "Not connected";
-                break;
-            case HTTPC_ERROR_CONNECTION_LOST:
-                errorMsg = "Connection lost";
-                break;
-            case HTTPC_ERROR_NO_STREAM:
-                errorMsg = "No stream";
-                break;
-            case HTTPC_ERROR_NO_HTTP_SERVER:
-                errorMsg = "No HTTP server";
-                break;
-            case HTTPC_ERROR_TOO_LESS_RAM:
-                errorMsg = "Too less RAM";
-                break;
-            case HTTPC_ERROR_ENCODING:
-                errorMsg = "Encoding error";
-                break;
-            case HTTPC_ERROR_STREAM_WRITE:
-                errorMsg = "Stream write error";
-                break;
-            case HTTPC_ERROR_READ_TIMEOUT:
-                errorMsg = "Read timeout";
-                break;
-            default:
-                if (httpCode > 0) {
-                    errorMsg = "HTTP " + String(httpCode);
-                } else {
-                    errorMsg = "Network error " + String(httpCode);
-                }
-                break;
+    http.collectHeaders(headerKeys, 3);
+
+    if (updateInProgress && writtenSize > 0) {
+        char range[24];
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned)writtenSize);
+        http.addHeader("Range", range);
+        if (resume.validator[0] != '\0') {
+            http.addHeader("If-Range", resume.validator);
         }
-        
-        LOG_DEBUGF("[OTA] Error details: %s", errorMsg.c_str());
-        http.end();
-        return false;
+        LOG_DEBUGF("[OTA] Requesting %s", range);
+    } else {
+        LOG_DEBUG("[OTA] Sending HTTP GET request...");
     }
-    
-    int contentLength = http.getSize();
-    if (contentLength <= 0) {
-        LOG_ERROR("[OTA] Invalid content length");
-        http.end();
-        return false;
-    }
-    
-    LOG_DEBUGF("[OTA] Firmware size: %d bytes", contentLength);
-    
-    if (!startUpdate(contentLength)) {
-        http.end();
-        return false;
-    }
-    
+    return http.GET();
+}
+
+// Stream the response body into the update, hashing it on the way. Returns
+// false if the connection drops or stalls first (the caller resumes it) or the
+// update itself fails (updateInProgress is cleared).
+bool OTAManager::streamDownload(HTTPClient& http) {
     WiFiClient* stream = http.getStreamPtr();
     uint8_t buffer[1024];
-    size_t totalRead = 0;
-    
-    while (http.connected() && totalRead < contentLength) {
+    unsigned long lastData = millis();
+
+    while (writtenSize < totalSize) {
         size_t available = stream->available();
         if (available == 0) {
+            if (!stream->connected() || millis() - lastData > OTA_STALL_TIMEOUT_MS) {
+                LOG_WARNF("[OTA] Download interrupted at %u/%u bytes", (unsigned)writtenSize, (unsigned)totalSize);
+                return false;
+            }
             delay(10);
             continue;
         }
-        
+
+        // Reads stop at checkpoint boundaries so the saved hash state and the
+        // flash contents describe the same offset
         size_t toRead = min(available, sizeof(buffer));
+        size_t toBoundary = OTA_CHECKPOINT_INTERVAL - writtenSize % OTA_CHECKPOINT_INTERVAL;
+        if (toRead > toBoundary) toRead = toBoundary;
+        if (toRead > totalSize - writtenSize) toRead = totalSize - writtenSize;
+
         size_t bytesRead = stream->readBytes(buffer, toRead);
-        
         if (bytesRead == 0) {
-            LOG_ERROR("[OTA] Failed to read from stream");
-            abortUpdate();
-            http.end();
-            return false;
+            continue;
         }
-        
+
+        mbedtls_sha256_update(&sha, buffer, bytesRead);
         if (!writeChunk(buffer, bytesRead)) {
-            http.end();
             return false;
         }
-        
-        totalRead += bytesRead;
-        
+        lastData = millis();
+
+        if (writtenSize % OTA_CHECKPOINT_INTERVAL == 0 && writtenSize < totalSize) {
+            saveCheckpoint();
+        }
+
         // Yield to prevent watchdog timeout
         yield();
     }
-    
-    http.end();
-    
-    if (totalRead != contentLength) {
-        LOG_ERROR("[OTA] Download incomplete");
-        LOG_DEBUGF("[OTA] Expected %d bytes, got %u bytes", contentLength, totalRead);
+    return true;
+}
+
+// Persist the download position so a reboot can resume it. Only raw transfers
+// qualify (the gzip and delta decoders hold state that is not saved), and only
+// when the server gave a validator to check the file against on resume.
+void OTAManager::saveCheckpoint() {
+    if (resume.validator[0] == '\0' || decoder.transferFormat() != OtaImageFormat::Raw ||
+        !exportShaMidstate(sha, resume.shaState)) {
+        return;
+    }
+    // The checkpoint may only cover bytes that are in flash
+    if (!flash.flush()) {
+        return;
+    }
+    resume.offset = writtenSize;
+    if (OtaResumeStore::save(LittleFS, resume)) {
+        LOG_DEBUGF("[OTA] Checkpoint saved at %u bytes", (unsigned)writtenSize);
+    }
+}
+
+bool OTAManager::updateFromURL(const String& url, const String& expectedSha256) {
+    if (updateInProgress) {
+        LOG_ERROR("[OTA] Update already in progress");
+        return fail("Update already in progress");
+    }
+    otaError = nullptr;
+
+    uint8_t expected[32];
+    bool verify = expectedSha256.length() > 0;
+    if (verify && !parseSha256Hex(expectedSha256.c_str(), expected)) {
+        LOG_ERROR("[OTA] Expected SHA-256 must be 64 hex digits");
+        return fail("Invalid SHA-256 checksum");
+    }
+
+    LOG_DEBUGF("[OTA] Starting download from: %s", url.c_str());
+
+    // HTTPS uses one TLS client for every range request of every download
+    // rather than a fresh one per request. Integrity comes from the image
+    // checks and the SHA-256, not from the certificate.
+    WiFiClient plainClient;
+    WiFiClient* client = &plainClient;
+    if (url.startsWith("https://")) {
+        if (!tlsClient) {
+            tlsClient = new WiFiClientSecure();
+            tlsClient->setInsecure();
+            tlsClient->setTimeout(20);
+        }
+        client = tlsClient;
+    }
+
+    // Pick up where an earlier attempt at the same URL left off
+    uint32_t urlCrc = otaUrlCrc(url.c_str());
+    const esp_partition_t* target = esp_ota_get_next_update_partition(nullptr);
+    OtaResumeState saved;
+    if (target && OtaResumeStore::load(LittleFS, saved)) {
+        if (saved.urlCrc == urlCrc && strcmp(saved.partition, target->label) == 0 && resumeUpdate(saved)) {
+            LOGF("[OTA] Resuming interrupted download at %u/%u bytes",
+                 (unsigned)saved.offset, (unsigned)saved.totalSize);
+        } else {
+            OtaResumeStore::clear(LittleFS);
+        }
+    }
+
+    HTTPClient http;
+    bool complete = false;
+    bool permanent = false;
+    uint8_t attempts = 0;
+
+    while (!complete && !permanent) {
+        size_t before = updateInProgress ? writtenSize : 0;
+        int httpCode = requestDownload(http, *client, url);
+
+        if (httpCode == HTTP_CODE_OK) {
+            // The whole file: a first request, or the server ignored the range
+            // or the file changed since the checkpoint. Start from byte 0.
+            if (updateInProgress) {
+                LOG_WARN("[OTA] Server sent the whole file, restarting download");
+                abortUpdate();
+                otaError = nullptr;
+            }
+            int contentLength = http.getSize();
+            if (contentLength <= 0) {
+                LOG_ERROR("[OTA] Invalid content length");
+                fail("Invalid content length");
+                permanent = true;
+            } else {
+                LOG_DEBUGF("[OTA] Firmware size: %d bytes", contentLength);
+                if (!startUpdate(contentLength)) {
+                    permanent = true;
+                } else {
+                    mbedtls_sha256_starts(&sha, 0);
+                    hashing = true;
+                    resume.urlCrc = urlCrc;
+                    strlcpy(resume.partition, targetPartition->label, sizeof(resume.partition));
+                    resume.totalSize = contentLength;
+                    // A weak ETag does not promise identical bytes, so it
+                    // cannot guard a byte range
+                    String validator = http.header("ETag");
+                    if (validator.isEmpty() || validator.startsWith("W/")) {
+                        validator = http.header("Last-Modified");
+                    }
+                    if (validator.length() < sizeof(resume.validator) && validator.indexOf('|') < 0) {
+                        strlcpy(resume.validator, validator.c_str(), sizeof(resume.validator));
+                    }
+                }
+            }
+        } else if (httpCode == HTTP_CODE_PARTIAL_CONTENT) {
+            uint32_t start = 0, end = 0, total = 0;
+            if (!updateInProgress ||
+                !parseContentRange(http.header("Content-Range").c_str(), start, end, total) ||
+                start != writtenSize || total != totalSize) {
+                LOG_WARN("[OTA] Server returned an unexpected range, restarting download");
+                if (updateInProgress) {
+                    abortUpdate();
+                    otaError = nullptr;
+                }
+                OtaResumeStore::clear(LittleFS);
+            }
+        } else {
+            LOG_ERROR("[OTA] HTTP request failed");
+            LOG_DEBUGF("[OTA] HTTP code: %d", httpCode);
+            LOG_DEBUGF("[OTA] Error details: %s", httpErrorText(httpCode).c_str());
+            if (httpCode == 416 && updateInProgress) {
+                // The checkpoint offset is beyond the file: start over
+                abortUpdate();
+                otaError = nullptr;
+                OtaResumeStore::clear(LittleFS);
+            } else if (httpCode >= 400 && httpCode < 500 && httpCode != 408 && httpCode != 429) {
+                // Client errors do not go away by retrying
+                snprintf(downloadError, sizeof(downloadError), "Download failed: %s", httpErrorText(httpCode).c_str());
+                fail(downloadError);
+                permanent = true;
+            }
+        }
+
+        if (!permanent && updateInProgress && (httpCode == HTTP_CODE_OK || httpCode == HTTP_CODE_PARTIAL_CONTENT)) {
+            complete = streamDownload(http);
+            if (!complete && !updateInProgress) {
+                permanent = true;  // The image itself was rejected
+            }
+        }
+        http.end();
+
+        if (complete || permanent) {
+            break;
+        }
+        bool progressed = updateInProgress && writtenSize > before;
+        attempts = progressed ? 0 : attempts + 1;
+        if (attempts >= OTA_DOWNLOAD_ATTEMPTS) {
+            LOG_ERROR("[OTA] Download failed, giving up");
+            fail("Download failed");
+            break;
+        }
+        LOG_WARNF("[OTA] Retrying download (attempt %u/%u)", (unsigned)attempts + 1, (unsigned)OTA_DOWNLOAD_ATTEMPTS);
+        delay(1000 * (attempts + 1));
+    }
+
+    if (!complete) {
+        // The checkpoint (if any) stays for the next attempt at this URL
         abortUpdate();
         return false;
     }
-    
+
+    uint8_t digest[32];
+    char hex[65];
+    mbedtls_sha256_finish(&sha, digest);
+    releaseHash();
+    sha256ToHex(digest, hex);
+    if (verify && memcmp(digest, expected, sizeof(digest)) != 0) {
+        LOG_ERROR("[OTA] SHA-256 mismatch, firmware rejected");
+        LOG_DEBUGF("[OTA] Downloaded SHA-256: %s", hex);
+        fail("SHA-256 mismatch");
+        abortUpdate();
+        OtaResumeStore::clear(LittleFS);
+        return false;
+    }
+    LOGF("[OTA] Download SHA-256: %s%s", hex, verify ? " (verified)" : "");
+
     return finishUpdate();
 }
 
@@ -341,8 +672,11 @@ size_t OTAManager::getTotalSize() const {
 }
 
 String OTAManager::getLastError() const {
-    if (Update.hasError()) {
-        return Update.errorString();
+    if (otaError) {
+        return otaError;
+    }
+    if (decoder.error()) {
+        return decoder.error();
     }
     return "";
 }
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include "OtaFlashWriter.h"
+#include "Logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t OTA_JOB_STOP = 0xFF;
+static const size_t OTA_WORKER_STACK = 3072;
+
+// Everything the pipeline needs, in one allocation for the life of an update
+struct OtaFlashWriter::Work {
+    uint8_t buffers[2][OTA_WRITE_BUFFER_SIZE];
+    StackType_t stack[OTA_WORKER_STACK / sizeof(StackType_t)];
+    StaticTask_t tcb;
+    StaticQueue_t jobQueue;
+    uint8_t jobItems[2 * sizeof(Job)];
+    StaticSemaphore_t freeBufferSem;
+    StaticSemaphore_t stoppedSem;
+    QueueHandle_t jobs;              // Full buffers (and STOP) for the worker
+    SemaphoreHandle_t freeBuffer;    // Given when the worker is done with a buffer
+    SemaphoreHandle_t stopped;
+};
+
+OtaFlashWriter::OtaFlashWriter()
+    : partition(nullptr),
+      work(nullptr),
+      task(nullptr),
+      filling(0),
+      fillLen(0),
+      writePos(0),
+      submittedEnd(0),
+      erasedTo(0),
+      error(ESP_OK) {
+}
+
+OtaFlashWriter::~OtaFlashWriter() {
+    end();
+}
+
+bool OtaFlashWriter::begin(const esp_partition_t* target, uint32_t offset) {
+    end();
+    error = ESP_OK;
+    if (!target || offset % SPI_FLASH_SEC_SIZE != 0 || offset >= target->size) {
+        error = ESP_ERR_INVALID_ARG;
+        return false;
+    }
+
+    work = (Work*)malloc(sizeof(Work));
+    if (!work) {
+        LOG_ERRORF("[OTA] Not enough memory for flash write buffers (%u bytes)", (unsigned)sizeof(Work));
+        error = ESP_ERR_NO_MEM;
+        return false;
+    }
+    work->jobs = xQueueCreateStatic(2, sizeof(Job), work->jobItems, &work->jobQueue);
+    // Buffer 0 starts filling; buffer 1 is free
+    work->freeBuffer = xSemaphoreCreateCountingStatic(1, 1, &work->freeBufferSem);
+    work->stopped = xSemaphoreCreateBinaryStatic(&work->stoppedSem);
+
+    partition = target;
+    filling = 0;
+    fillLen = 0;
+    writePos = offset;
+    submittedEnd = offset;
+    erasedTo = offset;
+
+    // Core 0 with the network stack: the loop task on core 1 keeps receiving
+    task = xTaskCreateStaticPinnedToCore(
+        workerTask, "ota-flash",
+        sizeof(work->stack) / sizeof(StackType_t),
+        this, 1, work->stack, &work->tcb, 0);
+    if (!task) {
+        LOG_ERROR("[OTA] Failed to create flash write task");
+        free(work);
+        work = nullptr;
+        error = ESP_FAIL;
+        return false;
+    }
+    return true;
+}
+
+bool OtaFlashWriter::write(const uint8_t* data, size_t len) {
+    if (!work || error != ESP_OK) {
+        return false;
+    }
+    if (writePos + len > partition->size) {
+        error = ESP_ERR_INVALID_SIZE;
+        return false;
+    }
+    while (len > 0) {
+        size_t take = OTA_WRITE_BUFFER_SIZE - fillLen;
+        if (take > len) take = len;
+        memcpy(work->buffers[filling] + fillLen, data, take);
+        fillLen += take;
+        writePos += take;
+        data += take;
+        len -= take;
+        if (fillLen == OTA_WRITE_BUFFER_SIZE && !submit()) {
+            return false;
+        }
+    }
+    return error == ESP_OK;
+}
+
+// Hand the filling buffer to the worker and switch to the other one, waiting
+// only if the worker is still programming it
+bool OtaFlashWriter::submit() {
+    Job job = { filling, (uint32_t)(writePos - fillLen), (uint32_t)fillLen };
+    submittedEnd = writePos;
+    xQueueSend(work->jobs, &job, portMAX_DELAY);
+    xSemaphoreTake(work->freeBuffer, portMAX_DELAY);
+    filling ^= 1;
+    fillLen = 0;
+    return error == ESP_OK;
+}
+
+// Both buffers are free once the worker has finished the last job
+bool OtaFlashWriter::waitIdle() {
+    xSemaphoreTake(work->freeBuffer, portMAX_DELAY);
+    xSemaphoreGive(work->freeBuffer);
+    return error == ESP_OK;
+}
+
+bool OtaFlashWriter::flush() {
+    if (!work) {
+        return false;
+    }
+    if (fillLen > 0 && !submit()) {
+        return false;
+    }
+    return waitIdle();
+}
+
+void OtaFlashWriter::end() {
+    if (!work) {
+        return;
+    }
+    Job stop = { OTA_JOB_STOP, 0, 0 };
+    xQueueSend(work->jobs, &stop, portMAX_DELAY);
+    xSemaphoreTake(work->stopped, portMAX_DELAY);
+    // Its stack and TCB are in `work`: only delete it once it is parked
+    while (eTaskGetState(task) != eSuspended) {
+        vTaskDelay(1);
+    }
+    vTaskDelete(task);
+    task = nullptr;
+    free(work);
+    work = nullptr;
+    fillLen = 0;
+}
+
+// ============================================================================
+// Worker task
+// ============================================================================
+
+void OtaFlashWriter::workerTask(void* arg) {
+    static_cast<OtaFlashWriter*>(arg)->runWorker();
+}
+
+bool OtaFlashWriter::eraseNextSector() {
+    esp_err_t err = esp_partition_erase_range(partition, erasedTo, SPI_FLASH_SEC_SIZE);
+    if (err != ESP_OK) {
+        error = err;
+        return false;
+    }
+    erasedTo += SPI_FLASH_SEC_SIZE;
+    return true;
+}
+
+void OtaFlashWriter::runWorker() {
+    Job job;
+    for (;;) {
+        // Erase ahead of the write pointer while no buffer is waiting; a
+        // queued buffer is picked up between sector erases
+        bool eraseAhead = error == ESP_OK && erasedTo < partition->size &&
+                          erasedTo < submittedEnd + OTA_ERASE_AHEAD;
+        if (xQueueReceive(work->jobs, &job, eraseAhead ? 0 : portMAX_DELAY) != pdTRUE) {
+            eraseNextSector();
+            continue;
+        }
+        if (job.buffer == OTA_JOB_STOP) {
+            break;
+        }
+
+        // Catch up if the buffers outran the erase
+        while (erasedTo < job.offset + job.length && eraseNextSector()) {
+        }
+        if (error == ESP_OK) {
+            esp_err_t err = esp_partition_write(partition, job.offset, work->buffers[job.buffer], job.length);
+            if (err != ESP_OK) {
+                error = err;
+            }
+        }
+        xSemaphoreGive(work->freeBuffer);
+    }
+
+    // end() deletes the task once it has seen this
+    xSemaphoreGive(work->stopped);
+    vTaskSuspend(nullptr);
+}
@@ -0,0 +1,544 @@
+#include "OtaImage.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TEST
+#include "MockCRC.h"
+#else
+#include <esp_rom_crc.h>
+#endif
+
+namespace {
+const uint8_t DELTA_MAGIC[4] = { 'C', 'P', 'D', '1' };
+
+const uint8_t GZIP_FHCRC    = 0x02;
+const uint8_t GZIP_FEXTRA   = 0x04;
+const uint8_t GZIP_FNAME    = 0x08;
+const uint8_t GZIP_FCOMMENT = 0x10;
+const uint8_t GZIP_RESERVED = 0xE0;
+
+uint32_t readLe32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Append up to `want - have` bytes from the stream into a fixed field. True
+// once the field is complete.
+bool collectField(uint8_t* field, size_t& have, size_t want, const uint8_t*& data, size_t& len) {
+    size_t take = want - have;
+    if (take > len) take = len;
+    memcpy(field + have, data, take);
+    have += take;
+    data += take;
+    len -= take;
+    return have == want;
+}
+
+// Collect the first bytes of a stream until its format is known. False when
+// the bytes cannot start any supported format.
+bool collectFormatSniff(uint8_t* stash, size_t& stashLen, const uint8_t*& data, size_t& len,
+                        OtaImageFormat& format) {
+    while (len > 0 && stashLen < 4 && format == OtaImageFormat::Unknown) {
+        stash[stashLen++] = *data++;
+        len--;
+        format = detectOtaImageFormat(stash, stashLen);
+    }
+    if (format != OtaImageFormat::Unknown) {
+        return true;
+    }
+    // Still a possible start of a gzip header or delta magic?
+    return (stashLen == 1 && stash[0] == 0x1F) ||
+           (stashLen < 4 && memcmp(stash, DELTA_MAGIC, stashLen) == 0);
+}
+}
+
+const char* otaImageFormatName(OtaImageFormat format) {
+    switch (format) {
+        case OtaImageFormat::Raw:   return "raw";
+        case OtaImageFormat::Gzip:  return "gzip";
+        case OtaImageFormat::Delta: return "delta";
+        default:                    return "unknown";
+    }
+}
+
+OtaImageFormat detectOtaImageFormat(const uint8_t* data, size_t len) {
+    if (len >= 1 && data[0] == 0xE9) {
+        return OtaImageFormat::Raw;
+    }
+    if (len >= 2 && data[0] == 0x1F && data[1] == 0x8B) {
+        return OtaImageFormat::Gzip;
+    }
+    if (len >= 4 && memcmp(data, DELTA_MAGIC, 4) == 0) {
+        return OtaImageFormat::Delta;
+    }
+    return OtaImageFormat::Unknown;
+}
+
+// ============================================================================
+// DeltaPatchApplier
+// ============================================================================
+
+DeltaPatchApplier::DeltaPatchApplier() {
+    begin(nullptr, nullptr, nullptr, nullptr);
+}
+
+void DeltaPatchApplier::begin(OtaSourceReader source, void* sourceCtx, OtaImageSink sink, void* sinkCtx) {
+    this->source = source;
+    this->sourceCtx = sourceCtx;
+    this->sink = sink;
+    this->sinkCtx = sinkCtx;
+    state = State::Header;
+    fieldLen = 0;
+    sourceLen = 0;
+    target = 0;
+    targetCrc = 0;
+    produced = 0;
+    crc = 0;
+    sourcePos = 0;
+    diffLeft = 0;
+    extraLeft = 0;
+    seek = 0;
+    errorText = nullptr;
+}
+
+bool DeltaPatchApplier::fail(const char* reason) {
+    state = State::Failed;
+    if (!errorText) {
+        errorText = reason;
+    }
+    return false;
+}
+
+bool DeltaPatchApplier::emit(const uint8_t* data, size_t len) {
+    crc = esp_rom_crc32_le(crc, data, (uint32_t)len);
+    produced += (uint32_t)len;
+    if (!sink(sinkCtx, data, len)) {
+        return fail("Image write failed");
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::verifySource() {
+    uint32_t sum = 0;
+    for (uint32_t offset = 0; offset < sourceLen; ) {
+        size_t n = sourceLen - offset;
+        if (n > sizeof(scratch)) n = sizeof(scratch);
+        if (!source(sourceCtx, offset, scratch, n)) {
+            return fail("Cannot read running firmware");
+        }
+        sum = esp_rom_crc32_le(sum, scratch, (uint32_t)n);
+        offset += (uint32_t)n;
+    }
+    if (sum != readLe32(field + 8)) {
+        return fail("Delta was built for a different firmware");
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::onHeader() {
+    if (memcmp(field, DELTA_MAGIC, 4) != 0) {
+        return fail("Not a delta patch");
+    }
+    sourceLen = readLe32(field + 4);
+    target = readLe32(field + 12);
+    targetCrc = readLe32(field + 16);
+    if (target == 0) {
+        return fail("Empty delta target");
+    }
+    if (!source || !verifySource()) {
+        return fail("Cannot read running firmware");
+    }
+    state = State::Record;
+    fieldLen = 0;
+    return true;
+}
+
+bool DeltaPatchApplier::onRecord() {
+    diffLeft = readLe32(field);
+    extraLeft = readLe32(field + 4);
+    seek = (int32_t)readLe32(field + 8);
+    fieldLen = 0;
+    if ((uint64_t)produced + diffLeft + extraLeft > target) {
+        return fail("Delta writes past the target size");
+    }
+    if ((uint64_t)sourcePos + diffLeft > sourceLen) {
+        return fail("Delta reads past the source image");
+    }
+    if (diffLeft > 0) {
+        state = State::Diff;
+    } else if (extraLeft > 0) {
+        state = State::Extra;
+    } else {
+        return endRecord();
+    }
+    return true;
+}
+
+bool DeltaPatchApplier::endRecord() {
+    int64_t next = (int64_t)sourcePos + seek;
+    if (next < 0 || next > (int64_t)sourceLen) {
+        return fail("Delta seeks outside the source image");
+    }
+    sourcePos = (uint32_t)next;
+    if (produced < target) {
+        state = State::Record;
+        return true;
+    }
+    if (crc != targetCrc) {
+        return fail("Delta output CRC mismatch");
+    }
+    state = State::Done;
+    return true;
+}
+
+bool DeltaPatchApplier::feed(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        switch (state) {
+            case State::Header:
+                if (collectField(field, fieldLen, HEADER_BYTES, data, len) && !onHeader()) {
+                    return false;
+                }
+                break;
+
+            case State::Record:
+                if (collectField(field, fieldLen, RECORD_BYTES, data, len) && !onRecord()) {
+                    return false;
+                }
+                break;
+
+            case State::Diff: {
+                size_t n = diffLeft;
+                if (n > len) n = len;
+                if (n > sizeof(scratch)) n = sizeof(scratch);
+                if (!source(sourceCtx, sourcePos, scratch, n)) {
+                    return fail("Cannot read running firmware");
+                }
+                for (size_t i = 0; i < n; i++) {
+                    scratch[i] = (uint8_t)(scratch[i] + data[i]);
+                }
+                if (!emit(scratch, n)) {
+                    return false;
+                }
+                data += n;
+                len -= n;
+                sourcePos += (uint32_t)n;
+                diffLeft -= (uint32_t)n;
+                if (diffLeft == 0) {
+                    if (extraLeft > 0) {
+                        state = State::Extra;
+                    } else if (!endRecord()) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            case State::Extra: {
+                size_t n = extraLeft;
+                if (n > len) n = len;
+                if (!emit(data, n)) {
+                    return false;
+                }
+                data += n;
+                len -= n;
+                extraLeft -= (uint32_t)n;
+                if (extraLeft == 0 && !endRecord()) {
+                    return false;
+                }
+                break;
+            }
+
+            case State::Done:
+                return fail("Unexpected data after delta patch");
+
+            case State::Failed:
+                return false;
+        }
+    }
+    return state != State::Failed;
+}
+
+// ============================================================================
+// OtaImageDecoder
+// ============================================================================
+
+OtaImageDecoder::OtaImageDecoder() : inflate(nullptr) {
+    begin(nullptr, nullptr, nullptr, nullptr);
+}
+
+OtaImageDecoder::~OtaImageDecoder() {
+    end();
+}
+
+void OtaImageDecoder::begin(OtaImageSink sink, void* sinkCtx, OtaSourceReader source, void* sourceCtx) {
+    end();
+    this->sink = sink;
+    this->sinkCtx = sinkCtx;
+    this->source = source;
+    this->sourceCtx = sourceCtx;
+    transfer = OtaImageFormat::Unknown;
+    payload = OtaImageFormat::Unknown;
+    transferSniffLen = 0;
+    payloadSniffLen = 0;
+    imageLen = 0;
+    errorText = nullptr;
+    gz = GzipState::Header;
+    gzFieldLen = 0;
+    gzFlags = 0;
+    gzSkip = 0;
+    gzCrc = 0;
+    gzSize = 0;
+    windowPos = 0;
+}
+
+void OtaImageDecoder::resumeRaw(uint32_t bytes) {
+    transfer = OtaImageFormat::Raw;
+    payload = OtaImageFormat::Raw;
+    imageLen = bytes;
+}
+
+void OtaImageDecoder::end() {
+    if (inflate) {
+        free(inflate);
+        inflate = nullptr;
+    }
+}
+
+bool OtaImageDecoder::fail(const char* reason) {
+    if (!errorText) {
+        errorText = reason;
+    }
+    end();
+    return false;
+}
+
+bool OtaImageDecoder::write(const uint8_t* data, size_t len) {
+    if (errorText) {
+        return false;
+    }
+    if (transfer == OtaImageFormat::Unknown) {
+        if (!collectFormatSniff(transferSniff, transferSniffLen, data, len, transfer)) {
+            return fail("Not a firmware image, gzip or delta file");
+        }
+        if (transfer == OtaImageFormat::Unknown) {
+            return true;
+        }
+        if (!writeTransfer(transferSniff, transferSniffLen)) {
+            return false;
+        }
+    }
+    return len == 0 || writeTransfer(data, len);
+}
+
+bool OtaImageDecoder::writeTransfer(const uint8_t* data, size_t len) {
+    if (transfer == OtaImageFormat::Gzip) {
+        return feedGzip(data, len);
+    }
+    return writePayload(data, len);
+}
+
+bool OtaImageDecoder::writePayload(const uint8_t* data, size_t len) {
+    if (payload == OtaImageFormat::Unknown) {
+        if (!collectFormatSniff(payloadSniff, payloadSniffLen, data, len, payload)) {
+            return fail("Compressed file is not a firmware image or delta");
+        }
+        if (payload == OtaImageFormat::Unknown) {
+            return true;
+        }
+        if (payload == OtaImageFormat::Gzip) {
+            return fail("Nested gzip is not supported");
+        }
+        if (payload == OtaImageFormat::Delta) {
+            delta.begin(source, sourceCtx, deltaSink, this);
+        }
+        if (!writePayload(payloadSniff, payloadSniffLen)) {
+            return false;
+        }
+    }
+    if (len == 0) {
+        return true;
+    }
+    if (payload == OtaImageFormat::Delta) {
+        return delta.feed(data, len) || fail(delta.error());
+    }
+    return writeImage(data, len);
+}
+
+bool OtaImageDecoder::writeImage(const uint8_t* data, size_t len) {
+    imageLen += (uint32_t)len;
+    if (!sink(sinkCtx, data, len)) {
+        return fail("Image write failed");
+    }
+    return true;
+}
+
+bool OtaImageDecoder::deltaSink(void* ctx, const uint8_t* data, size_t len) {
+    return static_cast<OtaImageDecoder*>(ctx)->writeImage(data, len);
+}
+
+// ----------------------------------------------------------------------------
+// Gzip (RFC 1952): header fields are parsed here, the deflate body goes
+// through tinfl with a wrapping 32 KB window, the trailer is checked against
+// the CRC32 and length of what was inflated.
+// ----------------------------------------------------------------------------
+
+void OtaImageDecoder::nextHeaderField() {
+    gzFieldLen = 0;
+    if (gz < GzipState::ExtraLen && (gzFlags & GZIP_FEXTRA)) {
+        gz = GzipState::ExtraLen;
+    } else if (gz < GzipState::Name && (gzFlags & GZIP_FNAME)) {
+        gz = GzipState::Name;
+    } else if (gz < GzipState::Comment && (gzFlags & GZIP_FCOMMENT)) {
+        gz = GzipState::Comment;
+    } else if (gz < GzipState::HeaderCrc && (gzFlags & GZIP_FHCRC)) {
+        gz = GzipState::HeaderCrc;
+        gzSkip = 2;
+    } else {
+        gz = GzipState::Body;
+    }
+}
+
+bool OtaImageDecoder::feedGzip(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        switch (gz) {
+            case GzipState::Header:
+                if (!collectField(gzField, gzFieldLen, 10, data, len)) {
+                    break;
+                }
+                gzFlags = gzField[3];
+                if (gzField[2] != 8 || (gzFlags & GZIP_RESERVED)) {
+                    return fail("Unsupported gzip header");
+                }
+                nextHeaderField();
+                break;
+
+            case GzipState::ExtraLen:
+                if (collectField(gzField, gzFieldLen, 2, data, len)) {
+                    gzSkip = (uint16_t)(gzField[0] | (gzField[1] << 8));
+                    gz = GzipState::Extra;
+                }
+                break;
+
+            case GzipState::Extra:
+            case GzipState::HeaderCrc: {
+                size_t n = gzSkip < len ? gzSkip : len;
+                data += n;
+                len -= n;
+                gzSkip -= (uint16_t)n;
+                if (gzSkip == 0) {
+                    nextHeaderField();
+                }
+                break;
+            }
+
+            case GzipState::Name:
+            case GzipState::Comment: {
+                const uint8_t* nul = (const uint8_t*)memchr(data, 0, len);
+                size_t n = nul ? (size_t)(nul - data) + 1 : len;
+                data += n;
+                len -= n;
+                if (nul) {
+                    nextHeaderField();
+                }
+                break;
+            }
+
+            case GzipState::Body:
+                if (!inflate) {
+                    inflate = (Inflate*)malloc(sizeof(Inflate));
+                    if (!inflate) {
+                        return fail("Not enough memory to decompress");
+                    }
+                    tinfl_init(&inflate->tinfl);
+                    windowPos = 0;
+                }
+                if (!inflateBody(data, len)) {
+                    return false;
+                }
+                break;
+
+            case GzipState::Trailer:
+                return feedTrailer(data, len);
+
+            case GzipState::Done:
+                return fail("Unexpected data after gzip stream");
+        }
+    }
+    return true;
+}
+
+bool OtaImageDecoder::inflateBody(const uint8_t*& data, size_t& len) {
+    for (;;) {
+        size_t inBytes = len;
+        size_t outBytes = TINFL_LZ_DICT_SIZE - windowPos;
+        tinfl_status status = tinfl_decompress(&inflate->tinfl, data, &inBytes,
+                                               inflate->window, inflate->window + windowPos,
+                                               &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+        data += inBytes;
+        len -= inBytes;
+
+        if (outBytes > 0) {
+            const uint8_t* out = inflate->window + windowPos;
+            gzCrc = esp_rom_crc32_le(gzCrc, out, (uint32_t)outBytes);
+            gzSize += (uint32_t)outBytes;
+            windowPos = (windowPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+            if (!writePayload(out, outBytes)) {
+                return false;
+            }
+        }
+
+        if (status == TINFL_STATUS_DONE) {
+            // tinfl may have pulled trailer bytes into its bit buffer; hand the
+            // whole bytes back, after dropping the bits that padded the block
+            uint32_t bits = inflate->tinfl.m_num_bits;
+            uint64_t bitBuf = (uint64_t)inflate->tinfl.m_bit_buf >> (bits & 7);
+            bits &= ~7u;
+            end();
+            gz = GzipState::Trailer;
+            gzFieldLen = 0;
+            for (; bits >= 8; bits -= 8, bitBuf >>= 8) {
+                uint8_t b = (uint8_t)bitBuf;
+                if (!feedTrailer(&b, 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            return true;
+        }
+        if (status != TINFL_STATUS_HAS_MORE_OUTPUT) {
+            return fail("Corrupt gzip data");
+        }
+    }
+}
+
+bool OtaImageDecoder::feedTrailer(const uint8_t* data, size_t len) {
+    if (gz == GzipState::Done) {
+        return len == 0 || fail("Unexpected data after gzip stream");
+    }
+    if (!collectField(gzField, gzFieldLen, 8, data, len)) {
+        return true;
+    }
+    if (readLe32(gzField) != gzCrc || readLe32(gzField + 4) != gzSize) {
+        return fail("Gzip CRC or length mismatch");
+    }
+    gz = GzipState::Done;
+    return len == 0 || fail("Unexpected data after gzip stream");
+}
+
+bool OtaImageDecoder::finish() {
+    if (errorText) {
+        return false;
+    }
+    if (transfer == OtaImageFormat::Unknown || payload == OtaImageFormat::Unknown) {
+        return fail("Firmware file is truncated");
+    }
+    if (transfer == OtaImageFormat::Gzip && gz != GzipState::Done) {
+        return fail("Gzip stream is truncated");
+    }
+    if (payload == OtaImageFormat::Delta && !delta.isComplete()) {
+        return fail(delta.error() ? delta.error() : "Delta patch is truncated");
+    }
+    end();
+    return true;
+}
@@ -0,0 +1,192 @@
+#include "OtaResume.h"
+#include "Logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef UNIT_TEST
+#include "MockCRC.h"
+#else
+#include <esp_rom_crc.h>
+#endif
+
+namespace {
+int otaHexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Unsigned decimal up to the next non-digit; false if there is none
+bool parseUint32(const char*& p, uint32_t& out) {
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    char* end = nullptr;
+    unsigned long v = strtoul(p, &end, 10);
+    p = end;
+    out = (uint32_t)v;
+    return true;
+}
+
+// Copy the next '|'-separated field; returns the start of the following one
+const char* nextResumeField(const char* p, char* out, size_t outLen) {
+    const char* bar = strchr(p, '|');
+    size_t len = bar ? (size_t)(bar - p) : strlen(p);
+    if (len >= outLen) {
+        return nullptr;
+    }
+    memcpy(out, p, len);
+    out[len] = '\0';
+    return bar ? bar + 1 : p + len;
+}
+}
+
+const char* const OtaResumeStore::PATH = "/.ota_resume";
+
+uint32_t otaUrlCrc(const char* url) {
+    return esp_rom_crc32_le(0, (const uint8_t*)url, (uint32_t)strlen(url));
+}
+
+bool parseContentRange(const char* header, uint32_t& start, uint32_t& end, uint32_t& total) {
+    const char* p = header;
+    while (*p == ' ') p++;
+    if (strncmp(p, "bytes ", 6) != 0) {
+        return false;
+    }
+    p += 6;
+    if (!parseUint32(p, start) || *p++ != '-' || !parseUint32(p, end) || *p++ != '/' ||
+        !parseUint32(p, total)) {
+        return false;
+    }
+    return start <= end && end < total;
+}
+
+bool parseSha256Hex(const char* hex, uint8_t out[32]) {
+    while (*hex == ' ') hex++;
+    for (size_t i = 0; i < 32; i++) {
+        int hi = otaHexValue(hex[i * 2]);
+        int lo = hi < 0 ? -1 : otaHexValue(hex[i * 2 + 1]);
+        if (lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+    for (const char* p = hex + 64; *p; p++) {
+        if (*p != ' ' && *p != '\r' && *p != '\n') {
+            return false;
+        }
+    }
+    return true;
+}
+
+void sha256ToHex(const uint8_t digest[32], char out[65]) {
+    for (size_t i = 0; i < 32; i++) {
+        snprintf(out + i * 2, 3, "%02x", digest[i]);
+    }
+}
+
+// ============================================================================
+// OtaResumeStore
+// ============================================================================
+
+bool OtaResumeStore::formatLine(const OtaResumeState& state, char* out, size_t outLen) {
+    int n = snprintf(out, outLen, "R|%08lx|%s|%lu|%lu|", (unsigned long)state.urlCrc, state.partition,
+                     (unsigned long)state.totalSize, (unsigned long)state.offset);
+    for (size_t i = 0; i < 8 && n > 0 && n < (int)outLen; i++) {
+        n += snprintf(out + n, outLen - n, "%08lx", (unsigned long)state.shaState[i]);
+    }
+    if (n > 0 && n < (int)outLen) {
+        n += snprintf(out + n, outLen - n, "|%s", state.validator);
+    }
+    return n > 0 && n < (int)outLen;
+}
+
+bool OtaResumeStore::parseLine(const char* line, OtaResumeState& out) {
+    memset(&out, 0, sizeof(out));
+    if (strncmp(line, "R|", 2) != 0) {
+        return false;
+    }
+    char field[72];
+    const char* p = nextResumeField(line + 2, field, sizeof(field));
+    if (!p || strlen(field) != 8) {
+        return false;
+    }
+    out.urlCrc = (uint32_t)strtoul(field, nullptr, 16);
+    p = nextResumeField(p, out.partition, sizeof(out.partition));
+    if (!p || out.partition[0] == '\0' || !parseUint32(p, out.totalSize) || *p++ != '|' ||
+        !parseUint32(p, out.offset) || *p++ != '|') {
+        return false;
+    }
+    for (size_t i = 0; i < 8; i++) {
+        uint32_t word = 0;
+        for (size_t k = 0; k < 8; k++) {
+            int v = otaHexValue(*p++);
+            if (v < 0) {
+                return false;
+            }
+            word = (word << 4) | (uint32_t)v;
+        }
+        out.shaState[i] = word;
+    }
+    if (*p++ != '|' || strlen(p) >= sizeof(out.validator)) {
+        return false;
+    }
+    strcpy(out.validator, p);
+    // A checkpoint is only useful with a validator, on a SHA block boundary,
+    // inside the transfer
+    return out.validator[0] != '\0' && out.offset > 0 && out.offset % 64 == 0 &&
+           out.offset < out.totalSize;
+}
+
+bool OtaResumeStore::load(fs::FS &fs, OtaResumeState& out) {
+    if (!fs.exists(PATH)) {
+        return false;
+    }
+    fs::File file = fs.open(PATH, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    char line[224];
+    size_t len = file.read((uint8_t*)line, sizeof(line) - 1);
+    file.close();
+    line[len] = '\0';
+    char* eol = strpbrk(line, "\r\n");
+    if (eol) {
+        *eol = '\0';
+    }
+    return parseLine(line, out);
+}
+
+bool OtaResumeStore::save(fs::FS &fs, const OtaResumeState& state) {
+    char line[224];
+    if (!formatLine(state, line, sizeof(line))) {
+        return false;
+    }
+    String tempPath = String(PATH) + ".tmp";
+    fs::File file = fs.open(tempPath, FILE_WRITE);
+    if (!file) {
+        LOG_ERROR("[OTA] Failed to open resume checkpoint for writing");
+        return false;
+    }
+    bool written = file.println(line) > 0;
+    file.close();
+    if (!written) {
+        fs.remove(tempPath);
+        return false;
+    }
+    fs.remove(PATH);
+    if (!fs.rename(tempPath, PATH)) {
+        fs.remove(tempPath);
+        LOG_ERROR("[OTA] Failed to replace resume checkpoint");
+        return false;
+    }
+    return true;
+}
+
+void OtaResumeStore::clear(fs::FS &fs) {
+    if (fs.exists(PATH)) {
+        fs.remove(PATH);
+    }
+}
@@ -1,22 +1,55 @@
 #include "SDCardManager.h"
 #include "Logger.h"
 #include "pins_config.h"
+#include "TrafficMonitor.h"
+#include "DirScanner.h"
 #include <SD_MMC.h>
+#include <Preferences.h>
 #include <driver/gpio.h>
+#include <esp_task_wdt.h>
+#include <time.h>
 
 // Global config reference to check enableSdCmd0Reset
 #include "Config.h"
 extern Config config;
 
+// NVS namespace for calibrated bus profiles: "last" = id of the last mounted
+// card, "p<id hex>" = that card's profile record (see SdBusProfile.h)
+static const char* SD_PREFS_NAMESPACE = "cpap_sd";
+static const char* SD_PREFS_LAST_CARD = "last";
+// "hs<model hash>" = handover timing for that machine model (see SdHandover.h)
+
+// Identification.* is small; the model name sits in the first part of the file
+static const size_t SD_ID_READ_BYTES = 1536;
+// PCNT poll interval while waiting for the CPAP's first access after release
+static const uint32_t SD_RELEASE_POLL_MS = 5;
+
+// Calibration reads this many bytes of the reference file per pass
+static const uint32_t SD_CAL_READ_BYTES = 128 * 1024;
+static const uint32_t SD_CAL_MIN_FILE_BYTES = 64 * 1024;
+static const uint8_t  SD_CAL_PASSES = 2;
+static const size_t   SD_CAL_BUF_SIZE = 4096;
+
 SDCardManager::SDCardManager() : 
     initialized(false), 
     espHasControl(false),
-    controlAcquiredAt(0) {
+    controlAcquiredAt(0),
+    activeProfile{4, SD_BUS_FREQ_DEFAULT_KHZ, 0, 0},
+    cardId(0),
+    trafficMonitor(nullptr),
+    modelKey(0),
+    handoverStats{0, 0, 0, 0},
+    savedHandoverStats{0, 0, 0, 0},
+    lastAcquireMs(0),
+    metaCache(SD_MOUNT_POINT) {
+    machineModel[0] = '\0';
 }
 
 void SDCardManager::setControlPin(bool espControl) {
     digitalWrite(SD_SWITCH_PIN, espControl ? SD_SWITCH_ESP_VALUE : SD_SWITCH_CPAP_VALUE);
-    delay(300);  // Wait for MUX switch to settle and CPAP to reinitialize after returning control
+    // Only the MUX itself needs a fixed settle; card readiness (acquire) and
+    // the CPAP's re-access (release) are polled by the callers.
+    delay(SD_MUX_SETTLE_MS);
 }
 
 bool SDCardManager::begin() {
@@ -44,14 +77,12 @@ bool SDCardManager::takeControl() {
     // Activity detection is handled by TrafficMonitor + FSM BEFORE this call.
     // By the time takeControl() is called, the FSM has already confirmed bus silence.
 
-    // Take control of SD card
+    // Take control of SD card. No fixed stabilisation delay: the mount below
+    // is retried until the card finishes its internal initialisation.
+    unsigned long switchedAt = millis();
     setControlPin(true);
     espHasControl = true;
 
-    // Wait for SD card to stabilize after control switch
-    // SD cards need time to stabilize voltage and complete internal initialization
-    delay(500);
-
     // ── POWER: Reduce GPIO drive strength on SD pins before mount ──
     // Reducing drive from default ~20mA (CAP_2) to ~5mA (CAP_0) slows
     // edge rates, reducing di/dt current spikes on the 3.3V rail.
@@ -62,26 +93,57 @@ bool SDCardManager::takeControl() {
     gpio_set_drive_capability((gpio_num_t)SD_D2_PIN, GPIO_DRIVE_CAP_0);
     gpio_set_drive_capability((gpio_num_t)SD_D3_PIN, GPIO_DRIVE_CAP_0);
 
-    // Mount SD in 1-bit or 4-bit mode based on config.
-    // 4-bit is default and safer for CPAP handoff.
-    // 1-bit uses less ESP-side bus current but requires a compatibility remount on release.
-    bool use1Bit = config.getEnable1BitSdMode();
-    if (!SD_MMC.begin("/sdcard", use1Bit ? SDIO_BIT_MODE_SLOW : SDIO_BIT_MODE_FAST, false, SDMMC_FREQ_DEFAULT, 2)) {
+    // Mount with the calibrated profile of the card seen last time (usually
+    // the same card), falling back to the configured default width at 20 MHz.
+    // 4-bit is default and safer for CPAP handoff; 1-bit (ENABLE_1BIT_SD_MODE)
+    // uses less ESP-side bus current but requires a compatibility remount on release.
+    bool autotune = config.getSdBusAutotune();
+    SdBusProfile target = defaultProfile();
+    uint32_t lastId = 0;
+    if (autotune) {
+        lastId = loadLastCardId();
+        if (lastId != 0) {
+            loadProfile(lastId, target);
+        }
+    }
+
+    activeProfile = defaultProfile();
+    if (!mountWithFallback(target, lastId)) {
         LOG("SD card mount failed");
         releaseControl();
         return false;
     }
 
-    uint8_t cardType = SD_MMC.cardType();
-    if (cardType == CARD_NONE) {
-        LOG("No SD card attached");
-        releaseControl();
-        return false;
+    cardId = computeCardId();
+    if (autotune && cardId != lastId) {
+        // A different card: its own profile (or the default) applies
+        saveLastCardId(cardId);
+        SdBusProfile own = defaultProfile();
+        loadProfile(cardId, own);
+        if (!sdBusProfileEquals(own, activeProfile)) {
+            SD_MMC.end();
+            if (!mountWithFallback(own, cardId)) {
+                LOG("SD card mount failed");
+                releaseControl();
+                return false;
+            }
+        }
+    }
+
+    if (activeProfile.width != 4 || activeProfile.freqKhz != SD_BUS_FREQ_DEFAULT_KHZ) {
+        LOGF("[SD] Bus profile: %u-bit @ %lu kHz (card %08lx)",
+             (unsigned)activeProfile.width, (unsigned long)activeProfile.freqKhz,
+             (unsigned long)cardId);
     }
 
-    LOG("SD card mounted successfully");
     initialized = true;
     controlAcquiredAt = millis();
+    lastAcquireMs = controlAcquiredAt - switchedAt;
+
+    identifyMachineModel();
+    sdHandoverRecordAcquire(handoverStats, lastAcquireMs);
+
+    LOGF("SD card mounted successfully (%lu ms after MUX switch)", (unsigned long)lastAcquireMs);
     return true;
 }
 
@@ -96,6 +158,11 @@ void SDCardManager::releaseControl() {
     SD_MMC.end();
     initialized = false;
 
+    // The CPAP may change any file once it has the card back
+    LOG_DEBUGF("[SD] Metadata cache: %lu hits, %lu misses",
+               (unsigned long)metaCache.getHits(), (unsigned long)metaCache.getMisses());
+    metaCache.clear();
+
     gpio_set_drive_capability((gpio_num_t)SD_CMD_PIN, GPIO_DRIVE_CAP_2);
     gpio_set_drive_capability((gpio_num_t)SD_CLK_PIN, GPIO_DRIVE_CAP_2);
     gpio_set_drive_capability((gpio_num_t)SD_D0_PIN, GPIO_DRIVE_CAP_2);
@@ -105,19 +172,441 @@ void SDCardManager::releaseControl() {
 
     // If we mounted in 1-bit mode, do a brief 4-bit compatibility remount
     // so the card's negotiated bus width is restored to 4-bit before the CPAP takes over.
-    if (config.getEnable1BitSdMode()) {
-        if (SD_MMC.begin("/sdcard", SDIO_BIT_MODE_FAST, false, SDMMC_FREQ_DEFAULT, 2)) {
+    // Same for a high-speed profile: leave the card in default-speed mode.
+    if (activeProfile.width == 1 || activeProfile.freqKhz > SD_BUS_FREQ_DEFAULT_KHZ) {
+        if (SD_MMC.begin(SD_MOUNT_POINT, SDIO_BIT_MODE_FAST, false, SDMMC_FREQ_DEFAULT, 2)) {
             SD_MMC.end();
         } else {
             LOG_WARN("SD handoff compatibility remount failed");
         }
     }
 
+    // Baseline the host-side edge counter before switching so the CPAP's
+    // first access after handback is not missed during the MUX settle
+    int hostBaseline = trafficMonitor ? trafficMonitor->peekRawCount() : -1;
+    unsigned long switchedAt = millis();
     setControlPin(false);
     espHasControl = false;
+    waitForHostAfterRelease(hostBaseline, switchedAt);
     LOG("SD card control released to CPAP machine");
 }
 
+// ============================================================================
+// Handover readiness
+// ============================================================================
+
+// Retry the mount until the card answers. Each attempt runs the full SD init
+// sequence, which itself polls ACMD41 until the card reports ready, so a card
+// still busy after the MUX switch just costs one more short retry instead of
+// a fixed worst-case delay on every handover.
+bool SDCardManager::mountWhenReady(const SdBusProfile& profile) {
+    unsigned long start = millis();
+    uint8_t attempts = 0;
+    while (true) {
+        attempts++;
+        if (mountWithProfile(profile)) {
+            if (attempts > 1) {
+                LOG_DEBUGF("[SD] Card ready after %u mount attempts (%lu ms)",
+                           (unsigned)attempts, (unsigned long)(millis() - start));
+            }
+            return true;
+        }
+        SD_MMC.end();
+        if (millis() - start + SD_ACQUIRE_RETRY_MS >= SD_ACQUIRE_READY_TIMEOUT_MS) {
+            return false;
+        }
+        delay(SD_ACQUIRE_RETRY_MS);
+    }
+}
+
+// Hold until the CPAP accesses the card again (first edges on CS_SENSE) or
+// the learned bound for this machine model expires. Without PCNT (suspended
+// in IDLE) the host cannot be observed, so the bound is simply waited out.
+void SDCardManager::waitForHostAfterRelease(int hostBaseline, unsigned long switchedAt) {
+    uint32_t bound = sdHandoverReleaseWaitMs(handoverStats);
+
+    if (hostBaseline < 0) {
+        uint32_t elapsed = millis() - switchedAt;
+        if (elapsed < bound) {
+            delay(bound - elapsed);
+        }
+        return;
+    }
+
+    bool seen = false;
+    uint32_t elapsed = millis() - switchedAt;
+    while (elapsed < bound) {
+        int count = trafficMonitor->peekRawCount();
+        if (count >= 0 && count != hostBaseline) {
+            seen = true;
+            break;
+        }
+        delay(SD_RELEASE_POLL_MS);
+        elapsed = millis() - switchedAt;
+    }
+
+    sdHandoverRecordRelease(handoverStats, seen, elapsed);
+    if (seen) {
+        LOG_DEBUGF("[SD] CPAP accessed card %lu ms after handback", (unsigned long)elapsed);
+    }
+    if (sdHandoverNeedsSave(savedHandoverStats, handoverStats)) {
+        saveHandoverStats();
+    }
+}
+
+// Read the machine model once per boot while the card is mounted and load
+// that model's handover timing from NVS
+void SDCardManager::identifyMachineModel() {
+    if (modelKey != 0) {
+        return;
+    }
+
+    strcpy(machineModel, "unknown");
+    char* buf = (char*)malloc(SD_ID_READ_BYTES + 1);
+    if (buf) {
+        const char* paths[] = { "/Identification.json", "/Identification.tgt" };
+        for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++) {
+            File f = SD_MMC.open(paths[i], FILE_READ);
+            if (!f) continue;
+            size_t n = f.read((uint8_t*)buf, SD_ID_READ_BYTES);
+            f.close();
+            buf[n] = '\0';
+            if (parseMachineModel(buf, machineModel, sizeof(machineModel))) {
+                break;
+            }
+        }
+        free(buf);
+    }
+
+    uint32_t h = 2166136261UL;  // FNV-1a
+    for (const char* p = machineModel; *p; p++) {
+        h ^= (uint8_t)*p;
+        h *= 16777619UL;
+    }
+    modelKey = h ? h : 1;
+
+    loadHandoverStats();
+    LOGF("[SD] Machine model: %s (handover: acquire ~%u ms, release wait %lu ms)",
+         machineModel, (unsigned)handoverStats.acquireMs,
+         (unsigned long)sdHandoverReleaseWaitMs(handoverStats));
+}
+
+void SDCardManager::loadHandoverStats() {
+    char key[12];
+    snprintf(key, sizeof(key), "hs%08lx", (unsigned long)modelKey);
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, true)) return;
+    String rec = prefs.getString(key, "");
+    prefs.end();
+
+    SdHandoverStats parsed;
+    if (parseSdHandoverStats(rec.c_str(), parsed)) {
+        handoverStats = parsed;
+        savedHandoverStats = parsed;
+    }
+}
+
+void SDCardManager::saveHandoverStats() {
+    if (modelKey == 0) {
+        return;
+    }
+    char key[12];
+    char rec[32];
+    snprintf(key, sizeof(key), "hs%08lx", (unsigned long)modelKey);
+    formatSdHandoverStats(handoverStats, rec, sizeof(rec));
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, false)) return;
+    if (prefs.putString(key, rec) > 0) {
+        savedHandoverStats = handoverStats;
+    }
+    prefs.end();
+}
+
 bool SDCardManager::hasControl() const { return espHasControl; }
 
 fs::FS& SDCardManager::getFS() { return SD_MMC; }
+
+// ============================================================================
+// Bus auto-tuning
+// ============================================================================
+
+SdBusProfile SDCardManager::defaultProfile() const {
+    SdBusProfile p = {};
+    p.width = config.getEnable1BitSdMode() ? 1 : 4;
+    p.freqKhz = SD_BUS_FREQ_DEFAULT_KHZ;
+    return p;
+}
+
+bool SDCardManager::mountWithProfile(const SdBusProfile& profile) {
+    bool use1Bit = profile.width == 1;
+    if (!SD_MMC.begin(SD_MOUNT_POINT, use1Bit ? SDIO_BIT_MODE_SLOW : SDIO_BIT_MODE_FAST, false,
+                      (int)profile.freqKhz, 2)) {
+        return false;
+    }
+    if (SD_MMC.cardType() == CARD_NONE) {
+        LOG("No SD card attached");
+        SD_MMC.end();
+        return false;
+    }
+    activeProfile = profile;
+    return true;
+}
+
+// Mount with a calibrated profile; if the card does not come up with it
+// within the readiness timeout the profile is dropped (the card will be
+// recalibrated) and the default profile is tried.
+bool SDCardManager::mountWithFallback(const SdBusProfile& preferred, uint32_t preferredCardId) {
+    if (mountWhenReady(preferred)) {
+        return true;
+    }
+    SdBusProfile fallback = defaultProfile();
+    if (sdBusProfileEquals(preferred, fallback)) {
+        return false;
+    }
+    LOG_WARNF("[SD] Mount at %u-bit @ %lu kHz failed — dropping profile, using default",
+              (unsigned)preferred.width, (unsigned long)preferred.freqKhz);
+    if (preferredCardId != 0) {
+        forgetProfile(preferredCardId);
+    }
+    SD_MMC.end();
+    return mountWithProfile(fallback);
+}
+
+// Card identity for the profile table. The Arduino SD_MMC wrapper does not
+// expose the CID register, so the identity is derived from the card type and
+// geometry; same-model cards share a profile, which every mount and periodic
+// revalidation still checks.
+uint32_t SDCardManager::computeCardId() {
+    uint64_t fields[3] = {
+        (uint64_t)SD_MMC.cardType(),
+        (uint64_t)SD_MMC.cardSize(),
+        (uint64_t)SD_MMC.totalBytes()
+    };
+    uint32_t h = 2166136261UL;  // FNV-1a
+    const uint8_t* p = (const uint8_t*)fields;
+    for (size_t i = 0; i < sizeof(fields); i++) {
+        h ^= p[i];
+        h *= 16777619UL;
+    }
+    return h ? h : 1;
+}
+
+bool SDCardManager::loadProfile(uint32_t id, SdBusProfile& out) {
+    char key[12];
+    snprintf(key, sizeof(key), "p%08lx", (unsigned long)id);
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, true)) return false;
+    String rec = prefs.getString(key, "");
+    prefs.end();
+
+    SdBusProfile parsed;
+    if (!parseSdBusProfile(rec.c_str(), parsed)) return false;
+    // ENABLE_1BIT_SD_MODE caps the width regardless of what was calibrated
+    if (config.getEnable1BitSdMode() && parsed.width != 1) return false;
+    out = parsed;
+    return true;
+}
+
+void SDCardManager::saveProfile(uint32_t id, const SdBusProfile& profile) {
+    char key[12];
+    char rec[48];
+    snprintf(key, sizeof(key), "p%08lx", (unsigned long)id);
+    formatSdBusProfile(profile, rec, sizeof(rec));
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, false)) {
+        LOG_WARN("[SD] Failed to open NVS for bus profile");
+        return;
+    }
+    prefs.putString(key, rec);
+    prefs.end();
+}
+
+void SDCardManager::forgetProfile(uint32_t id) {
+    char key[12];
+    snprintf(key, sizeof(key), "p%08lx", (unsigned long)id);
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, false)) return;
+    prefs.remove(key);
+    prefs.end();
+}
+
+uint32_t SDCardManager::loadLastCardId() {
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, true)) return 0;
+    uint32_t id = prefs.getUInt(SD_PREFS_LAST_CARD, 0);
+    prefs.end();
+    return id;
+}
+
+void SDCardManager::saveLastCardId(uint32_t id) {
+    Preferences prefs;
+    if (!prefs.begin(SD_PREFS_NAMESPACE, false)) return;
+    prefs.putUInt(SD_PREFS_LAST_CARD, id);
+    prefs.end();
+}
+
+// Remount with the candidate profile and read the reference file
+// SD_CAL_PASSES times. Any short read, open failure or checksum mismatch
+// against the first complete read (refChecksum, 0 = not yet known) is an error.
+bool SDCardManager::benchmarkProfile(const SdBusProfile& profile, const char* refPath,
+                                     uint32_t refBytes, uint32_t& refChecksum,
+                                     SdBusTrial& trial) {
+    memset(&trial, 0, sizeof(trial));
+    trial.profile = profile;
+
+    SD_MMC.end();
+    if (!mountWithProfile(profile)) {
+        return false;
+    }
+    trial.mounted = true;
+
+    uint8_t* buf = (uint8_t*)malloc(SD_CAL_BUF_SIZE);
+    if (!buf) {
+        trial.errors++;
+        return false;
+    }
+
+    for (uint8_t pass = 0; pass < SD_CAL_PASSES; pass++) {
+        trial.passes++;
+        File f = SD_MMC.open(refPath, FILE_READ);
+        if (!f) {
+            trial.errors++;
+            continue;
+        }
+
+        uint32_t sum = 2166136261UL;
+        uint32_t got = 0;
+        unsigned long t0 = millis();
+        while (got < refBytes) {
+            size_t want = refBytes - got < SD_CAL_BUF_SIZE ? refBytes - got : SD_CAL_BUF_SIZE;
+            size_t n = f.read(buf, want);
+            if (n == 0) break;
+            for (size_t i = 0; i < n; i++) {
+                sum ^= buf[i];
+                sum *= 16777619UL;
+            }
+            got += n;
+        }
+        trial.elapsedMs += millis() - t0;
+        trial.bytes += got;
+        f.close();
+        esp_task_wdt_reset();
+
+        if (got != refBytes) {
+            trial.errors++;
+        } else if (refChecksum == 0) {
+            refChecksum = sum ? sum : 1;
+        } else if ((sum ? sum : 1) != refChecksum) {
+            trial.errors++;
+        }
+    }
+
+    free(buf);
+    return trial.errors == 0;
+}
+
+bool SDCardManager::calibrateBusIfDue() {
+    if (!espHasControl || !initialized || cardId == 0 || !config.getSdBusAutotune()) {
+        return false;
+    }
+
+    SdBusProfile stored = {};
+    bool hasStored = loadProfile(cardId, stored);
+    time_t nowT = time(nullptr);
+    uint32_t now = nowT > 0 ? (uint32_t)nowT : 0;
+    if (!isSdBusCalibrationDue(hasStored, stored, now)) {
+        return false;
+    }
+
+    // Reference file: STR.edf is large and present on every ResMed card;
+    // otherwise the first big enough file in the root.
+    char refPath[40] = "/STR.edf";
+    uint32_t refSize = 0;
+    {
+        File f = SD_MMC.open(refPath, FILE_READ);
+        if (f) {
+            refSize = f.size();
+            f.close();
+        }
+        if (refSize < SD_CAL_MIN_FILE_BYTES) {
+            refSize = 0;
+            DirScanner root(SD_MOUNT_POINT);
+            if (root.open("/")) {
+                while (root.next()) {
+                    uint32_t size = 0;
+                    time_t mtime = 0;
+                    if (root.isFile() && root.stat(size, mtime) && size >= SD_CAL_MIN_FILE_BYTES &&
+                        strlen(root.name()) + 1 < sizeof(refPath)) {
+                        snprintf(refPath, sizeof(refPath), "/%s", root.name());
+                        refSize = size;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    if (refSize == 0) {
+        LOG_DEBUG("[SD] Bus calibration skipped: no reference file >= 64 KB");
+        return false;
+    }
+    uint32_t refBytes = refSize < SD_CAL_READ_BYTES ? refSize : SD_CAL_READ_BYTES;
+
+    LOGF("[SD] Calibrating bus for card %08lx (%s, %lu bytes x %u passes)",
+         (unsigned long)cardId, refPath, (unsigned long)refBytes, (unsigned)SD_CAL_PASSES);
+
+    // Candidates in ascending speed; default first so it sets the reference checksum
+    uint8_t width = config.getEnable1BitSdMode() ? 1 : 4;
+    SdBusTrial trials[3];
+    size_t trialCount = 0;
+    uint32_t refChecksum = 0;
+    const uint32_t freqs[] = { SD_BUS_FREQ_DEFAULT_KHZ, SD_BUS_FREQ_HIGHSPEED_KHZ };
+    for (size_t i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++) {
+        SdBusProfile candidate = { width, freqs[i], 0, 0 };
+        benchmarkProfile(candidate, refPath, refBytes, refChecksum, trials[trialCount]);
+        trialCount++;
+    }
+
+    int best = selectFastestStableSdBusTrial(trials, trialCount);
+
+    // 4-bit unreliable on this card/MUX: try 1-bit at default clock
+    if (best < 0 && width == 4) {
+        SdBusProfile candidate = { 1, SD_BUS_FREQ_DEFAULT_KHZ, 0, 0 };
+        uint32_t ownChecksum = 0;
+        if (benchmarkProfile(candidate, refPath, refBytes, ownChecksum, trials[trialCount])) {
+            best = (int)trialCount;
+        }
+        trialCount++;
+    }
+
+    for (size_t i = 0; i < trialCount; i++) {
+        const SdBusTrial& t = trials[i];
+        LOGF("[SD]   %u-bit @ %lu kHz: %s, %lu B/s, %u/%u passes with errors",
+             (unsigned)t.profile.width, (unsigned long)t.profile.freqKhz,
+             t.mounted ? "mounted" : "mount failed",
+             (unsigned long)(t.elapsedMs > 0 ? ((uint64_t)t.bytes * 1000ULL) / t.elapsedMs : 0),
+             (unsigned)t.errors, (unsigned)t.passes);
+    }
+
+    SdBusProfile chosen = defaultProfile();
+    if (best >= 0) {
+        const SdBusTrial& t = trials[best];
+        chosen = t.profile;
+        chosen.readBps = t.elapsedMs > 0 ? (uint32_t)(((uint64_t)t.bytes * 1000ULL) / t.elapsedMs) : 0;
+        chosen.validatedTs = now >= 1000000000UL ? now : 0;
+        saveProfile(cardId, chosen);
+        LOGF("[SD] Bus profile for card %08lx: %u-bit @ %lu kHz (%lu B/s)",
+             (unsigned long)cardId, (unsigned)chosen.width,
+             (unsigned long)chosen.freqKhz, (unsigned long)chosen.readBps);
+    } else {
+        // Nothing was stable — keep the default and retry at the next mount
+        forgetProfile(cardId);
+        LOG_WARN("[SD] Bus calibration found no stable profile — using default");
+    }
+
+    SD_MMC.end();
+    if (!mountWithFallback(chosen, cardId)) {
+        LOG_ERROR("[SD] Remount after bus calibration failed");
+        initialized = false;
+    }
+    return true;
+}
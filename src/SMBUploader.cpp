@@ -2,6 +2,10 @@
 #include "Logger.h"
 #include "NetworkRecovery.h"
 #include <esp_task_wdt.h>
+#include "FileFingerprint.h"
+#include "TarArchive.h"
+#include "HeapGovernor.h"
+#include "IoBufferPool.h"
 
 #ifdef ENABLE_SMB_UPLOAD
 
@@ -178,9 +182,27 @@ static struct smb2dir* smb2_opendir_ev(struct smb2_context* smb2,
     return (struct smb2dir*)cb.result;
 }
 
+static int smb2_unlink_ev(struct smb2_context* smb2, const char* path) {
+    struct smb2_async_cb_data cb = {0, 0, nullptr};
+    int rc = smb2_unlink_async(smb2, path, smb2_generic_cb, &cb);
+    if (rc < 0) return rc;
+    rc = smb2_run_event_loop(smb2, &cb);
+    if (rc < 0) return rc;
+    return cb.status;
+}
+
+static int smb2_rename_ev(struct smb2_context* smb2, const char* oldPath, const char* newPath) {
+    struct smb2_async_cb_data cb = {0, 0, nullptr};
+    int rc = smb2_rename_async(smb2, oldPath, newPath, smb2_generic_cb, &cb);
+    if (rc < 0) return rc;
+    rc = smb2_run_event_loop(smb2, &cb);
+    if (rc < 0) return rc;
+    return cb.status;
+}
+
 // Note: smb2_readdir() and smb2_closedir() never block — no async needed.
 
-// Buffer size for file streaming (8KB to avoid fragmentation in mixed-backend mode)
+// Buffer size for file streaming (the I/O pool's 8KB slot)
 #define UPLOAD_BUFFER_SIZE 8192
 #define UPLOAD_BUFFER_FALLBACK_SIZE 4096
 #define SMB_COMMAND_TIMEOUT_SECONDS 15
@@ -188,6 +210,8 @@ static struct smb2dir* smb2_opendir_ev(struct smb2_context* smb2,
 #define SMB_WRITE_EAGAIN_RETRIES 6
 #define SMB_WRITE_EAGAIN_BASE_DELAY_MS 20
 #define SMB_WRITE_TCP_DRAIN_BYTES 16384  // Pause every 16KB to let lwIP drain TCP send buffer
+#define SMB_WRITE_CHUNK_MIN 1024          // Adaptive write chunk floor
+#define SMB_WRITE_CHUNK_MAX 8192          // Adaptive write chunk ceiling (also capped by uploadBufferSize)
 
 static bool isRecoverableSmbWriteError(int errorCode, const char* smbError) {
     if (errorCode == ETIMEDOUT ||
@@ -255,28 +279,28 @@ static bool isTransientSmbSocketBackpressure(int errorCode, const char* smbError
            strstr(smbError, "EAGAIN") != nullptr;
 }
 
-static bool recoverWiFiAfterSmbTransportFailure() {
-    // Delegate to the coordinated cycle which enforces the SMB-active guard,
-    // the 45-second cooldown, and the in-progress-cycle wait — preventing the
-    // double-cycle ASSOC_LEAVE storms that caused EHOSTUNREACH (errno 113).
-    // g_smbConnectionActive is already false here because disconnect() was
-    // called before this function, so the SMB guard does not block us.
-    return tryCoordinatedWifiCycle(true);
+static bool recoverNetworkAfterSmbTransportFailure(const char* connectError) {
+    // Classify the connect failure and run the cheapest recovery step for it
+    // (socket reset → ARP refresh → DHCP renew → reassociate → full cycle).
+    // Repeated calls escalate; the full cycle keeps the SMB-active guard, the
+    // 45-second cooldown and the in-progress-cycle wait that prevent
+    // ASSOC_LEAVE storms. g_smbConnectionActive is already false here because
+    // disconnect() was called before this function.
+    return recoverNetwork(classifyNetworkFailure(0, connectError), true);
 }
 
 SMBUploader::SMBUploader(const String& endpoint, const String& user, const String& password)
     : smbUser(user), smbPassword(password), smb2(nullptr), connected(false),
-      uploadBuffer(nullptr), uploadBufferSize(0), lastVerifiedParentDir("") {
+      uploadBuffer(nullptr), uploadBufferSize(0),
+      chunkTuner(SMB_WRITE_CHUNK_MIN, SMB_WRITE_CHUNK_MAX), readTap(nullptr),
+      lastVerifiedParentDir("") {
+    lastConnectError[0] = '\0';
     parseEndpoint(endpoint);
 }
 
 SMBUploader::~SMBUploader() {
     end();
-    if (uploadBuffer) {
-        free(uploadBuffer);
-        uploadBuffer = nullptr;
-        uploadBufferSize = 0;
-    }
+    freeBuffer();
 }
 
 bool SMBUploader::parseEndpoint(const String& endpoint) {
@@ -375,6 +399,8 @@ bool SMBUploader::connect() {
     if (smb2_connect_share_ev(smb2, smbServer.c_str(), smbShare.c_str(), nullptr) < 0) {
         const char* error = smb2_get_error(smb2);
         LOGF("[SMB] ERROR: Connection failed: %s", error);
+        strncpy(lastConnectError, error ? error : "", sizeof(lastConnectError) - 1);
+        lastConnectError[sizeof(lastConnectError) - 1] = '\0';
         LOG("[SMB] Possible causes:");
         LOG("[SMB]   - Server unreachable (check network/firewall)");
         LOG("[SMB]   - Invalid credentials (check ENDPOINT_USER/ENDPOINT_PASS)");
@@ -388,6 +414,8 @@ bool SMBUploader::connect() {
     connected = true;
     g_smbConnectionActive = true;
     lastVerifiedParentDir = "";
+    lastConnectError[0] = '\0';
+    noteNetworkHealthy();
     LOG("[SMB] Connected successfully");
     
     // Test if we can access the base path (if configured)
@@ -438,15 +466,10 @@ bool SMBUploader::isConnected() const {
 }
 
 bool SMBUploader::allocateBuffer(size_t size) {
-    // Free existing buffer if already allocated
-    if (uploadBuffer) {
-        free(uploadBuffer);
-        uploadBuffer = nullptr;
-        uploadBufferSize = 0;
-    }
+    // Return existing buffer if already checked out
+    freeBuffer();
     
-    // Allocate new buffer
-    uploadBuffer = (uint8_t*)malloc(size);
+    uploadBuffer = IoBufferPool::checkout(size, "smb");
     if (!uploadBuffer) {
         LOG_ERRORF("[SMB] Failed to allocate upload buffer (%u bytes)", size);
         LOG("[SMB] System may be low on memory");
@@ -454,59 +477,51 @@ bool SMBUploader::allocateBuffer(size_t size) {
     }
     
     uploadBufferSize = size;
-    LOGF("[SMB] Allocated upload buffer: %u bytes", uploadBufferSize);
+    LOGF("[SMB] Upload buffer ready: %u bytes", (unsigned)uploadBufferSize);
     return true;
 }
 
 void SMBUploader::freeBuffer() {
     if (uploadBuffer) {
-        free(uploadBuffer);
+        IoBufferPool::give(uploadBuffer);
         uploadBuffer = nullptr;
         uploadBufferSize = 0;
-        LOG("[SMB] Upload buffer freed");
+        LOG("[SMB] Upload buffer returned");
     }
 }
 
-bool SMBUploader::createDirectory(const String& path) {
+bool SMBUploader::createDirectory(const char* path) {
     if (!connected) {
         LOG("[SMB] ERROR: Not connected - cannot create directory");
         return false;
     }
     
-    if (path.isEmpty() || path == "/") {
-        return true;  // Root always exists
-    }
-    
     // Remove leading slash for libsmb2 compatibility (paths are relative to share)
-    String cleanPath = path;
-    if (cleanPath.startsWith("/")) {
-        cleanPath = cleanPath.substring(1);
-    }
+    const char* cleanPath = path[0] == '/' ? path + 1 : path;
     
-    if (cleanPath.isEmpty()) {
+    if (cleanPath[0] == '\0') {
         return true;  // Root always exists
     }
     
     // Check heap before attempting directory operations.
     // IMPORTANT: Do not skip create/check in low-memory mode, otherwise we can
     // incorrectly report success and then fail smb2_open with PATH_NOT_FOUND.
-    uint32_t maxAlloc = ESP.getMaxAllocHeap();
-    if (g_debugMode && maxAlloc < 20000) {
+    if (g_debugMode && !g_heapGovernor.hasRoom(HeapBudget::Smb)) {
         LOGF("[SMB] Low memory (%u bytes), validating/creating directory: %s",
-             maxAlloc,
-             cleanPath.c_str());
+             (unsigned)ESP.getMaxAllocHeap(),
+             cleanPath);
     }
     
     // Check if directory already exists
     struct smb2_stat_64 st;
-    int stat_result = smb2_stat_ev(smb2, cleanPath.c_str(), &st);
+    int stat_result = smb2_stat_ev(smb2, cleanPath, &st);
     if (stat_result == 0) {
         // Path exists, check if it's a directory
         if (st.smb2_type == SMB2_TYPE_DIRECTORY) {
-            LOG_DEBUGF("[SMB] Directory already exists: %s", cleanPath.c_str());
+            LOG_DEBUGF("[SMB] Directory already exists: %s", cleanPath);
             return true;  // Directory already exists
         } else {
-            LOGF("[SMB] ERROR: Path exists but is not a directory: %s", cleanPath.c_str());
+            LOGF("[SMB] ERROR: Path exists but is not a directory: %s", cleanPath);
             LOG("[SMB] Cannot create directory - file with same name exists");
             return false;
         }
@@ -517,51 +532,52 @@ bool SMBUploader::createDirectory(const String& path) {
         // to PDU allocation. Do not misclassify as "directory missing".
         if (isSmbPduAllocationError(statError)) {
             LOG_WARNF("[SMB] Directory stat failed due libsmb2 memory pressure for %s: %s",
-                      cleanPath.c_str(),
+                      cleanPath,
                       statError);
             return false;
         }
 
         // Stat failed - directory might not exist or we might not have permissions
-        LOGF("[SMB] Directory does not exist: %s (will create)", cleanPath.c_str());
+        LOGF("[SMB] Directory does not exist: %s (will create)", cleanPath);
     }
     
     // Directory doesn't exist, need to create it
     // First ensure parent directory exists
-    int lastSlash = cleanPath.lastIndexOf('/');
-    if (lastSlash > 0) {
-        String parentPath = cleanPath.substring(0, lastSlash);
-        if (!createDirectory(parentPath)) {
+    const char* lastSlash = strrchr(cleanPath, '/');
+    if (lastSlash && lastSlash > cleanPath) {
+        SmbPath parentPath;
+        parentPath.assign(cleanPath, lastSlash - cleanPath);
+        if (!createDirectory(parentPath.c_str())) {
             LOGF("[SMB] ERROR: Failed to create parent directory: %s", parentPath.c_str());
             return false;  // Failed to create parent
         }
     }
     
     // Create this directory
-    LOGF("[SMB] Creating directory: %s", cleanPath.c_str());
+    LOGF("[SMB] Creating directory: %s", cleanPath);
     
-    int mkdir_result = smb2_mkdir_ev(smb2, cleanPath.c_str());
+    int mkdir_result = smb2_mkdir_ev(smb2, cleanPath);
     if (mkdir_result < 0) {
         const char* error = smb2_get_error(smb2);
 
         if (isSmbPduAllocationError(error)) {
             LOG_WARNF("[SMB] Directory create failed due libsmb2 memory pressure for %s: %s",
-                      cleanPath.c_str(),
+                      cleanPath,
                       error);
             return false;
         }
         
         // Check if error is because directory already exists
         // STATUS_INVALID_PARAMETER can mean the directory already exists in some SMB implementations
-        if (smb2_stat_ev(smb2, cleanPath.c_str(), &st) == 0 && st.smb2_type == SMB2_TYPE_DIRECTORY) {
-            LOG_DEBUGF("[SMB] Directory already exists (mkdir failed but stat succeeded): %s", cleanPath.c_str());
+        if (smb2_stat_ev(smb2, cleanPath, &st) == 0 && st.smb2_type == SMB2_TYPE_DIRECTORY) {
+            LOG_DEBUGF("[SMB] Directory already exists (mkdir failed but stat succeeded): %s", cleanPath);
             return true;  // Directory exists, treat as success
         }
         
         // If we get STATUS_INVALID_PARAMETER, assume directory exists and continue
         // This is a workaround for SMB servers that return this error for existing directories
         if (strstr(error, "STATUS_INVALID_PARAMETER") != NULL) {
-            LOG_DEBUGF("[SMB] WARNING: mkdir failed with STATUS_INVALID_PARAMETER for %s", cleanPath.c_str());
+            LOG_DEBUGF("[SMB] WARNING: mkdir failed with STATUS_INVALID_PARAMETER for %s", cleanPath);
             LOG_DEBUG("[SMB] Assuming directory already exists, continuing...");
             return true;  // Assume directory exists
         }
@@ -574,32 +590,26 @@ bool SMBUploader::createDirectory(const String& path) {
         return false;
     }
     
-    LOGF("[SMB] Directory created successfully: %s", cleanPath.c_str());
+    LOGF("[SMB] Directory created successfully: %s", cleanPath);
     return true;
 }
 
-bool SMBUploader::upload(const String& localPath, const String& remotePath, 
-                         fs::FS &sd, unsigned long& bytesTransferred) {
+bool SMBUploader::upload(const char* localPath, const char* remotePath, 
+                         fs::FS &sd, unsigned long& bytesTransferred,
+                         String* fileChecksum) {
     bytesTransferred = 0;
+    if (fileChecksum) *fileChecksum = "";
     
     if (!connected) {
         LOG("SMB: Not connected");
         return false;
     }
     
-    // Prepend base path if configured
-    // Note: libsmb2 expects paths relative to share root WITHOUT leading slash
-    String fullRemotePath = remotePath;
-    if (!smbBasePath.isEmpty()) {
-        // Remove leading slash from remotePath if present
-        String cleanRemotePath = remotePath;
-        if (cleanRemotePath.startsWith("/")) {
-            cleanRemotePath = cleanRemotePath.substring(1);
-        }
-        fullRemotePath = smbBasePath + "/" + cleanRemotePath;
-    } else if (fullRemotePath.startsWith("/")) {
-        // Remove leading slash for libsmb2 compatibility
-        fullRemotePath = fullRemotePath.substring(1);
+    // Prepend base path if configured (libsmb2 paths have no leading slash)
+    SmbPath fullRemotePath;
+    if (!toSharePath(remotePath, fullRemotePath)) {
+        LOGF("[SMB] ERROR: Remote path too long: %s", remotePath);
+        return false;
     }
     
     for (int attempt = 1; attempt <= SMB_UPLOAD_MAX_ATTEMPTS; ++attempt) {
@@ -608,13 +618,13 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
 
         if (attempt > 1) {
             LOG_WARNF("[SMB] Retry attempt %d/%d for %s",
-                      attempt, SMB_UPLOAD_MAX_ATTEMPTS, localPath.c_str());
+                      attempt, SMB_UPLOAD_MAX_ATTEMPTS, localPath);
         }
 
         // Open local file from SD card
         File localFile = sd.open(localPath, FILE_READ);
         if (!localFile) {
-            LOGF("[SMB] ERROR: Failed to open local file: %s", localPath.c_str());
+            LOGF("[SMB] ERROR: Failed to open local file: %s", localPath);
             LOG("[SMB] File may not exist or SD card has read errors");
             return false;
         }
@@ -623,25 +633,24 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
 
         // Sanity check file size
         if (fileSize == 0) {
-            LOGF("[SMB] WARNING: File is empty: %s", localPath.c_str());
+            LOGF("[SMB] WARNING: File is empty: %s", localPath);
             localFile.close();
             return false;
         }
 
-        LOG_DEBUGF("[SMB] Uploading %s (%u bytes)", localPath.c_str(), (unsigned int)fileSize);
+        LOG_DEBUGF("[SMB] Uploading %s (%u bytes)", localPath, (unsigned int)fileSize);
         LOG_DEBUGF("[SMB] Remote path: %s", fullRemotePath.c_str());
 
         // Ensure parent directory exists
-        String parentDir;
+        SmbPath parentDir;
         int lastSlash = fullRemotePath.lastIndexOf('/');
         if (lastSlash > 0) {
-            parentDir = fullRemotePath.substring(0, lastSlash);
-            if (parentDir != lastVerifiedParentDir) {
-                if (!createDirectory(parentDir)) {
-                    uint32_t maxAllocNow = ESP.getMaxAllocHeap();
-                    if (maxAllocNow < 20000) {
+            parentDir.assign(fullRemotePath.c_str(), lastSlash);
+            if (parentDir != lastVerifiedParentDir.c_str()) {
+                if (!createDirectory(parentDir.c_str())) {
+                    if (!g_heapGovernor.hasRoom(HeapBudget::Smb)) {
                         LOG_WARNF("[SMB] Parent directory check/create deferred under low memory (%u bytes): %s",
-                                  maxAllocNow,
+                                  (unsigned)ESP.getMaxAllocHeap(),
                                   parentDir.c_str());
                         LOG_WARN("[SMB] Proceeding with direct open; PATH_NOT_FOUND recovery will retry creation");
                     } else {
@@ -651,7 +660,7 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
                         return false;
                     }
                 } else {
-                    lastVerifiedParentDir = parentDir;
+                    lastVerifiedParentDir = parentDir.c_str();
                     feedUploadHeartbeat();
                 }
             }
@@ -668,19 +677,18 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
                  strstr(error, "PATH_NOT_FOUND") != nullptr)) {
                 LOG_WARNF("[SMB] Parent path missing for %s, retrying directory creation", parentDir.c_str());
 
-                bool dirReady = createDirectory(parentDir);
+                bool dirReady = createDirectory(parentDir.c_str());
 
                 // If directory recovery fails under low memory, reconnect SMB
                 // context and retry once to clear any stale libsmb2 state.
                 if (!dirReady) {
-                    uint32_t maxAllocNow = ESP.getMaxAllocHeap();
-                    if (maxAllocNow < 20000) {
+                    if (!g_heapGovernor.hasRoom(HeapBudget::Smb)) {
                         LOG_WARN("[SMB] Low memory during directory recovery; reconnecting SMB context and retrying once");
                         disconnect();
                         feedUploadHeartbeat();
                         delay(150);
                         if (connect()) {
-                            dirReady = createDirectory(parentDir);
+                            dirReady = createDirectory(parentDir.c_str());
                         } else {
                             error = "SMB reconnect failed during directory recovery";
                         }
@@ -688,7 +696,7 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
                 }
 
                 if (dirReady) {
-                    lastVerifiedParentDir = parentDir;
+                    lastVerifiedParentDir = parentDir.c_str();
                     feedUploadHeartbeat();
                     remoteFile = smb2_open_ev(smb2, fullRemotePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
                     if (remoteFile != nullptr) {
@@ -740,9 +748,16 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
         bool skipRemoteClose = false;
         bool transportErrorDetected = false;
         unsigned long totalBytesRead = 0;
+        chunkTuner.beginFile(uploadBufferSize, WiFi.RSSI());
+
+        // Hash exactly what is written, restarted with each attempt
+        FileFingerprint fingerprint(LOCAL_FINGERPRINT_ALGO);
+        if (readTap) readTap->restart();
 
         while (localFile.available()) {
-            size_t bytesRead = localFile.read(uploadBuffer, uploadBufferSize);
+            size_t chunkSize = chunkTuner.getChunkSize();
+            if (chunkSize > uploadBufferSize) chunkSize = uploadBufferSize;
+            size_t bytesRead = localFile.read(uploadBuffer, chunkSize);
             if (bytesRead == 0) {
                 // Check if we've read all expected bytes
                 if (totalBytesRead < fileSize) {
@@ -759,6 +774,8 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
             ssize_t bytesWritten = -1;
             int writeErrno = 0;
             const char* writeError = nullptr;
+            int eagainRetries = 0;
+            unsigned long chunkStart = millis();
 
             for (int writeAttempt = 0; writeAttempt <= SMB_WRITE_EAGAIN_RETRIES; ++writeAttempt) {
                 bytesWritten = smb2_write_ev(smb2, remoteFile, uploadBuffer, bytesRead);
@@ -783,6 +800,7 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
                 }
 
                 feedUploadHeartbeat();
+                eagainRetries++;
                 delay(SMB_WRITE_EAGAIN_BASE_DELAY_MS * (writeAttempt + 1));
             }
 
@@ -824,6 +842,9 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
             }
 
             attemptBytesTransferred += bytesWritten;
+            if (fileChecksum) fingerprint.update(uploadBuffer, (size_t)bytesWritten);
+            if (readTap) readTap->feed(uploadBuffer, (size_t)bytesWritten);
+            chunkTuner.recordChunk((size_t)bytesWritten, millis() - chunkStart, eagainRetries);
 
             // Update progress tracking
             if (attemptBytesTransferred > lastBytesTransferred) {
@@ -845,14 +866,20 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
             feedUploadHeartbeat();
             
             // ── POWER: Yield between chunks to allow DFS frequency scaling ──
-            taskYIELD();
+            // The tuner replaces the yield with a short pause on a stalling link.
+            uint16_t paceMs = chunkTuner.getPaceDelayMs();
+            if (paceMs > 0) {
+                delay(paceMs);
+            } else {
+                taskYIELD();
+            }
 
             // ── TCP drain: pause periodically to let lwIP process ACKs ──
             // Without this, writes fill the TCP send buffer (~32KB) faster
             // than the stack can drain it under low-heap conditions, causing
             // EAGAIN followed by EBADF as the socket dies from backpressure.
             if (attemptBytesTransferred >= SMB_WRITE_TCP_DRAIN_BYTES &&
-                (attemptBytesTransferred % SMB_WRITE_TCP_DRAIN_BYTES) < uploadBufferSize) {
+                (attemptBytesTransferred % SMB_WRITE_TCP_DRAIN_BYTES) < (unsigned long)bytesWritten) {
                 delay(10);
                 yield();
             }
@@ -896,6 +923,11 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
 
         if (success) {
             bytesTransferred = attemptBytesTransferred;
+            if (fileChecksum) {
+                char text[FileFingerprint::MAX_TEXT_LEN];
+                fingerprint.finishText(text);
+                *fileChecksum = String(text);
+            }
             float transferRate = uploadTime > 0 ? (attemptBytesTransferred / 1024.0f) / (uploadTime / 1000.0f) : 0.0f;
             LOG_DEBUGF("[SMB] Upload complete: %lu bytes in %lu ms (%.2f KB/s)",
                  attemptBytesTransferred, uploadTime, transferRate);
@@ -927,28 +959,28 @@ bool SMBUploader::upload(const String& localPath, const String& remotePath,
         if (!connect()) {
             LOG_WARN("[SMB] Initial reconnect failed after transport error");
 
+            // Each round runs the next recovery step for the classified
+            // failure, then retries the SMB connect. Cheap steps (socket
+            // reset, ARP refresh, DHCP renew) finish in well under a second;
+            // only a persisting failure escalates to reassociation/full cycle.
             bool smbReconnected = false;
-            if (recoverWiFiAfterSmbTransportFailure()) {
-                // Give network stack a brief settle window after WiFi reconnect,
-                // then try SMB connect a few times before giving up.
-                const int SMB_RECONNECT_ATTEMPTS_AFTER_WIFI = 3;
-                for (int reconnectAttempt = 1;
-                     reconnectAttempt <= SMB_RECONNECT_ATTEMPTS_AFTER_WIFI;
-                     ++reconnectAttempt) {
-                    if (reconnectAttempt > 1) {
-                        LOG_WARNF("[SMB] SMB reconnect retry %d/%d after WiFi recovery",
-                                  reconnectAttempt,
-                                  SMB_RECONNECT_ATTEMPTS_AFTER_WIFI);
-                    }
-
-                    feedUploadHeartbeat();
-                    delay(200 * reconnectAttempt);
-                    if (connect()) {
-                        smbReconnected = true;
-                        break;
-                    }
-                    feedUploadHeartbeat();
+            const int SMB_RECOVERY_ROUNDS = 3;
+            for (int round = 1; round <= SMB_RECOVERY_ROUNDS; ++round) {
+                feedUploadHeartbeat();
+                if (!recoverNetworkAfterSmbTransportFailure(lastConnectError)) {
+                    continue;
+                }
+                if (round > 1) {
+                    LOG_WARNF("[SMB] SMB reconnect retry %d/%d after network recovery",
+                              round, SMB_RECOVERY_ROUNDS);
                 }
+                feedUploadHeartbeat();
+                delay(100 * round);
+                if (connect()) {
+                    smbReconnected = true;
+                    break;
+                }
+                feedUploadHeartbeat();
             }
 
             if (smbReconnected) {
@@ -971,18 +1003,11 @@ int SMBUploader::countRemoteFiles(const String& remotePath) {
         return -1;
     }
     
-    // Prepend base path if configured
-    String fullRemotePath = remotePath;
-    if (!smbBasePath.isEmpty()) {
-        // Remove leading slash from remotePath if present
-        String cleanRemotePath = remotePath;
-        if (cleanRemotePath.startsWith("/")) {
-            cleanRemotePath = cleanRemotePath.substring(1);
-        }
-        fullRemotePath = smbBasePath + "/" + cleanRemotePath;
-    } else if (fullRemotePath.startsWith("/")) {
-        // Remove leading slash for libsmb2 compatibility
-        fullRemotePath = fullRemotePath.substring(1);
+    // Prepend base path if configured (libsmb2 paths have no leading slash)
+    SmbPath fullRemotePath;
+    if (!toSharePath(remotePath.c_str(), fullRemotePath)) {
+        LOGF("[SMB] ERROR: Remote path too long: %s", remotePath.c_str());
+        return -1;
     }
     
     LOG_DEBUGF("[SMB] Scanning remote directory: %s", fullRemotePath.c_str());
@@ -1041,18 +1066,11 @@ bool SMBUploader::getRemoteFileInfo(const String& remotePath, std::map<String, s
     // Clear the output map
     fileInfo.clear();
     
-    // Prepend base path if configured
-    String fullRemotePath = remotePath;
-    if (!smbBasePath.isEmpty()) {
-        // Remove leading slash from remotePath if present
-        String cleanRemotePath = remotePath;
-        if (cleanRemotePath.startsWith("/")) {
-            cleanRemotePath = cleanRemotePath.substring(1);
-        }
-        fullRemotePath = smbBasePath + "/" + cleanRemotePath;
-    } else if (fullRemotePath.startsWith("/")) {
-        // Remove leading slash for libsmb2 compatibility
-        fullRemotePath = fullRemotePath.substring(1);
+    // Prepend base path if configured (libsmb2 paths have no leading slash)
+    SmbPath fullRemotePath;
+    if (!toSharePath(remotePath.c_str(), fullRemotePath)) {
+        LOGF("[SMB] ERROR: Remote path too long: %s", remotePath.c_str());
+        return false;
     }
     
     LOG_DEBUGF("[SMB] Getting file info from remote directory: %s", fullRemotePath.c_str());
@@ -1104,4 +1122,352 @@ bool SMBUploader::getRemoteFileInfo(const String& remotePath, std::map<String, s
     return true;
 }
 
+// ============================================================================
+// Folder archive mode
+// ============================================================================
+
+// State shared with archiveSink() while one archive is open
+struct SMBUploader::ArchiveWriteCtx {
+    SMBUploader* self;
+    struct smb2fh* fh;
+    unsigned long written;
+    bool transportError;
+};
+
+bool SMBUploader::toSharePath(const char* remotePath, SmbPath& out) const {
+    // libsmb2 expects paths relative to share root WITHOUT leading slash
+    const char* clean = remotePath[0] == '/' ? remotePath + 1 : remotePath;
+    if (smbBasePath.isEmpty()) {
+        out.assign(clean);
+    } else {
+        out.format("%s/%s", smbBasePath.c_str(), clean);
+    }
+    return !out.truncated();
+}
+
+// Member name inside the archive: the SD path below localRoot
+static const char* archiveMemberName(const SmbArchiveMember& m, const String& localRoot) {
+    return m.localPath.startsWith(localRoot) ? m.localPath.c_str() + localRoot.length() : m.localPath.c_str();
+}
+
+bool SMBUploader::archiveSink(void* ctx, const uint8_t* data, size_t len) {
+    ArchiveWriteCtx* w = (ArchiveWriteCtx*)ctx;
+    SMBUploader* self = w->self;
+
+    // One full buffer arrives at a time; the tuner splits it into link-sized writes
+    while (len > 0) {
+        size_t chunk = self->chunkTuner.getChunkSize();
+        if (chunk > len) chunk = len;
+
+        unsigned long chunkStart = millis();
+        int eagainRetries = 0;
+        int written = -1;
+        for (int writeAttempt = 0; writeAttempt <= SMB_WRITE_EAGAIN_RETRIES; ++writeAttempt) {
+            written = smb2_write_ev(self->smb2, w->fh, data, (uint32_t)chunk);
+            if (written >= 0) {
+                break;
+            }
+            int writeErrno = errno;
+            const char* writeError = smb2_get_error(self->smb2);
+            if (!isTransientSmbSocketBackpressure(writeErrno, writeError) ||
+                writeAttempt == SMB_WRITE_EAGAIN_RETRIES) {
+                LOGF("[SMB] ERROR: Archive write failed at offset %lu: %s (errno=%d)",
+                     w->written, writeError ? writeError : "unknown", writeErrno);
+                w->transportError = isRecoverableSmbWriteError(writeErrno, writeError) ||
+                                    isSmbPduAllocationError(writeError);
+                return false;
+            }
+            feedUploadHeartbeat();
+            eagainRetries++;
+            delay(SMB_WRITE_EAGAIN_BASE_DELAY_MS * (writeAttempt + 1));
+        }
+        if ((size_t)written != chunk) {
+            LOGF("[SMB] ERROR: Incomplete archive write, expected %u bytes, wrote %d",
+                 (unsigned)chunk, written);
+            return false;
+        }
+
+        self->chunkTuner.recordChunk(chunk, millis() - chunkStart, eagainRetries);
+        w->written += chunk;
+        data += chunk;
+        len -= chunk;
+
+        feedUploadHeartbeat();
+        uint16_t paceMs = self->chunkTuner.getPaceDelayMs();
+        if (paceMs > 0) {
+            delay(paceMs);
+        } else {
+            taskYIELD();
+        }
+    }
+    return true;
+}
+
+bool SMBUploader::uploadArchive(const std::vector<SmbArchiveMember>& members, const String& localRoot,
+                                const String& remotePath, fs::FS &sd, unsigned long& bytesTransferred,
+                                const std::function<void(const String&, bool)>& memberHook) {
+    bytesTransferred = 0;
+    if (!connected) {
+        LOG("SMB: Not connected");
+        return false;
+    }
+    if (!uploadBuffer) {
+        LOG("[SMB] ERROR: No upload buffer allocated");
+        return false;
+    }
+
+    SmbPath sharePath;
+    if (!toSharePath(remotePath.c_str(), sharePath)) {
+        LOGF("[SMB] ERROR: Remote path too long: %s", remotePath.c_str());
+        return false;
+    }
+    int lastSlash = sharePath.lastIndexOf('/');
+    if (lastSlash > 0) {
+        SmbPath parentDir;
+        parentDir.assign(sharePath.c_str(), lastSlash);
+        if (parentDir != lastVerifiedParentDir.c_str()) {
+            if (!createDirectory(parentDir.c_str())) {
+                LOGF("[SMB] ERROR: Failed to create parent directory: %s", parentDir.c_str());
+                return false;
+            }
+            lastVerifiedParentDir = parentDir.c_str();
+        }
+    }
+
+    // Archive and index are written as .part files and renamed over the
+    // published pair only once both are complete, so a failed night never
+    // leaves a truncated tar next to an index that describes the old one
+    String tarPart = sharePath + ".part";
+    String indexPath = sharePath + ".idx";
+    String indexPart = indexPath + ".part";
+    struct smb2fh* fh = smb2_open_ev(smb2, tarPart.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+    if (fh == nullptr) {
+        LOGF("[SMB] ERROR: Failed to open remote archive %s: %s", tarPart.c_str(), smb2_get_error(smb2));
+        return false;
+    }
+
+    // Remembered per member for the sidecar index (offsets follow from sizes)
+    std::vector<uint32_t> mtimes(members.size(), 0);
+    ArchiveWriteCtx ctx = {this, fh, 0, false};
+    TarStreamWriter tar(uploadBuffer, uploadBufferSize, archiveSink, &ctx);
+    chunkTuner.beginFile(uploadBufferSize, WiFi.RSSI());
+    unsigned long startTime = millis();
+    bool success = true;
+
+    for (size_t i = 0; i < members.size() && success; i++) {
+        const SmbArchiveMember& m = members[i];
+        File localFile = sd.open(m.localPath, FILE_READ);
+        if (!localFile) {
+            LOGF("[SMB] ERROR: Failed to open local file: %s", m.localPath.c_str());
+            success = false;
+            break;
+        }
+        mtimes[i] = (uint32_t)localFile.getLastWrite();
+        const char* name = archiveMemberName(m, localRoot);
+        if (!tar.beginMember(name, m.size, mtimes[i])) {
+            LOGF("[SMB] ERROR: Cannot add %s to archive", name);
+            localFile.close();
+            success = false;
+            break;
+        }
+
+        if (memberHook) memberHook(m.localPath, false);
+        uint32_t remaining = m.size;
+        while (remaining > 0) {
+            size_t space = 0;
+            uint8_t* dst = tar.reserve(space);
+            if (!dst) {
+                success = false;
+                break;
+            }
+            if (space > remaining) space = remaining;
+            size_t bytesRead = localFile.read(dst, space);
+            if (bytesRead == 0) {
+                LOGF("[SMB] ERROR: Unexpected end of file: %s (%u bytes left)",
+                     m.localPath.c_str(), (unsigned)remaining);
+                success = false;
+                break;
+            }
+            if (readTap) readTap->feed(dst, bytesRead);
+            tar.commit(bytesRead);
+            remaining -= (uint32_t)bytesRead;
+        }
+        localFile.close();
+        if (memberHook && success) memberHook(m.localPath, true);
+        if (success && !tar.endMember()) {
+            success = false;
+        }
+    }
+
+    if (success && !tar.finish()) {
+        success = false;
+    }
+
+    if (ctx.transportError) {
+        LOG_WARN("[SMB] Skipping smb2_close after transport failure; forcing reconnect");
+        disconnect();
+        return false;
+    }
+    if (smb2_close_ev(smb2, fh) < 0) {
+        LOGF("[SMB] WARNING: Failed to close remote archive: %s", smb2_get_error(smb2));
+    }
+    feedUploadHeartbeat();
+    bytesTransferred = ctx.written;
+    if (!success) {
+        LOGF("[SMB] Archive upload failed after %lu bytes: %s", ctx.written, sharePath.c_str());
+        smb2_unlink_ev(smb2, tarPart.c_str());
+        return false;
+    }
+
+    // Sidecar index, streamed through the same buffer: one line per member
+    fh = smb2_open_ev(smb2, indexPart.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+    if (fh == nullptr) {
+        LOGF("[SMB] ERROR: Failed to open archive index %s: %s", indexPart.c_str(), smb2_get_error(smb2));
+        smb2_unlink_ev(smb2, tarPart.c_str());
+        return false;
+    }
+    ctx.fh = fh;
+    ctx.written = 0;
+    size_t fill = 0;
+    uint32_t dataOffset = 0;
+    for (size_t i = 0; i < members.size() && success; i++) {
+        const SmbArchiveMember& m = members[i];
+        dataOffset += TAR_BLOCK_SIZE;
+        char line[160];
+        size_t n = formatTarIndexLine(line, sizeof(line), archiveMemberName(m, localRoot), dataOffset, m.size, mtimes[i]);
+        if (fill + n > uploadBufferSize) {
+            success = archiveSink(&ctx, uploadBuffer, fill);
+            fill = 0;
+        }
+        memcpy(uploadBuffer + fill, line, n);
+        fill += n;
+        dataOffset += m.size + tarPadding(m.size);
+    }
+    if (success && fill > 0) {
+        success = archiveSink(&ctx, uploadBuffer, fill);
+    }
+    if (ctx.transportError) {
+        disconnect();
+        return false;
+    }
+    smb2_close_ev(smb2, fh);
+    if (!success) {
+        smb2_unlink_ev(smb2, tarPart.c_str());
+        smb2_unlink_ev(smb2, indexPart.c_str());
+        return false;
+    }
+
+    // Publish: SMB2 rename does not replace, so drop the old pair first
+    // (index before archive, so no old index is ever left beside a new tar)
+    smb2_unlink_ev(smb2, indexPath.c_str());
+    smb2_unlink_ev(smb2, sharePath.c_str());
+    if (smb2_rename_ev(smb2, tarPart.c_str(), sharePath.c_str()) < 0 ||
+        smb2_rename_ev(smb2, indexPart.c_str(), indexPath.c_str()) < 0) {
+        LOGF("[SMB] ERROR: Failed to publish archive %s: %s", sharePath.c_str(), smb2_get_error(smb2));
+        return false;
+    }
+    feedUploadHeartbeat();
+
+    unsigned long elapsed = millis() - startTime;
+    LOGF("[SMB] Archive %s: %u files, %lu bytes in %lu ms",
+         sharePath.c_str(), (unsigned)members.size(), bytesTransferred, elapsed);
+    return success;
+}
+
+// ============================================================================
+// Network self-test
+// ============================================================================
+
+bool SMBUploader::runNetBench(uint32_t totalBytes, SmbBenchResult& result) {
+    memset(&result, 0, sizeof(result));
+
+    if (smbServer.isEmpty() || smbShare.isEmpty()) {
+        LOG_WARN("[SMB] NetBench: endpoint not configured");
+        return false;
+    }
+
+    // Phase 1: raw TCP handshake to the SMB port — isolates WiFi/LAN latency
+    // from anything the SMB server does.  Sending raw payload here would just
+    // be reset by the server, so throughput is measured through SMB below.
+    {
+        WiFiClient probe;
+        unsigned long t0 = millis();
+        if (probe.connect(smbServer.c_str(), 445, 5000)) {
+            result.tcpConnectMs = millis() - t0;
+            probe.stop();
+            LOGF("[SMB] NetBench: TCP connect %lu ms", (unsigned long)result.tcpConnectMs);
+        } else {
+            LOG_WARNF("[SMB] NetBench: TCP connect to %s:445 failed", smbServer.c_str());
+            return false;
+        }
+    }
+    feedUploadHeartbeat();
+
+    // Phase 2: SMB negotiate + auth + tree connect
+    if (!connected) {
+        unsigned long t0 = millis();
+        if (!connect()) {
+            LOG_WARN("[SMB] NetBench: SMB session setup failed");
+            return false;
+        }
+        result.sessionMs = millis() - t0;
+    }
+
+    bool ownBuffer = false;
+    if (!uploadBuffer) {
+        if (!allocateBuffer(UPLOAD_BUFFER_SIZE) && !allocateBuffer(UPLOAD_BUFFER_FALLBACK_SIZE)) {
+            disconnect();
+            return false;
+        }
+        ownBuffer = true;
+    }
+    memset(uploadBuffer, 0x5A, uploadBufferSize);
+
+    // Phase 3: bounded scratch-file write
+    String scratchPath = ".netbench.tmp";
+    if (!smbBasePath.isEmpty()) {
+        createDirectory(smbBasePath.c_str());
+        scratchPath = smbBasePath + "/" + scratchPath;
+    }
+
+    bool writeOk = false;
+    struct smb2fh* fh = smb2_open_ev(smb2, scratchPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC);
+    if (fh == nullptr) {
+        LOG_WARNF("[SMB] NetBench: cannot create %s: %s", scratchPath.c_str(), smb2_get_error(smb2));
+    } else {
+        unsigned long t0 = millis();
+        uint32_t written = 0;
+        writeOk = true;
+        while (written < totalBytes && millis() - t0 < NETBENCH_PHASE_MAX_MS) {
+            uint32_t chunk = totalBytes - written;
+            if (chunk > uploadBufferSize) chunk = uploadBufferSize;
+            int rc = smb2_write_ev(smb2, fh, uploadBuffer, chunk);
+            if (rc < 0) {
+                LOG_WARNF("[SMB] NetBench: write failed at %u: %s", (unsigned)written, smb2_get_error(smb2));
+                writeOk = false;
+                break;
+            }
+            written += (uint32_t)rc;
+            feedUploadHeartbeat();
+        }
+        // The close flushes the last write on most servers — include it
+        smb2_close_ev(smb2, fh);
+        result.writeMs = millis() - t0;
+        result.writeBytes = written;
+        smb2_unlink_ev(smb2, scratchPath.c_str());
+
+        LOGF("[SMB] NetBench: wrote %u bytes in %lu ms (%u B/s)",
+             (unsigned)written, (unsigned long)result.writeMs,
+             (unsigned)netBenchBps(written, result.writeMs));
+    }
+
+    if (ownBuffer) {
+        freeBuffer();
+    }
+    disconnect();
+
+    result.ok = writeOk && result.writeBytes > 0;
+    return result.ok;
+}
+
 #endif // ENABLE_SMB_UPLOAD
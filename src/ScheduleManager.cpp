@@ -1,6 +1,20 @@
 #include "ScheduleManager.h"
 #include "Logger.h"
 
+#ifdef UNIT_TEST
+#include "MockPreferences.h"
+#else
+#include <Preferences.h>
+#endif
+
+// NVS namespace/key for the learned session-end history.
+// Format: "<lastEndEpoch>|<min>,<min>,..." (oldest first)
+static const char* SCHED_PREFS_NAMESPACE = "cpap_sched";
+static const char* SCHED_PREFS_SESSION_KEY = "sess_end";
+
+// Samples further than this from the median count as outliers
+static const int SESSION_END_TOLERANCE_MINUTES = 60;
+
 extern bool g_heapRecoveryBoot;  // defined in main.cpp (RTC_DATA_ATTR)
 
 ScheduleManager::ScheduleManager() :
@@ -13,8 +27,14 @@ ScheduleManager::ScheduleManager() :
     lastUploadTimestamp(0),
     ntpSynced(false),
     ntpServer("pool.ntp.org"),
-    gmtOffsetHours(0)
-{}
+    gmtOffsetHours(0),
+    sessionEndCount(0),
+    sessionEndHead(0),
+    lastSessionEndEpoch(0),
+    lastPreWarmEpoch(0)
+{
+    memset(sessionEndMinutes, 0, sizeof(sessionEndMinutes));
+}
 
 bool ScheduleManager::begin(const String& mode, int startHour, int endHour, int gmtOffset) {
     this->uploadMode = mode;
@@ -28,6 +48,7 @@ bool ScheduleManager::begin(const String& mode, int startHour, int endHour, int
     LOGF("[Schedule] Mode: %s, Window: %d:00-%d:00, GMT%+d",
          mode.c_str(), startHour, endHour, gmtOffset);
     
+    loadSessionEndHistory();
     syncTime();
     return true;
 }
@@ -279,3 +300,146 @@ const String& ScheduleManager::getUploadMode() const { return uploadMode; }
 int ScheduleManager::getUploadStartHour() const { return uploadStartHour; }
 int ScheduleManager::getUploadEndHour() const { return uploadEndHour; }
 bool ScheduleManager::isSmartMode() const { return uploadMode == "smart"; }
+
+// ============================================================================
+// Session-end learning (smart mode predictive pre-warm)
+// ============================================================================
+
+void ScheduleManager::recordSessionEnd(unsigned long endEpoch) {
+    if (!ntpSynced || endEpoch == 0) return;
+
+    time_t t = (time_t)endEpoch;
+    struct tm timeinfo;
+    if (!localtime_r(&t, &timeinfo)) return;
+    int16_t minute = (int16_t)(timeinfo.tm_hour * 60 + timeinfo.tm_min);
+
+    if (sessionEndCount > 0 && lastSessionEndEpoch != 0 &&
+        endEpoch >= lastSessionEndEpoch &&
+        endEpoch - lastSessionEndEpoch < SESSION_END_MERGE_SECONDS) {
+        // Same night (mask was off briefly) — the later end wins
+        int newest = (sessionEndHead + SESSION_END_HISTORY - 1) % SESSION_END_HISTORY;
+        sessionEndMinutes[newest] = minute;
+    } else {
+        sessionEndMinutes[sessionEndHead] = minute;
+        sessionEndHead = (sessionEndHead + 1) % SESSION_END_HISTORY;
+        if (sessionEndCount < SESSION_END_HISTORY) sessionEndCount++;
+    }
+    lastSessionEndEpoch = endEpoch;
+    saveSessionEndHistory();
+
+    int predicted = getPredictedSessionEndMinute();
+    if (predicted >= 0) {
+        LOGF("[Schedule] Session end recorded at %02d:%02d (predicted end %02d:%02d, %d samples)",
+             minute / 60, minute % 60, predicted / 60, predicted % 60, sessionEndCount);
+    } else {
+        LOGF("[Schedule] Session end recorded at %02d:%02d (%d samples, no prediction yet)",
+             minute / 60, minute % 60, sessionEndCount);
+    }
+}
+
+int ScheduleManager::getPredictedSessionEndMinute() const {
+    if (sessionEndCount < SESSION_END_MIN_SAMPLES) return -1;
+
+    // Circular median: express every sample as a signed offset from the newest
+    // one so a cluster straddling midnight (23:50, 00:10) stays contiguous.
+    int newest = sessionEndMinutes[(sessionEndHead + SESSION_END_HISTORY - 1) % SESSION_END_HISTORY];
+    int offsets[SESSION_END_HISTORY];
+    for (int i = 0; i < sessionEndCount; i++) {
+        int d = ((sessionEndMinutes[i] - newest) % 1440 + 1440 + 720) % 1440 - 720;
+        int j = i;
+        while (j > 0 && offsets[j - 1] > d) {
+            offsets[j] = offsets[j - 1];
+            j--;
+        }
+        offsets[j] = d;
+    }
+    int median = (offsets[(sessionEndCount - 1) / 2] + offsets[sessionEndCount / 2]) / 2;
+
+    // Irregular schedules get no pre-warm rather than a wrong one:
+    // a majority of samples must sit close to the median.
+    int close = 0;
+    for (int i = 0; i < sessionEndCount; i++) {
+        if (abs(offsets[i] - median) <= SESSION_END_TOLERANCE_MINUTES) close++;
+    }
+    if (close * 2 <= sessionEndCount) return -1;
+
+    return ((newest + median) % 1440 + 1440) % 1440;
+}
+
+int ScheduleManager::getSessionEndSampleCount() const {
+    return sessionEndCount;
+}
+
+bool ScheduleManager::isPreWarmDue() {
+    if (!ntpSynced || !isSmartMode()) return false;
+
+    int predicted = getPredictedSessionEndMinute();
+    if (predicted < 0) return false;
+
+    time_t now = time(nullptr);
+    if (lastPreWarmEpoch != 0 &&
+        (unsigned long)now - lastPreWarmEpoch < SESSION_END_MERGE_SECONDS) {
+        return false;  // Already pre-warmed for this night
+    }
+
+    struct tm timeinfo;
+    if (!localtime_r(&now, &timeinfo)) return false;
+    int nowMinute = timeinfo.tm_hour * 60 + timeinfo.tm_min;
+    int minutesUntilEnd = (predicted - nowMinute + 1440) % 1440;
+    return minutesUntilEnd <= PREWARM_LEAD_MINUTES;
+}
+
+void ScheduleManager::markPreWarmStarted() {
+    lastPreWarmEpoch = (unsigned long)time(nullptr);
+}
+
+void ScheduleManager::loadSessionEndHistory() {
+    sessionEndCount = 0;
+    sessionEndHead = 0;
+    lastSessionEndEpoch = 0;
+
+    Preferences prefs;
+    if (!prefs.begin(SCHED_PREFS_NAMESPACE, true)) return;
+    String stored = prefs.getString(SCHED_PREFS_SESSION_KEY, "");
+    prefs.end();
+    if (stored.isEmpty()) return;
+
+    const char* p = stored.c_str();
+    char* end = nullptr;
+    lastSessionEndEpoch = strtoul(p, &end, 10);
+    if (!end || *end != '|') {
+        lastSessionEndEpoch = 0;
+        return;
+    }
+    p = end + 1;
+    while (*p && sessionEndCount < SESSION_END_HISTORY) {
+        long minute = strtol(p, &end, 10);
+        if (end == p) break;
+        if (minute >= 0 && minute < 1440) {
+            sessionEndMinutes[sessionEndHead] = (int16_t)minute;
+            sessionEndHead = (sessionEndHead + 1) % SESSION_END_HISTORY;
+            sessionEndCount++;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    LOG_DEBUGF("[Schedule] Loaded %d session-end samples", sessionEndCount);
+}
+
+void ScheduleManager::saveSessionEndHistory() {
+    // 10 (epoch) + 1 + 7 * 5 ("1439,") + NUL
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "%lu|", lastSessionEndEpoch);
+    int oldest = (sessionEndHead - sessionEndCount + SESSION_END_HISTORY) % SESSION_END_HISTORY;
+    for (int i = 0; i < sessionEndCount && n < (int)sizeof(buf); i++) {
+        int idx = (oldest + i) % SESSION_END_HISTORY;
+        n += snprintf(buf + n, sizeof(buf) - n, i ? ",%d" : "%d", sessionEndMinutes[idx]);
+    }
+
+    Preferences prefs;
+    if (!prefs.begin(SCHED_PREFS_NAMESPACE, false)) {
+        LOG_WARN("[Schedule] Failed to open NVS for session-end history");
+        return;
+    }
+    prefs.putString(SCHED_PREFS_SESSION_KEY, buf);
+    prefs.end();
+}
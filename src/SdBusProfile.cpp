@@ -0,0 +1,46 @@
+#include "SdBusProfile.h"
+#include <stdio.h>
+
+int formatSdBusProfile(const SdBusProfile& p, char* buf, size_t len) {
+    return snprintf(buf, len, "%u,%lu,%lu,%lu",
+                    (unsigned)p.width, (unsigned long)p.freqKhz,
+                    (unsigned long)p.readBps, (unsigned long)p.validatedTs);
+}
+
+bool parseSdBusProfile(const char* s, SdBusProfile& out) {
+    if (!s || !*s) return false;
+    unsigned width = 0;
+    unsigned long freq = 0, bps = 0, ts = 0;
+    if (sscanf(s, "%u,%lu,%lu,%lu", &width, &freq, &bps, &ts) != 4) return false;
+    if (width != 1 && width != 4) return false;
+    if (freq != SD_BUS_FREQ_DEFAULT_KHZ && freq != SD_BUS_FREQ_HIGHSPEED_KHZ) return false;
+
+    out.width = (uint8_t)width;
+    out.freqKhz = (uint32_t)freq;
+    out.readBps = (uint32_t)bps;
+    out.validatedTs = (uint32_t)ts;
+    return true;
+}
+
+int selectFastestStableSdBusTrial(const SdBusTrial* trials, size_t count) {
+    int best = -1;
+    uint64_t bestBps = 0;
+    for (size_t i = 0; i < count; i++) {
+        const SdBusTrial& t = trials[i];
+        if (!t.mounted || t.passes == 0 || t.errors > 0 || t.bytes == 0) continue;
+
+        uint64_t bps = ((uint64_t)t.bytes * 1000ULL) / (t.elapsedMs > 0 ? t.elapsedMs : 1);
+        if (best < 0 || bps * 100 >= bestBps * (100 + SD_BUS_MIN_GAIN_PCT)) {
+            best = (int)i;
+            bestBps = bps;
+        }
+    }
+    return best;
+}
+
+bool isSdBusCalibrationDue(bool hasStored, const SdBusProfile& stored, uint32_t now) {
+    if (!hasStored) return true;
+    if (now < 1000000000UL) return false;       // no NTP: keep the stored profile
+    if (stored.validatedTs == 0 || stored.validatedTs > now) return true;
+    return now - stored.validatedTs >= SD_BUS_REVALIDATE_SECS;
+}
@@ -0,0 +1,131 @@
+#include "SdHandover.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+static uint16_t ewma16(uint16_t current, uint32_t sample, bool first) {
+    if (sample > 0xFFFF) sample = 0xFFFF;
+    if (first) return (uint16_t)sample;
+    return (uint16_t)(((uint32_t)current * 3 + sample) / 4);
+}
+
+void sdHandoverRecordAcquire(SdHandoverStats& stats, uint32_t ms) {
+    stats.acquireMs = ewma16(stats.acquireMs, ms, stats.acquireMs == 0);
+}
+
+void sdHandoverRecordRelease(SdHandoverStats& stats, bool hostAccessSeen, uint32_t ms) {
+    // Halve both counters on saturation so the ratio keeps tracking recent behaviour
+    if (stats.releaseSeen == 255 || stats.releaseMissed == 255) {
+        stats.releaseSeen /= 2;
+        stats.releaseMissed /= 2;
+    }
+    if (hostAccessSeen) {
+        stats.releaseMs = ewma16(stats.releaseMs, ms, stats.releaseSeen == 0);
+        stats.releaseSeen++;
+    } else {
+        stats.releaseMissed++;
+    }
+}
+
+uint32_t sdHandoverReleaseWaitMs(const SdHandoverStats& stats) {
+    uint32_t samples = (uint32_t)stats.releaseSeen + stats.releaseMissed;
+    if (samples < SD_RELEASE_LEARN_SAMPLES) {
+        return SD_RELEASE_SETTLE_MAX_MS;
+    }
+    // Host seldom re-accesses promptly: waiting would only add dead time.
+    // Every SD_RELEASE_REPROBE_EVERY releases the full bound is waited again
+    // so a change in the machine's behaviour is still picked up.
+    if ((uint32_t)stats.releaseSeen * 4 < samples) {
+        return (samples % SD_RELEASE_REPROBE_EVERY) == 0 ? SD_RELEASE_SETTLE_MAX_MS : SD_MUX_SETTLE_MS;
+    }
+    uint32_t wait = (uint32_t)stats.releaseMs * 2;
+    if (wait < (uint32_t)stats.releaseMs + 50) wait = (uint32_t)stats.releaseMs + 50;
+    if (wait < SD_MUX_SETTLE_MS) wait = SD_MUX_SETTLE_MS;
+    if (wait > SD_RELEASE_SETTLE_MAX_MS) wait = SD_RELEASE_SETTLE_MAX_MS;
+    return wait;
+}
+
+static bool hostSeldomAccesses(const SdHandoverStats& stats) {
+    uint32_t samples = (uint32_t)stats.releaseSeen + stats.releaseMissed;
+    return (uint32_t)stats.releaseSeen * 4 < samples;
+}
+
+static bool movedBy(uint16_t a, uint16_t b, uint16_t delta) {
+    return (a > b ? a - b : b - a) >= delta;
+}
+
+bool sdHandoverNeedsSave(const SdHandoverStats& saved, const SdHandoverStats& current) {
+    uint32_t savedSamples = (uint32_t)saved.releaseSeen + saved.releaseMissed;
+    uint32_t samples = (uint32_t)current.releaseSeen + current.releaseMissed;
+    if (samples == savedSamples &&
+        current.acquireMs == saved.acquireMs && current.releaseMs == saved.releaseMs) {
+        return false;
+    }
+    if (samples < savedSamples || samples - savedSamples >= SD_HANDOVER_SAVE_EVERY) {
+        return true;  // Counters halved, or enough releases to be worth keeping
+    }
+    if (savedSamples < SD_RELEASE_LEARN_SAMPLES) {
+        return true;
+    }
+    if (hostSeldomAccesses(saved) != hostSeldomAccesses(current)) {
+        return true;
+    }
+    return movedBy(saved.acquireMs, current.acquireMs, SD_HANDOVER_SAVE_DELTA_MS) ||
+           movedBy(saved.releaseMs, current.releaseMs, SD_HANDOVER_SAVE_DELTA_MS);
+}
+
+int formatSdHandoverStats(const SdHandoverStats& stats, char* buf, size_t len) {
+    return snprintf(buf, len, "%u,%u,%u,%u",
+                    (unsigned)stats.acquireMs, (unsigned)stats.releaseMs,
+                    (unsigned)stats.releaseSeen, (unsigned)stats.releaseMissed);
+}
+
+bool parseSdHandoverStats(const char* s, SdHandoverStats& out) {
+    if (!s || !*s) return false;
+    unsigned a = 0, r = 0, seen = 0, missed = 0;
+    if (sscanf(s, "%u,%u,%u,%u", &a, &r, &seen, &missed) != 4) return false;
+    if (a > 0xFFFF || r > 0xFFFF || seen > 255 || missed > 255) return false;
+    out.acquireMs = (uint16_t)a;
+    out.releaseMs = (uint16_t)r;
+    out.releaseSeen = (uint8_t)seen;
+    out.releaseMissed = (uint8_t)missed;
+    return true;
+}
+
+bool parseMachineModel(const char* text, char* out, size_t outLen) {
+    if (!text || !out || outLen == 0) return false;
+    const char* start = nullptr;
+    const char* end = nullptr;
+
+    // AirSense 11: {"FlowGenerator":{"IdentificationProfiles":{"Product":{"ProductName":"..."
+    const char* key = strstr(text, "\"ProductName\"");
+    if (key) {
+        const char* colon = strchr(key + 13, ':');
+        const char* quote = colon ? strchr(colon, '"') : nullptr;
+        if (quote) {
+            start = quote + 1;
+            end = strchr(start, '"');
+        }
+    }
+
+    // AirSense 10: "#PNA AirSense_10_AutoSet"
+    if (!start || !end) {
+        const char* pna = strstr(text, "#PNA ");
+        if (pna) {
+            start = pna + 5;
+            end = start;
+            while (*end && *end != '\r' && *end != '\n') end++;
+        }
+    }
+
+    if (!start || !end || end <= start) return false;
+
+    size_t len = (size_t)(end - start);
+    if (len >= outLen) len = outLen - 1;
+    for (size_t i = 0; i < len; i++) {
+        char c = start[i];
+        out[i] = (isalnum((unsigned char)c) || c == '-' || c == '.') ? c : '_';
+    }
+    out[len] = '\0';
+    return len > 0;
+}
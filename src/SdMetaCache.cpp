@@ -0,0 +1,80 @@
+#include "SdMetaCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+SdMetaCache::SdMetaCache(const char* mountPoint) :
+    mountPoint(mountPoint ? mountPoint : ""),
+    hits(0),
+    misses(0) {
+    memset(slots, 0, sizeof(slots));
+}
+
+uint64_t SdMetaCache::hashPath(const char* path, uint16_t& len) {
+    uint64_t h = 1469598103934665603ULL;  // FNV-1a
+    size_t n = 0;
+    for (const char* p = path; *p; p++, n++) {
+        h ^= (uint8_t)*p;
+        h *= 1099511628211ULL;
+    }
+    len = (uint16_t)(n > 0xFFFF ? 0xFFFF : n);
+    return h ? h : 1;
+}
+
+bool SdMetaCache::lookup(const char* path, SdFileMeta& out) const {
+    if (!path) return false;
+    uint16_t len;
+    uint64_t key = hashPath(path, len);
+    const Slot& slot = slots[(size_t)(key % SLOTS)];
+    if (slot.key != key || slot.pathLen != len) return false;
+    out = slot.meta;
+    return true;
+}
+
+bool SdMetaCache::get(const char* path, SdFileMeta& out) {
+    if (!path) return false;
+    if (lookup(path, out)) {
+        hits++;
+        return (out.attr & SD_META_EXISTS) != 0;
+    }
+
+    misses++;
+    SdFileMeta meta = {0, 0, 0};
+    char full[160];
+    int n = snprintf(full, sizeof(full), "%s%s", mountPoint, path);
+    struct stat st;
+    if (n > 0 && (size_t)n < sizeof(full) && stat(full, &st) == 0) {
+        meta.size = (uint32_t)st.st_size;
+        meta.mtime = (uint32_t)st.st_mtime;
+        meta.attr = SD_META_EXISTS | (S_ISDIR(st.st_mode) ? SD_META_DIR : 0);
+    }
+    put(path, meta);
+    out = meta;
+    return (meta.attr & SD_META_EXISTS) != 0;
+}
+
+void SdMetaCache::put(const char* path, const SdFileMeta& meta) {
+    if (!path) return;
+    uint16_t len;
+    uint64_t key = hashPath(path, len);
+    Slot& slot = slots[(size_t)(key % SLOTS)];
+    slot.key = key;
+    slot.pathLen = len;
+    slot.meta = meta;
+}
+
+void SdMetaCache::invalidate(const char* path) {
+    if (!path) return;
+    uint16_t len;
+    uint64_t key = hashPath(path, len);
+    Slot& slot = slots[(size_t)(key % SLOTS)];
+    if (slot.key == key && slot.pathLen == len) {
+        slot.key = 0;
+    }
+}
+
+void SdMetaCache::clear() {
+    memset(slots, 0, sizeof(slots));
+    hits = 0;
+    misses = 0;
+}
@@ -1,5 +1,8 @@
 #include "SleepHQUploader.h"
 #include "Logger.h"
+#include "StaticString.h"
+#include "HeapGovernor.h"
+#include "IoBufferPool.h"
 
 #ifdef ENABLE_SLEEPHQ_UPLOAD
 
@@ -32,15 +35,29 @@ static const char* GTS_ROOT_R4_CA = \
 // Smaller buffers reduce peak current from concurrent SD read + TLS encrypt + WiFi TX,
 // at the cost of more SD read calls per file. Network throughput is the bottleneck,
 // not SD read speed, so smaller buffers have negligible transfer time impact.
+// The size comes from the heap governor's cloud_buffer budget (4096, 2048 or
+// 1024, whichever leaves its floor free); callers release the budget when done.
 #define CLOUD_UPLOAD_BUFFER_SIZE_MAX  4096
-#define CLOUD_UPLOAD_BUFFER_SIZE_MID  2048
 #define CLOUD_UPLOAD_BUFFER_SIZE_MIN  1024
 
 static size_t getAdaptiveBufferSize() {
-    uint32_t ma = ESP.getMaxAllocHeap();
-    if (ma > 50000) return CLOUD_UPLOAD_BUFFER_SIZE_MAX;
-    if (ma > 35000) return CLOUD_UPLOAD_BUFFER_SIZE_MID;
-    return CLOUD_UPLOAD_BUFFER_SIZE_MIN;
+    size_t size = g_heapGovernor.reserve(HeapBudget::CloudBuffer,
+                                         CLOUD_UPLOAD_BUFFER_SIZE_MAX,
+                                         CLOUD_UPLOAD_BUFFER_SIZE_MIN);
+    // Denied: stream anyway at the minimum, as before — the TLS session is
+    // already up and a 1K chunk is the least this path can do.
+    return size ? size : CLOUD_UPLOAD_BUFFER_SIZE_MIN;
+}
+
+// Classify a failed TLS connect for NetworkRecovery. Must be called before
+// resetTLS() — the mbedTLS error is held by the client instance.
+static NetFailureClass classifyTlsConnectFailure(WiFiClientSecure* client) {
+    char tlsError[96] = {0};
+    int tlsErrorCode = client ? client->lastError(tlsError, sizeof(tlsError)) : 0;
+    if (tlsErrorCode != 0) {
+        LOG_DEBUGF("[SleepHQ] TLS error %d: %s", tlsErrorCode, tlsError);
+    }
+    return classifyNetworkFailure(errno, tlsError);
 }
 
 SleepHQUploader::SleepHQUploader(Config* cfg)
@@ -49,7 +66,11 @@ SleepHQUploader::SleepHQUploader(Config* cfg)
       tokenExpiresIn(0),
       connected(false),
       lowMemoryKeepAliveWarned(false),
-      tlsClient(nullptr) {
+      transportError(false),
+      sdReadError(false),
+      tlsClient(nullptr),
+      chunkTuner(CLOUD_UPLOAD_BUFFER_SIZE_MIN, CLOUD_UPLOAD_BUFFER_SIZE_MAX),
+      readTap(nullptr) {
 }
 
 SleepHQUploader::~SleepHQUploader() {
@@ -173,6 +194,39 @@ bool SleepHQUploader::preWarmTLS() {
     return true;
 }
 
+bool SleepHQUploader::preWarm() {
+    // Resolve the API host first — lwIP caches the answer for its TTL,
+    // so the upload session's connect() skips the DNS round trip.
+    char host[128];
+    int port = 443;
+    parseHostPort(host, sizeof(host), port);
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip)) {
+        LOG_WARN("[SleepHQ] Pre-warm: DNS lookup failed (non-fatal)");
+    }
+
+    // Open the keep-alive TLS connection and refresh the OAuth token over it.
+    // The token and team id survive until the upload session's begin().
+    preWarmTLS();
+    if (!ensureAccessToken()) {
+        LOG_WARN("[SleepHQ] Pre-warm: OAuth failed (non-fatal, will retry during upload)");
+        return false;
+    }
+    if (teamId.isEmpty()) {
+        String configTeamId = config->getCloudTeamId();
+        if (!configTeamId.isEmpty()) {
+            teamId = configTeamId;
+        } else if (!discoverTeamId()) {
+            LOG_WARN("[SleepHQ] Pre-warm: team discovery failed (non-fatal)");
+        }
+    }
+
+    LOGF("[SleepHQ] Pre-warm complete: token valid %lus, TLS %s (fh=%u, ma=%u)",
+         getTokenRemainingSeconds(), isTlsAlive() ? "open" : "closed",
+         ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+    return true;
+}
+
 bool SleepHQUploader::begin() {
     LOG("[SleepHQ] Initializing cloud uploader...");
     
@@ -183,8 +237,8 @@ bool SleepHQUploader::begin() {
         return false;
     }
     
-    // Authenticate
-    if (!authenticate()) {
+    // Authenticate (reuses a token still valid from predictive pre-warm)
+    if (!ensureAccessToken()) {
         LOG_ERROR("[SleepHQ] Authentication failed");
         return false;
     }
@@ -194,6 +248,8 @@ bool SleepHQUploader::begin() {
     if (!configTeamId.isEmpty()) {
         teamId = configTeamId;
         LOGF("[SleepHQ] Using configured team ID: %s", teamId.c_str());
+    } else if (!teamId.isEmpty()) {
+        LOGF("[SleepHQ] Using cached team ID: %s", teamId.c_str());
     } else {
         if (!discoverTeamId()) {
             LOG_ERROR("[SleepHQ] Failed to discover team ID");
@@ -219,7 +275,7 @@ bool SleepHQUploader::authenticate() {
     LOG("[SleepHQ] Authenticating with OAuth...");
     
     String baseUrl = config->getCloudBaseUrl();
-    String tokenPath = "/oauth/token";
+    const char* tokenPath = "/oauth/token";
     
     // Build OAuth request body
     char bodyBuf[256];
@@ -332,7 +388,8 @@ bool SleepHQUploader::createImport() {
     
     LOG("[SleepHQ] Creating new import session...");
     
-    String path = "/api/v1/teams/" + teamId + "/imports";
+    StaticString<96> path;
+    path.format("/api/v1/teams/%s/imports", teamId.c_str());
     int deviceId = config->getCloudDeviceId();
     
     String body = "";
@@ -343,7 +400,7 @@ bool SleepHQUploader::createImport() {
     String responseBody;
     int httpCode;
     
-    if (!httpRequest("POST", path, body, 
+    if (!httpRequest("POST", path.c_str(), body, 
                      body.isEmpty() ? "" : "application/x-www-form-urlencoded",
                      responseBody, httpCode)) {
         LOG_ERROR("[SleepHQ] Failed to create import");
@@ -399,12 +456,13 @@ bool SleepHQUploader::processImport() {
     
     LOG("[SleepHQ] Processing import...");
     
-    String path = "/api/v1/imports/" + currentImportId + "/process_files";
+    StaticString<96> path;
+    path.format("/api/v1/imports/%s/process_files", currentImportId.c_str());
     
     String responseBody;
     int httpCode;
     
-    if (!httpRequest("POST", path, "", "", responseBody, httpCode)) {
+    if (!httpRequest("POST", path.c_str(), "", "", responseBody, httpCode)) {
         LOG_ERROR("[SleepHQ] Failed to process import");
         return false;
     }
@@ -444,10 +502,17 @@ String SleepHQUploader::computeContentHash(fs::FS &sd, const String& localPath,
     esp_rom_md5_init(&md5ctx);
     
     // Hash exactly snapshotSize bytes (not file.available() which can grow)
-    uint8_t buffer[CLOUD_UPLOAD_BUFFER_SIZE_MAX];
+    IoBuffer io(CLOUD_UPLOAD_BUFFER_SIZE_MAX, "cloud-hash");
+    if (!io) {
+        LOG_ERRORF("[SleepHQ] No buffer for hashing: %s", localPath.c_str());
+        file.close();
+        hashedSize = 0;
+        return "";
+    }
+    uint8_t* buffer = io.data();
     unsigned long totalHashed = 0;
     while (totalHashed < snapshotSize) {
-        size_t toRead = sizeof(buffer);
+        size_t toRead = io.size();
         if (snapshotSize - totalHashed < toRead) {
             toRead = snapshotSize - totalHashed;
         }
@@ -476,25 +541,26 @@ String SleepHQUploader::computeContentHash(fs::FS &sd, const String& localPath,
     return String(hashStr);
 }
 
-bool SleepHQUploader::upload(const String& localPath, const String& remotePath,
+bool SleepHQUploader::upload(const char* localPath, const char* remotePath,
                               fs::FS &sd, unsigned long& bytesTransferred, String& fileChecksum) {
     bytesTransferred = 0;
+    transportError = false;
+    sdReadError = false;
     
     if (!ensureAccessToken()) {
+        transportError = true;
         return false;
     }
     
     if (currentImportId.isEmpty()) {
         LOG_ERROR("[SleepHQ] No active import - call createImport() first");
+        transportError = true;
         return false;
     }
     
     // Extract filename from path
-    String fileName = localPath;
-    int lastSlash = fileName.lastIndexOf('/');
-    if (lastSlash >= 0) {
-        fileName = fileName.substring(lastSlash + 1);
-    }
+    const char* fileName = strrchr(localPath, '/');
+    fileName = fileName ? fileName + 1 : localPath;
     
     // ── Single-pass upload: content_hash computed on-the-fly ──
     // The SleepHQ API accepts content_hash in the multipart footer (after file
@@ -503,14 +569,14 @@ bool SleepHQUploader::upload(const String& localPath, const String& remotePath,
     // File size is snapshotted at open time to lock the byte count.
     File sizeCheckFile = sd.open(localPath, FILE_READ);
     if (!sizeCheckFile) {
-        LOG_ERRORF("[SleepHQ] Cannot open file: %s", localPath.c_str());
+        LOG_ERRORF("[SleepHQ] Cannot open file: %s", localPath);
         return false;
     }
     unsigned long lockedFileSize = sizeCheckFile.size();
     sizeCheckFile.close();
     
     if (lockedFileSize == 0) {
-        LOG_WARNF("[SleepHQ] Skipping empty file: %s", localPath.c_str());
+        LOG_WARNF("[SleepHQ] Skipping empty file: %s", localPath);
         return true;
     }
     
@@ -518,7 +584,7 @@ bool SleepHQUploader::upload(const String& localPath, const String& remotePath,
     uint32_t maxAlloc = ESP.getMaxAllocHeap();
     
     LOG_DEBUGF("[SleepHQ] Uploading: %s (%lu bytes, free: %u, max_alloc: %u)",
-               localPath.c_str(), lockedFileSize, freeHeap, maxAlloc);
+               localPath, lockedFileSize, freeHeap, maxAlloc);
     
     // Prefer one persistent TLS session across the entire import.
     // Reconnecting per large file increases TLS handshake churn and heap fragmentation risk.
@@ -540,20 +606,24 @@ bool SleepHQUploader::upload(const String& localPath, const String& remotePath,
     // packet bursts when the radio would be idle anyway.
     
     // Upload via multipart POST — content_hash computed on-the-fly and sent in footer
-    String path = "/api/v1/imports/" + currentImportId + "/files";
+    StaticString<96> path;
+    path.format("/api/v1/imports/%s/files", currentImportId.c_str());
     String responseBody;
     int httpCode;
     
     String calculatedFileChecksum;
     // contentHash is empty — httpMultipartUpload computes it on-the-fly
-    if (!httpMultipartUpload(path, fileName, localPath, "", lockedFileSize, sd, bytesTransferred, responseBody, httpCode, &calculatedFileChecksum, useKeepAlive)) {
-        LOG_ERRORF("[SleepHQ] Upload failed for: %s", localPath.c_str());
+    if (!httpMultipartUpload(path.c_str(), fileName, localPath, "", lockedFileSize, sd, bytesTransferred, responseBody, httpCode, &calculatedFileChecksum, useKeepAlive)) {
+        LOG_ERRORF("[SleepHQ] Upload failed for: %s", localPath);
+        transportError = !sdReadError;
         return false;
     }
     
     if (httpCode != 201 && httpCode != 200) {
-        LOG_ERRORF("[SleepHQ] Upload returned HTTP %d for: %s", httpCode, localPath.c_str());
+        LOG_ERRORF("[SleepHQ] Upload returned HTTP %d for: %s", httpCode, localPath);
         LOG_ERRORF("[SleepHQ] Response: %s", responseBody.c_str());
+        // Server/auth trouble is the backend's; other 4xx reject this file
+        transportError = (httpCode >= 500 || httpCode == 401 || httpCode == 408 || httpCode == 429);
         return false;
     }
     
@@ -561,7 +631,7 @@ bool SleepHQUploader::upload(const String& localPath, const String& remotePath,
         fileChecksum = calculatedFileChecksum;
     }
     
-    LOG_DEBUGF("[SleepHQ] Uploaded: %s (%lu bytes)", fileName.c_str(), bytesTransferred);
+    LOG_DEBUGF("[SleepHQ] Uploaded: %s (%lu bytes)", fileName, bytesTransferred);
     return true;
 }
 
@@ -596,7 +666,7 @@ unsigned long SleepHQUploader::getTokenRemainingSeconds() const {
 // HTTP Helpers
 // ============================================================================
 
-bool SleepHQUploader::httpRequest(const String& method, const String& path,
+bool SleepHQUploader::httpRequest(const char* method, const char* path,
                                    const String& body, const String& contentType,
                                    String& responseBody, int& httpCode) {
     httpCode = -1;
@@ -621,7 +691,8 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
             // SMB transfers the observed steady-state floor is ~38900 bytes, which
             // recovers after the transfer completes.  Since SMB and TLS never run
             // simultaneously, this guard only fires if heap is persistently fragmented.
-            if (maxAlloc < 36000) {
+            // The 36KB is the heap governor's tls floor.
+            if (!g_heapGovernor.hasRoom(HeapBudget::Tls)) {
                 LOG_ERRORF("[SleepHQ] Insufficient contiguous heap for SSL (%u bytes), skipping request", maxAlloc);
                 return false;
             }
@@ -631,16 +702,19 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
             if (!tlsClient->connect(host, port)) {
                 LOG_ERRORF("[SleepHQ] TLS connect failed (attempt %d)", attempt + 1);
                 if (attempt == 0) {
+                    NetFailureClass failure = classifyTlsConnectFailure(tlsClient);
                     resetTLS();
                     if (WiFi.status() != WL_CONNECTED) {
                         LOG_WARN("[SleepHQ] WiFi disconnected, waiting for reconnection...");
                         unsigned long startWait = millis();
-                        while (WiFi.status() != WL_CONNECTED && millis() - startWait < 10000) {
+                        while (WiFi.status() != WL_CONNECTED && millis() - startWait < 3000) {
                             esp_task_wdt_reset();
                             delay(100);
                         }
-                    } else {
-                        tryCoordinatedWifiCycle(true);
+                        if (WiFi.status() != WL_CONNECTED) {
+                            recoverNetwork(NetFailureClass::LinkLost, true);
+                        }
+                    } else if (recoverNetwork(failure, true)) {
                         resetTLS();
                     }
                     continue;
@@ -649,6 +723,7 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
             }
             LOGF("[SleepHQ] TLS connected (fh=%u, ma=%u)",
                  ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+            noteNetworkHealthy();
             setSendTimeout();
             esp_task_wdt_reset();  // Feed after handshake before header writes
         }
@@ -658,7 +733,7 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
             char hdrBuf[256];
             int n;
 
-            n = snprintf(hdrBuf, sizeof(hdrBuf), "%s %s HTTP/1.1\r\n", method.c_str(), path.c_str());
+            n = snprintf(hdrBuf, sizeof(hdrBuf), "%s %s HTTP/1.1\r\n", method, path);
             tlsClient->write((const uint8_t*)hdrBuf, n);
             esp_task_wdt_reset();
 
@@ -823,7 +898,7 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
 
         // Negative/zero code on attempt 0 → retry
         if (attempt == 0) {
-            LOG_WARNF("[SleepHQ] HTTP %s returned code %d, retrying...", method.c_str(), httpCode);
+            LOG_WARNF("[SleepHQ] HTTP %s returned code %d, retrying...", method, httpCode);
             resetTLS();
             continue;
         }
@@ -833,8 +908,8 @@ bool SleepHQUploader::httpRequest(const String& method, const String& path,
     return false;
 }
 
-bool SleepHQUploader::httpMultipartUpload(const String& path, const String& fileName,
-                                           const String& filePath, const String& contentHash,
+bool SleepHQUploader::httpMultipartUpload(const char* path, const char* fileName,
+                                           const char* filePath, const String& contentHash,
                                            unsigned long lockedFileSize,
                                            fs::FS &sd, unsigned long& bytesTransferred,
                                            String& responseBody, int& httpCode,
@@ -852,7 +927,8 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
     // Open the file
     File file = sd.open(filePath, FILE_READ);
     if (!file) {
-        LOG_ERRORF("[SleepHQ] Cannot open file: %s", filePath.c_str());
+        LOG_ERRORF("[SleepHQ] Cannot open file: %s", filePath);
+        sdReadError = true;
         return false;
     }
     // Use the locked file size (same byte count that was hashed) instead of
@@ -862,7 +938,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
     // Extract the directory path for the 'path' field (stack-allocated to avoid heap churn)
     char dirPath[128];
     {
-        const char* fp = filePath.c_str();
+        const char* fp = filePath;
         const char* ls = strrchr(fp, '/');
         if (ls && ls > fp) {
             size_t dirLen = ls - fp;
@@ -879,7 +955,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
     snprintf(boundary, sizeof(boundary), "----ESP32Boundary%lu", millis());
     
     // Calculate exact part lengths using snprintf(NULL,0,...) — zero heap allocation
-    const char* fnStr = fileName.c_str();
+    const char* fnStr = fileName;
     int head1Len = snprintf(NULL, 0, "--%s\r\nContent-Disposition: form-data; name=\"name\"\r\n\r\n%s\r\n",
                             boundary, fnStr);
     int head2Len = snprintf(NULL, 0, "--%s\r\nContent-Disposition: form-data; name=\"path\"\r\n\r\n%s\r\n",
@@ -905,9 +981,17 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
     char host[128];
     int port = 443;
     parseHostPort(host, sizeof(host), port);
+
+    // Stream buffer from the I/O pool, taken before anything is sent
+    IoBuffer io(CLOUD_UPLOAD_BUFFER_SIZE_MAX, "cloud-stream");
+    if (!io) {
+        LOG_ERROR("[SleepHQ] No buffer for streaming upload");
+        return false;
+    }
     
     // Retry loop for streaming upload (same pattern as in-memory path)
     for (int attempt = 0; attempt < 2; attempt++) {
+        sdReadError = false;  // Classify by the last attempt
         // Ensure we have a valid TLS client before attempting
         if (!tlsClient) {
             LOG_ERROR("[SleepHQ] TLS client lost during retry");
@@ -929,6 +1013,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
                 LOG_ERROR("[SleepHQ] Failed to connect for streaming upload");
                 
                 if (attempt == 0) {
+                    NetFailureClass failure = classifyTlsConnectFailure(tlsClient);
                     resetTLS(); // Full reset instead of just stop()
                     
                     // Check WiFi status and wait if disconnected
@@ -947,11 +1032,11 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
                             LOG_ERROR("[SleepHQ] WiFi still disconnected");
                         }
                     } else {
-                        // WiFi connected but TLS connect failed — attempt coordinated cycle.
-                        // Skips if SMB holds an active connection or cooldown has not elapsed.
-                        // Only reset TLS again if the cycle actually ran (WiFi was cycled);
-                        // if skipped, the fresh client from the resetTLS() above is still good.
-                        if (tryCoordinatedWifiCycle(true)) {
+                        // WiFi connected but TLS connect failed — run the recovery step
+                        // for the classified failure (DNS → DHCP renew, EHOSTUNREACH →
+                        // ARP refresh, RST/TLS → socket reset, escalating on repeats).
+                        // The full-cycle step still skips while SMB holds a connection.
+                        if (recoverNetwork(failure, true)) {
                             resetTLS();
                             if (!tlsClient) {
                                 LOG_ERROR("[SleepHQ] TLS client allocation failed after WiFi cycle (OOM)");
@@ -965,6 +1050,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
                 return false;
             }
             esp_task_wdt_reset();  // Feed after successful handshake
+            noteNetworkHealthy();
             setSendTimeout();
         } else {
             LOG_DEBUG("[SleepHQ] Streaming: reusing existing TLS connection (keep-alive)");
@@ -974,7 +1060,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
         {
             char hdrBuf[256];
             int n;
-            n = snprintf(hdrBuf, sizeof(hdrBuf), "POST %s HTTP/1.1\r\n", path.c_str());
+            n = snprintf(hdrBuf, sizeof(hdrBuf), "POST %s HTTP/1.1\r\n", path);
             tlsClient->write((const uint8_t*)hdrBuf, n);
             esp_task_wdt_reset();
             n = snprintf(hdrBuf, sizeof(hdrBuf), "Host: %s\r\n", host);
@@ -1020,22 +1106,27 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
         file = sd.open(filePath, FILE_READ);
         if (!file) {
             LOG_ERROR("[SleepHQ] Cannot re-open file for streaming");
+            sdReadError = true;
             return false;
         }
         
         md5_context_t md5ctx;
         esp_rom_md5_init(&md5ctx);
+        if (readTap) readTap->restart();
         
-        uint8_t buffer[CLOUD_UPLOAD_BUFFER_SIZE_MAX];
-        // Adaptive chunk size: smaller reads when heap is constrained
-        // to reduce peak current from concurrent SD + TLS + WiFi operations
-        const size_t adaptiveChunk = getAdaptiveBufferSize();
+        uint8_t* buffer = io.data();
+        // Adaptive chunk size: heap headroom caps it (smaller reads when heap is
+        // constrained reduce peak current from concurrent SD + TLS + WiFi);
+        // per-chunk latency, write retries and RSSI move it within that cap.
+        chunkTuner.beginFile(getAdaptiveBufferSize(), WiFi.RSSI());
+        // The buffer itself is pooled: the grant only caps the chunk
+        g_heapGovernor.release(HeapBudget::CloudBuffer);
         unsigned long totalSent = 0;
         bool writeError = false;
         int readRetries = 0;
         
         while (totalSent < fileSize) {
-            size_t toRead = adaptiveChunk;
+            size_t toRead = chunkTuner.getChunkSize();
             if (fileSize - totalSent < toRead) {
                 toRead = fileSize - totalSent;
             }
@@ -1050,17 +1141,21 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
                     continue;
                 }
                 LOG_ERRORF("[SleepHQ] File read failed at %lu/%lu bytes", totalSent, fileSize);
+                sdReadError = true;
                 break;
             }
             readRetries = 0; // Reset retry counter on success
             
             // Update checksum with file data
             esp_rom_md5_update(&md5ctx, buffer, bytesRead);
+            if (readTap) readTap->feed(buffer, bytesRead);
             
             // Write to TLS with retry and partial write handling
             size_t remainingToWrite = bytesRead;
             uint8_t* writePtr = buffer;
             int writeRetries = 0;
+            int chunkRetries = 0;
+            unsigned long chunkStart = millis();
             
             while (remainingToWrite > 0) {
                 size_t written = tlsClient->write(writePtr, remainingToWrite);
@@ -1087,6 +1182,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
                         esp_task_wdt_reset();  // feed WDT during retry back-off
                         delay(500); // Wait longer for socket buffer to drain
                         writeRetries++;
+                        chunkRetries++;
                         yield();
                         continue;
                     } else {
@@ -1100,6 +1196,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
             if (writeError) {
                 break;
             }
+            chunkTuner.recordChunk(bytesRead, millis() - chunkStart, chunkRetries);
             
             // Feed both hardware and software watchdogs during large file streaming
             esp_task_wdt_reset();
@@ -1110,9 +1207,18 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
             // Without yields, the upload loop monopolizes the CPU at max frequency.
             // taskYIELD() lets the IDLE task run briefly, allowing the DFS governor
             // to scale down if no other high-priority work is pending.
-            taskYIELD();
+            // On a stalling link the tuner adds pacing so lwIP can drain ACKs.
+            uint16_t paceMs = chunkTuner.getPaceDelayMs();
+            if (paceMs > 0) {
+                delay(paceMs);
+            } else {
+                taskYIELD();
+            }
         }
         file.close();
+        LOG_DEBUGF("[SleepHQ] Chunk tuner: %u B chunks, %u ms pace, ~%lu B/s, %lu stalls",
+                   (unsigned)chunkTuner.getChunkSize(), (unsigned)chunkTuner.getPaceDelayMs(),
+                   (unsigned long)chunkTuner.getThroughputBps(), (unsigned long)chunkTuner.getStallCount());
 
         if (totalSent != fileSize) {
             if (writeError) {
@@ -1123,9 +1229,9 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
             resetTLS(); // Full reset to clear FDs
             
             // resetTLS() above already created a fresh WiFiClientSecure.
-            // Attempt a coordinated cycle only if SMB is idle and cooldown allows;
-            // write errors are usually transient buffer pressure, not dead WiFi.
-            tryCoordinatedWifiCycle(true);
+            // Write errors are usually transient buffer pressure, not dead WiFi:
+            // start at the socket-reset step and only escalate if they repeat.
+            recoverNetwork(classifyNetworkFailure(errno, nullptr), true);
             
             if (attempt == 0) {
                 continue;
@@ -1136,8 +1242,7 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
         if (writeError) {
             resetTLS(); // Full reset to clear FDs
             
-            // Attempt a coordinated cycle only if SMB is idle and cooldown allows.
-            tryCoordinatedWifiCycle(true);
+            recoverNetwork(classifyNetworkFailure(errno, nullptr), true);
             
             if (attempt == 0) {
                 LOG_WARN("[SleepHQ] Streaming write failed, reconnecting...");
@@ -1400,4 +1505,155 @@ bool SleepHQUploader::httpMultipartUpload(const String& path, const String& file
     return false;
 }
 
+// ============================================================================
+// Network self-test
+// ============================================================================
+
+// Unrouted path: the server reads and rejects the body, so the POST exercises
+// the full upload path without creating an import.  Pointing CLOUD_BASE_URL at
+// a local stand-in times the same path without leaving the LAN.
+#define NETBENCH_CLOUD_POST_PATH "/api/v1/netbench"
+
+bool SleepHQUploader::runNetBench(uint32_t postBytes, CloudBenchResult& result) {
+    memset(&result, 0, sizeof(result));
+    result.postHttpCode = -1;
+
+    char host[128];
+    int port = 443;
+    parseHostPort(host, sizeof(host), port);
+
+    // Phase 1: DNS
+    IPAddress ip;
+    unsigned long t0 = millis();
+    if (!WiFi.hostByName(host, ip)) {
+        LOG_WARNF("[SleepHQ] NetBench: DNS lookup for %s failed", host);
+        return false;
+    }
+    result.dnsMs = millis() - t0;
+
+    // Phase 2: fresh TCP + TLS handshake
+    if (tlsClient && tlsClient->connected()) {
+        resetTLS();
+    } else {
+        setupTLS();
+    }
+    if (!tlsClient || !g_heapGovernor.hasRoom(HeapBudget::Tls)) {
+        LOG_WARNF("[SleepHQ] NetBench: insufficient heap for TLS (ma=%u)", ESP.getMaxAllocHeap());
+        return false;
+    }
+    esp_task_wdt_reset();
+    t0 = millis();
+    if (!tlsClient->connect(host, port)) {
+        esp_task_wdt_reset();
+        LOG_WARN("[SleepHQ] NetBench: TLS handshake failed");
+        return false;
+    }
+    result.tlsMs = millis() - t0;
+    esp_task_wdt_reset();
+    setSendTimeout();
+    noteNetworkHealthy();
+
+    // Phase 3: authenticated API round trip over the open connection
+    if (ensureAccessToken()) {
+        String responseBody;
+        int httpCode = -1;
+        t0 = millis();
+        if (httpRequest("GET", "/api/v1/me", "", "", responseBody, httpCode)) {
+            result.apiRttMs = millis() - t0;
+        }
+    } else {
+        LOG_WARN("[SleepHQ] NetBench: OAuth failed — skipping API round trip");
+    }
+
+    // Phase 4: bounded upload-sized POST
+    if (!tlsClient->connected()) {
+        esp_task_wdt_reset();
+        if (!tlsClient->connect(host, port)) {
+            LOG_WARN("[SleepHQ] NetBench: reconnect before POST failed");
+            resetTLS();
+            return false;
+        }
+        setSendTimeout();
+    }
+
+    size_t bufSize = getAdaptiveBufferSize();
+    IoBuffer post(bufSize, "netbench");
+    uint8_t* buf = post.data();
+    if (!buf) {
+        LOG_WARN("[SleepHQ] NetBench: POST buffer allocation failed");
+        g_heapGovernor.release(HeapBudget::CloudBuffer);
+        resetTLS();
+        return false;
+    }
+    memset(buf, 0x5A, bufSize);
+
+    char hdrBuf[256];
+    int n = snprintf(hdrBuf, sizeof(hdrBuf),
+                     "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/octet-stream\r\n"
+                     "Content-Length: %u\r\nConnection: close\r\n",
+                     NETBENCH_CLOUD_POST_PATH, host, (unsigned)postBytes);
+    tlsClient->write((const uint8_t*)hdrBuf, n);
+    if (!accessToken.isEmpty()) {
+        tlsClient->write((const uint8_t*)"Authorization: Bearer ", 22);
+        tlsClient->write((const uint8_t*)accessToken.c_str(), accessToken.length());
+        tlsClient->write((const uint8_t*)"\r\n", 2);
+    }
+    tlsClient->write((const uint8_t*)"\r\n", 2);
+
+    extern volatile unsigned long g_uploadHeartbeat;
+    uint32_t sent = 0;
+    t0 = millis();
+    while (sent < postBytes && millis() - t0 < NETBENCH_PHASE_MAX_MS) {
+        size_t chunk = postBytes - sent;
+        if (chunk > bufSize) chunk = bufSize;
+        size_t w = tlsClient->write(buf, chunk);
+        if (w == 0) {
+            // Server answered early and closed — keep what was sent
+            break;
+        }
+        sent += w;
+        esp_task_wdt_reset();
+        g_uploadHeartbeat = millis();
+    }
+    tlsClient->flush();
+    result.postMs = millis() - t0;
+    result.postBytes = sent;
+    post.release();
+    g_heapGovernor.release(HeapBudget::CloudBuffer);
+
+    // Time to the status line (server-side processing + one RTT)
+    t0 = millis();
+    unsigned long deadline = t0 + 15000;
+    while (!tlsClient->available() && tlsClient->connected() && millis() < deadline) {
+        esp_task_wdt_reset();
+        delay(5);
+    }
+    if (tlsClient->available()) {
+        result.postResponseMs = millis() - t0;
+        char lineBuf[64];
+        int lineLen = 0;
+        unsigned long ld = millis() + 2000;
+        while (millis() < ld) {
+            if (!tlsClient->available()) { delay(2); continue; }
+            int c = tlsClient->read();
+            if (c < 0 || c == '\n') break;
+            if (c != '\r' && lineLen < (int)sizeof(lineBuf) - 1) lineBuf[lineLen++] = (char)c;
+        }
+        lineBuf[lineLen] = '\0';
+        const char* sp = strchr(lineBuf, ' ');
+        result.postHttpCode = sp ? atoi(sp + 1) : -1;
+    }
+
+    // Connection: close — drop it and reclaim the TLS buffers
+    resetTLS();
+
+    LOGF("[SleepHQ] NetBench: dns=%lums tls=%lums api=%lums post=%u B in %lums (HTTP %d, +%lums)",
+         (unsigned long)result.dnsMs, (unsigned long)result.tlsMs, (unsigned long)result.apiRttMs,
+         (unsigned)result.postBytes, (unsigned long)result.postMs, result.postHttpCode,
+         (unsigned long)result.postResponseMs);
+
+    result.ok = result.postBytes > 0 && result.postHttpCode > 0;
+    return result.ok;
+}
+
 #endif // ENABLE_SLEEPHQ_UPLOAD
@@ -0,0 +1,155 @@
+#include "TarArchive.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+// Right-aligned, zero-padded octal with a trailing NUL in a `width`-byte field
+bool putOctal(uint8_t* field, size_t width, uint32_t value) {
+    char text[16];
+    int n = snprintf(text, sizeof(text), "%0*lo", (int)(width - 1), (unsigned long)value);
+    if (n != (int)(width - 1)) {
+        return false;
+    }
+    memcpy(field, text, width - 1);
+    field[width - 1] = '\0';
+    return true;
+}
+}
+
+bool formatTarHeader(uint8_t* block, const char* name, uint32_t size, uint32_t mtime) {
+    memset(block, 0, TAR_BLOCK_SIZE);
+    size_t nameLen = name ? strlen(name) : 0;
+    if (nameLen == 0 || nameLen > TAR_NAME_MAX) {
+        return false;
+    }
+    memcpy(block, name, nameLen);
+    if (!putOctal(block + 100, 8, 0644) ||     // mode
+        !putOctal(block + 108, 8, 0) ||        // uid
+        !putOctal(block + 116, 8, 0) ||        // gid
+        !putOctal(block + 124, 12, size) ||
+        !putOctal(block + 136, 12, mtime)) {
+        return false;
+    }
+    block[156] = '0';                          // regular file
+    memcpy(block + 257, "ustar", 6);           // magic incl. NUL
+    memcpy(block + 263, "00", 2);              // version
+
+    // Checksum is computed with its own field set to spaces
+    memset(block + 148, ' ', 8);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += block[i];
+    }
+    // At most 512 * 255 = 0377000: six digits and a NUL, then a space
+    if (!putOctal(block + 148, 7, sum)) {
+        return false;
+    }
+    block[155] = ' ';
+    return true;
+}
+
+size_t formatTarIndexLine(char* out, size_t outLen, const char* name,
+                          uint32_t dataOffset, uint32_t size, uint32_t mtime) {
+    int n = snprintf(out, outLen, "%s\t%lu\t%lu\t%lu\n", name ? name : "",
+                     (unsigned long)dataOffset, (unsigned long)size, (unsigned long)mtime);
+    return (n > 0 && (size_t)n < outLen) ? (size_t)n : 0;
+}
+
+// ============================================================================
+// TarStreamWriter
+// ============================================================================
+
+TarStreamWriter::TarStreamWriter(uint8_t* buffer, size_t capacity, TarSink sink, void* ctx)
+    : buffer(buffer),
+      capacity(capacity),
+      fill(0),
+      sink(sink),
+      ctx(ctx),
+      produced(0),
+      memberStart(0),
+      memberSize(0),
+      memberWritten(0),
+      failed(!buffer || capacity == 0 || !sink) {
+}
+
+bool TarStreamWriter::flush() {
+    if (failed) {
+        return false;
+    }
+    if (fill > 0 && !sink(ctx, buffer, fill)) {
+        failed = true;
+        return false;
+    }
+    fill = 0;
+    return true;
+}
+
+bool TarStreamWriter::put(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        if (fill == capacity && !flush()) {
+            return false;
+        }
+        size_t take = capacity - fill;
+        if (take > len) take = len;
+        if (data) {
+            memcpy(buffer + fill, data, take);
+            data += take;
+        } else {
+            memset(buffer + fill, 0, take);
+        }
+        fill += take;
+        produced += take;
+        len -= take;
+    }
+    return !failed;
+}
+
+bool TarStreamWriter::putZeros(size_t len) {
+    return put(nullptr, len);
+}
+
+bool TarStreamWriter::beginMember(const char* name, uint32_t size, uint32_t mtime) {
+    uint8_t header[TAR_BLOCK_SIZE];
+    if (failed || !formatTarHeader(header, name, size, mtime) || !put(header, sizeof(header))) {
+        return false;
+    }
+    memberStart = produced;
+    memberSize = size;
+    memberWritten = 0;
+    return true;
+}
+
+uint8_t* TarStreamWriter::reserve(size_t& space) {
+    space = 0;
+    if (fill == capacity && !flush()) {
+        return nullptr;
+    }
+    if (failed) {
+        return nullptr;
+    }
+    space = capacity - fill;
+    return buffer + fill;
+}
+
+bool TarStreamWriter::commit(size_t len) {
+    if (failed || len > capacity - fill || memberWritten + len > memberSize) {
+        failed = true;
+        return false;
+    }
+    fill += len;
+    produced += len;
+    memberWritten += len;
+    return true;
+}
+
+bool TarStreamWriter::endMember() {
+    if (failed || memberWritten != memberSize) {
+        failed = true;
+        return false;
+    }
+    return putZeros(tarPadding(memberSize));
+}
+
+bool TarStreamWriter::finish() {
+    return putZeros(2 * TAR_BLOCK_SIZE) && flush();
+}
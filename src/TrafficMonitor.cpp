@@ -6,6 +6,7 @@ TrafficMonitor::TrafficMonitor()
     , _initialized(false)
     , _pcntUnit(nullptr)
     , _pcntChannel(nullptr)
+    , _activityHook(nullptr)
     , _lastSampleTime(0)
     , _lastSampleActive(false)
     , _lastPulseCount(0)
@@ -71,6 +72,18 @@ void TrafficMonitor::begin(int pin) {
         PCNT_CHANNEL_LEVEL_ACTION_KEEP,      // High level
         PCNT_CHANNEL_LEVEL_ACTION_KEEP);     // Low level
     
+    // First edge after each clear wakes the FSM (callbacks must be
+    // registered before the unit is enabled)
+    err = pcnt_unit_add_watch_point(_pcntUnit, 1);
+    if (err == ESP_OK) {
+        pcnt_event_callbacks_t cbs = {};
+        cbs.on_reach = onWatchPoint;
+        err = pcnt_unit_register_event_callbacks(_pcntUnit, &cbs, this);
+    }
+    if (err != ESP_OK) {
+        LOG_WARNF("PCNT activity wake-up unavailable: %d", err);
+    }
+    
     // Enable and start counter
     pcnt_unit_enable(_pcntUnit);
     pcnt_unit_clear_count(_pcntUnit);
@@ -83,6 +96,13 @@ void TrafficMonitor::begin(int pin) {
     LOGF("TrafficMonitor initialized on GPIO %d", _pin);
 }
 
+bool IRAM_ATTR TrafficMonitor::onWatchPoint(pcnt_unit_handle_t unit,
+                                            const pcnt_watch_event_data_t* edata, void* ctx) {
+    TrafficMonitor* self = static_cast<TrafficMonitor*>(ctx);
+    ActivityHook hook = self->_activityHook;
+    return hook ? hook() : false;
+}
+
 void TrafficMonitor::update() {
     if (!_initialized || _suspended) return;
     
@@ -166,6 +186,13 @@ void TrafficMonitor::clearActivityLatch() {
     }
 }
 
+int TrafficMonitor::peekRawCount() const {
+    if (!_initialized || _suspended || _pcntUnit == nullptr) return -1;
+    int count = 0;
+    if (pcnt_unit_get_count(_pcntUnit, &count) != ESP_OK) return -1;
+    return count;
+}
+
 void TrafficMonitor::suspend() {
     if (!_initialized || _suspended) return;
     
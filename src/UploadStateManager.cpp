@@ -1,5 +1,7 @@
 #include "UploadStateManager.h"
 #include "Logger.h"
+#include "SdMetaCache.h"
+#include "IoBufferPool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,423 +13,203 @@
 #endif
 
 namespace {
-static inline bool readLine(File& file, char* buffer, size_t bufferLen) {
-    if (bufferLen == 0) {
-        return false;
+// Hash read chunk; checked out of the I/O pool (a 4KB slot)
+static const size_t HASH_BUFFER_SIZE = 4096;
+
+// EDF "number of bytes in header record" (8 ASCII chars at offset 184).
+// Returns 0 if the field is not a plausible header length for this file.
+static uint32_t readEdfHeaderLen(File& file, uint32_t fileSize, uint32_t maxLen) {
+    char field[9] = {0};
+    if (fileSize < 512 || !file.seek(184) || file.read((uint8_t*)field, 8) != 8) {
+        return 0;
     }
 
-    size_t idx = 0;
-    while (file.available()) {
-        int ch = file.read();
-        if (ch < 0) {
-            break;
-        }
-        if (ch == '\r') {
+    uint32_t value = 0;
+    bool digits = false;
+    for (int i = 0; i < 8; ++i) {
+        char c = field[i];
+        if (c == ' ') {
+            if (digits) break;
             continue;
         }
-        if (ch == '\n') {
-            break;
-        }
-        if (idx + 1 < bufferLen) {
-            buffer[idx++] = (char)ch;
+        if (c < '0' || c > '9') {
+            return 0;
         }
+        value = value * 10 + (uint32_t)(c - '0');
+        digits = true;
     }
 
-    if (idx == 0 && !file.available()) {
-        buffer[0] = '\0';
-        return false;
+    if (!digits || value < 512 || (value % 256) != 0 || value > maxLen || value > fileSize) {
+        return 0;
     }
-
-    buffer[idx] = '\0';
-    return true;
+    return value;
 }
 
-static inline int hexNibble(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    return -1;
+// Last 64-byte MD5 block boundary of the data records
+static inline uint32_t appendBoundary(uint32_t headerLen, uint32_t length) {
+    return headerLen + ((length - headerLen) & ~(uint32_t)63);
 }
 
-static inline bool parseDayToken(const char* token, uint32_t& day) {
-    if (!token) {
-        return false;
-    }
-
-    if (strcmp(token, "0") == 0) {
-        day = 0;
+static bool hashFileRange(File& file, uint32_t from, uint32_t to, md5_context_t& ctx,
+                          uint8_t* buffer, size_t bufferSize) {
+    if (to <= from) {
         return true;
     }
-
-    if (strlen(token) != 8) {
+    if (!file.seek(from)) {
         return false;
     }
 
-    uint32_t value = 0;
-    for (size_t i = 0; i < 8; ++i) {
-        char c = token[i];
-        if (c < '0' || c > '9') {
+    uint32_t pos = from;
+    while (pos < to) {
+        size_t want = (to - pos) < bufferSize ? (size_t)(to - pos) : bufferSize;
+        size_t bytesRead = file.read(buffer, want);
+        if (bytesRead == 0) {
             return false;
         }
-        value = value * 10 + (uint32_t)(c - '0');
-    }
-
-    day = value;
-    return true;
-}
-}
-
-void UploadStateManager::setPaths(const String& snapshotPath, const String& journalPath) {
-    stateSnapshotPath = snapshotPath;
-    stateJournalPath  = journalPath;
-}
-
-UploadStateManager::UploadStateManager() 
-    : stateSnapshotPath("/littlefs/.upload_state.v2"),
-      stateJournalPath("/littlefs/.upload_state.v2.log"),
-      lastUploadTimestamp(0),
-      completedCount(0),
-      pendingCount(0),
-      fileEntryCount(0),
-      currentRetryFolderDay(0),
-      currentRetryCount(0),
-      journalEventCount(0),
-      journalLineCount(0),
-      forceCompaction(false),
-      totalFoldersCount(0) {
-    clearState();
-}
-
-bool UploadStateManager::begin(fs::FS &sd) {
-    LOG("[UploadStateManager] Initializing...");
-    
-    // Try to load existing state
-    bool loadedState = loadState(sd);
-    if (!loadedState) {
-        LOG("[UploadStateManager] WARNING: No existing state file or failed to load");
-        LOG("[UploadStateManager] Starting with empty state - all files will be considered new");
-        clearState();
-    }
-
-    if (loadedState && shouldCompact(sd)) {
-        compactState(sd);
-    }
-    
-    return true;  // Always return true - we can operate with empty state
-}
-
-void UploadStateManager::clearState() {
-    lastUploadTimestamp = 0;
-    completedCount = 0;
-    pendingCount = 0;
-    fileEntryCount = 0;
-    currentRetryFolderDay = 0;
-    currentRetryCount = 0;
-    journalEventCount = 0;
-    journalLineCount = 0;
-    forceCompaction = false;
-    totalFoldersCount = 0;
-
-    memset(completedFolders, 0, sizeof(completedFolders));
-    memset(pendingFolders, 0, sizeof(pendingFolders));
-    memset(fileEntries, 0, sizeof(fileEntries));
-    memset(journalEvents, 0, sizeof(journalEvents));
-}
-
-bool UploadStateManager::isDatalogPath(const String& path) {
-    return path.startsWith("/DATALOG/");
-}
-
-bool UploadStateManager::parseDayKey(const String& text, DayKey& outDay) {
-    if (text.length() != 8) {
-        return false;
-    }
-
-    uint32_t value = 0;
-    for (size_t i = 0; i < 8; ++i) {
-        char c = text[i];
-        if (c < '0' || c > '9') {
-            return false;
+        esp_rom_md5_update(&ctx, buffer, bytesRead);
+        pos += bytesRead;
+        if (((pos - from) % (10 * bufferSize)) == 0) {
+            yield();
         }
-        value = value * 10 + (uint32_t)(c - '0');
     }
-
-    outDay = value;
     return true;
 }
 
-void UploadStateManager::dayKeyToChars(DayKey day, char* out, size_t outLen) {
-    if (outLen == 0) {
-        return;
-    }
-    if (day == 0) {
-        snprintf(out, outLen, "0");
-        return;
-    }
-    snprintf(out, outLen, "%08lu", (unsigned long)day);
-}
-
-UploadStateManager::PathHash UploadStateManager::hashPath(const String& path) {
-    const uint64_t fnvOffset = 1469598103934665603ULL;
-    const uint64_t fnvPrime = 1099511628211ULL;
-    uint64_t hash = fnvOffset;
-
-    const char* p = path.c_str();
-    while (*p) {
-        hash ^= (uint8_t)(*p);
-        hash *= fnvPrime;
-        ++p;
-    }
-
-    return hash;
-}
-
-bool UploadStateManager::parseHexMd5(const char* hex, uint8_t out[16]) {
-    if (!hex || strlen(hex) != 32) {
+// Resume the body MD5 from a saved block-boundary state and finish it over [from, to)
+static bool finishAppendBody(File& file, const uint8_t* midstate, size_t midstateLen,
+                             uint32_t from, uint32_t to, uint8_t out[16],
+                             uint8_t* buffer, size_t bufferSize) {
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    memcpy(&ctx, midstate, midstateLen);
+    if (!hashFileRange(file, from, to, ctx, buffer, bufferSize)) {
         return false;
     }
-
-    for (int i = 0; i < 16; ++i) {
-        int hi = hexNibble(hex[i * 2]);
-        int lo = hexNibble(hex[i * 2 + 1]);
-        if (hi < 0 || lo < 0) {
-            return false;
-        }
-        out[i] = (uint8_t)((hi << 4) | lo);
-    }
-
+    esp_rom_md5_final(out, &ctx);
     return true;
 }
-
-void UploadStateManager::md5ToHex(const uint8_t md5[16], char out[33]) {
-    for (int i = 0; i < 16; ++i) {
-        snprintf(out + (i * 2), 3, "%02x", md5[i]);
-    }
-    out[32] = '\0';
 }
 
-int UploadStateManager::findCompletedIndex(DayKey day) const {
-    for (uint16_t i = 0; i < completedCount; ++i) {
-        if (completedFolders[i].day == day) {
-            return (int)i;
-        }
-    }
-    return -1;
-}
 
-int UploadStateManager::findPendingIndex(DayKey day) const {
-    for (uint16_t i = 0; i < pendingCount; ++i) {
-        if (pendingFolders[i].day == day) {
-            return (int)i;
-        }
-    }
-    return -1;
+UploadStateManager::UploadStateManager()
+    : store(new UploadStateStore(1)),
+      ownsStore(true),
+      backend(0),
+      backendBit(1),
+      metaCache(nullptr) {
 }
 
-int UploadStateManager::findFileIndex(PathHash pathHash) const {
-    for (uint16_t i = 0; i < fileEntryCount; ++i) {
-        if ((fileEntries[i].flags & FILE_FLAG_ACTIVE) && fileEntries[i].pathHash == pathHash) {
-            return (int)i;
-        }
-    }
-    return -1;
+UploadStateManager::UploadStateManager(UploadStateStore* sharedStore, uint8_t backend)
+    : store(sharedStore),
+      ownsStore(false),
+      backend(backend),
+      backendBit((uint8_t)(1u << backend)),
+      metaCache(nullptr) {
 }
 
-void UploadStateManager::queueEvent(const JournalEvent& event) {
-    if (journalEventCount >= MAX_JOURNAL_EVENTS) {
-        forceCompaction = true;
-        return;
+UploadStateManager::~UploadStateManager() {
+    if (ownsStore) {
+        delete store;
     }
-    journalEvents[journalEventCount++] = event;
 }
 
-bool UploadStateManager::addCompletedInternal(DayKey day, bool queue) {
-    if (findCompletedIndex(day) >= 0) {
-        return false;  // Already exists
-    }
-
-    if (completedCount >= MAX_COMPLETED_FOLDERS) {
-        // Remove oldest entry (at index 0)
-        if (completedCount > 1) {
-            memmove(&completedFolders[0], &completedFolders[1], 
-                    sizeof(CompletedFolderEntry) * (completedCount - 1));
-        }
-        completedCount--;
-        forceCompaction = true;
-    }
-
-    completedFolders[completedCount].day = day;
-    completedCount++;
-
-    if (queue) {
-        JournalEvent event = {};
-        event.type = JournalEventType::AddCompleted;
-        event.day = day;
-        queueEvent(event);
-    }
-
-    return true;
+void UploadStateManager::setPaths(const String& snapshotPath, const String& journalPath) {
+    store->setPaths(snapshotPath, journalPath);
 }
 
-bool UploadStateManager::removeCompletedInternal(DayKey day, bool queue) {
-    int idx = findCompletedIndex(day);
-    if (idx < 0) {
-        return false;
-    }
-
-    if ((uint16_t)idx < (completedCount - 1)) {
-        memmove(&completedFolders[idx], &completedFolders[idx + 1], sizeof(CompletedFolderEntry) * (completedCount - idx - 1));
-    }
-    completedCount--;
-
-    if (queue) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::RemoveCompleted;
-        ev.day = day;
-        queueEvent(ev);
-    }
-    return true;
+bool UploadStateManager::begin(fs::FS &sd) {
+    // A shared store is loaded once by whoever created it
+    return ownsStore ? store->begin(sd) : true;
 }
 
-bool UploadStateManager::addPendingInternal(DayKey day, UnixTs ts, bool queue) {
-    if (day == 0) {
-        return false;
-    }
-
-    int idx = findPendingIndex(day);
-    if (idx >= 0) {
-        pendingFolders[idx].firstSeenTs = ts;
-    } else {
-        if (pendingCount >= MAX_PENDING_FOLDERS) {
-            memmove(&pendingFolders[0], &pendingFolders[1], sizeof(PendingFolderEntry) * (MAX_PENDING_FOLDERS - 1));
-            pendingCount = MAX_PENDING_FOLDERS - 1;
-            forceCompaction = true;
-        }
-        pendingFolders[pendingCount].day = day;
-        pendingFolders[pendingCount].firstSeenTs = ts;
-        pendingCount++;
-    }
-
-    if (queue) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::AddPending;
-        ev.day = day;
-        ev.timestamp = ts;
-        queueEvent(ev);
-    }
-    return true;
+bool UploadStateManager::isDatalogPath(const char* path) {
+    return strncmp(path, "/DATALOG/", 9) == 0;
 }
 
-bool UploadStateManager::removePendingInternal(DayKey day, bool queue) {
-    int idx = findPendingIndex(day);
-    if (idx < 0) {
+bool UploadStateManager::isAppendTracked(const char* path) {
+    // Root-level EDF files only grow (STR.edf); DATALOG files are tracked by size
+    size_t len = strlen(path);
+    if (isDatalogPath(path) || len < 5) {
         return false;
     }
-
-    if ((uint16_t)idx < (pendingCount - 1)) {
-        memmove(&pendingFolders[idx], &pendingFolders[idx + 1], sizeof(PendingFolderEntry) * (pendingCount - idx - 1));
-    }
-    pendingCount--;
-
-    if (queue) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::RemovePending;
-        ev.day = day;
-        queueEvent(ev);
-    }
-    return true;
-}
-
-void UploadStateManager::setRetryInternal(DayKey day, int retryCount, bool queue) {
-    currentRetryFolderDay = day;
-    currentRetryCount = retryCount < 0 ? 0 : retryCount;
-
-    if (queue) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::SetRetry;
-        ev.day = day;
-        ev.retryCount = (uint16_t)currentRetryCount;
-        queueEvent(ev);
-    }
+    return strcasecmp(path + len - 4, ".edf") == 0;
 }
 
-void UploadStateManager::setTimestampInternal(UnixTs ts, bool queue) {
-    lastUploadTimestamp = ts;
-
-    if (queue) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::SetTimestamp;
-        ev.timestamp = ts;
-        queueEvent(ev);
-    }
+String UploadStateManager::calculateChecksum(fs::FS &sd, const char* filePath) {
+    return calculateFingerprint(sd, filePath, FingerprintAlgo::Md5);
 }
 
-String UploadStateManager::calculateChecksum(fs::FS &sd, const String& filePath) {
+String UploadStateManager::calculateFingerprint(fs::FS &sd, const char* filePath, FingerprintAlgo algo) {
     File file = sd.open(filePath, FILE_READ);
     if (!file) {
-        LOGF("[UploadStateManager] ERROR: Failed to open file for checksum: %s", filePath.c_str());
+        LOGF("[UploadStateManager] ERROR: Failed to open file for checksum: %s", filePath);
         return "";
     }
-    
+
     // Check if file is readable
     if (!file.available() && file.size() > 0) {
-        LOGF("[UploadStateManager] ERROR: File exists but cannot be read: %s", filePath.c_str());
+        LOGF("[UploadStateManager] ERROR: File exists but cannot be read: %s", filePath);
+        file.close();
+        return "";
+    }
+
+    FileFingerprint fingerprint(algo);
+
+    IoBuffer io(HASH_BUFFER_SIZE, "checksum");
+    if (!io) {
+        LOGF("[UploadStateManager] ERROR: No buffer for checksum: %s", filePath);
         file.close();
         return "";
     }
-    
-    md5_context_t md5_ctx;
-    esp_rom_md5_init(&md5_ctx);
-    
-    const size_t bufferSize = 4096;
-    uint8_t buffer[bufferSize];
+    uint8_t* buffer = io.data();
     size_t totalBytesRead = 0;
     size_t expectedSize = file.size();
-    
+
     while (file.available()) {
-        size_t bytesRead = file.read(buffer, bufferSize);
+        size_t bytesRead = file.read(buffer, HASH_BUFFER_SIZE);
         if (bytesRead == 0) {
             // Read error
-            LOGF("[UploadStateManager] ERROR: Read error while calculating checksum for: %s", filePath.c_str());
+            LOGF("[UploadStateManager] ERROR: Read error while calculating checksum for: %s", filePath);
             file.close();
             return "";
         }
-        
-        esp_rom_md5_update(&md5_ctx, buffer, bytesRead);
+
+        fingerprint.update(buffer, bytesRead);
         totalBytesRead += bytesRead;
-        
+
         // Yield periodically to prevent watchdog timeout on large files
-        if (totalBytesRead % (10 * bufferSize) == 0) {
+        if (totalBytesRead % (10 * HASH_BUFFER_SIZE) == 0) {
             yield();
         }
     }
-    
+
     // Verify we read the expected amount
     if (totalBytesRead != expectedSize) {
-        LOG_DEBUGF("[UploadStateManager] WARNING: Checksum size mismatch for %s (read %u bytes, expected %u bytes)", 
-             filePath.c_str(), totalBytesRead, expectedSize);
+        LOG_DEBUGF("[UploadStateManager] WARNING: Checksum size mismatch for %s (read %u bytes, expected %u bytes)",
+             filePath, totalBytesRead, expectedSize);
     }
-    
-    uint8_t hash[16];
-    esp_rom_md5_final(hash, &md5_ctx);
-    
+
     file.close();
-    
-    // Convert hash to hex string
-    String checksumStr = "";
-    for (int i = 0; i < 16; i++) {
-        char hex[3];
-        snprintf(hex, sizeof(hex), "%02x", hash[i]);
-        checksumStr += hex;
-    }
-    
-    return checksumStr;
+
+    char text[FileFingerprint::MAX_TEXT_LEN];
+    fingerprint.finishText(text);
+    return String(text);
 }
 
-bool UploadStateManager::hasFileChanged(fs::FS &sd, const String& filePath) {
-    PathHash pathHash = hashPath(filePath);
-    int idx = findFileIndex(pathHash);
-    if (idx < 0) {
+bool UploadStateManager::hasFileChanged(fs::FS &sd, const char* filePath) {
+    PathHash pathHash = UploadStateStore::hashPath(filePath);
+    UploadStateStore::FileFingerprintEntry entry;
+    bool tracked = store->findFile(pathHash, entry);
+
+    // Size (and existence) from the SD metadata cache when one is attached
+    SdFileMeta meta;
+    bool cached = metaCache != nullptr;
+    bool exists = cached && metaCache->get(filePath, meta);
+
+    if (!tracked) {
+        if (cached) {
+            return exists;
+        }
         File file = sd.open(filePath, FILE_READ);
         if (!file) {
             return false;
@@ -436,834 +218,672 @@ bool UploadStateManager::hasFileChanged(fs::FS &sd, const String& filePath) {
         return true;
     }
 
-    const FileFingerprintEntry& entry = fileEntries[idx];
+    // Another backend uploaded the file, this one has not
+    bool uploadedHere = (entry.uploaded & backendBit) != 0;
 
     if (entry.fileSize > 0) {
-        File file = sd.open(filePath, FILE_READ);
-        if (!file) {
-            return false;
+        unsigned long currentSize = 0;
+        if (cached) {
+            if (!exists) {
+                return false;
+            }
+            currentSize = meta.size;
+        } else {
+            File file = sd.open(filePath, FILE_READ);
+            if (!file) {
+                return false;
+            }
+            currentSize = file.size();
+            file.close();
         }
 
-        unsigned long currentSize = file.size();
-        file.close();
-
         if (currentSize != entry.fileSize) {
             LOG_DEBUGF("[UploadStateManager] Size changed: %s (%lu -> %lu)",
-                       filePath.c_str(),
+                       filePath,
                        entry.fileSize,
                        currentSize);
+            // Carry the append fingerprint forward over the new tail only, so
+            // markFileUploaded() can accept it for the bytes about to be sent
+            if (isAppendTracked(filePath)) {
+                advanceAppendHash(sd, filePath, pathHash, (uint32_t)currentSize);
+            }
+            return true;
+        }
+
+        if (!uploadedHere) {
             return true;
         }
 
-        if ((entry.flags & FILE_FLAG_HAS_MD5) == 0) {
+        if ((entry.flags & UploadStateStore::FILE_FLAG_HAS_DIGEST) == 0) {
+            return false;
+        }
+
+        if (isAppendTracked(filePath)) {
+            int a = store->findAppendIndex(pathHash);
+            if (a >= 0 && (store->appendEntries[a].uploaded & backendBit) &&
+                store->appendEntries[a].length == currentSize) {
+                if (verifyAppendHash(sd, filePath, store->appendEntries[a])) {
+                    return false;
+                }
+                LOG_DEBUGF("[UploadStateManager] Append fingerprint mismatch: %s", filePath);
+                buildAppendHash(sd, filePath, pathHash, (uint32_t)currentSize, entry.algo, nullptr);
+                return true;
+            }
+
+            // No usable fingerprint yet: one full pass compares the upload
+            // fingerprint and seeds the append state for the following sessions
+            uint8_t fullDigest[FileFingerprint::MAX_DIGEST_LEN];
+            if (buildAppendHash(sd, filePath, pathHash, (uint32_t)currentSize, entry.algo, fullDigest)) {
+                bool changed = memcmp(fullDigest, entry.digest, FileFingerprint::digestLen(entry.algo)) != 0;
+                if (!changed) {
+                    a = store->findAppendIndex(pathHash);
+                    if (a >= 0) {
+                        // Other backends' uploads match the same stored fingerprint
+                        store->appendEntries[a].uploaded = entry.uploaded;
+                        store->queueAppendEvent(pathHash);
+                    }
+                }
+                return changed;
+            }
+        }
+    } else if (!uploadedHere) {
+        if (cached) {
+            return exists;
+        }
+        File file = sd.open(filePath, FILE_READ);
+        if (!file) {
             return false;
         }
+        file.close();
+        return true;
     }
 
-    if ((entry.flags & FILE_FLAG_HAS_MD5) == 0) {
+    if ((entry.flags & UploadStateStore::FILE_FLAG_HAS_DIGEST) == 0) {
         return false;
     }
 
-    String currentChecksum = calculateChecksum(sd, filePath);
-    if (currentChecksum.isEmpty()) {
+    // Same algorithm as the stored entry (older entries are MD5)
+    String current = calculateFingerprint(sd, filePath, entry.algo);
+    if (current.isEmpty()) {
         return false;
     }
 
-    uint8_t currentMd5[16] = {0};
-    if (!parseHexMd5(currentChecksum.c_str(), currentMd5)) {
+    FingerprintAlgo currentAlgo;
+    uint8_t currentDigest[FileFingerprint::MAX_DIGEST_LEN] = {0};
+    if (!FileFingerprint::parse(current.c_str(), currentAlgo, currentDigest)) {
         return true;
     }
 
-    return memcmp(currentMd5, entry.md5, sizeof(currentMd5)) != 0;
+    return memcmp(currentDigest, entry.digest, FileFingerprint::digestLen(entry.algo)) != 0;
+}
+
+String UploadStateManager::fingerprintForRecord(fs::FS &sd, const char* filePath, const String& checksum) {
+    UploadStateStore::FileFingerprintEntry entry;
+    if (isDatalogPath(filePath) || checksum.isEmpty() ||
+        !store->findFile(UploadStateStore::hashPath(filePath), entry) ||
+        (entry.uploaded & ~backendBit) == 0 ||
+        (entry.flags & UploadStateStore::FILE_FLAG_HAS_DIGEST) == 0) {
+        return checksum;
+    }
+
+    FingerprintAlgo algo;
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN];
+    if (!FileFingerprint::parse(checksum.c_str(), algo, digest) || algo == entry.algo) {
+        return checksum;
+    }
+
+    // If the card cannot be read the upload's own digest stands; the store
+    // then treats the mismatch as new content
+    String stored = calculateFingerprint(sd, filePath, entry.algo);
+    return stored.isEmpty() ? checksum : stored;
 }
 
-void UploadStateManager::markFileUploaded(const String& filePath, const String& checksum, unsigned long fileSize) {
-    PathHash pathHash = hashPath(filePath);
+void UploadStateManager::markFileUploaded(const char* filePath, const String& checksum, unsigned long fileSize) {
+    PathHash pathHash = UploadStateStore::hashPath(filePath);
+
+    // Callers that did not pass a size get it from the SD metadata cache
+    if (fileSize == 0 && metaCache && checksum != "empty_file") {
+        SdFileMeta meta;
+        if (metaCache->lookup(filePath, meta) && (meta.attr & SD_META_EXISTS)) {
+            fileSize = meta.size;
+        }
+    }
 
     if (isDatalogPath(filePath)) {
         if (fileSize > 0) {
-            // Enable persistence for DATALOG files (persistent=true, queue=true)
-            // This allows skipping already uploaded files even after a reboot
-            upsertFileEntry(pathHash, (uint32_t)fileSize, nullptr, false, true, true);
+            // Persistent, so already uploaded files are skipped even after a reboot
+            store->recordFileUpload(pathHash, (uint32_t)fileSize, nullptr, false, FingerprintAlgo::Md5,
+                                    backendBit, true);
         }
         return;
     }
 
     if (checksum.isEmpty()) {
-        removeFileEntry(pathHash, true);
+        store->removeFileEntry(pathHash, backendBit, true);
         return;
     }
 
-    uint8_t md5[16] = {0};
-    bool hasMd5 = parseHexMd5(checksum.c_str(), md5);
-    upsertFileEntry(pathHash,
-                    (uint32_t)fileSize,
-                    hasMd5 ? md5 : nullptr,
-                    hasMd5,
-                    true,
-                    true);
+    FingerprintAlgo algo = FingerprintAlgo::Md5;
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN] = {0};
+    bool hasDigest = FileFingerprint::parse(checksum.c_str(), algo, digest);
+    store->recordFileUpload(pathHash,
+                            (uint32_t)fileSize,
+                            hasDigest ? digest : nullptr,
+                            hasDigest,
+                            algo,
+                            backendBit,
+                            true);
+
+    // The append fingerprint stands for the upload only if it was taken from
+    // the card this session at exactly the uploaded length
+    int a = store->findAppendIndex(pathHash);
+    if (a >= 0) {
+        AppendHashEntry& append = store->appendEntries[a];
+        if (hasDigest && (append.flags & UploadStateStore::APPEND_FLAG_FRESH) && append.length == fileSize) {
+            append.uploaded |= backendBit;
+            store->queueAppendEvent(pathHash);
+        } else {
+            store->removeAppendEntry(pathHash, true);
+        }
+    }
 }
 
 bool UploadStateManager::isFolderCompleted(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return false;
     }
-    return findCompletedIndex(day) >= 0;
+    int idx = store->findCompletedIndex(day);
+    return idx >= 0 && (store->completedFolders[idx].backends & backendBit);
 }
 
 void UploadStateManager::markFolderCompleted(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         LOG_WARNF("[UploadStateManager] Invalid folder name for completion: %s", folderName.c_str());
         return;
     }
 
-    addCompletedInternal(day, true);
+    store->addCompletedInternal(day, backendBit, true);
 
-    if (removePendingInternal(day, true)) {
+    if (store->removePendingInternal(day, backendBit, true)) {
         LOG_DEBUGF("[UploadStateManager] Removed folder from pending state: %s", folderName.c_str());
     }
 
-    if (currentRetryFolderDay == day) {
+    if (store->currentRetryFolderDay[backend] == day) {
         clearCurrentRetry();
     }
 }
 
 void UploadStateManager::removeFileEntriesForPaths(const std::vector<String>& filePaths) {
     for (const String& path : filePaths) {
-        PathHash h = hashPath(path);
-        removeFileEntry(h, true);
+        PathHash h = UploadStateStore::hashPath(path.c_str());
+        store->removeFileEntry(h, backendBit, true);
     }
 }
 
 void UploadStateManager::removeFolderFromCompleted(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return;
     }
 
-    if (removeCompletedInternal(day, true)) {
+    if (store->removeCompletedInternal(day, backendBit, true)) {
         LOG_DEBUGF("[UploadStateManager] Removed folder from completed state: %s", folderName.c_str());
     }
 }
 
 int UploadStateManager::getCurrentRetryCount() {
-    return currentRetryCount;
+    return store->currentRetryCount[backend];
 }
 
 void UploadStateManager::setCurrentRetryFolder(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         LOG_WARNF("[UploadStateManager] Invalid retry folder: %s", folderName.c_str());
         return;
     }
 
-    if (currentRetryFolderDay != day) {
-        setRetryInternal(day, 0, true);
+    if (store->currentRetryFolderDay[backend] != day) {
+        store->setRetryInternal(backend, day, 0, true);
     }
 }
 
 void UploadStateManager::incrementCurrentRetryCount() {
-    setRetryInternal(currentRetryFolderDay, currentRetryCount + 1, true);
+    store->setRetryInternal(backend, store->currentRetryFolderDay[backend],
+                            store->currentRetryCount[backend] + 1, true);
 }
 
 void UploadStateManager::clearCurrentRetry() {
-    setRetryInternal(0, 0, true);
+    store->setRetryInternal(backend, 0, 0, true);
 }
 
 int UploadStateManager::getCompletedFoldersCount() const {
-    return completedCount;
+    return store->countCompleted(backendBit);
 }
 
 int UploadStateManager::getIncompleteFoldersCount() const {
-    if (totalFoldersCount == 0) {
+    int total = store->totalFoldersCount[backend];
+    if (total == 0) {
         return 0;  // Not yet scanned
     }
-    int incomplete = totalFoldersCount - completedCount - pendingCount;
+    int incomplete = total - store->countCompleted(backendBit) - store->countPending(backendBit);
     return incomplete > 0 ? incomplete : 0;
 }
 
 void UploadStateManager::setTotalFoldersCount(int count) {
-    totalFoldersCount = count;
+    store->totalFoldersCount[backend] = count;
 }
 
 bool UploadStateManager::isPendingFolder(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return false;
     }
-    return findPendingIndex(day) >= 0;
+    int idx = store->findPendingIndex(day);
+    return idx >= 0 && (store->pendingFolders[idx].backends & backendBit);
 }
 
 void UploadStateManager::markFolderPending(const String& folderName, unsigned long timestamp) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         LOG_WARNF("[UploadStateManager] Invalid folder name for pending: %s", folderName.c_str());
         return;
     }
 
-    addPendingInternal(day, (UnixTs)timestamp, true);
-    LOG_DEBUGF("[UploadStateManager] Marked folder as pending: %s (timestamp: %lu)", 
+    store->addPendingInternal(day, (UnixTs)timestamp, backendBit, true);
+    LOG_DEBUGF("[UploadStateManager] Marked folder as pending: %s (timestamp: %lu)",
          folderName.c_str(), timestamp);
 }
 
 void UploadStateManager::removeFolderFromPending(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return;
     }
 
-    if (removePendingInternal(day, true)) {
+    if (store->removePendingInternal(day, backendBit, true)) {
         LOG_DEBUGF("[UploadStateManager] Removed folder from pending state: %s", folderName.c_str());
     }
 }
 
 bool UploadStateManager::shouldPromotePendingToCompleted(const String& folderName, unsigned long currentTime) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return false;
     }
 
-    int idx = findPendingIndex(day);
-    if (idx < 0) {
+    int idx = store->findPendingIndex(day);
+    if (idx < 0 || (store->pendingFolders[idx].backends & backendBit) == 0) {
         return false;
     }
 
-    unsigned long firstSeenTime = pendingFolders[idx].firstSeenTs;
+    unsigned long firstSeenTime = store->pendingFolders[idx].firstSeenTs;
     return (currentTime - firstSeenTime) >= PENDING_FOLDER_TIMEOUT_SECONDS;
 }
 
 void UploadStateManager::promotePendingToCompleted(const String& folderName) {
     DayKey day = 0;
-    if (!parseDayKey(folderName, day)) {
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return;
     }
 
-    if (removePendingInternal(day, true)) {
-        addCompletedInternal(day, true);
-        LOGF("[UploadStateManager] Promoted pending folder to completed: %s (empty for 7+ days)", 
+    if (store->removePendingInternal(day, backendBit, true)) {
+        store->addCompletedInternal(day, backendBit, true);
+        LOGF("[UploadStateManager] Promoted pending folder to completed: %s (empty for 7+ days)",
              folderName.c_str());
     }
 }
 
 int UploadStateManager::getPendingFoldersCount() const {
-    return pendingCount;
+    return store->countPending(backendBit);
 }
 
 String UploadStateManager::getCurrentRetryFolder() const {
-    if (currentRetryFolderDay == 0) {
+    DayKey day = store->currentRetryFolderDay[backend];
+    if (day == 0) {
         return "";
     }
 
     char dayText[16] = {0};
-    dayKeyToChars(currentRetryFolderDay, dayText, sizeof(dayText));
+    UploadStateStore::dayKeyToChars(day, dayText, sizeof(dayText));
     return String(dayText);
 }
 
 unsigned long UploadStateManager::getLastUploadTimestamp() {
-    return lastUploadTimestamp;
+    return store->lastUploadTimestamp[backend];
 }
 
 void UploadStateManager::setLastUploadTimestamp(unsigned long timestamp) {
-    setTimestampInternal((UnixTs)timestamp, true);
+    store->setTimestampInternal(backend, (UnixTs)timestamp, true);
 }
 
 bool UploadStateManager::save(fs::FS &sd) {
-    return saveState(sd);
-}
-
-bool UploadStateManager::upsertFileEntry(PathHash pathHash,
-                                         uint32_t fileSize,
-                                         const uint8_t* md5,
-                                         bool hasMd5,
-                                         bool persistent,
-                                         bool queue) {
-    int idx = findFileIndex(pathHash);
-
-    if (idx < 0) {
-        if (fileEntryCount >= MAX_FILE_ENTRIES) {
-            int evictIdx = -1;
-            for (uint16_t i = 0; i < fileEntryCount; ++i) {
-                if ((fileEntries[i].flags & FILE_FLAG_PERSISTENT) == 0) {
-                    evictIdx = (int)i;
-                    break;
-                }
-            }
-
-            if (evictIdx < 0) {
-                evictIdx = 0;
-            }
-
-            if ((uint16_t)evictIdx < (fileEntryCount - 1)) {
-                memmove(&fileEntries[evictIdx], &fileEntries[evictIdx + 1],
-                        sizeof(FileFingerprintEntry) * (fileEntryCount - evictIdx - 1));
-            }
-            fileEntryCount--;
-            forceCompaction = true;
-        }
-
-        idx = fileEntryCount++;
-    }
-
-    FileFingerprintEntry& entry = fileEntries[idx];
-    entry.pathHash = pathHash;
-    entry.fileSize = fileSize;
-    entry.flags = FILE_FLAG_ACTIVE | (persistent ? FILE_FLAG_PERSISTENT : 0) | (hasMd5 ? FILE_FLAG_HAS_MD5 : 0);
-
-    if (hasMd5 && md5) {
-        memcpy(entry.md5, md5, sizeof(entry.md5));
-    } else {
-        memset(entry.md5, 0, sizeof(entry.md5));
-    }
-
-    if (queue && persistent) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::SetFile;
-        ev.pathHash = pathHash;
-        ev.fileSize = fileSize;
-        ev.hasMd5 = hasMd5;
-        if (hasMd5 && md5) {
-            memcpy(ev.md5, md5, sizeof(ev.md5));
-        }
-        queueEvent(ev);
-    }
-
-    return true;
+    return store->save(sd);
 }
 
-bool UploadStateManager::removeFileEntry(PathHash pathHash, bool queue) {
-    int idx = findFileIndex(pathHash);
-    if (idx < 0) {
-        return false;
-    }
-
-    bool persistent = (fileEntries[idx].flags & FILE_FLAG_PERSISTENT) != 0;
-
-    if ((uint16_t)idx < (fileEntryCount - 1)) {
-        memmove(&fileEntries[idx], &fileEntries[idx + 1],
-                sizeof(FileFingerprintEntry) * (fileEntryCount - idx - 1));
-    }
-    fileEntryCount--;
-
-    if (queue && persistent) {
-        JournalEvent ev = {};
-        ev.type = JournalEventType::RemoveFile;
-        ev.pathHash = pathHash;
-        queueEvent(ev);
-    }
-
-    return true;
+bool UploadStateManager::isCompactionDue() const {
+    return store->isCompactionDue();
 }
 
-bool UploadStateManager::appendJournalLine(File& file, const JournalEvent& event) {
-    char line[192] = {0};
-    char dayText[16] = {0};
-
-    switch (event.type) {
-        case JournalEventType::SetTimestamp:
-            snprintf(line, sizeof(line), "T|%lu", (unsigned long)event.timestamp);
-            break;
-        case JournalEventType::SetRetry:
-            dayKeyToChars(event.day, dayText, sizeof(dayText));
-            snprintf(line, sizeof(line), "R|%s|%u", dayText, (unsigned)event.retryCount);
-            break;
-        case JournalEventType::AddCompleted:
-            dayKeyToChars(event.day, dayText, sizeof(dayText));
-            snprintf(line, sizeof(line), "C+|%s", dayText);
-            break;
-        case JournalEventType::RemoveCompleted:
-            dayKeyToChars(event.day, dayText, sizeof(dayText));
-            snprintf(line, sizeof(line), "C-|%s", dayText);
-            break;
-        case JournalEventType::AddPending:
-            dayKeyToChars(event.day, dayText, sizeof(dayText));
-            snprintf(line, sizeof(line), "P+|%s|%lu", dayText, (unsigned long)event.timestamp);
-            break;
-        case JournalEventType::RemovePending:
-            dayKeyToChars(event.day, dayText, sizeof(dayText));
-            snprintf(line, sizeof(line), "P-|%s", dayText);
-            break;
-        case JournalEventType::SetFile: {
-            char md5Hex[33] = {0};
-            if (event.hasMd5) {
-                md5ToHex(event.md5, md5Hex);
-            } else {
-                snprintf(md5Hex, sizeof(md5Hex), "-");
-            }
-            snprintf(line,
-                     sizeof(line),
-                     "F|%016llx|%lu|%s",
-                     (unsigned long long)event.pathHash,
-                     (unsigned long)event.fileSize,
-                     md5Hex);
-            break;
-        }
-        case JournalEventType::RemoveFile:
-            snprintf(line, sizeof(line), "F-|%016llx", (unsigned long long)event.pathHash);
-            break;
-    }
-
-    return file.println(line) > 0;
+bool UploadStateManager::compactIfDue(fs::FS &sd) {
+    return store->compactIfDue(sd);
 }
 
-bool UploadStateManager::flushJournal(fs::FS &sd) {
-    if (journalEventCount == 0) {
-        return true;
-    }
+// ============================================================================
+// Circuit breaker + quarantine
+// ============================================================================
 
-    File file = sd.open(stateJournalPath, FILE_APPEND);
-    if (!file) {
-        LOGF("[UploadStateManager] ERROR: Failed to open journal file for append: %s", stateJournalPath.c_str());
+bool UploadStateManager::isQuarantinedInternal(QuarantineKind kind, uint64_t key, unsigned long now) const {
+    int idx = findQuarantineIndex(kind, key);
+    if (idx < 0) {
         return false;
     }
 
-    for (uint16_t i = 0; i < journalEventCount; ++i) {
-        if (!appendJournalLine(file, journalEvents[i])) {
-            file.close();
-            LOG("[UploadStateManager] ERROR: Failed to append journal event");
-            return false;
-        }
-    }
-
-    file.close();
-
-    if ((uint32_t)journalLineCount + journalEventCount > 0xFFFFu) {
-        journalLineCount = 0xFFFFu;
-    } else {
-        journalLineCount = (uint16_t)(journalLineCount + journalEventCount);
+    UnixTs retryAfterTs = store->quarantineEntries[idx].retryAfterTs;
+    if (retryAfterTs == 0 || now < 1000000000UL) {
+        return false;  // Below threshold, or no valid clock — never block
     }
-
-    journalEventCount = 0;
-    return true;
+    return now < retryAfterTs;
 }
 
-bool UploadStateManager::applySnapshotLine(const char* line) {
-    if (!line || line[0] == '\0') {
-        return true;
-    }
-
-    if (strncmp(line, "R|", 2) == 0) {
-        char dayToken[16] = {0};
-        unsigned long retryCount = 0;
-        if (sscanf(line, "R|%15[^|]|%lu", dayToken, &retryCount) == 2) {
-            DayKey day = 0;
-            if (!parseDayToken(dayToken, day)) {
-                return false;
-            }
-
-            setRetryInternal(day, (int)retryCount, false);
-            return true;
-        }
-        return false;
+void UploadStateManager::recordFailureInternal(QuarantineKind kind, uint64_t key, unsigned long now) {
+    int idx = findQuarantineIndex(kind, key);
+    uint8_t failures = idx >= 0 ? store->quarantineEntries[idx].failures : 0;
+    if (failures < 0xFF) {
+        failures++;
     }
 
-    if (strncmp(line, "C|", 2) == 0) {
-        // Format: C|day  (extra fields from older snapshot formats are silently ignored)
-        char dayToken[16] = {0};
-        if (sscanf(line, "C|%15[^|\n]", dayToken) == 1) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return addCompletedInternal(day, false);
-            }
+    UnixTs retryAfterTs = 0;
+    if (failures >= QUARANTINE_FAILURE_THRESHOLD && now >= 1000000000UL) {
+        bool backendKind = (kind == QuarantineKind::Backend);
+        unsigned long backoff = backendKind ? BACKEND_BACKOFF_BASE_SECONDS : QUARANTINE_BACKOFF_BASE_SECONDS;
+        unsigned long cap = backendKind ? BACKEND_BACKOFF_MAX_SECONDS : QUARANTINE_BACKOFF_MAX_SECONDS;
+        for (uint8_t i = QUARANTINE_FAILURE_THRESHOLD; i < failures && backoff < cap; ++i) {
+            backoff *= 2;
         }
-        return false;
-    }
-
-    if (strncmp(line, "P|", 2) == 0) {
-        char dayToken[16] = {0};
-        unsigned long firstSeenTs = 0;
-        if (sscanf(line, "P|%15[^|]|%lu", dayToken, &firstSeenTs) == 2) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return addPendingInternal(day, (UnixTs)firstSeenTs, false);
-            }
+        if (backoff > cap) {
+            backoff = cap;
         }
-        return false;
+        retryAfterTs = (UnixTs)(now + backoff);
     }
 
-    if (strncmp(line, "F|", 2) == 0) {
-        char pathHashHex[24] = {0};
-        unsigned long fileSize = 0;
-        char md5Hex[40] = {0};
-        if (sscanf(line, "F|%23[^|]|%lu|%39s", pathHashHex, &fileSize, md5Hex) == 3) {
-            PathHash pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
-            uint8_t md5[16] = {0};
-            bool hasMd5 = false;
-            if (strcmp(md5Hex, "-") != 0) {
-                hasMd5 = parseHexMd5(md5Hex, md5);
-                if (!hasMd5) {
-                    return false;
-                }
-            }
-
-            return upsertFileEntry(pathHash,
-                                   (uint32_t)fileSize,
-                                   hasMd5 ? md5 : nullptr,
-                                   hasMd5,
-                                   true,
-                                   false);
-        }
-        return false;
-    }
+    store->setQuarantineInternal(kind, key, backend, failures, retryAfterTs, true);
+}
 
-    return false;
+bool UploadStateManager::isBackendAvailable(unsigned long now) const {
+    return !isQuarantinedInternal(QuarantineKind::Backend, 0, now);
 }
 
-bool UploadStateManager::applyJournalLine(const char* line) {
-    if (!line || line[0] == '\0') {
-        return true;
-    }
+void UploadStateManager::recordBackendFailure(unsigned long now) {
+    recordFailureInternal(QuarantineKind::Backend, 0, now);
 
-    if (strncmp(line, "T|", 2) == 0) {
-        unsigned long ts = 0;
-        if (sscanf(line, "T|%lu", &ts) == 1) {
-            setTimestampInternal((UnixTs)ts, false);
-            return true;
-        }
-        return false;
+    int idx = findQuarantineIndex(QuarantineKind::Backend, 0);
+    if (idx >= 0 && store->quarantineEntries[idx].retryAfterTs != 0) {
+        LOG_WARNF("[UploadStateManager] Backend circuit open: %u consecutive failures, retry in %lus",
+                  (unsigned)store->quarantineEntries[idx].failures,
+                  (unsigned long)(store->quarantineEntries[idx].retryAfterTs - now));
     }
+}
 
-    if (strncmp(line, "R|", 2) == 0) {
-        char dayToken[16] = {0};
-        unsigned long retryCount = 0;
-        if (sscanf(line, "R|%15[^|]|%lu", dayToken, &retryCount) == 2) {
-            DayKey day = 0;
-            if (!parseDayToken(dayToken, day)) {
-                return false;
-            }
-
-            setRetryInternal(day, (int)retryCount, false);
-            return true;
-        }
-        return false;
+void UploadStateManager::recordBackendSuccess() {
+    if (store->removeQuarantineInternal(QuarantineKind::Backend, 0, backend, true)) {
+        LOG("[UploadStateManager] Backend circuit closed");
     }
+}
 
-    if (strncmp(line, "C+|", 3) == 0) {
-        char dayToken[16] = {0};
-        if (sscanf(line, "C+|%15s", dayToken) == 1) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return addCompletedInternal(day, false);
-            }
-        }
-        return false;
-    }
+unsigned long UploadStateManager::getBackendRetryAfter() const {
+    int idx = findQuarantineIndex(QuarantineKind::Backend, 0);
+    return idx >= 0 ? store->quarantineEntries[idx].retryAfterTs : 0;
+}
 
-    if (strncmp(line, "C-|", 3) == 0) {
-        char dayToken[16] = {0};
-        if (sscanf(line, "C-|%15s", dayToken) == 1) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return removeCompletedInternal(day, false);
-            }
-        }
+bool UploadStateManager::isFolderQuarantined(const String& folderName, unsigned long now) const {
+    DayKey day = 0;
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
         return false;
     }
+    return isQuarantinedInternal(QuarantineKind::Folder, day, now);
+}
 
-    if (strncmp(line, "P+|", 3) == 0) {
-        char dayToken[16] = {0};
-        unsigned long firstSeenTs = 0;
-        if (sscanf(line, "P+|%15[^|]|%lu", dayToken, &firstSeenTs) == 2) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return addPendingInternal(day, (UnixTs)firstSeenTs, false);
-            }
-        }
-        return false;
+void UploadStateManager::recordFolderFailure(const String& folderName, unsigned long now) {
+    DayKey day = 0;
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
+        return;
     }
 
-    if (strncmp(line, "P-|", 3) == 0) {
-        char dayToken[16] = {0};
-        if (sscanf(line, "P-|%15s", dayToken) == 1) {
-            DayKey day = 0;
-            if (parseDayToken(dayToken, day)) {
-                return removePendingInternal(day, false);
-            }
-        }
-        return false;
-    }
+    recordFailureInternal(QuarantineKind::Folder, day, now);
 
-    if (strncmp(line, "F-|", 3) == 0) {
-        char pathHashHex[24] = {0};
-        if (sscanf(line, "F-|%23s", pathHashHex) == 1) {
-            PathHash pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
-            return removeFileEntry(pathHash, false);
-        }
-        return false;
+    int idx = findQuarantineIndex(QuarantineKind::Folder, day);
+    if (idx >= 0 && store->quarantineEntries[idx].retryAfterTs != 0) {
+        LOG_WARNF("[UploadStateManager] Folder %s quarantined: %u consecutive failures, retry in %lus",
+                  folderName.c_str(),
+                  (unsigned)store->quarantineEntries[idx].failures,
+                  (unsigned long)(store->quarantineEntries[idx].retryAfterTs - now));
     }
-
-    if (strncmp(line, "F|", 2) == 0) {
-        char pathHashHex[24] = {0};
-        unsigned long fileSize = 0;
-        char md5Hex[40] = {0};
-        if (sscanf(line, "F|%23[^|]|%lu|%39s", pathHashHex, &fileSize, md5Hex) == 3) {
-            PathHash pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
-            uint8_t md5[16] = {0};
-            bool hasMd5 = false;
-            if (strcmp(md5Hex, "-") != 0) {
-                hasMd5 = parseHexMd5(md5Hex, md5);
-                if (!hasMd5) {
-                    return false;
-                }
-            }
-
-            return upsertFileEntry(pathHash,
-                                   (uint32_t)fileSize,
-                                   hasMd5 ? md5 : nullptr,
-                                   hasMd5,
-                                   true,
-                                   false);
-        }
-        return false;
-    }
-
-    return false;
 }
 
-bool UploadStateManager::replayJournal(fs::FS &sd) {
-    if (!sd.exists(stateJournalPath)) {
-        journalLineCount = 0;
-        return false;
-    }
-    File file = sd.open(stateJournalPath, FILE_READ);
-    if (!file) {
-        journalLineCount = 0;
-        return false;
-    }
-
-    char line[256] = {0};
-    uint16_t lines = 0;
-
-    while (readLine(file, line, sizeof(line))) {
-        if (line[0] == '\0') {
-            continue;
-        }
-
-        if (!applyJournalLine(line)) {
-            LOG_WARNF("[UploadStateManager] Ignoring invalid journal line: %s", line);
-            continue;
-        }
-
-        if (lines < 0xFFFFu) {
-            lines++;
-        }
+void UploadStateManager::clearFolderQuarantine(const String& folderName) {
+    DayKey day = 0;
+    if (!UploadStateStore::parseDayKey(folderName, day)) {
+        return;
     }
+    store->removeQuarantineInternal(QuarantineKind::Folder, day, backend, true);
+}
 
-    file.close();
-    journalLineCount = lines;
-    return lines > 0;
+bool UploadStateManager::isFileQuarantined(const char* filePath, unsigned long now) const {
+    return isQuarantinedInternal(QuarantineKind::File, UploadStateStore::hashPath(filePath), now);
 }
 
-bool UploadStateManager::shouldCompact(fs::FS &sd) const {
-    if (forceCompaction) {
-        return true;
-    }
+void UploadStateManager::recordFileFailure(const char* filePath, unsigned long now) {
+    PathHash pathHash = UploadStateStore::hashPath(filePath);
+    recordFailureInternal(QuarantineKind::File, pathHash, now);
 
-    if (!sd.exists(stateSnapshotPath)) {
-        return true;
+    int idx = findQuarantineIndex(QuarantineKind::File, pathHash);
+    if (idx >= 0 && store->quarantineEntries[idx].retryAfterTs != 0) {
+        LOG_WARNF("[UploadStateManager] File %s quarantined: %u consecutive failures, retry in %lus",
+                  filePath,
+                  (unsigned)store->quarantineEntries[idx].failures,
+                  (unsigned long)(store->quarantineEntries[idx].retryAfterTs - now));
     }
+}
 
-    if (journalLineCount >= COMPACTION_LINE_THRESHOLD) {
-        return true;
-    }
+void UploadStateManager::clearFileQuarantine(const char* filePath) {
+    store->removeQuarantineInternal(QuarantineKind::File, UploadStateStore::hashPath(filePath), backend, true);
+}
 
-    if (sd.exists(stateJournalPath)) {
-        File file = sd.open(stateJournalPath, FILE_READ);
-        if (file) {
-            size_t journalSize = file.size();
-            file.close();
-            if (journalSize >= COMPACTION_SIZE_THRESHOLD_BYTES) {
-                return true;
-            }
+int UploadStateManager::getQuarantinedCount(unsigned long now) const {
+    int count = 0;
+    for (uint16_t i = 0; i < store->quarantineCount; ++i) {
+        const UploadStateStore::QuarantineEntry& entry = store->quarantineEntries[i];
+        if (entry.backend == backend && entry.kind != QuarantineKind::Backend &&
+            isQuarantinedInternal(entry.kind, entry.key, now)) {
+            count++;
         }
     }
-
-    return false;
+    return count;
 }
 
-bool UploadStateManager::compactState(fs::FS &sd) {
-    String tempPath = stateSnapshotPath + ".tmp";
-    File file = sd.open(tempPath, FILE_WRITE);
+// ============================================================================
+// Append fingerprints (resumable hashing for append-only EDF files)
+// ============================================================================
+
+bool UploadStateManager::buildAppendHash(fs::FS &sd,
+                                         const char* filePath,
+                                         PathHash pathHash,
+                                         uint32_t size,
+                                         FingerprintAlgo fullAlgo,
+                                         uint8_t fullDigest[16]) {
+    static_assert(sizeof(md5_context_t) >= UploadStateStore::MD5_MIDSTATE_BYTES, "MD5 midstate larger than context");
+
+    File file = sd.open(filePath, FILE_READ);
     if (!file) {
-        LOGF("[UploadStateManager] ERROR: Failed to open temp snapshot file: %s", tempPath.c_str());
         return false;
     }
 
-    char line[256] = {0};
-    snprintf(line, sizeof(line), "U2|2|%lu", (unsigned long)lastUploadTimestamp);
-    if (file.println(line) == 0) {
+    uint32_t headerLen = readEdfHeaderLen(file, size, APPEND_MAX_HEADER_BYTES);
+    if (headerLen == 0 || !file.seek(0)) {
         file.close();
-        sd.remove(tempPath);
+        store->removeAppendEntry(pathHash, true);
         return false;
     }
 
-    char retryDay[16] = {0};
-    dayKeyToChars(currentRetryFolderDay, retryDay, sizeof(retryDay));
-    snprintf(line, sizeof(line), "R|%s|%u", retryDay, (unsigned)currentRetryCount);
-    if (file.println(line) == 0) {
+    // One pass feeds the upload fingerprint (same 4 KB chunks as
+    // calculateFingerprint), the header hash and the body hash up to the last
+    // block boundary
+    uint32_t boundary = appendBoundary(headerLen, size);
+    FileFingerprint full(fullAlgo);
+    md5_context_t headCtx;
+    md5_context_t bodyCtx;
+    esp_rom_md5_init(&headCtx);
+    esp_rom_md5_init(&bodyCtx);
+
+    IoBuffer io(HASH_BUFFER_SIZE, "checksum");
+    if (!io) {
         file.close();
-        sd.remove(tempPath);
         return false;
     }
-
-    for (uint16_t i = 0; i < completedCount; ++i) {
-        char dayText[16] = {0};
-        dayKeyToChars(completedFolders[i].day, dayText, sizeof(dayText));
-        snprintf(line, sizeof(line), "C|%s", dayText);
-        if (file.println(line) == 0) {
-            file.close();
-            sd.remove(tempPath);
-            return false;
-        }
-    }
-
-    for (uint16_t i = 0; i < pendingCount; ++i) {
-        char dayText[16] = {0};
-        dayKeyToChars(pendingFolders[i].day, dayText, sizeof(dayText));
-        snprintf(line, sizeof(line), "P|%s|%lu", dayText, (unsigned long)pendingFolders[i].firstSeenTs);
-        if (file.println(line) == 0) {
+    uint8_t* buffer = io.data();
+    uint32_t pos = 0;
+    while (pos < size) {
+        size_t want = (size - pos) < HASH_BUFFER_SIZE ? (size_t)(size - pos) : HASH_BUFFER_SIZE;
+        size_t bytesRead = file.read(buffer, want);
+        if (bytesRead == 0) {
+            LOGF("[UploadStateManager] ERROR: Read error while hashing: %s", filePath);
             file.close();
-            sd.remove(tempPath);
             return false;
         }
-    }
 
-    for (uint16_t i = 0; i < fileEntryCount; ++i) {
-        const FileFingerprintEntry& entry = fileEntries[i];
-        if ((entry.flags & FILE_FLAG_ACTIVE) == 0 || (entry.flags & FILE_FLAG_PERSISTENT) == 0) {
-            continue;
+        full.update(buffer, bytesRead);
+        if (pos < headerLen) {
+            uint32_t headBytes = headerLen - pos;
+            esp_rom_md5_update(&headCtx, buffer, headBytes < bytesRead ? headBytes : (uint32_t)bytesRead);
         }
-
-        char md5Hex[33] = {0};
-        if (entry.flags & FILE_FLAG_HAS_MD5) {
-            md5ToHex(entry.md5, md5Hex);
-        } else {
-            snprintf(md5Hex, sizeof(md5Hex), "-");
+        uint32_t bodyStart = pos > headerLen ? pos : headerLen;
+        uint32_t bodyEnd = (pos + bytesRead) < boundary ? (uint32_t)(pos + bytesRead) : boundary;
+        if (bodyEnd > bodyStart) {
+            esp_rom_md5_update(&bodyCtx, buffer + (bodyStart - pos), bodyEnd - bodyStart);
         }
 
-        snprintf(line,
-                 sizeof(line),
-                 "F|%016llx|%lu|%s",
-                 (unsigned long long)entry.pathHash,
-                 (unsigned long)entry.fileSize,
-                 md5Hex);
-        if (file.println(line) == 0) {
-            file.close();
-            sd.remove(tempPath);
-            return false;
+        pos += bytesRead;
+        if (pos % (10 * HASH_BUFFER_SIZE) == 0) {
+            yield();
         }
     }
 
+    AppendHashEntry built = {};
+    built.pathHash = pathHash;
+    built.headerLen = headerLen;
+    built.length = size;
+    built.flags = UploadStateStore::APPEND_FLAG_FRESH;
+    esp_rom_md5_final(built.headMd5, &headCtx);
+    memcpy(built.midstate, &bodyCtx, UploadStateStore::MD5_MIDSTATE_BYTES);
+    bool ok = finishAppendBody(file, built.midstate, UploadStateStore::MD5_MIDSTATE_BYTES, boundary, size,
+                               built.bodyMd5, buffer, HASH_BUFFER_SIZE);
     file.close();
-
-    File verify = sd.open(tempPath, FILE_READ);
-    if (!verify) {
-        sd.remove(tempPath);
+    if (!ok) {
         return false;
     }
 
-    size_t verifySize = verify.size();
-    verify.close();
-    if (verifySize == 0) {
-        sd.remove(tempPath);
-        return false;
+    if (fullDigest) {
+        full.finish(fullDigest);
     }
+    *store->upsertAppendEntry(pathHash) = built;
+    return true;
+}
 
-    if (sd.exists(stateSnapshotPath)) {
-        sd.remove(stateSnapshotPath);
+bool UploadStateManager::advanceAppendHash(fs::FS &sd, const char* filePath, PathHash pathHash, uint32_t size) {
+    int idx = store->findAppendIndex(pathHash);
+    if (idx < 0) {
+        return false;  // Seeded by the next full comparison
     }
+    AppendHashEntry& entry = store->appendEntries[idx];
 
-    if (!sd.rename(tempPath, stateSnapshotPath)) {
-        sd.remove(tempPath);
+    File file = sd.open(filePath, FILE_READ);
+    if (!file) {
         return false;
     }
 
-    if (sd.exists(stateJournalPath)) {
-        sd.remove(stateJournalPath);
+    IoBuffer io(HASH_BUFFER_SIZE, "checksum");
+    if (!io) {
+        file.close();
+        return false;
     }
-
-    journalEventCount = 0;
-    journalLineCount = 0;
-    forceCompaction = false;
-
-    return true;
-}
-
-bool UploadStateManager::loadState(fs::FS &sd) {
-    clearState();
-
-    bool loadedSnapshot = false;
-
-    if (sd.exists(stateSnapshotPath)) {
-        File file = sd.open(stateSnapshotPath, FILE_READ);
-        if (!file) {
-            LOGF("[UploadStateManager] ERROR: Failed to open snapshot file: %s", stateSnapshotPath.c_str());
-            return false;
-        }
-
-        char line[256] = {0};
-        if (!readLine(file, line, sizeof(line))) {
-            file.close();
-            LOG("[UploadStateManager] WARNING: Snapshot file is empty");
-            return false;
-        }
-
-        unsigned long version = 0;
-        unsigned long ts = 0;
-        if (sscanf(line, "U2|%lu|%lu", &version, &ts) != 2 || version != 2) {
-            file.close();
-            LOGF("[UploadStateManager] ERROR: Invalid snapshot header: %s", line);
-            return false;
-        }
-
-        setTimestampInternal((UnixTs)ts, false);
-
-        while (readLine(file, line, sizeof(line))) {
-            if (line[0] == '\0') {
-                continue;
-            }
-
-            if (!applySnapshotLine(line)) {
-                LOG_WARNF("[UploadStateManager] Ignoring invalid snapshot line: %s", line);
-            }
-        }
-
+    uint8_t* buffer = io.data();
+    uint8_t check[16];
+    uint32_t oldBoundary = appendBoundary(entry.headerLen, entry.length);
+    bool appended = size > entry.length &&
+        readEdfHeaderLen(file, size, APPEND_MAX_HEADER_BYTES) == entry.headerLen &&
+        // The partial block hashed last time must still be there unchanged
+        finishAppendBody(file, entry.midstate, UploadStateStore::MD5_MIDSTATE_BYTES, oldBoundary, entry.length,
+                         check, buffer, HASH_BUFFER_SIZE) &&
+        memcmp(check, entry.bodyMd5, sizeof(check)) == 0;
+    if (!appended) {
         file.close();
-        loadedSnapshot = true;
+        LOG_DEBUGF("[UploadStateManager] Not an append, dropping fingerprint: %s", filePath);
+        store->removeAppendEntry(pathHash, true);
+        return false;
     }
 
-    bool replayedJournal = replayJournal(sd);
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    bool ok = hashFileRange(file, 0, entry.headerLen, ctx, buffer, HASH_BUFFER_SIZE);
+    uint8_t headMd5[16];
+    esp_rom_md5_final(headMd5, &ctx);
 
-    if (!loadedSnapshot && !replayedJournal) {
-        LOG("[UploadStateManager] State snapshot/journal not found - will create on first save");
-        return false;
-    }
+    uint32_t newBoundary = appendBoundary(entry.headerLen, size);
+    esp_rom_md5_init(&ctx);
+    memcpy(&ctx, entry.midstate, UploadStateStore::MD5_MIDSTATE_BYTES);
+    ok = ok && hashFileRange(file, oldBoundary, newBoundary, ctx, buffer, HASH_BUFFER_SIZE);
 
-    LOG("[UploadStateManager] State v2 loaded successfully");
-    LOG_DEBUGF("[UploadStateManager]   Completed folders: %u", completedCount);
-    LOG_DEBUGF("[UploadStateManager]   Pending folders: %u", pendingCount);
-    LOG_DEBUGF("[UploadStateManager]   Tracked files: %u", fileEntryCount);
-    if (currentRetryFolderDay != 0) {
-        char retryDay[16] = {0};
-        dayKeyToChars(currentRetryFolderDay, retryDay, sizeof(retryDay));
-        LOG_DEBUGF("[UploadStateManager]   Current retry folder: %s (attempt %d)", retryDay, currentRetryCount);
+    uint8_t midstate[UploadStateStore::MD5_MIDSTATE_BYTES];
+    memcpy(midstate, &ctx, UploadStateStore::MD5_MIDSTATE_BYTES);
+    uint8_t bodyMd5[16];
+    ok = ok && finishAppendBody(file, midstate, UploadStateStore::MD5_MIDSTATE_BYTES, newBoundary, size,
+                                bodyMd5, buffer, HASH_BUFFER_SIZE);
+    file.close();
+    if (!ok) {
+        store->removeAppendEntry(pathHash, true);
+        return false;
     }
 
+    LOG_DEBUGF("[UploadStateManager] Append hash advanced: %s (%lu header + %lu new bytes)",
+               filePath,
+               (unsigned long)entry.headerLen,
+               (unsigned long)(size - oldBoundary));
+    memcpy(entry.headMd5, headMd5, sizeof(headMd5));
+    memcpy(entry.bodyMd5, bodyMd5, sizeof(bodyMd5));
+    memcpy(entry.midstate, midstate, sizeof(midstate));
+    entry.length = size;
+    entry.flags = UploadStateStore::APPEND_FLAG_FRESH;
+    entry.uploaded = 0;  // No backend has sent this length yet
     return true;
 }
 
-bool UploadStateManager::saveState(fs::FS &sd) {
-    if (!flushJournal(sd)) {
+bool UploadStateManager::verifyAppendHash(fs::FS &sd, const char* filePath, const AppendHashEntry& entry) {
+    File file = sd.open(filePath, FILE_READ);
+    if (!file) {
         return false;
     }
 
-    if (shouldCompact(sd)) {
-        if (!compactState(sd)) {
-            LOG("[UploadStateManager] ERROR: Failed to compact state snapshot");
-            return false;
-        }
+    IoBuffer io(HASH_BUFFER_SIZE, "checksum");
+    if (!io) {
+        file.close();
+        return false;
     }
+    uint8_t* buffer = io.data();
+    uint8_t headMd5[16];
+    uint8_t bodyMd5[16];
+    md5_context_t ctx;
+    esp_rom_md5_init(&ctx);
+    bool ok = readEdfHeaderLen(file, entry.length, APPEND_MAX_HEADER_BYTES) == entry.headerLen &&
+              hashFileRange(file, 0, entry.headerLen, ctx, buffer, HASH_BUFFER_SIZE);
+    esp_rom_md5_final(headMd5, &ctx);
+    ok = ok && finishAppendBody(file, entry.midstate, UploadStateStore::MD5_MIDSTATE_BYTES,
+                                appendBoundary(entry.headerLen, entry.length), entry.length,
+                                bodyMd5, buffer, HASH_BUFFER_SIZE);
+    file.close();
 
-    return true;
+    return ok &&
+           memcmp(headMd5, entry.headMd5, sizeof(headMd5)) == 0 &&
+           memcmp(bodyMd5, entry.bodyMd5, sizeof(bodyMd5)) == 0;
 }
@@ -0,0 +1,1566 @@
+#include "UploadStateStore.h"
+#include "Logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+static inline bool readLine(File& file, char* buffer, size_t bufferLen) {
+    if (bufferLen == 0) {
+        return false;
+    }
+
+    size_t idx = 0;
+    while (file.available()) {
+        int ch = file.read();
+        if (ch < 0) {
+            break;
+        }
+        if (ch == '\r') {
+            continue;
+        }
+        if (ch == '\n') {
+            break;
+        }
+        if (idx + 1 < bufferLen) {
+            buffer[idx++] = (char)ch;
+        }
+    }
+
+    if (idx == 0 && !file.available()) {
+        buffer[0] = '\0';
+        return false;
+    }
+
+    buffer[idx] = '\0';
+    return true;
+}
+
+static inline int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static inline bool parseDayToken(const char* token, uint32_t& day) {
+    if (!token) {
+        return false;
+    }
+
+    if (strcmp(token, "0") == 0) {
+        day = 0;
+        return true;
+    }
+
+    if (strlen(token) != 8) {
+        return false;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        char c = token[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(c - '0');
+    }
+
+    day = value;
+    return true;
+}
+}
+
+void UploadStateStore::setPaths(const String& snapshotPath, const String& journalPath) {
+    stateSnapshotPath = snapshotPath;
+    stateJournalPath  = journalPath;
+    stateIndexPath    = snapshotPath + ".idx";
+}
+
+UploadStateStore::UploadStateStore(uint8_t backendCount)
+    : backendCount(backendCount == 0 ? 1 :
+                   backendCount > UPLOAD_STATE_MAX_BACKENDS ? UPLOAD_STATE_MAX_BACKENDS : backendCount),
+      stateSnapshotPath("/littlefs/.upload_state.v2"),
+      stateJournalPath("/littlefs/.upload_state.v2.log"),
+      stateIndexPath("/littlefs/.upload_state.v2.idx"),
+      completedCount(0),
+      pendingCount(0),
+      fileChangeCount(0),
+      quarantineCount(0),
+      journalEventCount(0),
+      journalLineCount(0),
+      forceCompaction(false),
+      compactionDue(false),
+      eventsDropped(false),
+      importing(false) {
+    clearState();
+}
+
+bool UploadStateStore::begin(fs::FS &sd) {
+    LOG("[UploadStateManager] Initializing...");
+
+    // Try to load existing state
+    bool loadedState = loadState(sd);
+    if (!loadedState) {
+        LOG("[UploadStateManager] WARNING: No existing state file or failed to load");
+        LOG("[UploadStateManager] Starting with empty state - all files will be considered new");
+        clearState();
+    }
+
+    if (loadedState && shouldCompact(sd)) {
+        compactState(sd);
+    }
+
+    return true;  // Always return true - we can operate with empty state
+}
+
+bool UploadStateStore::save(fs::FS &sd) {
+    return saveState(sd);
+}
+
+void UploadStateStore::clearState() {
+    completedCount = 0;
+    pendingCount = 0;
+    fileChangeCount = 0;
+    quarantineCount = 0;
+    appendCount = 0;
+    journalEventCount = 0;
+    journalLineCount = 0;
+    forceCompaction = false;
+    compactionDue = false;
+    eventsDropped = false;
+    importing = false;
+
+    for (uint8_t b = 0; b < UPLOAD_STATE_MAX_BACKENDS; ++b) {
+        lastUploadTimestamp[b] = 0;
+        currentRetryFolderDay[b] = 0;
+        currentRetryCount[b] = 0;
+        totalFoldersCount[b] = 0;
+    }
+
+    memset(completedFolders, 0, sizeof(completedFolders));
+    memset(pendingFolders, 0, sizeof(pendingFolders));
+    memset(fileChanges, 0, sizeof(fileChanges));
+    fileIndex.reset();
+    memset(quarantineEntries, 0, sizeof(quarantineEntries));
+    memset(appendEntries, 0, sizeof(appendEntries));
+    memset(journalEvents, 0, sizeof(journalEvents));
+}
+
+bool UploadStateStore::parseDayKey(const String& text, DayKey& outDay) {
+    if (text.length() != 8) {
+        return false;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        char c = text[i];
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        value = value * 10 + (uint32_t)(c - '0');
+    }
+
+    outDay = value;
+    return true;
+}
+
+void UploadStateStore::dayKeyToChars(DayKey day, char* out, size_t outLen) {
+    if (outLen == 0) {
+        return;
+    }
+    if (day == 0) {
+        snprintf(out, outLen, "0");
+        return;
+    }
+    snprintf(out, outLen, "%08lu", (unsigned long)day);
+}
+
+UploadStateStore::PathHash UploadStateStore::hashPath(const char* path) {
+    const uint64_t fnvOffset = 1469598103934665603ULL;
+    const uint64_t fnvPrime = 1099511628211ULL;
+    uint64_t hash = fnvOffset;
+
+    const char* p = path;
+    while (*p) {
+        hash ^= (uint8_t)(*p);
+        hash *= fnvPrime;
+        ++p;
+    }
+
+    return hash;
+}
+
+bool UploadStateStore::parseHexMd5(const char* hex, uint8_t out[16]) {
+    return parseHexBytes(hex, out, 16);
+}
+
+void UploadStateStore::md5ToHex(const uint8_t md5[16], char out[33]) {
+    bytesToHex(md5, 16, out);
+}
+
+bool UploadStateStore::parseHexBytes(const char* hex, uint8_t* out, size_t len) {
+    if (!hex || strlen(hex) != len * 2) {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i) {
+        int hi = hexNibble(hex[i * 2]);
+        int lo = hexNibble(hex[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+
+    return true;
+}
+
+void UploadStateStore::bytesToHex(const uint8_t* bytes, size_t len, char* out) {
+    for (size_t i = 0; i < len; ++i) {
+        snprintf(out + (i * 2), 3, "%02x", bytes[i]);
+    }
+    out[len * 2] = '\0';
+}
+
+// ============================================================================
+// Backend bits
+// ============================================================================
+
+void UploadStateStore::appendBackends(char* line, size_t lineLen, uint8_t backends) {
+    // Backend 0 alone is the default, so single-backend files keep the v2 lines
+    if (backends == DEFAULT_BACKENDS) {
+        return;
+    }
+    size_t len = strlen(line);
+    if (len < lineLen) {
+        snprintf(line + len, lineLen - len, "|b%x", (unsigned)backends);
+    }
+}
+
+uint8_t UploadStateStore::splitBackends(char* line, uint8_t defaultBackends) {
+    // Trailing "|b<hex>" field; no other field is a 'b' plus one or two hex digits
+    char* sep = strrchr(line, '|');
+    if (!sep || sep[1] != 'b' || hexNibble(sep[2]) < 0) {
+        return defaultBackends;
+    }
+    if (sep[3] != '\0' && (hexNibble(sep[3]) < 0 || sep[4] != '\0')) {
+        return defaultBackends;
+    }
+
+    uint8_t backends = (uint8_t)strtoul(sep + 2, nullptr, 16);
+    if (backends == 0) {
+        return defaultBackends;
+    }
+    *sep = '\0';
+    return backends;
+}
+
+uint8_t UploadStateStore::backendOf(uint8_t backends) {
+    for (uint8_t b = 0; b < UPLOAD_STATE_MAX_BACKENDS; ++b) {
+        if (backends & (1u << b)) {
+            return b;
+        }
+    }
+    return 0;
+}
+
+// ============================================================================
+// Records
+// ============================================================================
+
+int UploadStateStore::findCompletedIndex(DayKey day) const {
+    for (uint16_t i = 0; i < completedCount; ++i) {
+        if (completedFolders[i].day == day) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+int UploadStateStore::findPendingIndex(DayKey day) const {
+    for (uint16_t i = 0; i < pendingCount; ++i) {
+        if (pendingFolders[i].day == day) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// Position of pathHash in the change table, or where it would be inserted
+int UploadStateStore::findFileChange(PathHash pathHash, bool& found) const {
+    int lo = 0;
+    int hi = (int)fileChangeCount;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (fileChanges[mid].pathHash < pathHash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    found = lo < (int)fileChangeCount && fileChanges[lo].pathHash == pathHash;
+    return lo;
+}
+
+bool UploadStateStore::findFile(PathHash pathHash, FileFingerprintEntry& out) {
+    bool found = false;
+    int idx = findFileChange(pathHash, found);
+    if (found) {
+        if (fileChanges[idx].uploaded == 0) {
+            return false;  // Removed since the last merge
+        }
+        out = fileChanges[idx];
+        return true;
+    }
+    return fileIndex.find(pathHash, out);
+}
+
+uint16_t UploadStateStore::countCompleted(uint8_t backends) const {
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < completedCount; ++i) {
+        if (completedFolders[i].backends & backends) {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint16_t UploadStateStore::countPending(uint8_t backends) const {
+    uint16_t count = 0;
+    for (uint16_t i = 0; i < pendingCount; ++i) {
+        if (pendingFolders[i].backends & backends) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int UploadStateStore::findQuarantineIndex(QuarantineKind kind, uint64_t key, uint8_t backend) const {
+    for (uint16_t i = 0; i < quarantineCount; ++i) {
+        if (quarantineEntries[i].kind == kind && quarantineEntries[i].key == key &&
+            quarantineEntries[i].backend == backend) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+void UploadStateStore::queueEvent(const JournalEvent& event) {
+    if (journalEventCount >= MAX_JOURNAL_EVENTS) {
+        forceCompaction = true;
+        eventsDropped = true;
+        return;
+    }
+    journalEvents[journalEventCount++] = event;
+}
+
+bool UploadStateStore::addCompletedInternal(DayKey day, uint8_t backends, bool queue) {
+    int idx = findCompletedIndex(day);
+    if (idx >= 0) {
+        uint8_t added = backends & ~completedFolders[idx].backends;
+        if (added == 0) {
+            return false;  // Already exists
+        }
+        completedFolders[idx].backends |= added;
+        backends = added;
+    } else {
+        if (completedCount >= MAX_COMPLETED_FOLDERS) {
+            // Remove oldest entry (at index 0)
+            if (completedCount > 1) {
+                memmove(&completedFolders[0], &completedFolders[1],
+                        sizeof(CompletedFolderEntry) * (completedCount - 1));
+            }
+            completedCount--;
+            forceCompaction = true;
+        }
+
+        completedFolders[completedCount].day = day;
+        completedFolders[completedCount].backends = backends;
+        completedCount++;
+    }
+
+    if (queue) {
+        JournalEvent event = {};
+        event.type = JournalEventType::AddCompleted;
+        event.day = day;
+        event.backends = backends;
+        queueEvent(event);
+    }
+
+    return true;
+}
+
+bool UploadStateStore::removeCompletedInternal(DayKey day, uint8_t backends, bool queue) {
+    int idx = findCompletedIndex(day);
+    if (idx < 0) {
+        return false;
+    }
+
+    uint8_t removed = completedFolders[idx].backends & backends;
+    if (removed == 0) {
+        return false;
+    }
+
+    completedFolders[idx].backends &= ~removed;
+    if (completedFolders[idx].backends == 0) {
+        if ((uint16_t)idx < (completedCount - 1)) {
+            memmove(&completedFolders[idx], &completedFolders[idx + 1], sizeof(CompletedFolderEntry) * (completedCount - idx - 1));
+        }
+        completedCount--;
+    }
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::RemoveCompleted;
+        ev.day = day;
+        ev.backends = removed;
+        queueEvent(ev);
+    }
+    return true;
+}
+
+bool UploadStateStore::addPendingInternal(DayKey day, UnixTs ts, uint8_t backends, bool queue) {
+    if (day == 0) {
+        return false;
+    }
+
+    int idx = findPendingIndex(day);
+    if (idx >= 0) {
+        // First seen is when any backend first saw the folder empty
+        if ((pendingFolders[idx].backends & ~backends) == 0) {
+            pendingFolders[idx].firstSeenTs = ts;
+        }
+        pendingFolders[idx].backends |= backends;
+    } else {
+        if (pendingCount >= MAX_PENDING_FOLDERS) {
+            memmove(&pendingFolders[0], &pendingFolders[1], sizeof(PendingFolderEntry) * (MAX_PENDING_FOLDERS - 1));
+            pendingCount = MAX_PENDING_FOLDERS - 1;
+            forceCompaction = true;
+        }
+        idx = pendingCount++;
+        pendingFolders[idx].day = day;
+        pendingFolders[idx].firstSeenTs = ts;
+        pendingFolders[idx].backends = backends;
+    }
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::AddPending;
+        ev.day = day;
+        ev.timestamp = pendingFolders[idx].firstSeenTs;
+        ev.backends = backends;
+        queueEvent(ev);
+    }
+    return true;
+}
+
+bool UploadStateStore::removePendingInternal(DayKey day, uint8_t backends, bool queue) {
+    int idx = findPendingIndex(day);
+    if (idx < 0) {
+        return false;
+    }
+
+    uint8_t removed = pendingFolders[idx].backends & backends;
+    if (removed == 0) {
+        return false;
+    }
+
+    pendingFolders[idx].backends &= ~removed;
+    if (pendingFolders[idx].backends == 0) {
+        if ((uint16_t)idx < (pendingCount - 1)) {
+            memmove(&pendingFolders[idx], &pendingFolders[idx + 1], sizeof(PendingFolderEntry) * (pendingCount - idx - 1));
+        }
+        pendingCount--;
+    }
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::RemovePending;
+        ev.day = day;
+        ev.backends = removed;
+        queueEvent(ev);
+    }
+    return true;
+}
+
+void UploadStateStore::setRetryInternal(uint8_t backend, DayKey day, int retryCount, bool queue) {
+    if (backend >= UPLOAD_STATE_MAX_BACKENDS) {
+        return;
+    }
+    currentRetryFolderDay[backend] = day;
+    currentRetryCount[backend] = retryCount < 0 ? 0 : retryCount;
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::SetRetry;
+        ev.day = day;
+        ev.retryCount = (uint16_t)currentRetryCount[backend];
+        ev.backends = (uint8_t)(1u << backend);
+        queueEvent(ev);
+    }
+}
+
+void UploadStateStore::setTimestampInternal(uint8_t backend, UnixTs ts, bool queue) {
+    if (backend >= UPLOAD_STATE_MAX_BACKENDS) {
+        return;
+    }
+    lastUploadTimestamp[backend] = ts;
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::SetTimestamp;
+        ev.timestamp = ts;
+        ev.backends = (uint8_t)(1u << backend);
+        queueEvent(ev);
+    }
+}
+
+// ============================================================================
+// Quarantine records (policy lives in UploadStateManager)
+// ============================================================================
+
+bool UploadStateStore::setQuarantineInternal(QuarantineKind kind,
+                                             uint64_t key,
+                                             uint8_t backend,
+                                             uint8_t failures,
+                                             UnixTs retryAfterTs,
+                                             bool queue) {
+    int idx = findQuarantineIndex(kind, key, backend);
+
+    if (idx < 0) {
+        if (quarantineCount >= MAX_QUARANTINE_ENTRIES) {
+            // Evict the folder/file entry whose backoff expires first — it is
+            // the most likely to be retryable already. Backend entries stay.
+            int evictIdx = -1;
+            for (uint16_t i = 0; i < quarantineCount; ++i) {
+                if (quarantineEntries[i].kind == QuarantineKind::Backend) {
+                    continue;
+                }
+                if (evictIdx < 0 || quarantineEntries[i].retryAfterTs < quarantineEntries[evictIdx].retryAfterTs) {
+                    evictIdx = (int)i;
+                }
+            }
+            if (evictIdx < 0) {
+                return false;
+            }
+
+            if ((uint16_t)evictIdx < (quarantineCount - 1)) {
+                memmove(&quarantineEntries[evictIdx], &quarantineEntries[evictIdx + 1],
+                        sizeof(QuarantineEntry) * (quarantineCount - evictIdx - 1));
+            }
+            quarantineCount--;
+            forceCompaction = true;
+        }
+
+        idx = quarantineCount++;
+    }
+
+    QuarantineEntry& entry = quarantineEntries[idx];
+    entry.key = key;
+    entry.kind = kind;
+    entry.backend = backend;
+    entry.failures = failures;
+    entry.retryAfterTs = retryAfterTs;
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::SetQuarantine;
+        ev.quarantineKind = kind;
+        ev.pathHash = key;
+        ev.failures = failures;
+        ev.timestamp = retryAfterTs;
+        ev.backends = (uint8_t)(1u << backend);
+        queueEvent(ev);
+    }
+
+    return true;
+}
+
+bool UploadStateStore::removeQuarantineInternal(QuarantineKind kind, uint64_t key, uint8_t backend, bool queue) {
+    int idx = findQuarantineIndex(kind, key, backend);
+    if (idx < 0) {
+        return false;
+    }
+
+    if ((uint16_t)idx < (quarantineCount - 1)) {
+        memmove(&quarantineEntries[idx], &quarantineEntries[idx + 1],
+                sizeof(QuarantineEntry) * (quarantineCount - idx - 1));
+    }
+    quarantineCount--;
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::RemoveQuarantine;
+        ev.quarantineKind = kind;
+        ev.pathHash = key;
+        ev.backends = (uint8_t)(1u << backend);
+        queueEvent(ev);
+    }
+
+    return true;
+}
+
+bool UploadStateStore::applyQuarantineLine(const char* line, uint8_t backends) {
+    // Format: Q|kind|key|failures|retryAfterTs
+    char kindChar = 0;
+    char keyHex[24] = {0};
+    unsigned int failures = 0;
+    unsigned long retryAfterTs = 0;
+    if (sscanf(line, "Q|%c|%23[^|]|%u|%lu", &kindChar, keyHex, &failures, &retryAfterTs) != 4) {
+        return false;
+    }
+
+    QuarantineKind kind = (QuarantineKind)kindChar;
+    if (kind != QuarantineKind::Backend && kind != QuarantineKind::Folder && kind != QuarantineKind::File) {
+        return false;
+    }
+
+    uint64_t key = (uint64_t)strtoull(keyHex, nullptr, 16);
+    return setQuarantineInternal(kind, key, backendOf(backends), (uint8_t)(failures > 0xFF ? 0xFF : failures),
+                                 (UnixTs)retryAfterTs, false);
+}
+
+// ============================================================================
+// File fingerprints (one per path, shared by all backends)
+// ============================================================================
+
+UploadStateStore::FileFingerprintEntry* UploadStateStore::stageFileChange(PathHash pathHash) {
+    bool found = false;
+    int idx = findFileChange(pathHash, found);
+    if (found) {
+        return &fileChanges[idx];
+    }
+
+    if (fileChangeCount >= MAX_FILE_CHANGES) {
+        if (!flushFileChanges()) {
+            LOG_ERROR("[UploadStateManager] Fingerprint change table full and index merge failed");
+            return nullptr;
+        }
+        idx = 0;
+    }
+
+    if (idx < (int)fileChangeCount) {
+        memmove(&fileChanges[idx + 1], &fileChanges[idx],
+                sizeof(FileFingerprintEntry) * (fileChangeCount - idx));
+    }
+    fileChangeCount++;
+
+    FileFingerprintEntry& entry = fileChanges[idx];
+    memset(&entry, 0, sizeof(entry));
+    entry.pathHash = pathHash;
+    return &entry;
+}
+
+bool UploadStateStore::flushFileChanges() {
+    if (fileChangeCount == 0) {
+        return true;
+    }
+    if (!fileIndex.merge(fileChanges, fileChangeCount)) {
+        return false;
+    }
+    fileChangeCount = 0;
+    return true;
+}
+
+bool UploadStateStore::upsertFileEntry(PathHash pathHash,
+                                       uint32_t fileSize,
+                                       const uint8_t* digest,
+                                       bool hasDigest,
+                                       FingerprintAlgo algo,
+                                       uint8_t uploaded,
+                                       bool queue) {
+    FileFingerprintEntry* entry = stageFileChange(pathHash);
+    if (!entry) {
+        return false;
+    }
+
+    entry->fileSize = fileSize;
+    entry->algo = algo;
+    entry->flags = FILE_FLAG_ACTIVE | (hasDigest ? FILE_FLAG_HAS_DIGEST : 0);
+    entry->uploaded = uploaded;
+
+    memset(entry->digest, 0, sizeof(entry->digest));
+    if (hasDigest && digest) {
+        memcpy(entry->digest, digest, FileFingerprint::digestLen(algo));
+    }
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::SetFile;
+        ev.pathHash = pathHash;
+        ev.fileSize = fileSize;
+        ev.hasDigest = hasDigest;
+        ev.algo = algo;
+        ev.backends = uploaded;
+        if (hasDigest && digest) {
+            memcpy(ev.digest, digest, FileFingerprint::digestLen(algo));
+        }
+        queueEvent(ev);
+    }
+
+    return true;
+}
+
+bool UploadStateStore::recordFileUpload(PathHash pathHash,
+                                        uint32_t fileSize,
+                                        const uint8_t* digest,
+                                        bool hasDigest,
+                                        FingerprintAlgo algo,
+                                        uint8_t backends,
+                                        bool queue) {
+    FileFingerprintEntry entry;
+    if (!findFile(pathHash, entry) || (entry.uploaded & ~backends) == 0) {
+        // Nobody else relies on the entry: take the new fingerprint as is
+        return upsertFileEntry(pathHash, fileSize, digest, hasDigest, algo, backends, queue);
+    }
+
+    // Another backend uploaded this path. If this upload carried the same
+    // content, join its set and keep the stored fingerprint; otherwise the
+    // other backends are out of date.
+    bool storedDigest = (entry.flags & FILE_FLAG_HAS_DIGEST) != 0;
+    bool same = entry.fileSize == fileSize && storedDigest == hasDigest;
+    if (same && hasDigest) {
+        // Digests of different algorithms cannot be compared, and a matching
+        // size proves nothing: treat it as new content. Callers re-take the
+        // fingerprint in the stored algorithm (fingerprintForRecord()) so
+        // this stays the fallback.
+        same = entry.algo == algo &&
+               memcmp(entry.digest, digest, FileFingerprint::digestLen(algo)) == 0;
+    }
+    if (!same) {
+        return upsertFileEntry(pathHash, fileSize, digest, hasDigest, algo, backends, queue);
+    }
+    if ((entry.uploaded & backends) == backends) {
+        return true;
+    }
+
+    return upsertFileEntry(pathHash, fileSize, entry.digest, storedDigest, entry.algo,
+                           entry.uploaded | backends, queue);
+}
+
+bool UploadStateStore::removeFileEntry(PathHash pathHash, uint8_t backends, bool queue) {
+    FileFingerprintEntry entry;
+    if (!findFile(pathHash, entry)) {
+        return false;
+    }
+
+    uint8_t removed = entry.uploaded & backends;
+    if (removed == 0) {
+        return false;
+    }
+
+    // Staged with uploaded == 0 the next merge drops it from the index
+    FileFingerprintEntry* staged = stageFileChange(pathHash);
+    if (!staged) {
+        return false;
+    }
+    *staged = entry;
+    staged->uploaded &= ~removed;
+
+    if (staged->uploaded == 0) {
+        removeAppendEntry(pathHash, queue);
+    } else {
+        int a = findAppendIndex(pathHash);
+        if (a >= 0) {
+            appendEntries[a].uploaded &= ~removed;
+        }
+    }
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::RemoveFile;
+        ev.pathHash = pathHash;
+        ev.backends = removed;
+        queueEvent(ev);
+    }
+
+    return true;
+}
+
+// ============================================================================
+// Append fingerprint records (hashing lives in UploadStateManager)
+// ============================================================================
+
+int UploadStateStore::findAppendIndex(PathHash pathHash) const {
+    for (uint8_t i = 0; i < appendCount; ++i) {
+        if (appendEntries[i].pathHash == pathHash) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+UploadStateStore::AppendHashEntry* UploadStateStore::upsertAppendEntry(PathHash pathHash) {
+    int idx = findAppendIndex(pathHash);
+    if (idx < 0) {
+        if (appendCount >= MAX_APPEND_ENTRIES) {
+            // Drop the oldest; it is rebuilt by a full pass if the file is checked again
+            memmove(&appendEntries[0], &appendEntries[1],
+                    sizeof(AppendHashEntry) * (appendCount - 1));
+            appendCount--;
+            forceCompaction = true;
+        }
+        idx = appendCount++;
+    }
+
+    AppendHashEntry* entry = &appendEntries[idx];
+    memset(entry, 0, sizeof(*entry));
+    entry->pathHash = pathHash;
+    return entry;
+}
+
+bool UploadStateStore::removeAppendEntry(PathHash pathHash, bool queue) {
+    int idx = findAppendIndex(pathHash);
+    if (idx < 0) {
+        return false;
+    }
+
+    if ((uint8_t)idx < (appendCount - 1)) {
+        memmove(&appendEntries[idx], &appendEntries[idx + 1],
+                sizeof(AppendHashEntry) * (appendCount - idx - 1));
+    }
+    appendCount--;
+
+    if (queue) {
+        JournalEvent ev = {};
+        ev.type = JournalEventType::RemoveAppend;
+        ev.pathHash = pathHash;
+        queueEvent(ev);
+    }
+    return true;
+}
+
+void UploadStateStore::queueAppendEvent(PathHash pathHash) {
+    JournalEvent ev = {};
+    ev.type = JournalEventType::SetAppend;
+    ev.pathHash = pathHash;
+    queueEvent(ev);
+}
+
+bool UploadStateStore::formatAppendLine(const AppendHashEntry& entry, char* out, size_t outLen) const {
+    // Only fingerprints that match an upload are worth keeping across reboots
+    if (entry.uploaded == 0) {
+        return false;
+    }
+
+    char headHex[33];
+    char bodyHex[33];
+    char midHex[MD5_MIDSTATE_BYTES * 2 + 1];
+    md5ToHex(entry.headMd5, headHex);
+    md5ToHex(entry.bodyMd5, bodyHex);
+    bytesToHex(entry.midstate, MD5_MIDSTATE_BYTES, midHex);
+
+    int n = snprintf(out,
+                     outLen,
+                     "A|%016llx|%lu|%lu|%s|%s|%s",
+                     (unsigned long long)entry.pathHash,
+                     (unsigned long)entry.headerLen,
+                     (unsigned long)entry.length,
+                     headHex,
+                     bodyHex,
+                     midHex);
+    if (n <= 0 || (size_t)n >= outLen) {
+        return false;
+    }
+    appendBackends(out, outLen, entry.uploaded);
+    return true;
+}
+
+bool UploadStateStore::applyAppendLine(const char* line, uint8_t backends) {
+    char pathHashHex[24] = {0};
+
+    if (strncmp(line, "A-|", 3) == 0) {
+        if (sscanf(line, "A-|%23s", pathHashHex) == 1) {
+            removeAppendEntry((PathHash)strtoull(pathHashHex, nullptr, 16), false);
+            return true;
+        }
+        return false;
+    }
+
+    unsigned long headerLen = 0;
+    unsigned long length = 0;
+    char headHex[40] = {0};
+    char bodyHex[40] = {0};
+    char midHex[64] = {0};
+    if (sscanf(line, "A|%23[^|]|%lu|%lu|%39[^|]|%39[^|]|%63s",
+               pathHashHex, &headerLen, &length, headHex, bodyHex, midHex) != 6) {
+        return false;
+    }
+
+    AppendHashEntry parsed = {};
+    parsed.pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
+    parsed.headerLen = (uint32_t)headerLen;
+    parsed.length = (uint32_t)length;
+    parsed.uploaded = backends;
+    if (parsed.headerLen == 0 || parsed.length < parsed.headerLen ||
+        !parseHexMd5(headHex, parsed.headMd5) ||
+        !parseHexMd5(bodyHex, parsed.bodyMd5) ||
+        !parseHexBytes(midHex, parsed.midstate, MD5_MIDSTATE_BYTES)) {
+        return false;
+    }
+
+    int idx = findAppendIndex(parsed.pathHash);
+    if (importing && idx >= 0) {
+        const AppendHashEntry& existing = appendEntries[idx];
+        if (existing.length == parsed.length &&
+            memcmp(existing.headMd5, parsed.headMd5, sizeof(parsed.headMd5)) == 0 &&
+            memcmp(existing.bodyMd5, parsed.bodyMd5, sizeof(parsed.bodyMd5)) == 0) {
+            parsed.uploaded |= existing.uploaded;
+        }
+    }
+
+    *upsertAppendEntry(parsed.pathHash) = parsed;
+    return true;
+}
+
+// ============================================================================
+// Journal + snapshot
+// ============================================================================
+
+bool UploadStateStore::appendJournalLine(File& file, const JournalEvent& event) {
+    char line[192] = {0};
+    char dayText[16] = {0};
+
+    switch (event.type) {
+        case JournalEventType::SetTimestamp:
+            snprintf(line, sizeof(line), "T|%lu", (unsigned long)event.timestamp);
+            break;
+        case JournalEventType::SetRetry:
+            dayKeyToChars(event.day, dayText, sizeof(dayText));
+            snprintf(line, sizeof(line), "R|%s|%u", dayText, (unsigned)event.retryCount);
+            break;
+        case JournalEventType::AddCompleted:
+            dayKeyToChars(event.day, dayText, sizeof(dayText));
+            snprintf(line, sizeof(line), "C+|%s", dayText);
+            break;
+        case JournalEventType::RemoveCompleted:
+            dayKeyToChars(event.day, dayText, sizeof(dayText));
+            snprintf(line, sizeof(line), "C-|%s", dayText);
+            break;
+        case JournalEventType::AddPending:
+            dayKeyToChars(event.day, dayText, sizeof(dayText));
+            snprintf(line, sizeof(line), "P+|%s|%lu", dayText, (unsigned long)event.timestamp);
+            break;
+        case JournalEventType::RemovePending:
+            dayKeyToChars(event.day, dayText, sizeof(dayText));
+            snprintf(line, sizeof(line), "P-|%s", dayText);
+            break;
+        case JournalEventType::SetFile: {
+            char digestText[FileFingerprint::MAX_TEXT_LEN] = {0};
+            if (event.hasDigest) {
+                FileFingerprint::format(event.algo, event.digest, digestText);
+            } else {
+                snprintf(digestText, sizeof(digestText), "-");
+            }
+            snprintf(line,
+                     sizeof(line),
+                     "F|%016llx|%lu|%s",
+                     (unsigned long long)event.pathHash,
+                     (unsigned long)event.fileSize,
+                     digestText);
+            break;
+        }
+        case JournalEventType::RemoveFile:
+            snprintf(line, sizeof(line), "F-|%016llx", (unsigned long long)event.pathHash);
+            break;
+        case JournalEventType::SetQuarantine:
+            snprintf(line,
+                     sizeof(line),
+                     "Q|%c|%016llx|%u|%lu",
+                     (char)event.quarantineKind,
+                     (unsigned long long)event.pathHash,
+                     (unsigned)event.failures,
+                     (unsigned long)event.timestamp);
+            break;
+        case JournalEventType::RemoveQuarantine:
+            snprintf(line, sizeof(line), "Q-|%c|%016llx",
+                     (char)event.quarantineKind, (unsigned long long)event.pathHash);
+            break;
+        case JournalEventType::SetAppend: {
+            int idx = findAppendIndex(event.pathHash);
+            if (idx < 0 || !formatAppendLine(appendEntries[idx], line, sizeof(line))) {
+                return true;  // Removed again before the flush; the A- line follows
+            }
+            return file.println(line) > 0;  // Carries the entry's own backend bits
+        }
+        case JournalEventType::RemoveAppend:
+            snprintf(line, sizeof(line), "A-|%016llx", (unsigned long long)event.pathHash);
+            return file.println(line) > 0;  // Shared by all backends
+    }
+
+    appendBackends(line, sizeof(line), event.backends);
+    return file.println(line) > 0;
+}
+
+bool UploadStateStore::flushJournal(fs::FS &sd) {
+    if (journalEventCount == 0) {
+        return true;
+    }
+
+    File file = sd.open(stateJournalPath, FILE_APPEND);
+    if (!file) {
+        LOGF("[UploadStateManager] ERROR: Failed to open journal file for append: %s", stateJournalPath.c_str());
+        return false;
+    }
+
+    for (uint16_t i = 0; i < journalEventCount; ++i) {
+        if (!appendJournalLine(file, journalEvents[i])) {
+            file.close();
+            LOG("[UploadStateManager] ERROR: Failed to append journal event");
+            return false;
+        }
+    }
+
+    file.close();
+
+    if ((uint32_t)journalLineCount + journalEventCount > 0xFFFFu) {
+        journalLineCount = 0xFFFFu;
+    } else {
+        journalLineCount = (uint16_t)(journalLineCount + journalEventCount);
+    }
+
+    journalEventCount = 0;
+    return true;
+}
+
+bool UploadStateStore::applyFileLine(const char* format, const char* line, uint8_t backends) {
+    char pathHashHex[24] = {0};
+    unsigned long fileSize = 0;
+    char digestText[40] = {0};
+    if (sscanf(line, format, pathHashHex, &fileSize, digestText) != 3) {
+        return false;
+    }
+
+    PathHash pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
+    FingerprintAlgo algo = FingerprintAlgo::Md5;
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN] = {0};
+    bool hasDigest = false;
+    if (strcmp(digestText, "-") != 0) {
+        hasDigest = FileFingerprint::parse(digestText, algo, digest);
+        if (!hasDigest) {
+            return false;
+        }
+    }
+
+    // A line carries the entry's full backend set; a legacy file only its own
+    if (importing) {
+        return recordFileUpload(pathHash, (uint32_t)fileSize, hasDigest ? digest : nullptr,
+                                hasDigest, algo, backends, false);
+    }
+    return upsertFileEntry(pathHash,
+                           (uint32_t)fileSize,
+                           hasDigest ? digest : nullptr,
+                           hasDigest,
+                           algo,
+                           backends,
+                           false);
+}
+
+bool UploadStateStore::applySnapshotLine(const char* line, uint8_t backends) {
+    if (!line || line[0] == '\0') {
+        return true;
+    }
+
+    if (strncmp(line, "T|", 2) == 0) {
+        // Timestamps of backends other than the one in the header
+        unsigned long ts = 0;
+        if (sscanf(line, "T|%lu", &ts) == 1) {
+            setTimestampInternal(backendOf(backends), (UnixTs)ts, false);
+            return true;
+        }
+        return false;
+    }
+
+    if (strncmp(line, "R|", 2) == 0) {
+        char dayToken[16] = {0};
+        unsigned long retryCount = 0;
+        if (sscanf(line, "R|%15[^|]|%lu", dayToken, &retryCount) == 2) {
+            DayKey day = 0;
+            if (!parseDayToken(dayToken, day)) {
+                return false;
+            }
+
+            setRetryInternal(backendOf(backends), day, (int)retryCount, false);
+            return true;
+        }
+        return false;
+    }
+
+    if (strncmp(line, "C|", 2) == 0) {
+        // Format: C|day  (extra fields from older snapshot formats are silently ignored)
+        char dayToken[16] = {0};
+        if (sscanf(line, "C|%15[^|\n]", dayToken) == 1) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return addCompletedInternal(day, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "P|", 2) == 0) {
+        char dayToken[16] = {0};
+        unsigned long firstSeenTs = 0;
+        if (sscanf(line, "P|%15[^|]|%lu", dayToken, &firstSeenTs) == 2) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return addPendingInternal(day, (UnixTs)firstSeenTs, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "F|", 2) == 0) {
+        // Older snapshots list the fingerprints; the next compaction moves them to the index
+        forceCompaction = true;
+        return applyFileLine("F|%23[^|]|%lu|%39s", line, backends);
+    }
+
+    if (strncmp(line, "Q|", 2) == 0) {
+        return applyQuarantineLine(line, backends);
+    }
+
+    if (strncmp(line, "A|", 2) == 0) {
+        return applyAppendLine(line, backends);
+    }
+
+    return false;
+}
+
+bool UploadStateStore::applyJournalLine(const char* line, uint8_t backends) {
+    if (!line || line[0] == '\0') {
+        return true;
+    }
+
+    if (strncmp(line, "T|", 2) == 0) {
+        unsigned long ts = 0;
+        if (sscanf(line, "T|%lu", &ts) == 1) {
+            setTimestampInternal(backendOf(backends), (UnixTs)ts, false);
+            return true;
+        }
+        return false;
+    }
+
+    if (strncmp(line, "R|", 2) == 0) {
+        char dayToken[16] = {0};
+        unsigned long retryCount = 0;
+        if (sscanf(line, "R|%15[^|]|%lu", dayToken, &retryCount) == 2) {
+            DayKey day = 0;
+            if (!parseDayToken(dayToken, day)) {
+                return false;
+            }
+
+            setRetryInternal(backendOf(backends), day, (int)retryCount, false);
+            return true;
+        }
+        return false;
+    }
+
+    if (strncmp(line, "C+|", 3) == 0) {
+        char dayToken[16] = {0};
+        if (sscanf(line, "C+|%15s", dayToken) == 1) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return addCompletedInternal(day, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "C-|", 3) == 0) {
+        char dayToken[16] = {0};
+        if (sscanf(line, "C-|%15s", dayToken) == 1) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return removeCompletedInternal(day, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "P+|", 3) == 0) {
+        char dayToken[16] = {0};
+        unsigned long firstSeenTs = 0;
+        if (sscanf(line, "P+|%15[^|]|%lu", dayToken, &firstSeenTs) == 2) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return addPendingInternal(day, (UnixTs)firstSeenTs, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "P-|", 3) == 0) {
+        char dayToken[16] = {0};
+        if (sscanf(line, "P-|%15s", dayToken) == 1) {
+            DayKey day = 0;
+            if (parseDayToken(dayToken, day)) {
+                return removePendingInternal(day, backends, false);
+            }
+        }
+        return false;
+    }
+
+    if (strncmp(line, "Q|", 2) == 0) {
+        return applyQuarantineLine(line, backends);
+    }
+
+    if (strncmp(line, "Q-|", 3) == 0) {
+        char kindChar = 0;
+        char keyHex[24] = {0};
+        if (sscanf(line, "Q-|%c|%23s", &kindChar, keyHex) == 2) {
+            uint64_t key = (uint64_t)strtoull(keyHex, nullptr, 16);
+            return removeQuarantineInternal((QuarantineKind)kindChar, key, backendOf(backends), false);
+        }
+        return false;
+    }
+
+    if (strncmp(line, "A|", 2) == 0 || strncmp(line, "A-|", 3) == 0) {
+        return applyAppendLine(line, backends);
+    }
+
+    if (strncmp(line, "F-|", 3) == 0) {
+        char pathHashHex[24] = {0};
+        if (sscanf(line, "F-|%23s", pathHashHex) == 1) {
+            PathHash pathHash = (PathHash)strtoull(pathHashHex, nullptr, 16);
+            return removeFileEntry(pathHash, backends, false);
+        }
+        return false;
+    }
+
+    if (strncmp(line, "F|", 2) == 0) {
+        return applyFileLine("F|%23[^|]|%lu|%39s", line, backends);
+    }
+
+    return false;
+}
+
+bool UploadStateStore::replayJournal(fs::FS &sd, const String& journalPath, uint8_t defaultBackends, uint16_t& lines) {
+    lines = 0;
+    if (!sd.exists(journalPath)) {
+        return false;
+    }
+    File file = sd.open(journalPath, FILE_READ);
+    if (!file) {
+        return false;
+    }
+
+    char line[256] = {0};
+
+    while (readLine(file, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        uint8_t backends = splitBackends(line, defaultBackends);
+        if (!applyJournalLine(line, backends)) {
+            LOG_WARNF("[UploadStateManager] Ignoring invalid journal line: %s", line);
+            continue;
+        }
+
+        if (lines < 0xFFFFu) {
+            lines++;
+        }
+    }
+
+    file.close();
+    return lines > 0;
+}
+
+size_t UploadStateStore::journalSize(fs::FS &sd) const {
+    if (!sd.exists(stateJournalPath)) {
+        return 0;
+    }
+    File file = sd.open(stateJournalPath, FILE_READ);
+    if (!file) {
+        return 0;
+    }
+    size_t size = file.size();
+    file.close();
+    return size;
+}
+
+bool UploadStateStore::shouldCompact(fs::FS &sd) const {
+    if (forceCompaction) {
+        return true;
+    }
+
+    if (!sd.exists(stateSnapshotPath)) {
+        return true;
+    }
+
+    if (journalLineCount >= COMPACTION_LINE_THRESHOLD) {
+        return true;
+    }
+
+    return journalSize(sd) >= COMPACTION_SIZE_THRESHOLD_BYTES;
+}
+
+bool UploadStateStore::compactState(fs::FS &sd) {
+    // The journal's F lines may only go once the index holds them
+    if (!flushFileChanges()) {
+        LOG("[UploadStateManager] ERROR: Failed to merge file fingerprints into the index");
+        return false;
+    }
+
+    String tempPath = stateSnapshotPath + ".tmp";
+    File file = sd.open(tempPath, FILE_WRITE);
+    if (!file) {
+        LOGF("[UploadStateManager] ERROR: Failed to open temp snapshot file: %s", tempPath.c_str());
+        return false;
+    }
+
+#define SNAPSHOT_LINE(backends)                                                 \
+    do {                                                                        \
+        appendBackends(line, sizeof(line), (backends));                         \
+        if (file.println(line) == 0) {                                          \
+            file.close();                                                       \
+            sd.remove(tempPath);                                                \
+            return false;                                                       \
+        }                                                                       \
+    } while (0)
+
+    char line[256] = {0};
+    // Version 3: lines may carry backend bits
+    snprintf(line, sizeof(line), "U2|%u|%lu", backendCount > 1 ? 3u : 2u,
+             (unsigned long)lastUploadTimestamp[0]);
+    SNAPSHOT_LINE(DEFAULT_BACKENDS);
+
+    for (uint8_t b = 1; b < backendCount; ++b) {
+        snprintf(line, sizeof(line), "T|%lu", (unsigned long)lastUploadTimestamp[b]);
+        SNAPSHOT_LINE((uint8_t)(1u << b));
+    }
+
+    for (uint8_t b = 0; b < backendCount; ++b) {
+        char retryDay[16] = {0};
+        dayKeyToChars(currentRetryFolderDay[b], retryDay, sizeof(retryDay));
+        snprintf(line, sizeof(line), "R|%s|%u", retryDay, (unsigned)currentRetryCount[b]);
+        SNAPSHOT_LINE((uint8_t)(1u << b));
+    }
+
+    for (uint16_t i = 0; i < completedCount; ++i) {
+        char dayText[16] = {0};
+        dayKeyToChars(completedFolders[i].day, dayText, sizeof(dayText));
+        snprintf(line, sizeof(line), "C|%s", dayText);
+        SNAPSHOT_LINE(completedFolders[i].backends);
+    }
+
+    for (uint16_t i = 0; i < pendingCount; ++i) {
+        char dayText[16] = {0};
+        dayKeyToChars(pendingFolders[i].day, dayText, sizeof(dayText));
+        snprintf(line, sizeof(line), "P|%s|%lu", dayText, (unsigned long)pendingFolders[i].firstSeenTs);
+        SNAPSHOT_LINE(pendingFolders[i].backends);
+    }
+
+    for (uint8_t i = 0; i < appendCount; ++i) {
+        if (!formatAppendLine(appendEntries[i], line, sizeof(line))) {
+            continue;
+        }
+        SNAPSHOT_LINE(DEFAULT_BACKENDS);  // formatAppendLine() added the bits
+    }
+
+    for (uint16_t i = 0; i < quarantineCount; ++i) {
+        const QuarantineEntry& entry = quarantineEntries[i];
+        snprintf(line,
+                 sizeof(line),
+                 "Q|%c|%016llx|%u|%lu",
+                 (char)entry.kind,
+                 (unsigned long long)entry.key,
+                 (unsigned)entry.failures,
+                 (unsigned long)entry.retryAfterTs);
+        SNAPSHOT_LINE((uint8_t)(1u << entry.backend));
+    }
+#undef SNAPSHOT_LINE
+
+    file.close();
+
+    File verify = sd.open(tempPath, FILE_READ);
+    if (!verify) {
+        sd.remove(tempPath);
+        return false;
+    }
+
+    size_t verifySize = verify.size();
+    verify.close();
+    if (verifySize == 0) {
+        sd.remove(tempPath);
+        return false;
+    }
+
+    if (sd.exists(stateSnapshotPath)) {
+        sd.remove(stateSnapshotPath);
+    }
+
+    if (!sd.rename(tempPath, stateSnapshotPath)) {
+        sd.remove(tempPath);
+        return false;
+    }
+
+    if (sd.exists(stateJournalPath)) {
+        sd.remove(stateJournalPath);
+    }
+
+    journalEventCount = 0;
+    journalLineCount = 0;
+    forceCompaction = false;
+    compactionDue = false;
+    eventsDropped = false;
+
+    return true;
+}
+
+bool UploadStateStore::loadSnapshot(fs::FS &sd, const String& snapshotPath, uint8_t defaultBackends, bool& loaded) {
+    loaded = false;
+    if (!sd.exists(snapshotPath)) {
+        return true;
+    }
+
+    File file = sd.open(snapshotPath, FILE_READ);
+    if (!file) {
+        LOGF("[UploadStateManager] ERROR: Failed to open snapshot file: %s", snapshotPath.c_str());
+        return false;
+    }
+
+    char line[256] = {0};
+    if (!readLine(file, line, sizeof(line))) {
+        file.close();
+        LOG("[UploadStateManager] WARNING: Snapshot file is empty");
+        return false;
+    }
+
+    unsigned long version = 0;
+    unsigned long ts = 0;
+    if (sscanf(line, "U2|%lu|%lu", &version, &ts) != 2 || (version != 2 && version != 3)) {
+        file.close();
+        LOGF("[UploadStateManager] ERROR: Invalid snapshot header: %s", line);
+        return false;
+    }
+
+    setTimestampInternal(backendOf(defaultBackends), (UnixTs)ts, false);
+
+    while (readLine(file, line, sizeof(line))) {
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        uint8_t backends = splitBackends(line, defaultBackends);
+        if (!applySnapshotLine(line, backends)) {
+            LOG_WARNF("[UploadStateManager] Ignoring invalid snapshot line: %s", line);
+        }
+    }
+
+    file.close();
+    loaded = true;
+    return true;
+}
+
+bool UploadStateStore::loadState(fs::FS &sd) {
+    clearState();
+    fileIndex.open(sd, stateIndexPath);
+
+    bool loadedSnapshot = false;
+    if (!loadSnapshot(sd, stateSnapshotPath, DEFAULT_BACKENDS, loadedSnapshot)) {
+        return false;
+    }
+
+    bool replayedJournal = replayJournal(sd, stateJournalPath, DEFAULT_BACKENDS, journalLineCount);
+
+    if (!loadedSnapshot && !replayedJournal) {
+        LOG("[UploadStateManager] State snapshot/journal not found - will create on first save");
+        return false;
+    }
+
+    LOG("[UploadStateManager] State v2 loaded successfully");
+    LOG_DEBUGF("[UploadStateManager]   Completed folders: %u", completedCount);
+    LOG_DEBUGF("[UploadStateManager]   Pending folders: %u", pendingCount);
+    LOG_DEBUGF("[UploadStateManager]   Tracked files: %lu (+%u changes)",
+               (unsigned long)fileIndex.count(), (unsigned)fileChangeCount);
+    if (quarantineCount > 0) {
+        LOG_DEBUGF("[UploadStateManager]   Quarantine entries: %u", quarantineCount);
+    }
+    for (uint8_t b = 0; b < backendCount; ++b) {
+        if (currentRetryFolderDay[b] != 0) {
+            char retryDay[16] = {0};
+            dayKeyToChars(currentRetryFolderDay[b], retryDay, sizeof(retryDay));
+            LOG_DEBUGF("[UploadStateManager]   Current retry folder: %s (attempt %d)", retryDay, currentRetryCount[b]);
+        }
+    }
+
+    return true;
+}
+
+bool UploadStateStore::importLegacy(fs::FS &sd, const char* snapshotPath, const char* journalPath, uint8_t backend) {
+    if (backend >= backendCount || (!sd.exists(snapshotPath) && !sd.exists(journalPath))) {
+        return false;
+    }
+
+    uint8_t backends = (uint8_t)(1u << backend);
+    bool loadedSnapshot = false;
+    uint16_t lines = 0;
+
+    importing = true;
+    if (!loadSnapshot(sd, snapshotPath, backends, loadedSnapshot)) {
+        LOG_WARNF("[UploadStateManager] Skipping unreadable legacy snapshot: %s", snapshotPath);
+    }
+    replayJournal(sd, journalPath, backends, lines);
+    importing = false;
+
+    LOGF("[UploadStateManager] Imported %s (%u journal lines) into backend %u",
+         snapshotPath, (unsigned)lines, (unsigned)backend);
+
+    // Old files go only once the merged snapshot is on flash
+    if (!compactState(sd)) {
+        LOG("[UploadStateManager] ERROR: Failed to write merged state, keeping legacy files");
+        return false;
+    }
+    if (sd.exists(snapshotPath)) {
+        sd.remove(snapshotPath);
+    }
+    if (sd.exists(journalPath)) {
+        sd.remove(journalPath);
+    }
+    return true;
+}
+
+bool UploadStateStore::saveState(fs::FS &sd) {
+    if (!flushJournal(sd)) {
+        return false;
+    }
+
+    // Compaction waits for compactIfDue() unless the journal has run away or
+    // lost events (queue overflow): then only a snapshot keeps the state
+    if (!compactionDue && shouldCompact(sd)) {
+        compactionDue = true;
+        LOG_DEBUG("[UploadStateManager] Journal past compaction threshold - compaction deferred");
+    }
+
+    if (compactionDue && (eventsDropped || journalSize(sd) >= COMPACTION_HARD_LIMIT_BYTES)) {
+        LOG_WARN("[UploadStateManager] Journal overflow - compacting inline");
+        if (!compactState(sd)) {
+            LOG("[UploadStateManager] ERROR: Failed to compact state snapshot");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool UploadStateStore::compactIfDue(fs::FS &sd) {
+    if (!compactionDue) {
+        return true;
+    }
+
+    // Events queued since the last save belong in the snapshot too
+    if (!flushJournal(sd)) {
+        return false;
+    }
+
+    unsigned long startMs = millis();
+    if (!compactState(sd)) {
+        LOG("[UploadStateManager] ERROR: Failed to compact state snapshot");
+        return false;
+    }
+    LOG_DEBUGF("[UploadStateManager] Compacted state in %lu ms", (unsigned long)(millis() - startMs));
+    return true;
+}
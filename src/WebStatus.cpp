@@ -8,3 +8,5 @@ volatile SessionStatus g_cloudSessionStatus = { false, "", 0, 0 };
 
 BackendSummaryStatus g_activeBackendStatus   = { "NONE", 0, 0, 0, 0, false };
 BackendSummaryStatus g_inactiveBackendStatus = { "NONE", 0, 0, 0, 0, false };
+
+NetBenchStatus g_netBenchStatus = {};
@@ -26,6 +26,9 @@
 #include "TrafficMonitor.h"
 #include "UploadFSM.h"
 #include "TlsArena.h"
+#include "HeapGovernor.h"
+#include "FsmEvents.h"
+#include "WebStatus.h"
 #include <ESPmDNS.h>
 
 // True when esp_restart() was the reset cause (ESP_RST_SW).
@@ -97,9 +100,17 @@ bool stopMonitoringRequested = false;
 unsigned long lastIdleCheck = 0;
 const unsigned long IDLE_CHECK_INTERVAL_MS = 60000;  // 60 seconds
 
+// loop() blocks in g_fsmEvents.wait() between passes (see fsmWaitMs())
+const uint32_t FSM_MAX_WAIT_MS = 1000;        // Software watchdog, log flush, WiFi/NTP checks
+const uint32_t FSM_SAMPLE_WAIT_MS = 100;      // TrafficMonitor sample interval
+const uint32_t FSM_TRANSIENT_WAIT_MS = 10;    // States that transition on their next pass
+const uint32_t WEB_POLL_INTERVAL_MS = 100;    // handleClient() cadence while the web server runs
+
 // FreeRTOS upload task (runs upload on separate core for web server responsiveness)
+// The task posts FSM_EVT_UPLOAD_DONE after setting uploadTaskResult, then
+// suspends itself; loop() deletes it (reapUploadTask) before the static
+// stack/TCB below is handed to any other task.
 volatile bool uploadTaskRunning = false;
-volatile bool uploadTaskComplete = false;
 volatile UploadResult uploadTaskResult = UploadResult::ERROR;
 TaskHandle_t uploadTaskHandle = nullptr;
 
@@ -109,6 +120,25 @@ TaskHandle_t uploadTaskHandle = nullptr;
 static StackType_t uploadTaskStack[12288 / sizeof(StackType_t)];
 static StaticTask_t uploadTaskTCB;
 
+// ── Short-lived background tasks (predictive pre-warm, network self-test,
+//    state compaction) ──
+// Pre-warm: shortly before the learned therapy-end time, resolve DNS, refresh
+// the OAuth token and probe SMB so the upload that follows bus silence starts
+// with network setup already done.  Self-test: /api/netbench measurements.
+// Compaction: the upload path only appends to the state journal; the snapshot
+// rewrite it defers runs here in COOLDOWN/IDLE.
+// All borrow the upload task's static stack, one at a time;
+// handleUploading() waits until the task is gone.
+volatile bool g_netTaskRunning = false;
+TaskHandle_t netTaskHandle = nullptr;
+volatile unsigned long g_lastCompactionAttempt = 0;
+const unsigned long STATE_COMPACTION_RETRY_MS = 10UL * 60UL * 1000UL;  // 10 minutes after a failure
+
+// Bus-activity streak tracking for session-end learning.  Streaks shorter
+// than THERAPY_SESSION_MIN_MS (e.g. daytime card reads) are not recorded.
+unsigned long g_busStreakStartedAt = 0;  // millis() of first activity after silence (0 = none)
+const unsigned long THERAPY_SESSION_MIN_MS = 30UL * 60UL * 1000UL;  // 30 minutes
+
 // Software watchdog: upload task updates this heartbeat; main loop kills task if stale
 volatile unsigned long g_uploadHeartbeat = 0;
 const unsigned long UPLOAD_WATCHDOG_TIMEOUT_MS = 120000;  // 2 minutes
@@ -161,19 +191,13 @@ const unsigned long LOG_FLUSH_INTERVAL_MS = 10 * 1000;  // 10 seconds
 bool g_debugMode = false;
 
 #ifdef ENABLE_WEBSERVER
-// External trigger flags (defined in WebServer.cpp)
-extern volatile bool g_triggerUploadFlag;
+// Web requests arrive as FSM events (FsmEvents.h); these are their data
 extern volatile bool g_forceRecentOnlyFlag;
-extern volatile bool g_resetStateFlag;
 
-// Latched copy of g_triggerUploadFlag — set when the FSM transitions to
-// ACQUIRING due to a web-UI trigger, before g_triggerUploadFlag is cleared.
+// Set when the FSM transitions to ACQUIRING for FSM_EVT_UPLOAD_TRIGGER.
 // Read once in handleUploading() to propagate into UploadTaskParams.
 static bool g_uploadWasForceTriggered = false;
 
-// Monitoring trigger flags (defined in WebServer.cpp)
-extern volatile bool g_monitorActivityFlag;
-extern volatile bool g_stopMonitorFlag;
 extern volatile bool g_abortUploadFlag;
 #endif
 
@@ -217,6 +241,11 @@ void transitionTo(UploadState newState) {
 // Helper Functions
 // ============================================================================
 
+// PCNT watch-point ISR hook (TrafficMonitor::setActivityHook)
+static bool IRAM_ATTR busActivityWake() {
+    return g_fsmEvents.postFromISR(FSM_EVT_BUS_ACTIVITY);
+}
+
 /**
  * Extract panic details from the coredump partition after a WDT/panic reset.
  * Scans for the ESP_PANIC_DETAILS ELF note in the raw coredump data and
@@ -473,6 +502,11 @@ void setup() {
     
     // Initialize TrafficMonitor (PCNT-based bus activity detection on CS_SENSE pin)
     trafficMonitor.begin(CS_SENSE);
+    sdManager.setTrafficMonitor(&trafficMonitor);
+
+    // FSM events: web requests, task completion and bus activity wake loop()
+    g_fsmEvents.begin();
+    trafficMonitor.setActivityHook(busActivityWake);
     
 
     // Determine boot type: software reset (ESP_RST_SW) = soft-reboot / FastBoot.
@@ -551,7 +585,10 @@ void setup() {
             // Delete all known state/summary paths from internal LittleFS only.
             // Paths are relative to the LittleFS mount — do NOT include /littlefs/ prefix.
             static const char* STATE_FILES[] = {
-                "/.upload_state.v2.smb",
+                "/.upload_state.v3",      // shared SMB + Cloud store
+                "/.upload_state.v3.log",
+                "/.upload_state.v3.idx",  // file fingerprint index
+                "/.upload_state.v2.smb",  // per-backend files from older firmware
                 "/.upload_state.v2.smb.log",
                 "/.upload_state.v2.cloud",
                 "/.upload_state.v2.cloud.log",
@@ -761,6 +798,7 @@ void setup() {
         LOG_ERROR("Failed to initialize uploader");
         return;
     }
+    uploader->setMetaCache(&sdManager.getMetaCache());
     g_heapRecoveryBoot = false;  // consumed — only skip delays on this one boot
     LOG("Uploader initialized successfully");
     
@@ -844,6 +882,148 @@ void setup() {
     LOG("Setup complete!");
 }
 
+// ============================================================================
+// Predictive Pre-Warm (smart mode)
+// ============================================================================
+
+// Feed the session-end learner when confirmed bus silence follows a
+// therapy-length activity streak.  The end time is backdated by the silence
+// already observed.
+static void recordTherapySessionEnd() {
+    if (g_busStreakStartedAt == 0) return;
+    unsigned long streakMs = millis() - g_busStreakStartedAt;
+    uint32_t idleMs = trafficMonitor.getConsecutiveIdleMs();
+    g_busStreakStartedAt = 0;
+    if (streakMs <= idleMs || streakMs - idleMs < THERAPY_SESSION_MIN_MS) return;
+
+    ScheduleManager* sm = uploader->getScheduleManager();
+    if (!sm || !sm->isSmartMode() || !sm->isTimeSynced()) return;
+    sm->recordSessionEnd((unsigned long)time(nullptr) - idleMs / 1000);
+}
+
+void preWarmTaskFunction(void* pvParameters) {
+    esp_task_wdt_add(NULL);
+    uploader->preWarmBackends();
+    esp_task_wdt_delete(NULL);
+    g_netTaskRunning = false;
+    g_fsmEvents.post(FSM_EVT_NET_TASK_DONE);
+    // Suspend instead of self-deleting: the main loop deletes us from Core 1
+    // so the shared static stack/TCB is reclaimed before the next task reuses it.
+    vTaskSuspend(NULL);
+}
+
+void netBenchTaskFunction(void* pvParameters) {
+    esp_task_wdt_add(NULL);
+    uploader->runNetBench(g_netBenchStatus);
+    g_netBenchStatus.state = NetBenchState::DONE;
+    esp_task_wdt_delete(NULL);
+    g_netTaskRunning = false;
+    g_fsmEvents.post(FSM_EVT_NET_TASK_DONE);
+    vTaskSuspend(NULL);
+}
+
+void stateCompactionTaskFunction(void* pvParameters) {
+    esp_task_wdt_add(NULL);
+    if (uploader->compactStateIfDue()) {
+        g_lastCompactionAttempt = 0;  // Only a failure waits out the retry interval
+    } else {
+        LOG_WARN("[FSM] State compaction failed - will retry");
+    }
+    esp_task_wdt_delete(NULL);
+    g_netTaskRunning = false;
+    g_fsmEvents.post(FSM_EVT_NET_TASK_DONE);
+    vTaskSuspend(NULL);
+}
+
+// Delete the finished upload task once it has parked itself.  Returns true
+// once no upload task holds the shared static stack.
+static bool reapUploadTask() {
+    if (!uploadTaskHandle) return true;
+    if (uploadTaskRunning || eTaskGetState(uploadTaskHandle) != eSuspended) return false;
+
+    vTaskDelete(uploadTaskHandle);
+    uploadTaskHandle = nullptr;
+    return true;
+}
+
+// Reap a finished network task (and a finished upload task: both live in the
+// same static stack slot).  Returns true once neither exists, i.e. the stack
+// may be reused.
+static bool reapNetTask() {
+    if (!reapUploadTask()) return false;
+    if (!netTaskHandle) return true;
+    if (g_netTaskRunning || eTaskGetState(netTaskHandle) != eSuspended) return false;
+
+    vTaskDelete(netTaskHandle);
+    netTaskHandle = nullptr;
+    g_fsmEvents.clear(FSM_EVT_NET_TASK_DONE);
+
+    // Restore normal watchdog timeout now that Core 0 is free
+    esp_task_wdt_config_t wdt_cfg = {
+        .timeout_ms = 5000,
+        .idle_core_mask = (1 << 0) | (1 << 1),  // Both cores
+        .trigger_panic = true
+    };
+    esp_task_wdt_reconfigure(&wdt_cfg);
+    LOGF("[FSM] Network task finished (fh=%u ma=%u)", ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+    return true;
+}
+
+// Start a network task on Core 0 in the upload task's static stack slot.
+// Caller must have reaped any previous network task.
+static bool startNetTask(TaskFunction_t fn, const char* name) {
+    // Same relaxed WDT as the upload task: a TLS handshake starves IDLE0
+    esp_task_wdt_config_t wdt_cfg = {
+        .timeout_ms = 30000,
+        .idle_core_mask = (1 << 0) | (1 << 1),  // Both cores
+        .trigger_panic = true
+    };
+    esp_task_wdt_reconfigure(&wdt_cfg);
+
+    g_netTaskRunning = true;
+    netTaskHandle = xTaskCreateStaticPinnedToCore(
+        fn, name,
+        sizeof(uploadTaskStack) / sizeof(StackType_t),
+        nullptr, 1, uploadTaskStack, &uploadTaskTCB, 0);
+
+    if (netTaskHandle == nullptr) {
+        LOGF("[FSM] Failed to create %s task", name);
+        g_netTaskRunning = false;
+        wdt_cfg.timeout_ms = 5000;
+        esp_task_wdt_reconfigure(&wdt_cfg);
+        return false;
+    }
+    return true;
+}
+
+static void maybeStartPreWarm() {
+    if (!reapNetTask()) return;
+
+    ScheduleManager* sm = uploader->getScheduleManager();
+    if (!sm || !sm->isPreWarmDue()) return;
+    if (!wifiManager.isConnected()) return;
+    sm->markPreWarmStarted();
+
+    int predicted = sm->getPredictedSessionEndMinute();
+    LOGF("[PreWarm] Predicted session end %02d:%02d — warming network backends",
+         predicted / 60, predicted % 60);
+
+    startNetTask(preWarmTaskFunction, "prewarm");
+}
+
+// Compact the upload state on Core 0 at low priority while the card is
+// released and no upload is running (COOLDOWN/IDLE only).
+static void maybeStartStateCompaction() {
+    if (!uploader || !uploader->isStateCompactionDue()) return;
+    if (g_lastCompactionAttempt != 0 &&
+        millis() - g_lastCompactionAttempt < STATE_COMPACTION_RETRY_MS) return;
+    if (!reapNetTask()) return;
+
+    g_lastCompactionAttempt = millis();
+    LOG("[FSM] Compacting upload state in the background");
+    startNetTask(stateCompactionTaskFunction, "compact");
+}
+
 // ============================================================================
 // FSM State Handlers
 // ============================================================================
@@ -853,6 +1033,8 @@ void handleIdle() {
     // Smart mode never enters IDLE — it uses the continuous loop:
     // LISTENING → ACQUIRING → UPLOADING → RELEASING → COOLDOWN → LISTENING
     
+    maybeStartStateCompaction();
+
     unsigned long now = millis();
     if (now - lastIdleCheck < IDLE_CHECK_INTERVAL_MS) return;
     lastIdleCheck = now;
@@ -875,6 +1057,17 @@ void handleListening() {
     // TrafficMonitor.update() is called in main loop before FSM dispatch
     uint32_t inactivityMs = (uint32_t)config.getInactivitySeconds() * 1000UL;
 
+    // ── Session-end learning + predictive pre-warm (smart mode) ──
+    // A therapy session shows up as a long streak of bus activity; its end is
+    // learned when silence is confirmed below.  Shortly before the predicted
+    // end, network backends are warmed while the CPAP still owns the card.
+    if (config.isSmartMode()) {
+        if (g_busStreakStartedAt == 0 && trafficMonitor.isBusy()) {
+            g_busStreakStartedAt = millis();
+        }
+        maybeStartPreWarm();
+    }
+
     // ── No-work suppression ──
     // After a NOTHING_TO_DO result, we suppress further upload attempts until
     // new PCNT bus activity is detected (CPAP wrote new data to SD card).
@@ -920,9 +1113,11 @@ void handleListening() {
     if (config.isSmartMode()) {
         if (trafficMonitor.isIdleFor(inactivityMs)) {
             LOGF("[FSM] %ds of bus silence confirmed", config.getInactivitySeconds());
+            recordTherapySessionEnd();
             
             // No network pre-connect here — backends connect on-demand when actual work is confirmed
-            // (SMB connects lazily in FileUploader, Cloud connects after preflight)
+            // (SMB connects lazily in FileUploader, Cloud connects after preflight).
+            // Predictive pre-warm, if it ran, already refreshed DNS/OAuth ahead of this point.
             transitionTo(UploadState::ACQUIRING);
             return;
         }
@@ -998,10 +1193,10 @@ void uploadTaskFunction(void* pvParameters) {
                 LOG_WARN("[Upload] Aborting upload cycle to avoid SD card conflict");
 
                 uploadTaskResult = UploadResult::NOTHING_TO_DO;
-                uploadTaskComplete = true;
+                g_fsmEvents.post(FSM_EVT_UPLOAD_DONE);
                 esp_task_wdt_delete(NULL);
                 delete params;
-                vTaskDelete(NULL);
+                vTaskSuspend(NULL);  // Reaped by loop()
                 return;
             }
         } else {
@@ -1013,13 +1208,25 @@ void uploadTaskFunction(void* pvParameters) {
     // ── Step 2: Mount SD card ────────────────────────────────────────────────
     LOGF("[Upload] Mounting SD: heap fh=%u ma=%u",
          (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMaxAllocHeap());
+    // A mount attempted below the sd_mount floor fails partway through and
+    // leaves the card half-claimed; refuse it up front and retry next cycle.
+    if (!g_heapGovernor.admit(HeapBudget::SdMount)) {
+        LOG_ERROR("[Upload] Not enough contiguous heap to mount SD — skipping this cycle");
+        uploadTaskResult = UploadResult::ERROR;
+        g_fsmEvents.post(FSM_EVT_UPLOAD_DONE);
+        esp_task_wdt_delete(NULL);
+        delete params;
+        vTaskSuspend(NULL);  // Reaped by loop()
+        return;
+    }
     if (!params->sdManager->takeControl()) {
         LOG_ERROR("[Upload] Failed to acquire SD card control");
+        g_heapGovernor.release(HeapBudget::SdMount);
         uploadTaskResult = UploadResult::ERROR;
-        uploadTaskComplete = true;
+        g_fsmEvents.post(FSM_EVT_UPLOAD_DONE);
         esp_task_wdt_delete(NULL);
         delete params;
-        vTaskDelete(NULL);
+        vTaskSuspend(NULL);  // Reaped by loop()
         return;
     }
     LOG("[FSM] SD card control acquired");
@@ -1037,21 +1244,36 @@ void uploadTaskFunction(void* pvParameters) {
         g_uploadHeartbeat = millis();
 
         if (!workResult.hasCloudWork && !workResult.hasSmbWork) {
-            LOG("[Upload] Work probe: no work for any backend — releasing SD");
+            if (workResult.backendDeferred) {
+                LOG("[Upload] Work probe: work pending behind an open circuit breaker — releasing SD");
+            } else {
+                LOG("[Upload] Work probe: no work for any backend — releasing SD");
+            }
             if (params->sdManager->hasControl()) {
                 params->sdManager->releaseControl();
             }
-            uploadTaskResult = UploadResult::NOTHING_TO_DO;
-            uploadTaskComplete = true;
+            g_heapGovernor.release(HeapBudget::SdMount);
+            uploadTaskResult = workResult.backendDeferred ? UploadResult::BACKEND_DEFERRED
+                                                          : UploadResult::NOTHING_TO_DO;
+            g_fsmEvents.post(FSM_EVT_UPLOAD_DONE);
             esp_task_wdt_delete(NULL);
             delete params;
-            vTaskDelete(NULL);
+            vTaskSuspend(NULL);  // Reaped by loop()
             return;
         }
         LOGF("[Upload] Work probe: cloud=%d smb=%d — proceeding with upload",
              workResult.hasCloudWork, workResult.hasSmbWork);
     }
 
+    // ── Step 3b: SD bus calibration (first session with a card, then weekly) ─
+    // Bounded (~1-2 s): picks the fastest stable width/clock for the scan and
+    // hash phases that follow. Only runs once there is work, so the no-work
+    // path keeps its short card hold.
+    if (params->sdManager->calibrateBusIfDue()) {
+        esp_task_wdt_reset();
+        g_uploadHeartbeat = millis();
+    }
+
     // ── Step 4: Run phased upload (CLOUD first with on-demand TLS, then SMB) ─
     // TLS connects on-demand in cloud phase's begin() — the TLS Arena ensures
     // mbedTLS buffers come from static .bss, not the general heap.
@@ -1064,13 +1286,17 @@ void uploadTaskFunction(void* pvParameters) {
     if (params->sdManager->hasControl()) {
         params->sdManager->releaseControl();
     }
+    g_heapGovernor.release(HeapBudget::SdMount);
 
     uploadTaskResult = result;
-    uploadTaskComplete = true;
+    g_fsmEvents.post(FSM_EVT_UPLOAD_DONE);
     
-    esp_task_wdt_delete(NULL);  // Unsubscribe before self-delete
+    esp_task_wdt_delete(NULL);  // Unsubscribe before suspending
     delete params;
-    vTaskDelete(NULL);  // Self-delete
+    // Suspend instead of self-deleting: this teardown still runs on the shared
+    // static stack after FSM_EVT_UPLOAD_DONE, so loop() deletes us once we are
+    // parked, before the stack/TCB is reused (same as the network tasks)
+    vTaskSuspend(NULL);
 }
 
 void handleUploading() {
@@ -1080,6 +1306,9 @@ void handleUploading() {
     }
     
     if (!uploadTaskRunning) {
+        // Pre-warm / self-test borrow the upload task's static stack — wait for them
+        if (!reapNetTask()) return;
+
         // ── First call: determine filter and spawn upload task ──
         ScheduleManager* sm = uploader->getScheduleManager();
         DataFilter filter;
@@ -1128,7 +1357,7 @@ void handleUploading() {
         };
         g_uploadWasForceTriggered = false;  // consumed
         
-        uploadTaskComplete = false;
+        g_fsmEvents.clear(FSM_EVT_UPLOAD_DONE);
         uploadTaskRunning = true;
         
         // Relax task watchdog during upload — TLS handshake (5-15s of CPU-intensive
@@ -1182,10 +1411,10 @@ void handleUploading() {
             LOGF("[FSM] Upload task started on Core 0 (static stack, non-blocking) — heap after: fh=%u ma=%u",
                  ESP.getFreeHeap(), ESP.getMaxAllocHeap());
         }
-    } else if (uploadTaskComplete) {
+    } else if (g_fsmEvents.take(FSM_EVT_UPLOAD_DONE)) {
         // ── Task finished: read result and transition ──
+        // The handle stays set until reapUploadTask() deletes the parked task
         uploadTaskRunning = false;
-        uploadTaskHandle = nullptr;
         g_abortUploadFlag = false;  // Clear abort flag — task has stopped
         
         // Restore normal watchdog timeout now that Core 0 is free
@@ -1226,6 +1455,13 @@ void handleUploading() {
                 g_noWorkSuppressed = true;  // Don't retry until PCNT detects new CPAP activity
                 transitionTo(UploadState::RELEASING);
                 break;
+            case UploadResult::BACKEND_DEFERRED:
+                // Nothing was sent: skip the reboot, but keep the normal cooldown
+                // retry — suppression would wait for the next therapy session
+                LOG("[FSM] Backend deferred by circuit breaker — retrying after cooldown");
+                g_nothingToUpload = true;
+                transitionTo(UploadState::RELEASING);
+                break;
         }
     }
     // else: task still running — return immediately (non-blocking)
@@ -1300,6 +1536,7 @@ void handleCooldown() {
     unsigned long cooldownMs = (unsigned long)config.getCooldownMinutes() * 60UL * 1000UL;
     
     if (millis() - cooldownStartedAt < cooldownMs) {
+        maybeStartStateCompaction();
         return;  // Non-blocking wait
     }
     
@@ -1367,6 +1604,55 @@ void handleMonitoring() {
     }
 }
 
+// Longest loop() may block before something has to be polled again
+static uint32_t fsmWaitMs() {
+    unsigned long now = millis();
+    uint32_t waitMs;
+
+    switch (currentState) {
+        case UploadState::LISTENING:
+        case UploadState::MONITORING:
+            waitMs = FSM_SAMPLE_WAIT_MS;  // TrafficMonitor idle tracking / sample buffer
+            break;
+        case UploadState::UPLOADING:
+            // Completion arrives as FSM_EVT_UPLOAD_DONE / FSM_EVT_NET_TASK_DONE;
+            // only the software watchdog still looks periodically
+            waitMs = FSM_MAX_WAIT_MS;
+            break;
+        case UploadState::IDLE: {
+            unsigned long since = now - lastIdleCheck;
+            waitMs = since >= IDLE_CHECK_INTERVAL_MS ? 0 : (uint32_t)(IDLE_CHECK_INTERVAL_MS - since);
+            break;
+        }
+        case UploadState::COOLDOWN: {
+            unsigned long cooldownMs = (unsigned long)config.getCooldownMinutes() * 60UL * 1000UL;
+            unsigned long since = now - cooldownStartedAt;
+            waitMs = since >= cooldownMs ? 0 : (uint32_t)(cooldownMs - since);
+            break;
+        }
+        default:
+            waitMs = FSM_TRANSIENT_WAIT_MS;  // ACQUIRING, RELEASING, COMPLETE move on at once
+            break;
+    }
+
+    // A background or upload task posts its event just before suspending
+    // itself; if the reap raced it, look again shortly
+    if (((netTaskHandle && !g_netTaskRunning) || (uploadTaskHandle && !uploadTaskRunning)) &&
+        waitMs > FSM_TRANSIENT_WAIT_MS) {
+        waitMs = FSM_TRANSIENT_WAIT_MS;
+    }
+    if (waitMs > FSM_MAX_WAIT_MS) {
+        waitMs = FSM_MAX_WAIT_MS;
+    }
+#ifdef ENABLE_WEBSERVER
+    // WebServer only accepts connections when handleClient() is polled
+    if (webServer && waitMs > WEB_POLL_INTERVAL_MS) {
+        waitMs = WEB_POLL_INTERVAL_MS;
+    }
+#endif
+    return waitMs;
+}
+
 // ============================================================================
 // Loop Function
 // ============================================================================
@@ -1394,6 +1680,7 @@ void loop() {
     if (currentState == UploadState::LISTENING || 
         currentState == UploadState::MONITORING ||
         currentState == UploadState::COOLDOWN) {
+        g_fsmEvents.clear(FSM_EVT_BUS_ACTIVITY);
         trafficMonitor.update();
     }
 
@@ -1421,6 +1708,9 @@ void loop() {
         LOG_DEBUG("[POWER] Timed mDNS stopped after 60 seconds");
     }
     
+    // Delete a finished upload task as soon as it has parked itself
+    reapUploadTask();
+
     // ── Software watchdog for upload task ──
     // If the upload task hasn't sent a heartbeat in UPLOAD_WATCHDOG_TIMEOUT_MS, it's hung.
     // Force-kill it and reboot — vTaskDelete mid-SD-I/O corrupts the SD bus,
@@ -1445,15 +1735,14 @@ void loop() {
         esp_restart();
     }
     
-    // ── Web trigger handlers (operate independently of FSM) ──
+    // ── Web request events (operate independently of FSM state) ──
     
-    // Check for state reset trigger — takes effect IMMEDIATELY, even during upload.
+    // State reset — takes effect IMMEDIATELY, even during upload.
     // Strategy: set NVS flag → kill upload task → reboot.
     // State files are deleted on next boot with a clean SD card mount.
     // This avoids SD card access after killing a task mid-I/O (which can hang).
-    if (g_resetStateFlag) {
+    if (g_fsmEvents.take(FSM_EVT_RESET_STATE)) {
         LOG("=== State Reset Triggered via Web Interface ===");
-        g_resetStateFlag = false;
         
         // Set NVS flag so state files are deleted on next clean boot
         Preferences resetPrefs;
@@ -1479,42 +1768,55 @@ void loop() {
     }
     
     // Soft reboot — next boot detects ESP_RST_SW and skips all delays automatically
-    if (g_softRebootFlag) {
+    if (g_fsmEvents.take(FSM_EVT_SOFT_REBOOT)) {
         LOG("=== Soft Reboot Triggered via Web Interface ===");
-        g_softRebootFlag = false;
         setRebootReason("Soft reboot requested via Web UI");
         Logger::getInstance().flushBeforeReboot();
         delay(300);
         esp_restart();
     }
 
-    // Check for upload trigger (force immediate upload — skip inactivity check)
-    // Blocked while upload task is running — already uploading
-    if (g_triggerUploadFlag && !uploadTaskRunning) {
+    // Upload trigger (force immediate upload — skip inactivity check).
+    // Left pending while the upload task runs; FSM_EVT_UPLOAD_DONE wakes us for it.
+    if (!uploadTaskRunning && g_fsmEvents.take(FSM_EVT_UPLOAD_TRIGGER)) {
         LOG("=== Upload Triggered via Web Interface ===");
-        g_triggerUploadFlag = false;
         g_uploadWasForceTriggered = true;  // latch for upload task
         g_noWorkSuppressed = false;  // Manual trigger always overrides suppression
         uploadCycleHadTimeout = false;
         transitionTo(UploadState::ACQUIRING);
     }
     
-    // Check for monitoring triggers
-    if (g_monitorActivityFlag) {
-        g_monitorActivityFlag = false;
+    // Monitoring requests
+    if (g_fsmEvents.take(FSM_EVT_MONITOR_START)) {
         monitoringRequested = true;
     }
-    if (g_stopMonitorFlag) {
-        g_stopMonitorFlag = false;
+    if (g_fsmEvents.take(FSM_EVT_MONITOR_STOP)) {
         stopMonitoringRequested = true;
     }
+
+    // Network self-test — waits while an upload or another network task runs.
+    // A benchmark requested during an upload must also wait for the finished
+    // upload task to park and be deleted (reapNetTask() reaps it first): its
+    // teardown still runs on the shared static stack after UPLOAD_DONE.
+    // Network only, so it may run in any FSM state; an upload due meanwhile
+    // waits in handleUploading() until the task is reaped.
+    if (g_fsmEvents.isPending(FSM_EVT_NETBENCH) && !uploadTaskRunning &&
+        currentState != UploadState::UPLOADING && uploader && reapNetTask()) {
+        g_fsmEvents.clear(FSM_EVT_NETBENCH);
+        if (!wifiManager.isConnected()) {
+            LOG_WARN("[NetBench] WiFi not connected — self-test skipped");
+            g_netBenchStatus.state = NetBenchState::IDLE;
+        } else if (!startNetTask(netBenchTaskFunction, "netbench")) {
+            g_netBenchStatus.state = NetBenchState::IDLE;
+        }
+    }
 #endif
     
     // ── WiFi reconnection (non-blocking with 30 second retry interval) ──
-    // GUARD: Do NOT attempt reconnection while upload task is running on Core 0.
-    // The upload task manages its own WiFi recovery via tryCoordinatedWifiCycle().
+    // GUARD: Do NOT attempt reconnection while the upload or a network task runs on Core 0.
+    // The upload task manages its own WiFi recovery via recoverNetwork() (NetworkRecovery.h).
     // Concurrent reconnection from both cores corrupts the lwIP state machine.
-    if (!wifiManager.isConnected() && !uploadTaskRunning) {
+    if (!wifiManager.isConnected() && !uploadTaskRunning && !g_netTaskRunning) {
         unsigned long currentTime = millis();
         if (currentTime - lastWifiReconnectAttempt >= 30000) {
             LOG_WARN("WiFi disconnected, attempting to reconnect...");
@@ -1591,24 +1893,10 @@ void loop() {
         case UploadState::MONITORING: handleMonitoring(); break;
     }
     
-    // ── POWER: Yield CPU so DFS can scale down ──
-    // Without explicit yields the loop task never blocks, keeping CPU at max
-    // frequency. State-appropriate delays allow the FreeRTOS IDLE task to run,
-    // triggering automatic frequency scaling (DFS) when no work is pending.
-    switch (currentState) {
-        case UploadState::IDLE:
-        case UploadState::COOLDOWN:
-            vTaskDelay(pdMS_TO_TICKS(100));  // Low-frequency states: 100ms yield
-            break;
-        case UploadState::LISTENING:
-            vTaskDelay(pdMS_TO_TICKS(50));   // TrafficMonitor samples; 50ms is sufficient
-            break;
-        case UploadState::MONITORING:
-        case UploadState::UPLOADING:
-            vTaskDelay(pdMS_TO_TICKS(10));   // Responsive states: 10ms yield
-            break;
-        default:
-            vTaskDelay(pdMS_TO_TICKS(10));   // Transient states: brief yield
-            break;
-    }
+    // ── POWER: Block until the next event or this state's own deadline ──
+    // Web requests, upload/background task completion and bus activity post
+    // events that end the wait at once; the timeout only covers what still
+    // has to be polled. Fewer wake-ups let DFS and tickless idle keep the CPU
+    // down for longer.
+    g_fsmEvents.wait(fsmWaitMs());
 }
@@ -0,0 +1,24 @@
+#ifndef MOCK_CRC_H
+#define MOCK_CRC_H
+
+#ifdef UNIT_TEST
+
+#include <cstdint>
+#include <cstddef>
+
+// Bitwise stand-in for the ROM CRC32 (same result as esp_rom_crc32_le / zlib crc32):
+// the running value is passed in and returned un-inverted, so calls chain.
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len) {
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+#endif // UNIT_TEST
+
+#endif // MOCK_CRC_H
@@ -43,6 +43,21 @@ inline void MD5Final(uint8_t digest[16], struct MD5Context* context) {
     }
 }
 
+// ROM API names used by the firmware (esp_rom_md5.h)
+typedef struct MD5Context md5_context_t;
+
+inline void esp_rom_md5_init(md5_context_t* context) {
+    MD5Init(context);
+}
+
+inline void esp_rom_md5_update(md5_context_t* context, const void* input, uint32_t inputLen) {
+    MD5Update(context, (const uint8_t*)input, inputLen);
+}
+
+inline void esp_rom_md5_final(uint8_t digest[16], md5_context_t* context) {
+    MD5Final(digest, context);
+}
+
 #endif // UNIT_TEST
 
 #endif // MOCK_MD5_H
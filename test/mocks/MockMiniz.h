@@ -0,0 +1,105 @@
+#ifndef MOCK_MINIZ_H
+#define MOCK_MINIZ_H
+
+#ifdef UNIT_TEST
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// Stand-in for the ROM tinfl inflater (rom/miniz.h). Only stored (BTYPE 00)
+// deflate blocks are understood - enough to drive the streaming gzip path with
+// images produced by `gzip -0` / zlib level 0. Compressed blocks fail.
+
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+typedef enum {
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct {
+    mz_uint32 m_state;
+    mz_uint32 m_num_bits;
+    mz_uint32 m_final;
+    mz_uint32 m_counter;
+    mz_uint32 m_dist;
+    mz_uint32 m_bit_buf;
+} tinfl_decompressor;
+
+#define tinfl_init(r) do { (r)->m_state = 0; (r)->m_num_bits = 0; (r)->m_bit_buf = 0; } while (0)
+
+inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const mz_uint8* pIn_buf_next, size_t* pIn_buf_size,
+                                     mz_uint8* pOut_buf_start, mz_uint8* pOut_buf_next, size_t* pOut_buf_size,
+                                     const mz_uint32 decomp_flags) {
+    (void)pOut_buf_start;
+    size_t inAvail = *pIn_buf_size, outAvail = *pOut_buf_size;
+    size_t in = 0, out = 0;
+    tinfl_status status = TINFL_STATUS_DONE;
+
+    for (;;) {
+        if (r->m_state == 6) {
+            status = TINFL_STATUS_DONE;
+            break;
+        }
+        if (r->m_state == 5) {
+            if (r->m_counter == 0) {
+                r->m_state = (r->m_final & 1) ? 6 : 0;
+                continue;
+            }
+            if (out == outAvail) { status = TINFL_STATUS_HAS_MORE_OUTPUT; break; }
+            if (in == inAvail) {
+                status = (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+                break;
+            }
+            size_t n = r->m_counter;
+            if (n > inAvail - in) n = inAvail - in;
+            if (n > outAvail - out) n = outAvail - out;
+            memcpy(pOut_buf_next + out, pIn_buf_next + in, n);
+            in += n;
+            out += n;
+            r->m_counter -= (mz_uint32)n;
+            continue;
+        }
+        if (in == inAvail) {
+            status = (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT : TINFL_STATUS_FAILED;
+            break;
+        }
+        uint8_t b = pIn_buf_next[in++];
+        if (r->m_state == 0) {
+            if (((b >> 1) & 3) != 0) { status = TINFL_STATUS_FAILED; break; }
+            r->m_final = b & 1;
+            r->m_dist = 0;
+            r->m_state = 1;
+        } else {
+            // States 1-4: LEN and NLEN, little-endian
+            r->m_dist |= (mz_uint32)b << (8 * (r->m_state - 1));
+            if (++r->m_state == 5) {
+                if ((r->m_dist & 0xFFFF) != (~r->m_dist >> 16)) { status = TINFL_STATUS_FAILED; break; }
+                r->m_counter = r->m_dist & 0xFFFF;
+            }
+        }
+    }
+
+    *pIn_buf_size = in;
+    *pOut_buf_size = out;
+    return status;
+}
+
+#endif // UNIT_TEST
+
+#endif // MOCK_MINIZ_H
@@ -0,0 +1,162 @@
+#include <unity.h>
+#include "Arduino.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the AdaptiveChunkController implementation
+#include "AdaptiveChunk.h"
+#include "../../src/AdaptiveChunk.cpp"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// Feed n clean chunks at a steady rate (4 KB in 10 ms)
+static void feedCleanChunks(AdaptiveChunkController& tuner, int n) {
+    for (int i = 0; i < n; i++) {
+        tuner.recordChunk(tuner.getChunkSize(), 10, 0);
+    }
+}
+
+void test_start_point_follows_rssi() {
+    AdaptiveChunkController strong(1024, 8192);
+    strong.beginFile(8192, -50);
+    TEST_ASSERT_EQUAL(8192, strong.getChunkSize());
+    TEST_ASSERT_EQUAL(0, strong.getPaceDelayMs());
+
+    AdaptiveChunkController medium(1024, 8192);
+    medium.beginFile(8192, -65);
+    TEST_ASSERT_EQUAL(4096, medium.getChunkSize());
+
+    AdaptiveChunkController weak(1024, 8192);
+    weak.beginFile(8192, -80);
+    TEST_ASSERT_EQUAL(1024, weak.getChunkSize());
+    TEST_ASSERT_TRUE(weak.getPaceDelayMs() > 0);
+}
+
+void test_heap_limit_caps_chunk() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.beginFile(2048, -40);
+    TEST_ASSERT_EQUAL(2048, tuner.getChunkSize());
+
+    feedCleanChunks(tuner, 64);
+    TEST_ASSERT_EQUAL(2048, tuner.getChunkSize());
+
+    // Heap below the floor still yields the floor
+    tuner.beginFile(512, -40);
+    TEST_ASSERT_EQUAL(1024, tuner.getChunkSize());
+}
+
+void test_eagain_shrinks_and_paces() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.beginFile(8192, -50);
+
+    tuner.recordChunk(8192, 20, 2);
+    TEST_ASSERT_EQUAL(4096, tuner.getChunkSize());
+    TEST_ASSERT_EQUAL(AdaptiveChunkController::PACE_STEP_MS, tuner.getPaceDelayMs());
+    TEST_ASSERT_EQUAL(1, tuner.getStallCount());
+
+    tuner.recordChunk(4096, 20, 1);
+    tuner.recordChunk(2048, 20, 1);
+    tuner.recordChunk(1024, 20, 1);
+    TEST_ASSERT_EQUAL(1024, tuner.getChunkSize());
+}
+
+void test_slow_chunk_counts_as_stall() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.beginFile(8192, -50);
+
+    // 8 KB in 4 s = 500 ms/KB > STALL_MS_PER_KB
+    tuner.recordChunk(8192, 4000, 0);
+    TEST_ASSERT_EQUAL(4096, tuner.getChunkSize());
+}
+
+void test_clean_run_removes_pacing_then_grows() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.beginFile(8192, -80);
+    TEST_ASSERT_EQUAL(1024, tuner.getChunkSize());
+
+    // First clean run drops the pacing, later runs double the chunk
+    feedCleanChunks(tuner, AdaptiveChunkController::GROW_AFTER_CLEAN_CHUNKS);
+    TEST_ASSERT_EQUAL(0, tuner.getPaceDelayMs());
+    TEST_ASSERT_EQUAL(1024, tuner.getChunkSize());
+
+    feedCleanChunks(tuner, AdaptiveChunkController::GROW_AFTER_CLEAN_CHUNKS);
+    TEST_ASSERT_EQUAL(2048, tuner.getChunkSize());
+
+    feedCleanChunks(tuner, AdaptiveChunkController::GROW_AFTER_CLEAN_CHUNKS * 4);
+    TEST_ASSERT_EQUAL(8192, tuner.getChunkSize());
+}
+
+void test_state_carries_across_files() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.beginFile(8192, -50);
+    tuner.recordChunk(8192, 20, 3);
+    TEST_ASSERT_EQUAL(4096, tuner.getChunkSize());
+
+    // Next file on a strong link keeps the learned size
+    tuner.beginFile(8192, -50);
+    TEST_ASSERT_EQUAL(4096, tuner.getChunkSize());
+
+    // Link degraded: cap at 2x floor
+    tuner.beginFile(8192, -85);
+    TEST_ASSERT_EQUAL(2048, tuner.getChunkSize());
+}
+
+void test_throughput_estimate() {
+    AdaptiveChunkController tuner(1024, 8192);
+    tuner.seedThroughput(0);
+    TEST_ASSERT_EQUAL(0, tuner.getThroughputBps());
+
+    tuner.seedThroughput(400000);
+    TEST_ASSERT_EQUAL(400000, tuner.getThroughputBps());
+
+    tuner.beginFile(8192, -50);
+    tuner.recordChunk(4000, 10, 0);  // 400000 B/s
+    TEST_ASSERT_EQUAL(400000, tuner.getThroughputBps());
+}
+
+void test_seeded_throughput_sets_start_point() {
+    // Fast measured link on a medium RSSI starts at the ceiling
+    AdaptiveChunkController fast(1024, 8192);
+    fast.seedThroughput(AdaptiveChunkController::SEED_FAST_BPS);
+    fast.beginFile(8192, -65);
+    TEST_ASSERT_EQUAL(8192, fast.getChunkSize());
+
+    // ...but a weak link still wins over the seed
+    AdaptiveChunkController fastWeak(1024, 8192);
+    fastWeak.seedThroughput(AdaptiveChunkController::SEED_FAST_BPS);
+    fastWeak.beginFile(8192, -80);
+    TEST_ASSERT_EQUAL(1024, fastWeak.getChunkSize());
+
+    // Slow measured link on a strong RSSI starts at the floor, paced
+    AdaptiveChunkController slow(1024, 8192);
+    slow.seedThroughput(8 * 1024);
+    slow.beginFile(8192, -50);
+    TEST_ASSERT_EQUAL(1024, slow.getChunkSize());
+    TEST_ASSERT_TRUE(slow.getPaceDelayMs() > 0);
+
+    // Inconclusive seed falls back to RSSI
+    AdaptiveChunkController mid(1024, 8192);
+    mid.seedThroughput(64 * 1024);
+    mid.beginFile(8192, -65);
+    TEST_ASSERT_EQUAL(4096, mid.getChunkSize());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_start_point_follows_rssi);
+    RUN_TEST(test_heap_limit_caps_chunk);
+    RUN_TEST(test_eagain_shrinks_and_paces);
+    RUN_TEST(test_slow_chunk_counts_as_stall);
+    RUN_TEST(test_clean_run_removes_pacing_then_grows);
+    RUN_TEST(test_state_carries_across_files);
+    RUN_TEST(test_throughput_estimate);
+    RUN_TEST(test_seeded_throughput_sets_start_point);
+
+    return UNITY_END();
+}
@@ -0,0 +1,127 @@
+#include <unity.h>
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the directory scanner (POSIX — runs against a temp directory)
+#include "DirScanner.h"
+#include "../../src/DirScanner.cpp"
+
+static char mountPoint[64];
+
+static void writeFile(const char* rel, size_t bytes) {
+    char path[160];
+    snprintf(path, sizeof(path), "%s%s", mountPoint, rel);
+    FILE* f = fopen(path, "wb");
+    for (size_t i = 0; i < bytes; i++) fputc('x', f);
+    fclose(f);
+}
+
+static void makeDir(const char* rel) {
+    char path[160];
+    snprintf(path, sizeof(path), "%s%s", mountPoint, rel);
+    mkdir(path, 0755);
+}
+
+void setUp(void) {
+    strcpy(mountPoint, "/tmp/dirscanXXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(mountPoint));
+    makeDir("/DATALOG");
+    makeDir("/DATALOG/20250101");
+    makeDir("/DATALOG/20250102");
+    writeFile("/DATALOG/20250101/20250101_221500_BRP.edf", 100);
+    writeFile("/DATALOG/20250101/20250101_221500_PLD.EDF", 50);
+    writeFile("/DATALOG/20250101/notes.txt", 5);
+    writeFile("/STR.edf", 4096);
+}
+
+void tearDown(void) {
+    char cmd[96];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", mountPoint);
+    system(cmd);
+}
+
+void test_lists_entries_with_types_and_skips_dot_entries() {
+    DirScanner dir(mountPoint);
+    TEST_ASSERT_TRUE(dir.open("/DATALOG"));
+
+    int dirs = 0;
+    int files = 0;
+    bool first = false, second = false;
+    while (dir.next()) {
+        TEST_ASSERT_NOT_EQUAL(0, strcmp(dir.name(), "."));
+        TEST_ASSERT_NOT_EQUAL(0, strcmp(dir.name(), ".."));
+        if (dir.isDirectory()) dirs++;
+        if (dir.isFile()) files++;
+        if (strcmp(dir.name(), "20250101") == 0) first = true;
+        if (strcmp(dir.name(), "20250102") == 0) second = true;
+    }
+    TEST_ASSERT_EQUAL(2, dirs);
+    TEST_ASSERT_EQUAL(0, files);
+    TEST_ASSERT_TRUE(first && second);
+    TEST_ASSERT_FALSE(dir.next());
+}
+
+void test_stat_on_demand() {
+    DirScanner dir(mountPoint);
+    TEST_ASSERT_TRUE(dir.open("/DATALOG/20250101"));
+
+    int seen = 0;
+    while (dir.next()) {
+        TEST_ASSERT_TRUE(dir.isFile());
+        uint32_t size = 0;
+        time_t mtime = 0;
+        TEST_ASSERT_TRUE(dir.stat(size, mtime));
+        TEST_ASSERT_TRUE(mtime > 0);
+        if (strcmp(dir.name(), "20250101_221500_BRP.edf") == 0) TEST_ASSERT_EQUAL(100, size);
+        if (strcmp(dir.name(), "20250101_221500_PLD.EDF") == 0) TEST_ASSERT_EQUAL(50, size);
+        seen++;
+    }
+    TEST_ASSERT_EQUAL(3, seen);
+}
+
+void test_root_path_builds_single_separator() {
+    DirScanner dir(mountPoint);
+    TEST_ASSERT_TRUE(dir.open("/"));
+    bool found = false;
+    while (dir.next()) {
+        if (strcmp(dir.name(), "STR.edf") == 0) {
+            uint32_t size = 0;
+            time_t mtime = 0;
+            TEST_ASSERT_TRUE(dir.stat(size, mtime));
+            TEST_ASSERT_EQUAL(4096, size);
+            found = true;
+        }
+    }
+    TEST_ASSERT_TRUE(found);
+}
+
+void test_open_fails_for_missing_or_file() {
+    DirScanner dir(mountPoint);
+    TEST_ASSERT_FALSE(dir.open("/SETTINGS"));
+    TEST_ASSERT_FALSE(dir.isOpen());
+    TEST_ASSERT_FALSE(dir.next());
+    TEST_ASSERT_FALSE(dir.open("/STR.edf"));
+
+    // Reusable after a failed open
+    TEST_ASSERT_TRUE(dir.open("/DATALOG/20250102"));
+    TEST_ASSERT_FALSE(dir.next());   // empty folder
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_lists_entries_with_types_and_skips_dot_entries);
+    RUN_TEST(test_stat_on_demand);
+    RUN_TEST(test_root_path_builds_single_separator);
+    RUN_TEST(test_open_fails_for_missing_or_file);
+
+    return UNITY_END();
+}
@@ -0,0 +1,110 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockFS.h"
+
+#include <string>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the EDF header reader
+#include "EdfHeader.h"
+#include "../../src/EdfHeader.cpp"
+
+MockFS testFS;
+
+static void putField(std::string& edf, size_t offset, size_t width, const char* value) {
+    std::string field(value);
+    field.resize(width, ' ');
+    edf.replace(offset, width, field);
+}
+
+// Two signals (25 + 10 samples per record = 70 bytes per record)
+static std::string makeEdf(const char* records, size_t dataBytes, const char* duration = "60") {
+    std::string edf(768, ' ');
+    putField(edf, 0, 8, "0");
+    putField(edf, 168, 8, "14.03.25");
+    putField(edf, 176, 8, "22.15.00");
+    putField(edf, 184, 8, "768");
+    putField(edf, 236, 8, records);
+    putField(edf, 244, 8, duration);
+    putField(edf, 252, 4, "2");
+    size_t samples = 256 + 2 * 216;
+    putField(edf, samples, 8, "25");
+    putField(edf, samples + 8, 8, "10");
+    edf.append(dataBytes, '\0');
+    return edf;
+}
+
+static EdfFileState classify(const std::string& edf) {
+    testFS.addFile("/DATALOG/20250314/20250314_221500_BRP.edf", edf);
+    return classifyEdfFile(testFS, "/DATALOG/20250314/20250314_221500_BRP.edf", (uint32_t)edf.size());
+}
+
+void setUp(void) {
+    testFS.clear();
+}
+
+void tearDown(void) {
+    testFS.clear();
+}
+
+void test_header_fields() {
+    std::string edf = makeEdf("3", 210, "0.04");
+    testFS.addFile("/BRP.edf", edf);
+    fs::File file = testFS.open("/BRP.edf", FILE_READ);
+    EdfHeaderInfo info;
+    TEST_ASSERT_TRUE(readEdfHeader(file, info));
+    file.close();
+
+    TEST_ASSERT_EQUAL(768, info.headerBytes);
+    TEST_ASSERT_EQUAL(3, info.dataRecords);
+    TEST_ASSERT_EQUAL(40, info.recordDurationMs);
+    TEST_ASSERT_EQUAL(70, info.recordBytes);
+    TEST_ASSERT_EQUAL(2, info.signals);
+    TEST_ASSERT_EQUAL(2025, info.startYear);
+    TEST_ASSERT_EQUAL(3, info.startMonth);
+    TEST_ASSERT_EQUAL(14, info.startDay);
+    TEST_ASSERT_EQUAL(22, info.startHour);
+    TEST_ASSERT_EQUAL(15, info.startMinute);
+}
+
+void test_closed_when_header_matches_size() {
+    TEST_ASSERT_TRUE(classify(makeEdf("3", 210)) == EdfFileState::Closed);
+    TEST_ASSERT_TRUE(classify(makeEdf("0", 0)) == EdfFileState::Closed);
+}
+
+void test_open_while_recording() {
+    // Record count not written yet
+    TEST_ASSERT_TRUE(classify(makeEdf("-1", 140)) == EdfFileState::Open);
+    // Records appended past the count in the header
+    TEST_ASSERT_TRUE(classify(makeEdf("3", 280)) == EdfFileState::Open);
+    // Partial record at the end
+    TEST_ASSERT_TRUE(classify(makeEdf("3", 230)) == EdfFileState::Open);
+}
+
+void test_unknown_for_non_edf() {
+    TEST_ASSERT_TRUE(classify(std::string("not an edf file")) == EdfFileState::Unknown);
+
+    std::string badSignals = makeEdf("3", 210);
+    putField(badSignals, 252, 4, "x");
+    TEST_ASSERT_TRUE(classify(badSignals) == EdfFileState::Unknown);
+
+    // Header length must agree with the signal count
+    std::string badHeader = makeEdf("3", 210);
+    putField(badHeader, 184, 8, "512");
+    TEST_ASSERT_TRUE(classify(badHeader) == EdfFileState::Unknown);
+
+    TEST_ASSERT_TRUE(classifyEdfFile(testFS, "/missing.edf", 0) == EdfFileState::Unknown);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_header_fields);
+    RUN_TEST(test_closed_when_header_matches_size);
+    RUN_TEST(test_open_while_recording);
+    RUN_TEST(test_unknown_for_non_edf);
+
+    return UNITY_END();
+}
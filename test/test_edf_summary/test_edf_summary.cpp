@@ -0,0 +1,218 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockFS.h"
+#include "MockLogger.h"
+
+#include <string>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Prevent real Logger.h from being included (we're using MockLogger)
+#define LOGGER_H
+
+// Include the streaming reducer and summary store
+#include "EdfSummary.h"
+#include "../../src/EdfHeader.cpp"
+#include "../../src/EdfSummary.cpp"
+
+MockFS testFS;
+
+static const char* PLD_PATH = "/DATALOG/20250314/20250314_221500_PLD.edf";
+
+static void putField(std::string& edf, size_t offset, size_t width, const char* value) {
+    std::string field(value);
+    field.resize(width, ' ');
+    edf.replace(offset, width, field);
+}
+
+static void putSample(std::string& edf, int16_t value) {
+    edf.push_back((char)(value & 0xFF));
+    edf.push_back((char)((value >> 8) & 0xFF));
+}
+
+// PLD-like file: MaskPress (ignored), Press, Leak; 2 samples each per 60 s record.
+// Press: 0..1000 digital -> 0..20 cmH2O. Leak: 0..100 digital -> 0..2 L/s.
+static std::string makePld(int records) {
+    const int ns = 3;
+    std::string edf(256 * (ns + 1), ' ');
+    putField(edf, 0, 8, "0");
+    putField(edf, 168, 8, "14.03.25");
+    putField(edf, 176, 8, "22.15.00");
+    putField(edf, 184, 8, "1024");
+    putField(edf, 236, 8, "3");
+    putField(edf, 244, 8, "60");
+    putField(edf, 252, 4, "3");
+
+    const char* labels[ns] = {"MaskPress.2s", "Press.2s", "Leak.2s"};
+    const char* physMax[ns] = {"20", "20", "2"};
+    const char* digMax[ns] = {"1000", "1000", "100"};
+    for (int s = 0; s < ns; s++) {
+        putField(edf, 256 + s * 16, 16, labels[s]);
+        putField(edf, 256 + 104 * ns + s * 8, 8, "0");
+        putField(edf, 256 + 112 * ns + s * 8, 8, physMax[s]);
+        putField(edf, 256 + 120 * ns + s * 8, 8, "0");
+        putField(edf, 256 + 128 * ns + s * 8, 8, digMax[s]);
+        putField(edf, 256 + 216 * ns + s * 8, 8, "2");
+    }
+
+    for (int r = 0; r < records; r++) {
+        putSample(edf, 999);                       // MaskPress: never reported
+        putSample(edf, 999);
+        putSample(edf, (int16_t)(400 + r * 100));  // Press 8, 10, 12 cmH2O
+        putSample(edf, (int16_t)(400 + r * 100));
+        putSample(edf, (int16_t)(10 * (r + 1)));   // Leak 0.2, 0.4, 0.6 L/s
+        putSample(edf, -1);                        // Out of range: skipped
+    }
+    return edf;
+}
+
+static void feedInChunks(EdfStreamReducer& reducer, const std::string& data, size_t chunk) {
+    for (size_t pos = 0; pos < data.size(); pos += chunk) {
+        size_t n = data.size() - pos < chunk ? data.size() - pos : chunk;
+        reducer.feed((const uint8_t*)data.data() + pos, n);
+    }
+}
+
+void setUp(void) {
+    testFS.clear();
+}
+
+void tearDown(void) {
+    testFS.clear();
+}
+
+void test_reducer_only_arms_for_pld_files() {
+    EdfStreamReducer reducer;
+    TEST_ASSERT_FALSE(reducer.begin("/DATALOG/20250314/20250314_221500_BRP.edf"));
+    TEST_ASSERT_FALSE(reducer.begin("/STR.edf"));
+    TEST_ASSERT_FALSE(reducer.isActive());
+    TEST_ASSERT_TRUE(reducer.begin(PLD_PATH));
+    TEST_ASSERT_TRUE(reducer.isActive());
+}
+
+void test_reducer_stats_from_odd_chunks() {
+    EdfStreamReducer reducer;
+    TEST_ASSERT_TRUE(reducer.begin(PLD_PATH));
+    // 7-byte chunks split header fields and samples across feed() calls
+    feedInChunks(reducer, makePld(3), 7);
+
+    NightSession session;
+    TEST_ASSERT_TRUE(reducer.finish(session));
+    TEST_ASSERT_EQUAL(20250314, session.day);
+    TEST_ASSERT_EQUAL(221500, session.startTime);
+    TEST_ASSERT_EQUAL(180, session.usageSec);
+
+    const NightSignalStats& press = session.stats[NIGHT_PRESSURE];
+    TEST_ASSERT_EQUAL(6, press.samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 8.0f, press.min);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 12.0f, press.max);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.0f, press.mean);
+
+    const NightSignalStats& leak = session.stats[NIGHT_LEAK];
+    TEST_ASSERT_EQUAL(3, leak.samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 12.0f, leak.min);   // L/min
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 36.0f, leak.max);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 24.0f, leak.mean);
+
+    TEST_ASSERT_EQUAL(0, session.stats[NIGHT_RESP_RATE].samples);
+}
+
+void test_reducer_partial_record_and_restart() {
+    EdfStreamReducer reducer;
+    TEST_ASSERT_TRUE(reducer.begin(PLD_PATH));
+    std::string pld = makePld(2);
+    // A failed attempt stops mid-way through the second record
+    feedInChunks(reducer, pld.substr(0, pld.size() - 5), 64);
+    NightSession session;
+    TEST_ASSERT_TRUE(reducer.finish(session));
+    TEST_ASSERT_EQUAL(60, session.usageSec);
+
+    // The retry streams the whole file again from offset 0
+    reducer.restart();
+    feedInChunks(reducer, pld, 4096);
+    TEST_ASSERT_TRUE(reducer.finish(session));
+    TEST_ASSERT_EQUAL(120, session.usageSec);
+    TEST_ASSERT_EQUAL(4, session.stats[NIGHT_PRESSURE].samples);
+}
+
+void test_reducer_rejects_non_edf() {
+    EdfStreamReducer reducer;
+    TEST_ASSERT_TRUE(reducer.begin(PLD_PATH));
+    std::string junk(2048, 'x');
+    feedInChunks(reducer, junk, 512);
+    NightSession session;
+    TEST_ASSERT_FALSE(reducer.finish(session));
+    TEST_ASSERT_FALSE(reducer.isActive());
+}
+
+static NightSession makeSession(uint32_t day, uint32_t start, uint32_t usage, float pressMean, uint32_t samples) {
+    NightSession s;
+    memset(&s, 0, sizeof(s));
+    s.day = day;
+    s.startTime = start;
+    s.usageSec = usage;
+    s.stats[NIGHT_PRESSURE].min = pressMean - 1.0f;
+    s.stats[NIGHT_PRESSURE].max = pressMean + 1.0f;
+    s.stats[NIGHT_PRESSURE].mean = pressMean;
+    s.stats[NIGHT_PRESSURE].samples = samples;
+    return s;
+}
+
+void test_store_roundtrip_and_latest_night() {
+    NightSummaryStore store;
+    TEST_ASSERT_TRUE(store.load(testFS));
+    TEST_ASSERT_EQUAL(0, store.count());
+
+    store.record(makeSession(20250313, 230000, 25200, 9.0f, 100));
+    store.record(makeSession(20250314, 221500, 3600, 8.0f, 100));
+    store.record(makeSession(20250314, 10000, 7200, 11.0f, 300));
+    // Same session uploaded again (e.g. by the second backend) replaces it
+    store.record(makeSession(20250314, 221500, 3600, 8.0f, 100));
+    TEST_ASSERT_EQUAL(3, store.count());
+    TEST_ASSERT_TRUE(store.save(testFS));
+
+    NightSummaryStore reloaded;
+    TEST_ASSERT_TRUE(reloaded.load(testFS));
+    TEST_ASSERT_EQUAL(3, reloaded.count());
+    TEST_ASSERT_EQUAL(20250314, reloaded.at(0).day);
+    TEST_ASSERT_EQUAL(221500, reloaded.at(0).startTime);
+    TEST_ASSERT_EQUAL(20250313, reloaded.at(2).day);
+
+    NightSummary latest;
+    TEST_ASSERT_TRUE(NightSummaryStore::readLatest(testFS, latest));
+    TEST_ASSERT_EQUAL(20250314, latest.day);
+    TEST_ASSERT_EQUAL(2, latest.sessions);
+    TEST_ASSERT_EQUAL(10800, latest.usageSec);
+    TEST_ASSERT_EQUAL(400, latest.stats[NIGHT_PRESSURE].samples);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 7.0f, latest.stats[NIGHT_PRESSURE].min);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 12.0f, latest.stats[NIGHT_PRESSURE].max);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 10.25f, latest.stats[NIGHT_PRESSURE].mean);
+}
+
+void test_store_drops_oldest_when_full() {
+    NightSummaryStore store;
+    for (uint32_t i = 0; i < NightSummaryStore::MAX_SESSIONS + 4; i++) {
+        store.record(makeSession(20250101 + i, 220000, 3600, 10.0f, 10));
+    }
+    TEST_ASSERT_EQUAL(NightSummaryStore::MAX_SESSIONS, store.count());
+    TEST_ASSERT_EQUAL(20250101 + NightSummaryStore::MAX_SESSIONS + 3, store.at(0).day);
+    TEST_ASSERT_EQUAL(20250105, store.at(NightSummaryStore::MAX_SESSIONS - 1).day);
+
+    // Older than everything kept: ignored
+    store.record(makeSession(20241231, 220000, 3600, 10.0f, 10));
+    TEST_ASSERT_EQUAL(20250105, store.at(NightSummaryStore::MAX_SESSIONS - 1).day);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_reducer_only_arms_for_pld_files);
+    RUN_TEST(test_reducer_stats_from_odd_chunks);
+    RUN_TEST(test_reducer_partial_record_and_restart);
+    RUN_TEST(test_reducer_rejects_non_edf);
+    RUN_TEST(test_store_roundtrip_and_latest_night);
+    RUN_TEST(test_store_drops_oldest_when_full);
+
+    return UNITY_END();
+}
@@ -0,0 +1,88 @@
+#include <unity.h>
+#include "Arduino.h"
+
+#include <string.h>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the fingerprint implementation (MockCRC / MockMD5 stand in for the ROM)
+#include "FileFingerprint.h"
+#include "../../src/FileFingerprint.cpp"
+
+static const char* CHECK_INPUT = "123456789";
+
+void setUp(void) {}
+void tearDown(void) {}
+
+void test_crc32_check_value() {
+    FileFingerprint fp(FingerprintAlgo::Crc32);
+    fp.update((const uint8_t*)CHECK_INPUT, strlen(CHECK_INPUT));
+
+    char text[FileFingerprint::MAX_TEXT_LEN];
+    fp.finishText(text);
+    TEST_ASSERT_EQUAL_STRING("crc32:cbf43926", text);
+}
+
+void test_crc32_streaming_matches_one_shot() {
+    FileFingerprint whole(FingerprintAlgo::Crc32);
+    whole.update((const uint8_t*)CHECK_INPUT, 9);
+
+    FileFingerprint pieces(FingerprintAlgo::Crc32);
+    pieces.update((const uint8_t*)CHECK_INPUT, 2);
+    pieces.update((const uint8_t*)CHECK_INPUT + 2, 0);
+    pieces.update((const uint8_t*)CHECK_INPUT + 2, 7);
+
+    uint8_t a[FileFingerprint::MAX_DIGEST_LEN];
+    uint8_t b[FileFingerprint::MAX_DIGEST_LEN];
+    TEST_ASSERT_EQUAL(4, whole.finish(a));
+    TEST_ASSERT_EQUAL(4, pieces.finish(b));
+    TEST_ASSERT_EQUAL_MEMORY(a, b, 4);
+
+    pieces.reset();
+    pieces.update((const uint8_t*)CHECK_INPUT, 9);
+    pieces.finish(b);
+    TEST_ASSERT_EQUAL_MEMORY(a, b, 4);
+}
+
+void test_parse_round_trip_records_algorithm() {
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN] = {0};
+    FingerprintAlgo algo = FingerprintAlgo::Md5;
+
+    TEST_ASSERT_TRUE(FileFingerprint::parse("crc32:cbf43926", algo, digest));
+    TEST_ASSERT_TRUE(algo == FingerprintAlgo::Crc32);
+    TEST_ASSERT_EQUAL_HEX8(0xcb, digest[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x26, digest[3]);
+
+    char text[FileFingerprint::MAX_TEXT_LEN];
+    FileFingerprint::format(algo, digest, text);
+    TEST_ASSERT_EQUAL_STRING("crc32:cbf43926", text);
+
+    // Untagged 32-hex values are MD5 (entries written before tagging)
+    TEST_ASSERT_TRUE(FileFingerprint::parse("0123456789abcdef0123456789ABCDEF", algo, digest));
+    TEST_ASSERT_TRUE(algo == FingerprintAlgo::Md5);
+    FileFingerprint::format(algo, digest, text);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdef0123456789abcdef", text);
+}
+
+void test_parse_rejects_malformed() {
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN];
+    FingerprintAlgo algo;
+    TEST_ASSERT_FALSE(FileFingerprint::parse("crc32:cbf4392", algo, digest));
+    TEST_ASSERT_FALSE(FileFingerprint::parse("crc32:cbf43926a", algo, digest));
+    TEST_ASSERT_FALSE(FileFingerprint::parse("crc32:xbf43926", algo, digest));
+    TEST_ASSERT_FALSE(FileFingerprint::parse("checksum123", algo, digest));
+    TEST_ASSERT_FALSE(FileFingerprint::parse("empty_file", algo, digest));
+    TEST_ASSERT_FALSE(FileFingerprint::parse(nullptr, algo, digest));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_crc32_streaming_matches_one_shot);
+    RUN_TEST(test_parse_round_trip_records_algorithm);
+    RUN_TEST(test_parse_rejects_malformed);
+
+    return UNITY_END();
+}
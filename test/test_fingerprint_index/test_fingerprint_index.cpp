@@ -0,0 +1,188 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockFS.h"
+#include "MockLogger.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Prevent real Logger.h from being included (we're using MockLogger)
+#define LOGGER_H
+
+#include "FingerprintIndex.h"
+#include "../../src/FingerprintIndex.cpp"
+#include "../../src/FileFingerprint.cpp"
+
+MockFS testFS;
+static const char* INDEX_PATH = "/.upload_state.v3.idx";
+
+static FingerprintRecord makeRecord(uint64_t hash, uint32_t size, uint8_t uploaded = 0x01) {
+    FingerprintRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.pathHash = hash;
+    rec.fileSize = size;
+    rec.algo = FingerprintAlgo::Crc32;
+    rec.flags = 0x01;
+    rec.uploaded = uploaded;
+    return rec;
+}
+
+// Spread-out keys, like FNV path hashes
+static uint64_t keyOf(uint32_t i) {
+    return (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ull;
+}
+
+// Merge keys [first, first + n) in sorted batches the size of the store's change table
+static void mergeRange(FingerprintIndex& index, uint32_t first, uint32_t n) {
+    FingerprintRecord batch[64];
+    uint32_t done = 0;
+    while (done < n) {
+        uint16_t count = 0;
+        while (count < 64 && done < n) {
+            batch[count] = makeRecord(keyOf(first + done), first + done);
+            count++;
+            done++;
+        }
+        for (uint16_t i = 1; i < count; ++i) {
+            FingerprintRecord rec = batch[i];
+            int j = i - 1;
+            while (j >= 0 && batch[j].pathHash > rec.pathHash) {
+                batch[j + 1] = batch[j];
+                j--;
+            }
+            batch[j + 1] = rec;
+        }
+        TEST_ASSERT_TRUE(index.merge(batch, count));
+    }
+}
+
+void setUp(void) {
+    testFS.clear();
+}
+
+void tearDown(void) {
+    testFS.clear();
+}
+
+void test_missing_index_is_empty() {
+    FingerprintIndex index;
+    TEST_ASSERT_TRUE(index.open(testFS, INDEX_PATH));
+    TEST_ASSERT_EQUAL(0, index.count());
+    FingerprintRecord rec;
+    TEST_ASSERT_FALSE(index.find(keyOf(1), rec));
+    TEST_ASSERT_FALSE(testFS.exists(INDEX_PATH));
+}
+
+void test_lookup_across_pages() {
+    FingerprintIndex index;
+    index.open(testFS, INDEX_PATH);
+    mergeRange(index, 0, 1000);
+    TEST_ASSERT_EQUAL(1000, index.count());
+    TEST_ASSERT_EQUAL(32 + 1000 * 32, testFS.getFileContent(INDEX_PATH).size());
+
+    // Reopened from flash: every key found, keys in between not
+    FingerprintIndex reopened;
+    TEST_ASSERT_TRUE(reopened.open(testFS, INDEX_PATH));
+    TEST_ASSERT_EQUAL(1000, reopened.count());
+    FingerprintRecord rec;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        TEST_ASSERT_TRUE(reopened.find(keyOf(i), rec));
+        TEST_ASSERT_EQUAL(i, rec.fileSize);
+        TEST_ASSERT_FALSE(reopened.find(keyOf(i) + 1, rec));
+    }
+    TEST_ASSERT_FALSE(reopened.find(0, rec));
+    TEST_ASSERT_FALSE(reopened.find(~0ull, rec));
+
+    // Page keys are in RAM: at most one page read per lookup, none below the first key
+    const FingerprintIndexStats& st = reopened.stats();
+    TEST_ASSERT_EQUAL(2002, st.lookups);
+    TEST_ASSERT_TRUE(st.pageReads + st.pageHits <= 2001);
+
+    // The same path again (hasFileChanged, then markFileUploaded) is a cache hit
+    uint32_t reads = st.pageReads;
+    TEST_ASSERT_TRUE(reopened.find(keyOf(321), rec));
+    TEST_ASSERT_TRUE(reopened.find(keyOf(321), rec));
+    TEST_ASSERT_EQUAL(reads + 1, st.pageReads);
+}
+
+void test_merge_replaces_and_removes() {
+    FingerprintIndex index;
+    index.open(testFS, INDEX_PATH);
+    mergeRange(index, 0, 100);
+
+    FingerprintRecord changes[3];
+    changes[0] = makeRecord(keyOf(5), 555, 0x03);
+    changes[1] = makeRecord(keyOf(7), 0, 0x00);        // remove
+    changes[2] = makeRecord(keyOf(500), 42, 0x02);     // new key
+    // Sort by key
+    for (int i = 0; i < 3; ++i) {
+        for (int j = i + 1; j < 3; ++j) {
+            if (changes[j].pathHash < changes[i].pathHash) {
+                FingerprintRecord t = changes[i];
+                changes[i] = changes[j];
+                changes[j] = t;
+            }
+        }
+    }
+    TEST_ASSERT_TRUE(index.merge(changes, 3));
+    TEST_ASSERT_EQUAL(100, index.count());
+
+    FingerprintRecord rec;
+    TEST_ASSERT_TRUE(index.find(keyOf(5), rec));
+    TEST_ASSERT_EQUAL(555, rec.fileSize);
+    TEST_ASSERT_EQUAL_HEX8(0x03, rec.uploaded);
+    TEST_ASSERT_FALSE(index.find(keyOf(7), rec));
+    TEST_ASSERT_TRUE(index.find(keyOf(500), rec));
+    TEST_ASSERT_TRUE(index.find(keyOf(6), rec));
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v3.idx.tmp"));
+}
+
+void test_full_index_drops_oldest() {
+    FingerprintIndex index;
+    index.open(testFS, INDEX_PATH);
+    const uint32_t max = FingerprintIndex::MAX_RECORDS;
+    mergeRange(index, 0, max);
+    TEST_ASSERT_EQUAL(max, index.count());
+
+    // 100 more: the first keys written (oldest merges) make room
+    mergeRange(index, max, 100);
+    TEST_ASSERT_EQUAL(max, index.count());
+    TEST_ASSERT_EQUAL(100, index.stats().evicted);
+
+    FingerprintRecord rec;
+    TEST_ASSERT_FALSE(index.find(keyOf(0), rec));
+    TEST_ASSERT_FALSE(index.find(keyOf(63), rec));
+    TEST_ASSERT_TRUE(index.find(keyOf(max - 1), rec));
+    TEST_ASSERT_TRUE(index.find(keyOf(max + 99), rec));
+
+    // Rewriting an old key makes it the newest
+    mergeRange(index, 200, 1);
+    mergeRange(index, max + 100, 64);
+    TEST_ASSERT_TRUE(index.find(keyOf(200), rec));
+    TEST_ASSERT_EQUAL(max, index.count());
+}
+
+void test_damaged_index_reads_as_empty() {
+    testFS.addFile(INDEX_PATH, std::string("FPI1 not really an index"));
+    FingerprintIndex index;
+    TEST_ASSERT_FALSE(index.open(testFS, INDEX_PATH));
+    TEST_ASSERT_EQUAL(0, index.count());
+
+    // The next merge writes a fresh file
+    mergeRange(index, 0, 10);
+    FingerprintIndex reopened;
+    TEST_ASSERT_TRUE(reopened.open(testFS, INDEX_PATH));
+    TEST_ASSERT_EQUAL(10, reopened.count());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_missing_index_is_empty);
+    RUN_TEST(test_lookup_across_pages);
+    RUN_TEST(test_merge_replaces_and_removes);
+    RUN_TEST(test_full_index_drops_oldest);
+    RUN_TEST(test_damaged_index_reads_as_empty);
+
+    return UNITY_END();
+}
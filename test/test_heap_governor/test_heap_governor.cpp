@@ -0,0 +1,120 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockLogger.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Prevent real Logger.h from being included (we're using MockLogger)
+#define LOGGER_H
+
+#include "HeapGovernor.h"
+#include "../../src/HeapGovernor.cpp"
+
+static uint32_t fakeLargest = 0;
+static uint32_t fakeProbe() { return fakeLargest; }
+
+static HeapGovernor gov;
+
+void setUp(void) {
+    gov.reset();
+    gov.setProbe(fakeProbe);
+}
+
+void tearDown(void) {}
+
+void test_reserve_halves_to_fit_floor() {
+    uint32_t floor = HeapGovernor::floorOf(HeapBudget::CloudBuffer);
+
+    fakeLargest = floor + 8192;
+    TEST_ASSERT_EQUAL(8192, gov.reserve(HeapBudget::CloudBuffer, 8192, 1024));
+    gov.release(HeapBudget::CloudBuffer);
+
+    fakeLargest = floor + 8191;
+    TEST_ASSERT_EQUAL(4096, gov.reserve(HeapBudget::CloudBuffer, 8192, 1024));
+    gov.release(HeapBudget::CloudBuffer);
+
+    fakeLargest = floor + 1500;
+    TEST_ASSERT_EQUAL(1024, gov.reserve(HeapBudget::CloudBuffer, 8192, 1024));
+    gov.release(HeapBudget::CloudBuffer);
+
+    // Not even the minimum fits
+    fakeLargest = floor + 1000;
+    TEST_ASSERT_EQUAL(0, gov.reserve(HeapBudget::CloudBuffer, 8192, 1024));
+
+    const HeapBudgetState& s = gov.state(HeapBudget::CloudBuffer);
+    TEST_ASSERT_EQUAL(3, s.grants);
+    TEST_ASSERT_EQUAL(1, s.denials);
+    TEST_ASSERT_EQUAL(8192, s.peak);
+    TEST_ASSERT_FALSE(s.active);
+}
+
+void test_admit_and_has_room() {
+    uint32_t floor = HeapGovernor::floorOf(HeapBudget::Tls);
+
+    fakeLargest = floor - 1;
+    TEST_ASSERT_FALSE(gov.hasRoom(HeapBudget::Tls));
+    TEST_ASSERT_FALSE(gov.admit(HeapBudget::Tls));
+    TEST_ASSERT_FALSE(gov.state(HeapBudget::Tls).active);
+
+    fakeLargest = floor;
+    TEST_ASSERT_TRUE(gov.hasRoom(HeapBudget::Tls));
+    TEST_ASSERT_FALSE(gov.hasRoom(HeapBudget::Tls, 1));
+    TEST_ASSERT_TRUE(gov.admit(HeapBudget::Tls));
+    TEST_ASSERT_TRUE(gov.state(HeapBudget::Tls).active);
+
+    gov.release(HeapBudget::Tls);
+    TEST_ASSERT_FALSE(gov.state(HeapBudget::Tls).active);
+}
+
+void test_history_is_newest_first_and_bounded() {
+    fakeLargest = 100000;
+    TEST_ASSERT_EQUAL(4096, gov.reserve(HeapBudget::CloudBuffer, 4096, 1024));
+    gov.release(HeapBudget::CloudBuffer);
+    gov.release(HeapBudget::CloudBuffer);  // Not held: not recorded
+
+    HeapDecision d;
+    TEST_ASSERT_TRUE(gov.history(0, d));
+    TEST_ASSERT_TRUE(d.op == HeapOp::Release);
+    TEST_ASSERT_EQUAL(4096, d.granted);
+    TEST_ASSERT_TRUE(gov.history(1, d));
+    TEST_ASSERT_TRUE(d.op == HeapOp::Grant);
+    TEST_ASSERT_TRUE(d.budget == HeapBudget::CloudBuffer);
+    TEST_ASSERT_EQUAL(100000, d.largest);
+    TEST_ASSERT_FALSE(gov.history(2, d));
+
+    for (int i = 0; i < 40; i++) {
+        gov.admit(HeapBudget::WebResponse);
+        gov.release(HeapBudget::WebResponse);
+    }
+    TEST_ASSERT_TRUE(gov.history(HEAP_HISTORY_SIZE - 1, d));
+    TEST_ASSERT_TRUE(d.budget == HeapBudget::WebResponse);
+    TEST_ASSERT_FALSE(gov.history(HEAP_HISTORY_SIZE, d));
+}
+
+void test_json_lists_budgets_and_history() {
+    fakeLargest = 40000;
+    gov.reserve(HeapBudget::CloudBuffer, 4096, 1024);
+
+    char json[2560];
+    size_t n = gov.toJson(json, sizeof(json));
+    TEST_ASSERT_TRUE(n > 0);
+    TEST_ASSERT_EQUAL(strlen(json), n);
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"largest\":40000"));
+    TEST_ASSERT_NOT_NULL(strstr(json, "{\"name\":\"cloud_buffer\",\"floor\":33000,\"active\":true,\"held\":4096"));
+    TEST_ASSERT_NOT_NULL(strstr(json, "\"op\":\"grant\",\"requested\":4096,\"granted\":4096"));
+
+    // A buffer too small for everything yields nothing rather than broken JSON
+    TEST_ASSERT_EQUAL(0, gov.toJson(json, 64));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_reserve_halves_to_fit_floor);
+    RUN_TEST(test_admit_and_has_room);
+    RUN_TEST(test_history_is_newest_first_and_bounded);
+    RUN_TEST(test_json_lists_budgets_and_history);
+
+    return UNITY_END();
+}
@@ -0,0 +1,101 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockLogger.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Prevent real Logger.h from being included (we're using MockLogger)
+#define LOGGER_H
+
+#include "IoBufferPool.h"
+#include "../../src/IoBufferPool.cpp"
+
+static bool isPoolSlot(const uint8_t* p) {
+    return p == slot0 || p == slot1 || p == slot2;
+}
+
+void setUp(void) {}
+
+void tearDown(void) {
+    // Every test must return what it checked out
+    TEST_ASSERT_EQUAL(0, IoBufferPool::stats().inUse);
+}
+
+void test_smallest_fitting_slot_first() {
+    IoBuffer a(1024, "a");
+    TEST_ASSERT_TRUE(a.data() == slot2);
+    TEST_ASSERT_EQUAL(1024, a.size());
+    TEST_ASSERT_EQUAL_STRING("a", IoBufferPool::slotOwner(2));
+
+    IoBuffer b(4096, "b");
+    TEST_ASSERT_TRUE(b.data() == slot1);
+
+    // Both 4KB slots out: a small request takes the 8KB slot
+    IoBuffer c(512, "c");
+    TEST_ASSERT_TRUE(c.data() == slot0);
+    TEST_ASSERT_EQUAL(3, IoBufferPool::stats().inUse);
+}
+
+void test_large_request_takes_8k_slot() {
+    IoBuffer smb(8192, "smb");
+    TEST_ASSERT_TRUE(smb.data() == slot0);
+
+    IoBuffer check(4096, "checksum");
+    TEST_ASSERT_TRUE(check.data() == slot2);
+
+    smb.release();
+    TEST_ASSERT_NULL(IoBufferPool::slotOwner(0));
+    TEST_ASSERT_FALSE((bool)smb);
+}
+
+void test_heap_fallback_when_busy_or_too_large() {
+    IoPoolStats before = IoBufferPool::stats();
+
+    IoBuffer big(16384, "big");
+    TEST_ASSERT_TRUE((bool)big);
+    TEST_ASSERT_FALSE(isPoolSlot(big.data()));
+    TEST_ASSERT_EQUAL(16384, big.size());
+
+    IoBuffer s0(8192, "s0");
+    IoBuffer s1(4096, "s1");
+    IoBuffer s2(4096, "s2");
+    IoBuffer extra(4096, "extra");
+    TEST_ASSERT_TRUE((bool)extra);
+    TEST_ASSERT_FALSE(isPoolSlot(extra.data()));
+
+    IoPoolStats after = IoBufferPool::stats();
+    TEST_ASSERT_EQUAL(before.heapFallbacks + 2, after.heapFallbacks);
+    TEST_ASSERT_EQUAL(before.checkouts + 3, after.checkouts);
+    TEST_ASSERT_EQUAL(3, after.peakInUse);
+
+    // Returning a heap buffer does not touch the slots
+    extra.release();
+    TEST_ASSERT_EQUAL(3, IoBufferPool::stats().inUse);
+}
+
+void test_acquire_returns_previous_buffer() {
+    IoBuffer buf;
+    TEST_ASSERT_FALSE((bool)buf);
+    TEST_ASSERT_TRUE(buf.acquire(8192, "first"));
+    TEST_ASSERT_TRUE(buf.data() == slot0);
+    TEST_ASSERT_TRUE(buf.acquire(2048, "second"));
+    TEST_ASSERT_TRUE(buf.data() == slot2);
+    TEST_ASSERT_NULL(IoBufferPool::slotOwner(0));
+    TEST_ASSERT_EQUAL(1, IoBufferPool::stats().inUse);
+
+    // Zero-size requests get nothing
+    TEST_ASSERT_FALSE(buf.acquire(0, "zero"));
+    TEST_ASSERT_EQUAL(0, IoBufferPool::stats().inUse);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_smallest_fitting_slot_first);
+    RUN_TEST(test_large_request_takes_8k_slot);
+    RUN_TEST(test_heap_fallback_when_busy_or_too_large);
+    RUN_TEST(test_acquire_returns_previous_buffer);
+
+    return UNITY_END();
+}
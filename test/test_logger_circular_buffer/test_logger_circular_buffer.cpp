@@ -132,8 +132,8 @@ public:
     // Override virtual methods we don't want to execute during testing
     
     // Mock getTimestamp to return predictable value
-    virtual String getTimestamp() override {
-        return "[12:30:45] ";
+    virtual void getTimestamp(char* out, size_t outLen) override {
+        snprintf(out, outLen, "[12:30:45] ");
     }
     
     // Mock writeToSerial to do nothing (we don't care about serial output in tests)
@@ -0,0 +1,249 @@
+#include <unity.h>
+#include "Arduino.h"
+
+#include <string>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the OTA stream decoders (tinfl comes from MockMiniz.h: stored blocks only)
+#include "OtaImage.h"
+#include "../../src/OtaImage.cpp"
+
+static std::string image;
+static std::string running;
+static int sinkCalls;
+
+static bool captureSink(void* ctx, const uint8_t* data, size_t len) {
+    (void)ctx;
+    sinkCalls++;
+    image.append((const char*)data, len);
+    return true;
+}
+
+static bool readRunning(void* ctx, uint32_t offset, uint8_t* out, size_t len) {
+    (void)ctx;
+    if (offset + len > running.size()) return false;
+    memcpy(out, running.data() + offset, len);
+    return true;
+}
+
+static void putLe32(std::string& s, uint32_t v) {
+    for (int i = 0; i < 4; i++) s += (char)(uint8_t)(v >> (8 * i));
+}
+
+static uint32_t crcOf(const std::string& s) {
+    return esp_rom_crc32_le(0, (const uint8_t*)s.data(), (uint32_t)s.size());
+}
+
+// Fake app image: ESP32 magic byte followed by a recognisable body
+static std::string makeImage(size_t size, uint8_t seed) {
+    std::string s;
+    s += (char)0xE9;
+    s += (char)0x04;
+    for (size_t i = 2; i < size; i++) s += (char)(uint8_t)(i * 7 + seed);
+    return s;
+}
+
+// gzip member with an FNAME field and stored deflate blocks (like `gzip -0`)
+static std::string makeGzip(const std::string& payload, size_t blockSize) {
+    std::string gz = std::string("\x1f\x8b\x08\x08\x00\x00\x00\x00\x00\x03", 10);
+    gz += "firmware.bin";
+    gz += '\0';
+    size_t pos = 0;
+    do {
+        size_t n = payload.size() - pos < blockSize ? payload.size() - pos : blockSize;
+        bool last = pos + n == payload.size();
+        gz += (char)(last ? 1 : 0);
+        gz += (char)(n & 0xFF);
+        gz += (char)(n >> 8);
+        gz += (char)(~n & 0xFF);
+        gz += (char)((~n >> 8) & 0xFF);
+        gz += payload.substr(pos, n);
+        pos += n;
+    } while (pos < payload.size());
+    putLe32(gz, crcOf(payload));
+    putLe32(gz, (uint32_t)payload.size());
+    return gz;
+}
+
+static std::string deltaHeader(const std::string& source, const std::string& target) {
+    std::string p = "CPD1";
+    putLe32(p, (uint32_t)source.size());
+    putLe32(p, crcOf(source));
+    putLe32(p, (uint32_t)target.size());
+    putLe32(p, crcOf(target));
+    return p;
+}
+
+static void deltaRecord(std::string& p, uint32_t diffLen, uint32_t extraLen, int32_t seek) {
+    putLe32(p, diffLen);
+    putLe32(p, extraLen);
+    putLe32(p, (uint32_t)seek);
+}
+
+// Feed the transfer in `chunk`-sized pieces, like the web upload / HTTP loops
+static bool decodeAll(OtaImageDecoder& dec, const std::string& transfer, size_t chunk) {
+    dec.begin(captureSink, nullptr, readRunning, nullptr);
+    for (size_t pos = 0; pos < transfer.size(); pos += chunk) {
+        size_t n = transfer.size() - pos < chunk ? transfer.size() - pos : chunk;
+        if (!dec.write((const uint8_t*)transfer.data() + pos, n)) return false;
+    }
+    return dec.finish();
+}
+
+void setUp(void) {
+    image.clear();
+    running.clear();
+    sinkCalls = 0;
+}
+
+void tearDown(void) {
+}
+
+// ============================================================================
+// Format detection
+// ============================================================================
+
+void test_detect_formats() {
+    TEST_ASSERT_EQUAL(OtaImageFormat::Raw, detectOtaImageFormat((const uint8_t*)"\xE9\x04", 2));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Gzip, detectOtaImageFormat((const uint8_t*)"\x1f\x8b\x08", 3));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Delta, detectOtaImageFormat((const uint8_t*)"CPD1", 4));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Unknown, detectOtaImageFormat((const uint8_t*)"CPD", 3));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Unknown, detectOtaImageFormat((const uint8_t*)"PK\x03\x04", 4));
+
+    OtaImageDecoder dec;
+    dec.begin(captureSink, nullptr, readRunning, nullptr);
+    TEST_ASSERT_FALSE(dec.write((const uint8_t*)"PK\x03\x04", 4));
+    TEST_ASSERT_NOT_NULL(dec.error());
+    TEST_ASSERT_EQUAL(0, (int)image.size());
+}
+
+// ============================================================================
+// Raw and gzip transfers
+// ============================================================================
+
+void test_raw_image_passes_through() {
+    std::string fw = makeImage(5000, 1);
+    OtaImageDecoder dec;
+
+    TEST_ASSERT_TRUE(decodeAll(dec, fw, 1024));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Raw, dec.transferFormat());
+    TEST_ASSERT_EQUAL(5000, dec.imageBytes());
+    TEST_ASSERT_TRUE(image == fw);
+
+    // Byte-at-a-time delivery still sniffs and decodes the same stream
+    image.clear();
+    TEST_ASSERT_TRUE(decodeAll(dec, fw, 1));
+    TEST_ASSERT_TRUE(image == fw);
+}
+
+void test_gzip_image_is_inflated_and_verified() {
+    std::string fw = makeImage(70000, 2);   // Larger than the 32 KB window
+    std::string gz = makeGzip(fw, 4000);
+    OtaImageDecoder dec;
+
+    TEST_ASSERT_TRUE(decodeAll(dec, gz, 1436));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Gzip, dec.transferFormat());
+    TEST_ASSERT_EQUAL(OtaImageFormat::Raw, dec.imageFormat());
+    TEST_ASSERT_TRUE(image == fw);
+
+    image.clear();
+    TEST_ASSERT_TRUE(decodeAll(dec, gz, 7));
+    TEST_ASSERT_TRUE(image == fw);
+}
+
+void test_gzip_trailer_mismatch_and_truncation_fail() {
+    std::string fw = makeImage(3000, 3);
+    std::string gz = makeGzip(fw, 1000);
+    OtaImageDecoder dec;
+
+    std::string badCrc = gz;
+    badCrc[badCrc.size() - 8] ^= 0x01;
+    TEST_ASSERT_FALSE(decodeAll(dec, badCrc, 512));
+    TEST_ASSERT_EQUAL_STRING("Gzip CRC or length mismatch", dec.error());
+
+    TEST_ASSERT_FALSE(decodeAll(dec, gz.substr(0, gz.size() - 3), 512));
+    TEST_ASSERT_EQUAL_STRING("Gzip stream is truncated", dec.error());
+
+    TEST_ASSERT_FALSE(decodeAll(dec, gz + "x", 512));
+    TEST_ASSERT_EQUAL_STRING("Unexpected data after gzip stream", dec.error());
+}
+
+// ============================================================================
+// Delta patches
+// ============================================================================
+
+// Target = source with a patched byte, a moved block and some new bytes
+static std::string buildDelta(std::string& target) {
+    running = makeImage(2000, 4);
+    target = running.substr(0, 1000);
+    target[10] = (char)(target[10] + 3);
+    target += "NEW-CODE";
+    target += running.substr(1500, 500);
+
+    std::string p = deltaHeader(running, target);
+    deltaRecord(p, 1000, 8, 500);          // Copy 0..999 (one byte patched), 8 new bytes, skip to 1500
+    std::string diff(1000, '\0');
+    diff[10] = 3;
+    p += diff;
+    p += "NEW-CODE";
+    deltaRecord(p, 500, 0, 0);             // Copy 1500..1999 unchanged
+    p += std::string(500, '\0');
+    return p;
+}
+
+void test_delta_patch_rebuilds_target() {
+    std::string target;
+    std::string patch = buildDelta(target);
+    OtaImageDecoder dec;
+
+    TEST_ASSERT_TRUE(decodeAll(dec, patch, 100));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Delta, dec.transferFormat());
+    TEST_ASSERT_EQUAL((int)target.size(), (int)dec.imageBytes());
+    TEST_ASSERT_TRUE(image == target);
+
+    // Shipped gzip-compressed: gzip layer feeds the delta applier
+    image.clear();
+    TEST_ASSERT_TRUE(decodeAll(dec, makeGzip(patch, 300), 64));
+    TEST_ASSERT_EQUAL(OtaImageFormat::Gzip, dec.transferFormat());
+    TEST_ASSERT_EQUAL(OtaImageFormat::Delta, dec.imageFormat());
+    TEST_ASSERT_TRUE(image == target);
+}
+
+void test_delta_rejects_wrong_source_and_bad_records() {
+    std::string target;
+    std::string patch = buildDelta(target);
+    OtaImageDecoder dec;
+
+    // A different running image: refused before anything is written
+    running[1234] ^= 0x55;
+    TEST_ASSERT_FALSE(decodeAll(dec, patch, 256));
+    TEST_ASSERT_EQUAL_STRING("Delta was built for a different firmware", dec.error());
+    TEST_ASSERT_EQUAL(0, sinkCalls);
+
+    // Diff run reaching past the source image
+    running[1234] ^= 0x55;
+    std::string bad = deltaHeader(running, target);
+    deltaRecord(bad, 0, 0, 1500);
+    deltaRecord(bad, 600, 0, 0);
+    TEST_ASSERT_FALSE(decodeAll(dec, bad, 256));
+    TEST_ASSERT_EQUAL_STRING("Delta reads past the source image", dec.error());
+
+    // Truncated patch
+    TEST_ASSERT_FALSE(decodeAll(dec, patch.substr(0, patch.size() - 10), 256));
+    TEST_ASSERT_EQUAL_STRING("Delta patch is truncated", dec.error());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_detect_formats);
+    RUN_TEST(test_raw_image_passes_through);
+    RUN_TEST(test_gzip_image_is_inflated_and_verified);
+    RUN_TEST(test_gzip_trailer_mismatch_and_truncation_fail);
+    RUN_TEST(test_delta_patch_rebuilds_target);
+    RUN_TEST(test_delta_rejects_wrong_source_and_bad_records);
+
+    return UNITY_END();
+}
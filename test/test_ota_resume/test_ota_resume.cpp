@@ -0,0 +1,141 @@
+#include <unity.h>
+#include "Arduino.h"
+#include "MockFS.h"
+#include "MockLogger.h"
+
+#include <string>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Prevent real Logger.h from being included (we're using MockLogger)
+#define LOGGER_H
+
+// Include the OTA resume checkpoint helpers
+#include "OtaResume.h"
+#include "../../src/OtaResume.cpp"
+
+MockFS testFS;
+
+static const char* URL = "https://github.com/example/releases/download/v2.1/firmware-ota-upgrade.bin";
+
+static OtaResumeState makeState() {
+    OtaResumeState s;
+    memset(&s, 0, sizeof(s));
+    s.urlCrc = otaUrlCrc(URL);
+    strcpy(s.partition, "app1");
+    s.totalSize = 1441792;
+    s.offset = 3 * OTA_CHECKPOINT_INTERVAL;
+    for (int i = 0; i < 8; i++) s.shaState[i] = 0x6a09e667u + (uint32_t)i * 0x01010101u;
+    strcpy(s.validator, "\"0x8DC5A1B2C3D4E5F\"");
+    return s;
+}
+
+void setUp(void) {
+    testFS.clear();
+}
+
+void tearDown(void) {
+}
+
+// ============================================================================
+// Header and hash parsing
+// ============================================================================
+
+void test_parse_content_range() {
+    uint32_t start = 0, end = 0, total = 0;
+    TEST_ASSERT_TRUE(parseContentRange("bytes 196608-1441791/1441792", start, end, total));
+    TEST_ASSERT_EQUAL(196608, start);
+    TEST_ASSERT_EQUAL(1441791, end);
+    TEST_ASSERT_EQUAL(1441792, total);
+
+    TEST_ASSERT_FALSE(parseContentRange("bytes 0-99/*", start, end, total));
+    TEST_ASSERT_FALSE(parseContentRange("bytes */1441792", start, end, total));
+    TEST_ASSERT_FALSE(parseContentRange("bytes 100-99/200", start, end, total));
+    TEST_ASSERT_FALSE(parseContentRange("bytes 0-200/200", start, end, total));
+    TEST_ASSERT_FALSE(parseContentRange("", start, end, total));
+}
+
+void test_parse_sha256_hex() {
+    const char* hex = "9F86D081884C7D659A2FEAA0C55AD015A3BF4F1B2B0B822CD15D6C15B0F00A08";
+    uint8_t digest[32];
+    TEST_ASSERT_TRUE(parseSha256Hex(hex, digest));
+    TEST_ASSERT_EQUAL_HEX8(0x9F, digest[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x08, digest[31]);
+
+    char back[65];
+    sha256ToHex(digest, back);
+    TEST_ASSERT_EQUAL_STRING("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08", back);
+
+    // sha256sum output pasted with trailing whitespace is accepted
+    TEST_ASSERT_TRUE(parseSha256Hex("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08 \n", digest));
+    TEST_ASSERT_FALSE(parseSha256Hex("9f86d081884c7d659a2feaa0c55ad015", digest));
+    TEST_ASSERT_FALSE(parseSha256Hex("9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08  firmware.bin", digest));
+    TEST_ASSERT_FALSE(parseSha256Hex("zz86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08", digest));
+}
+
+// ============================================================================
+// Checkpoint store
+// ============================================================================
+
+void test_checkpoint_round_trip() {
+    OtaResumeState saved = makeState();
+    TEST_ASSERT_TRUE(OtaResumeStore::save(testFS, saved));
+    TEST_ASSERT_FALSE(testFS.exists("/.ota_resume.tmp"));
+
+    OtaResumeState loaded;
+    TEST_ASSERT_TRUE(OtaResumeStore::load(testFS, loaded));
+    TEST_ASSERT_EQUAL(saved.urlCrc, loaded.urlCrc);
+    TEST_ASSERT_EQUAL_STRING("app1", loaded.partition);
+    TEST_ASSERT_EQUAL(saved.totalSize, loaded.totalSize);
+    TEST_ASSERT_EQUAL(saved.offset, loaded.offset);
+    TEST_ASSERT_EQUAL_MEMORY(saved.shaState, loaded.shaState, sizeof(saved.shaState));
+    TEST_ASSERT_EQUAL_STRING(saved.validator, loaded.validator);
+
+    OtaResumeStore::clear(testFS);
+    TEST_ASSERT_FALSE(testFS.exists("/.ota_resume"));
+    TEST_ASSERT_FALSE(OtaResumeStore::load(testFS, loaded));
+}
+
+void test_checkpoint_rejects_unusable_lines() {
+    OtaResumeState s = makeState();
+    OtaResumeState parsed;
+    char line[224];
+
+    // No validator: the server cannot tell us if the file changed
+    s.validator[0] = '\0';
+    TEST_ASSERT_TRUE(OtaResumeStore::formatLine(s, line, sizeof(line)));
+    TEST_ASSERT_FALSE(OtaResumeStore::parseLine(line, parsed));
+
+    // Not on a SHA-256 block boundary
+    s = makeState();
+    s.offset += 10;
+    TEST_ASSERT_TRUE(OtaResumeStore::formatLine(s, line, sizeof(line)));
+    TEST_ASSERT_FALSE(OtaResumeStore::parseLine(line, parsed));
+
+    // Already complete
+    s = makeState();
+    s.offset = s.totalSize;
+    TEST_ASSERT_TRUE(OtaResumeStore::formatLine(s, line, sizeof(line)));
+    TEST_ASSERT_FALSE(OtaResumeStore::parseLine(line, parsed));
+
+    // Truncated write
+    s = makeState();
+    TEST_ASSERT_TRUE(OtaResumeStore::formatLine(s, line, sizeof(line)));
+    line[40] = '\0';
+    TEST_ASSERT_FALSE(OtaResumeStore::parseLine(line, parsed));
+
+    testFS.addFile("/.ota_resume", "garbage\n");
+    TEST_ASSERT_FALSE(OtaResumeStore::load(testFS, parsed));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_parse_content_range);
+    RUN_TEST(test_parse_sha256_hex);
+    RUN_TEST(test_checkpoint_round_trip);
+    RUN_TEST(test_checkpoint_rejects_unusable_lines);
+
+    return UNITY_END();
+}
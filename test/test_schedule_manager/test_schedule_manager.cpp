@@ -79,6 +79,9 @@ time_t mktime(struct tm* timeptr) {
 #include "../mocks/ESP32Ping.h"
 #include "../mocks/ESP32Ping.cpp"
 
+// Defined in main.cpp on the device (fast-boot flag read by syncTime)
+bool g_heapRecoveryBoot = false;
+
 // Include the ScheduleManager implementation
 #include "ScheduleManager.h"
 #include "../../src/ScheduleManager.cpp"
@@ -88,6 +91,7 @@ void setUp(void) {
     MockTimeState::reset();
     mockNtpSyncSuccess = true;
     mockGmtOffsetSeconds = 0;
+    Preferences::clearAll();
 }
 
 void tearDown(void) {
@@ -476,6 +480,128 @@ void test_ntp_sync_required_for_schedule() {
     TEST_ASSERT_EQUAL(0, manager.getSecondsUntilNextUpload());
 }
 
+// ============================================================================
+// Session-end learning (smart mode predictive pre-warm)
+// ============================================================================
+
+static void beginSmartAt(ScheduleManager& manager, time_t now) {
+    MockTimeState::setTime(now);
+    manager.begin("smart", 8, 22, 0);
+}
+
+void test_session_end_no_prediction_without_history() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 7, 5, 0));
+
+    TEST_ASSERT_EQUAL(2, manager.getSessionEndSampleCount());
+    TEST_ASSERT_EQUAL(-1, manager.getPredictedSessionEndMinute());
+    TEST_ASSERT_FALSE(manager.isPreWarmDue());
+}
+
+void test_session_end_prediction_is_median() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 7, 10, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 6, 50, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 7, 0, 0));
+
+    TEST_ASSERT_EQUAL(7 * 60, manager.getPredictedSessionEndMinute());
+}
+
+void test_session_end_prediction_across_midnight() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 23, 50, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 0, 10, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 17, 0, 0, 0));
+
+    TEST_ASSERT_EQUAL(0, manager.getPredictedSessionEndMinute());
+}
+
+void test_session_end_same_night_merges() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    // Mask off at 03:00 for a break, therapy resumes and ends at 07:00
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 3, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 7, 0, 0));
+    TEST_ASSERT_EQUAL(1, manager.getSessionEndSampleCount());
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 7, 0, 0));
+    TEST_ASSERT_EQUAL(3, manager.getSessionEndSampleCount());
+    TEST_ASSERT_EQUAL(7 * 60, manager.getPredictedSessionEndMinute());
+}
+
+void test_session_end_scattered_history_not_predicted() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 2, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 12, 0, 0));
+
+    TEST_ASSERT_EQUAL(-1, manager.getPredictedSessionEndMinute());
+}
+
+void test_prewarm_due_once_before_predicted_end() {
+    ScheduleManager manager;
+    beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 7, 0, 0));
+
+    MockTimeState::setTime(makeTimestamp(2025, 11, 17, 6, 30, 0));
+    TEST_ASSERT_FALSE(manager.isPreWarmDue());
+
+    MockTimeState::setTime(makeTimestamp(2025, 11, 17, 6, 52, 0));
+    TEST_ASSERT_TRUE(manager.isPreWarmDue());
+    manager.markPreWarmStarted();
+    TEST_ASSERT_FALSE(manager.isPreWarmDue());
+
+    // Next night is due again
+    MockTimeState::setTime(makeTimestamp(2025, 11, 18, 6, 55, 0));
+    TEST_ASSERT_TRUE(manager.isPreWarmDue());
+}
+
+void test_prewarm_never_due_in_scheduled_mode() {
+    ScheduleManager manager;
+    MockTimeState::setTime(makeTimestamp(2025, 11, 14, 6, 0, 0));
+    manager.begin("scheduled", 8, 22, 0);
+
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 7, 0, 0));
+    manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 7, 0, 0));
+
+    MockTimeState::setTime(makeTimestamp(2025, 11, 17, 6, 55, 0));
+    TEST_ASSERT_FALSE(manager.isPreWarmDue());
+}
+
+void test_session_end_history_persists() {
+    {
+        ScheduleManager manager;
+        beginSmartAt(manager, makeTimestamp(2025, 11, 14, 6, 0, 0));
+        manager.recordSessionEnd(makeTimestamp(2025, 11, 14, 6, 40, 0));
+        manager.recordSessionEnd(makeTimestamp(2025, 11, 15, 6, 45, 0));
+        manager.recordSessionEnd(makeTimestamp(2025, 11, 16, 6, 50, 0));
+    }
+
+    ScheduleManager reloaded;
+    beginSmartAt(reloaded, makeTimestamp(2025, 11, 16, 12, 0, 0));
+    TEST_ASSERT_EQUAL(3, reloaded.getSessionEndSampleCount());
+    TEST_ASSERT_EQUAL(6 * 60 + 45, reloaded.getPredictedSessionEndMinute());
+
+    // Same-night merge still applies to the reloaded history
+    reloaded.recordSessionEnd(makeTimestamp(2025, 11, 16, 7, 30, 0));
+    TEST_ASSERT_EQUAL(3, reloaded.getSessionEndSampleCount());
+}
+
 int main(int argc, char **argv) {
     UNITY_BEGIN();
     
@@ -513,5 +639,15 @@ int main(int argc, char **argv) {
     RUN_TEST(test_ntp_sync_failure);
     RUN_TEST(test_ntp_sync_required_for_schedule);
     
+    // Session-end learning tests
+    RUN_TEST(test_session_end_no_prediction_without_history);
+    RUN_TEST(test_session_end_prediction_is_median);
+    RUN_TEST(test_session_end_prediction_across_midnight);
+    RUN_TEST(test_session_end_same_night_merges);
+    RUN_TEST(test_session_end_scattered_history_not_predicted);
+    RUN_TEST(test_prewarm_due_once_before_predicted_end);
+    RUN_TEST(test_prewarm_never_due_in_scheduled_mode);
+    RUN_TEST(test_session_end_history_persists);
+    
     return UNITY_END();
 }
@@ -0,0 +1,108 @@
+#include <unity.h>
+#include "Arduino.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the SD bus profile helpers
+#include "SdBusProfile.h"
+#include "../../src/SdBusProfile.cpp"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+static SdBusTrial makeTrial(uint8_t width, uint32_t freqKhz, uint32_t bytes, uint32_t ms, uint8_t errors) {
+    SdBusTrial t = {};
+    t.profile.width = width;
+    t.profile.freqKhz = freqKhz;
+    t.mounted = true;
+    t.passes = 2;
+    t.errors = errors;
+    t.bytes = bytes;
+    t.elapsedMs = ms;
+    return t;
+}
+
+void test_profile_record_roundtrip() {
+    SdBusProfile p = { 4, SD_BUS_FREQ_HIGHSPEED_KHZ, 5242880, 1760000000 };
+    char buf[48];
+    formatSdBusProfile(p, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("4,40000,5242880,1760000000", buf);
+
+    SdBusProfile out = {};
+    TEST_ASSERT_TRUE(parseSdBusProfile(buf, out));
+    TEST_ASSERT_EQUAL(4, out.width);
+    TEST_ASSERT_EQUAL(SD_BUS_FREQ_HIGHSPEED_KHZ, out.freqKhz);
+    TEST_ASSERT_EQUAL(5242880, out.readBps);
+    TEST_ASSERT_EQUAL(1760000000, out.validatedTs);
+}
+
+void test_profile_record_rejects_garbage() {
+    SdBusProfile out = {};
+    TEST_ASSERT_FALSE(parseSdBusProfile("", out));
+    TEST_ASSERT_FALSE(parseSdBusProfile(nullptr, out));
+    TEST_ASSERT_FALSE(parseSdBusProfile("4,40000", out));
+    TEST_ASSERT_FALSE(parseSdBusProfile("2,20000,1,1", out));      // bad width
+    TEST_ASSERT_FALSE(parseSdBusProfile("4,52000,1,1", out));      // unsupported clock
+}
+
+void test_select_prefers_fastest_stable() {
+    SdBusTrial trials[2] = {
+        makeTrial(4, SD_BUS_FREQ_DEFAULT_KHZ,   262144, 100, 0),  // ~2.6 MB/s
+        makeTrial(4, SD_BUS_FREQ_HIGHSPEED_KHZ, 262144, 60,  0)   // ~4.4 MB/s
+    };
+    TEST_ASSERT_EQUAL(1, selectFastestStableSdBusTrial(trials, 2));
+}
+
+void test_select_skips_errors_and_mount_failures() {
+    SdBusTrial trials[2] = {
+        makeTrial(4, SD_BUS_FREQ_DEFAULT_KHZ,   262144, 100, 0),
+        makeTrial(4, SD_BUS_FREQ_HIGHSPEED_KHZ, 262144, 50,  1)   // checksum mismatch
+    };
+    TEST_ASSERT_EQUAL(0, selectFastestStableSdBusTrial(trials, 2));
+
+    trials[0].mounted = false;
+    TEST_ASSERT_EQUAL(-1, selectFastestStableSdBusTrial(trials, 2));
+}
+
+void test_select_requires_meaningful_gain() {
+    // High-speed request ignored by the card: within the margin, keep 20 MHz
+    SdBusTrial trials[2] = {
+        makeTrial(4, SD_BUS_FREQ_DEFAULT_KHZ,   262144, 100, 0),
+        makeTrial(4, SD_BUS_FREQ_HIGHSPEED_KHZ, 262144, 95,  0)
+    };
+    TEST_ASSERT_EQUAL(0, selectFastestStableSdBusTrial(trials, 2));
+}
+
+void test_calibration_due_schedule() {
+    SdBusProfile stored = { 4, SD_BUS_FREQ_HIGHSPEED_KHZ, 1, 1760000000 };
+
+    // No profile yet — always due, even without NTP
+    TEST_ASSERT_TRUE(isSdBusCalibrationDue(false, stored, 0));
+
+    // Without a valid clock a stored profile is kept
+    TEST_ASSERT_FALSE(isSdBusCalibrationDue(true, stored, 5000));
+
+    TEST_ASSERT_FALSE(isSdBusCalibrationDue(true, stored, 1760000000 + 3600));
+    TEST_ASSERT_TRUE(isSdBusCalibrationDue(true, stored, 1760000000 + SD_BUS_REVALIDATE_SECS));
+
+    // Stored without a timestamp (calibrated before NTP) — due once time is valid
+    stored.validatedTs = 0;
+    TEST_ASSERT_TRUE(isSdBusCalibrationDue(true, stored, 1760000000));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_profile_record_roundtrip);
+    RUN_TEST(test_profile_record_rejects_garbage);
+    RUN_TEST(test_select_prefers_fastest_stable);
+    RUN_TEST(test_select_skips_errors_and_mount_failures);
+    RUN_TEST(test_select_requires_meaningful_gain);
+    RUN_TEST(test_calibration_due_schedule);
+
+    return UNITY_END();
+}
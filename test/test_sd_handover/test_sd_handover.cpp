@@ -0,0 +1,165 @@
+#include <unity.h>
+#include "Arduino.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the SD handover helpers
+#include "SdHandover.h"
+#include "../../src/SdHandover.cpp"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+void test_release_wait_full_bound_while_learning() {
+    SdHandoverStats stats = {};
+    TEST_ASSERT_EQUAL(SD_RELEASE_SETTLE_MAX_MS, sdHandoverReleaseWaitMs(stats));
+
+    sdHandoverRecordRelease(stats, true, 40);
+    sdHandoverRecordRelease(stats, true, 40);
+    TEST_ASSERT_EQUAL(SD_RELEASE_SETTLE_MAX_MS, sdHandoverReleaseWaitMs(stats));
+}
+
+void test_release_wait_tracks_learned_latency() {
+    SdHandoverStats stats = {};
+    for (int i = 0; i < 3; i++) {
+        sdHandoverRecordRelease(stats, true, 40);
+    }
+    TEST_ASSERT_EQUAL(40, stats.releaseMs);
+    TEST_ASSERT_EQUAL(90, sdHandoverReleaseWaitMs(stats));   // ewma + 50 margin
+
+    // Slow machine: twice the latency, capped at the old fixed delay
+    stats.releaseMs = 120;
+    TEST_ASSERT_EQUAL(240, sdHandoverReleaseWaitMs(stats));
+    stats.releaseMs = 250;
+    TEST_ASSERT_EQUAL(SD_RELEASE_SETTLE_MAX_MS, sdHandoverReleaseWaitMs(stats));
+}
+
+void test_release_wait_settle_only_when_host_seldom_accesses() {
+    SdHandoverStats stats = {};
+    sdHandoverRecordRelease(stats, true, 60);
+    for (int i = 0; i < 4; i++) {
+        sdHandoverRecordRelease(stats, false, 300);
+    }
+    // 1 seen of 5 -> MUX settle only
+    TEST_ASSERT_EQUAL(60, stats.releaseMs);   // misses do not skew the latency
+    TEST_ASSERT_EQUAL(SD_MUX_SETTLE_MS, sdHandoverReleaseWaitMs(stats));
+
+    // Periodic full-bound probe
+    sdHandoverRecordRelease(stats, false, SD_MUX_SETTLE_MS);
+    sdHandoverRecordRelease(stats, false, SD_MUX_SETTLE_MS);
+    sdHandoverRecordRelease(stats, false, SD_MUX_SETTLE_MS);
+    TEST_ASSERT_EQUAL(8, stats.releaseSeen + stats.releaseMissed);
+    TEST_ASSERT_EQUAL(SD_RELEASE_SETTLE_MAX_MS, sdHandoverReleaseWaitMs(stats));
+}
+
+void test_counters_halve_on_saturation() {
+    SdHandoverStats stats = { 0, 50, 255, 10 };
+    sdHandoverRecordRelease(stats, true, 50);
+    TEST_ASSERT_EQUAL(128, stats.releaseSeen);
+    TEST_ASSERT_EQUAL(5, stats.releaseMissed);
+}
+
+void test_acquire_ewma() {
+    SdHandoverStats stats = {};
+    sdHandoverRecordAcquire(stats, 200);
+    TEST_ASSERT_EQUAL(200, stats.acquireMs);
+    sdHandoverRecordAcquire(stats, 40);
+    TEST_ASSERT_EQUAL(160, stats.acquireMs);
+}
+
+void test_stats_record_roundtrip() {
+    SdHandoverStats stats = { 85, 42, 17, 3 };
+    char buf[32];
+    formatSdHandoverStats(stats, buf, sizeof(buf));
+    TEST_ASSERT_EQUAL_STRING("85,42,17,3", buf);
+
+    SdHandoverStats out = {};
+    TEST_ASSERT_TRUE(parseSdHandoverStats(buf, out));
+    TEST_ASSERT_EQUAL(85, out.acquireMs);
+    TEST_ASSERT_EQUAL(42, out.releaseMs);
+    TEST_ASSERT_EQUAL(17, out.releaseSeen);
+    TEST_ASSERT_EQUAL(3, out.releaseMissed);
+
+    TEST_ASSERT_FALSE(parseSdHandoverStats("", out));
+    TEST_ASSERT_FALSE(parseSdHandoverStats(nullptr, out));
+    TEST_ASSERT_FALSE(parseSdHandoverStats("85,42", out));
+    TEST_ASSERT_FALSE(parseSdHandoverStats("85,42,300,0", out));
+}
+
+void test_parse_machine_model() {
+    char model[32];
+
+    const char* json =
+        "{\"FlowGenerator\":{\"IdentificationProfiles\":{\"Product\":"
+        "{\"ProductCode\":\"39000\",\"ProductName\":\"AirSense 11 AutoSet\"}}}}";
+    TEST_ASSERT_TRUE(parseMachineModel(json, model, sizeof(model)));
+    TEST_ASSERT_EQUAL_STRING("AirSense_11_AutoSet", model);
+
+    const char* tgt = "#SRN 22161234567\r\n#PNA AirSense_10_AutoSet\r\n#PCD 37028\r\n";
+    TEST_ASSERT_TRUE(parseMachineModel(tgt, model, sizeof(model)));
+    TEST_ASSERT_EQUAL_STRING("AirSense_10_AutoSet", model);
+
+    // Truncated to the buffer
+    char small[8];
+    TEST_ASSERT_TRUE(parseMachineModel(tgt, small, sizeof(small)));
+    TEST_ASSERT_EQUAL_STRING("AirSens", small);
+
+    TEST_ASSERT_FALSE(parseMachineModel("#SRN 123\n", model, sizeof(model)));
+    TEST_ASSERT_FALSE(parseMachineModel(nullptr, model, sizeof(model)));
+}
+
+void test_save_only_when_learned_timing_changes() {
+    SdHandoverStats saved = {};
+    SdHandoverStats stats = {};
+
+    // Learning: each of the first releases is kept
+    sdHandoverRecordAcquire(stats, 120);
+    sdHandoverRecordRelease(stats, true, 40);
+    TEST_ASSERT_TRUE(sdHandoverNeedsSave(saved, stats));
+    for (int i = 0; i < 2; i++) {
+        saved = stats;
+        sdHandoverRecordRelease(stats, true, 40);
+        TEST_ASSERT_TRUE(sdHandoverNeedsSave(saved, stats));
+    }
+    saved = stats;
+    TEST_ASSERT_FALSE(sdHandoverNeedsSave(saved, stats));
+
+    // Steady timing: counters move on every release, but nothing is written
+    // until SD_HANDOVER_SAVE_EVERY releases have passed
+    for (int i = 1; i < SD_HANDOVER_SAVE_EVERY; i++) {
+        sdHandoverRecordAcquire(stats, 120);
+        sdHandoverRecordRelease(stats, true, 40);
+        TEST_ASSERT_FALSE(sdHandoverNeedsSave(saved, stats));
+    }
+    sdHandoverRecordRelease(stats, true, 40);
+    TEST_ASSERT_TRUE(sdHandoverNeedsSave(saved, stats));
+    saved = stats;
+
+    // A latency shift is written straight away
+    sdHandoverRecordRelease(stats, true, 120);
+    TEST_ASSERT_TRUE(sdHandoverNeedsSave(saved, stats));
+
+    // So is a flip to "host seldom accesses"
+    SdHandoverStats prompt = { 120, 40, 4, 0 };
+    SdHandoverStats seldom = { 120, 40, 4, 13 };
+    TEST_ASSERT_TRUE(sdHandoverNeedsSave(prompt, seldom));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_release_wait_full_bound_while_learning);
+    RUN_TEST(test_release_wait_tracks_learned_latency);
+    RUN_TEST(test_release_wait_settle_only_when_host_seldom_accesses);
+    RUN_TEST(test_counters_halve_on_saturation);
+    RUN_TEST(test_acquire_ewma);
+    RUN_TEST(test_stats_record_roundtrip);
+    RUN_TEST(test_save_only_when_learned_timing_changes);
+    RUN_TEST(test_parse_machine_model);
+
+    return UNITY_END();
+}
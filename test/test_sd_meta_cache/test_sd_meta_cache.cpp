@@ -0,0 +1,115 @@
+#include <unity.h>
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the metadata cache (POSIX stat — runs against a temp directory)
+#include "SdMetaCache.h"
+#include "../../src/SdMetaCache.cpp"
+
+static char mountPoint[64];
+
+static void writeFile(const char* rel, size_t bytes) {
+    char path[160];
+    snprintf(path, sizeof(path), "%s%s", mountPoint, rel);
+    FILE* f = fopen(path, "wb");
+    for (size_t i = 0; i < bytes; i++) fputc('x', f);
+    fclose(f);
+}
+
+void setUp(void) {
+    strcpy(mountPoint, "/tmp/metacacheXXXXXX");
+    TEST_ASSERT_NOT_NULL(mkdtemp(mountPoint));
+    writeFile("/STR.edf", 2048);
+}
+
+void tearDown(void) {
+    char cmd[96];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", mountPoint);
+    system(cmd);
+}
+
+void test_miss_stats_once_then_hits() {
+    SdMetaCache cache(mountPoint);
+    SdFileMeta meta = {};
+
+    TEST_ASSERT_TRUE(cache.get("/STR.edf", meta));
+    TEST_ASSERT_EQUAL(2048, meta.size);
+    TEST_ASSERT_TRUE(meta.mtime > 0);
+    TEST_ASSERT_EQUAL(1, cache.getMisses());
+
+    // Changes on disk are not seen while cached (the CPAP cannot write during a hold)
+    writeFile("/STR.edf", 4096);
+    TEST_ASSERT_TRUE(cache.get("/STR.edf", meta));
+    TEST_ASSERT_EQUAL(2048, meta.size);
+    TEST_ASSERT_EQUAL(1, cache.getHits());
+
+    cache.invalidate("/STR.edf");
+    TEST_ASSERT_TRUE(cache.get("/STR.edf", meta));
+    TEST_ASSERT_EQUAL(4096, meta.size);
+}
+
+void test_absent_file_is_cached() {
+    SdMetaCache cache(mountPoint);
+    SdFileMeta meta = {};
+
+    TEST_ASSERT_FALSE(cache.get("/Identification.json", meta));
+    TEST_ASSERT_FALSE(cache.get("/Identification.json", meta));
+    TEST_ASSERT_EQUAL(1, cache.getMisses());
+    TEST_ASSERT_EQUAL(1, cache.getHits());
+    TEST_ASSERT_TRUE(cache.lookup("/Identification.json", meta));
+    TEST_ASSERT_EQUAL(0, meta.attr);
+}
+
+void test_directory_attribute() {
+    SdMetaCache cache(mountPoint);
+    SdFileMeta meta = {};
+    TEST_ASSERT_TRUE(cache.get("", meta));   // the mount point itself
+    TEST_ASSERT_TRUE((meta.attr & SD_META_DIR) != 0);
+}
+
+void test_clear_drops_entries() {
+    SdMetaCache cache(mountPoint);
+    SdFileMeta meta = {};
+    SdFileMeta put = {10, 0, SD_META_EXISTS};
+    cache.put("/SETTINGS/CurrentSettings.json", put);
+    TEST_ASSERT_TRUE(cache.lookup("/SETTINGS/CurrentSettings.json", meta));
+
+    cache.clear();
+    TEST_ASSERT_FALSE(cache.lookup("/SETTINGS/CurrentSettings.json", meta));
+    TEST_ASSERT_EQUAL(0, cache.getHits());
+    TEST_ASSERT_EQUAL(0, cache.getMisses());
+}
+
+void test_slot_answers_only_for_its_path() {
+    SdMetaCache cache(mountPoint);
+    SdFileMeta meta = {};
+    // Same length, same slot: the second evicts the first, neither stands in
+    // for the other
+    SdFileMeta first = {100, 0, SD_META_EXISTS};
+    SdFileMeta second = {200, 0, SD_META_EXISTS};
+    cache.put("/DATALOG/20250101/20250101_221500_BRP.edf", first);
+    TEST_ASSERT_FALSE(cache.lookup("/DATALOG/20250101/20250101_220002_BRP.edf", meta));
+    cache.put("/DATALOG/20250101/20250101_220002_BRP.edf", second);
+    TEST_ASSERT_FALSE(cache.lookup("/DATALOG/20250101/20250101_221500_BRP.edf", meta));
+    TEST_ASSERT_TRUE(cache.lookup("/DATALOG/20250101/20250101_220002_BRP.edf", meta));
+    TEST_ASSERT_EQUAL(200, meta.size);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_miss_stats_once_then_hits);
+    RUN_TEST(test_absent_file_is_cached);
+    RUN_TEST(test_directory_attribute);
+    RUN_TEST(test_clear_drops_entries);
+    RUN_TEST(test_slot_answers_only_for_its_path);
+
+    return UNITY_END();
+}
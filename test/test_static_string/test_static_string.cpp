@@ -0,0 +1,93 @@
+#include <unity.h>
+#include "Arduino.h"
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+#include "StaticString.h"
+
+void setUp(void) {
+}
+
+void tearDown(void) {
+}
+
+// ============================================================================
+// Building
+// ============================================================================
+
+void test_append_and_format() {
+    StaticString<64> path("/DATALOG/");
+    path += "20240101";
+    path += '/';
+    path.append(String("20240101_231501_BRP.edf"));
+    TEST_ASSERT_EQUAL_STRING("/DATALOG/20240101/20240101_231501_BRP.edf", path.c_str());
+    TEST_ASSERT_EQUAL(41, (int)path.length());
+    TEST_ASSERT_FALSE(path.truncated());
+
+    path.format("/api/v1/imports/%s/files", "12345");
+    TEST_ASSERT_EQUAL_STRING("/api/v1/imports/12345/files", path.c_str());
+    path.appendf("?page=%d", 2);
+    TEST_ASSERT_EQUAL_STRING("/api/v1/imports/12345/files?page=2", path.c_str());
+    TEST_ASSERT_EQUAL(63, (int)StaticString<64>::capacity());
+}
+
+void test_truncation_is_detected() {
+    StaticString<8> s;
+    s.append("abcd");
+    TEST_ASSERT_FALSE(s.truncated());
+    s.append("efghij");
+    TEST_ASSERT_TRUE(s.truncated());
+    TEST_ASSERT_EQUAL_STRING("abcdefg", s.c_str());
+    TEST_ASSERT_EQUAL(7, (int)s.length());
+
+    // Stays set until the string is rebuilt
+    s.truncate(2);
+    TEST_ASSERT_TRUE(s.truncated());
+    s.assign("ok");
+    TEST_ASSERT_FALSE(s.truncated());
+
+    s.format("%s-%d", "longer", 12345);
+    TEST_ASSERT_TRUE(s.truncated());
+    TEST_ASSERT_EQUAL_STRING("longer-", s.c_str());
+
+    // Appending to a full string keeps it terminated
+    s.appendf("%d", 9);
+    TEST_ASSERT_EQUAL(7, (int)s.length());
+    TEST_ASSERT_EQUAL_STRING("longer-", s.c_str());
+}
+
+// ============================================================================
+// Queries
+// ============================================================================
+
+void test_queries() {
+    StaticString<48> p("share/base/DATALOG/20240101/file.edf");
+    TEST_ASSERT_EQUAL(27, p.lastIndexOf('/'));
+    TEST_ASSERT_EQUAL(5, p.indexOf('/'));
+    TEST_ASSERT_EQUAL(-1, p.indexOf('?'));
+    TEST_ASSERT_TRUE(p.startsWith("share/"));
+    TEST_ASSERT_TRUE(p.endsWith(".edf"));
+    TEST_ASSERT_FALSE(p.endsWith("a very long suffix that cannot match"));
+
+    p.truncate(p.lastIndexOf('/'));
+    TEST_ASSERT_TRUE(p == "share/base/DATALOG/20240101");
+    TEST_ASSERT_TRUE(p != "share/base");
+    TEST_ASSERT_EQUAL('s', p[0]);
+    TEST_ASSERT_EQUAL('\0', p[100]);
+
+    p.clear();
+    TEST_ASSERT_TRUE(p.isEmpty());
+    TEST_ASSERT_EQUAL_STRING("", p.c_str());
+    TEST_ASSERT_EQUAL(-1, p.lastIndexOf('/'));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_append_and_format);
+    RUN_TEST(test_truncation_is_detected);
+    RUN_TEST(test_queries);
+
+    return UNITY_END();
+}
@@ -0,0 +1,134 @@
+#include <unity.h>
+#include "Arduino.h"
+
+#include <string>
+
+// Include mock implementations
+#include "../mocks/Arduino.cpp"
+
+// Include the streaming tar writer
+#include "TarArchive.h"
+#include "../../src/TarArchive.cpp"
+
+static std::string archive;
+static int sinkCalls;
+static int failAfterCalls;
+
+static bool captureSink(void* ctx, const uint8_t* data, size_t len) {
+    (void)ctx;
+    if (failAfterCalls >= 0 && sinkCalls >= failAfterCalls) return false;
+    sinkCalls++;
+    archive.append((const char*)data, len);
+    return true;
+}
+
+static bool addMember(TarStreamWriter& tar, const char* name, const std::string& data) {
+    if (!tar.beginMember(name, (uint32_t)data.size(), 1741990500)) return false;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t space = 0;
+        uint8_t* dst = tar.reserve(space);
+        if (!dst) return false;
+        size_t n = data.size() - pos < space ? data.size() - pos : space;
+        memcpy(dst, data.data() + pos, n);
+        if (!tar.commit(n)) return false;
+        pos += n;
+    }
+    return tar.endMember();
+}
+
+static unsigned long octalField(const std::string& s, size_t offset, size_t width) {
+    return strtoul(s.substr(offset, width).c_str(), nullptr, 8);
+}
+
+void setUp(void) {
+    archive.clear();
+    sinkCalls = 0;
+    failAfterCalls = -1;
+}
+
+void tearDown(void) {}
+
+void test_header_checksum_and_fields() {
+    uint8_t block[TAR_BLOCK_SIZE];
+    TEST_ASSERT_TRUE(formatTarHeader(block, "20250314/20250314_221500_EVE.edf", 1234, 1741990500));
+    std::string h((const char*)block, TAR_BLOCK_SIZE);
+
+    TEST_ASSERT_EQUAL_STRING("20250314/20250314_221500_EVE.edf", (const char*)block);
+    TEST_ASSERT_EQUAL(1234, octalField(h, 124, 12));
+    TEST_ASSERT_EQUAL(1741990500UL, octalField(h, 136, 12));
+    TEST_ASSERT_EQUAL('0', block[156]);
+    TEST_ASSERT_EQUAL_STRING("ustar", (const char*)block + 257);
+
+    // Checksum: sum of the header with the checksum field read as spaces
+    unsigned long stored = octalField(h, 148, 7);
+    unsigned long sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        sum += (i >= 148 && i < 156) ? ' ' : block[i];
+    }
+    TEST_ASSERT_EQUAL(sum, stored);
+
+    std::string longName(TAR_NAME_MAX + 1, 'x');
+    TEST_ASSERT_FALSE(formatTarHeader(block, longName.c_str(), 1, 0));
+}
+
+void test_members_are_block_aligned_with_index_offsets() {
+    uint8_t buffer[700];   // Not a multiple of 512: headers and data straddle flushes
+    TarStreamWriter tar(buffer, sizeof(buffer), captureSink, nullptr);
+
+    std::string a(1000, 'a');
+    std::string b(512, 'b');
+    TEST_ASSERT_TRUE(addMember(tar, "20250314/a.edf", a));
+    uint32_t aOffset = 512;
+    TEST_ASSERT_TRUE(addMember(tar, "20250314/b.edf", b));
+    uint32_t bOffset = tar.memberDataOffset();
+    TEST_ASSERT_TRUE(tar.finish());
+
+    // a: header + 1000 data + 24 pad; b: header + 512 data; two zero blocks
+    TEST_ASSERT_EQUAL(512 + 1024 + 512 + 512 + 1024, archive.size());
+    TEST_ASSERT_EQUAL(tar.offset(), archive.size());
+    TEST_ASSERT_EQUAL(1536 + 512, bOffset);
+    TEST_ASSERT_TRUE(a == archive.substr(aOffset, a.size()));
+    TEST_ASSERT_TRUE(b == archive.substr(bOffset, b.size()));
+    TEST_ASSERT_TRUE(std::string(1024, '\0') == archive.substr(archive.size() - 1024));
+    TEST_ASSERT_TRUE(sinkCalls > 1);
+
+    char line[96];
+    size_t n = formatTarIndexLine(line, sizeof(line), "20250314/b.edf", bOffset, 512, 1741990500);
+    TEST_ASSERT_TRUE(n > 0);
+    TEST_ASSERT_EQUAL_STRING("20250314/b.edf\t2048\t512\t1741990500\n", line);
+}
+
+void test_short_member_is_rejected() {
+    uint8_t buffer[1024];
+    TarStreamWriter tar(buffer, sizeof(buffer), captureSink, nullptr);
+    TEST_ASSERT_TRUE(tar.beginMember("20250314/c.edf", 100, 0));
+    size_t space = 0;
+    TEST_ASSERT_NOT_NULL(tar.reserve(space));
+    TEST_ASSERT_TRUE(tar.commit(60));
+    // The file came up short: the header already promised 100 bytes
+    TEST_ASSERT_FALSE(tar.endMember());
+    TEST_ASSERT_FALSE(tar.finish());
+}
+
+void test_sink_failure_aborts() {
+    uint8_t buffer[512];
+    TarStreamWriter tar(buffer, sizeof(buffer), captureSink, nullptr);
+    failAfterCalls = 1;
+    TEST_ASSERT_FALSE(addMember(tar, "20250314/d.edf", std::string(2000, 'd')));
+    size_t space = 1;
+    TEST_ASSERT_NULL(tar.reserve(space));
+    TEST_ASSERT_EQUAL(0, space);
+    TEST_ASSERT_FALSE(tar.finish());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_header_checksum_and_fields);
+    RUN_TEST(test_members_are_block_aligned_with_index_offsets);
+    RUN_TEST(test_short_member_is_rejected);
+    RUN_TEST(test_sink_failure_aborts);
+
+    return UNITY_END();
+}
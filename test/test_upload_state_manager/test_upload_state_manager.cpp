@@ -16,7 +16,12 @@
 
 // Include the UploadStateManager implementation
 #include "UploadStateManager.h"
+#include "../../src/FingerprintIndex.cpp"
+#include "../../src/UploadStateStore.cpp"
 #include "../../src/UploadStateManager.cpp"
+#include "../../src/SdMetaCache.cpp"
+#include "../../src/FileFingerprint.cpp"
+#include "../../src/IoBufferPool.cpp"
 
 // Global mock filesystem for tests
 MockFS testFS;
@@ -347,6 +352,192 @@ void test_mark_file_uploaded() {
     // by checking that the state file contains the file
 }
 
+void test_file_change_detection_uses_meta_cache() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+
+    // Mount point that does not exist: every answer must come from the cache
+    SdMetaCache cache("/nonexistent-mount");
+    manager.setMetaCache(&cache);
+
+    const char* edf = "/DATALOG/20250101/20250101_221500_BRP.edf";
+    SdFileMeta meta = {100, 0, SD_META_EXISTS};
+    cache.put(edf, meta);
+    TEST_ASSERT_TRUE(manager.hasFileChanged(testFS, edf));      // never uploaded
+    manager.markFileUploaded(edf, "", 100);
+    TEST_ASSERT_FALSE(manager.hasFileChanged(testFS, edf));
+    meta.size = 120;
+    cache.put(edf, meta);
+    TEST_ASSERT_TRUE(manager.hasFileChanged(testFS, edf));
+
+    // Cached "absent" is not a change
+    SdFileMeta absent = {0, 0, 0};
+    cache.put(edf, absent);
+    TEST_ASSERT_FALSE(manager.hasFileChanged(testFS, edf));
+
+    // markFileUploaded picks the size up from the cache when none is passed
+    SdFileMeta str = {50, 0, SD_META_EXISTS};
+    cache.put("/STR.edf", str);
+    manager.markFileUploaded("/STR.edf", "0123456789abcdef0123456789abcdef");
+    str.size = 60;
+    cache.put("/STR.edf", str);
+    TEST_ASSERT_TRUE(manager.hasFileChanged(testFS, "/STR.edf"));
+}
+
+// Minimal EDF: 512-byte header (2 signals) followed by data records
+static std::string makeEdf(size_t bodyBytes, char fill) {
+    std::string edf(512, ' ');
+    memcpy(&edf[184], "512     ", 8);
+    char records[9];
+    snprintf(records, sizeof(records), "%-8lu", (unsigned long)(bodyBytes / 100));
+    memcpy(&edf[236], records, 8);
+    edf.append(bodyBytes, fill);
+    return edf;
+}
+
+static bool stateContains(const char* needle) {
+    std::vector<uint8_t> snap = testFS.getFileContent("/littlefs/.upload_state.v2");
+    std::vector<uint8_t> journal = testFS.getFileContent("/littlefs/.upload_state.v2.log");
+    std::string all(snap.begin(), snap.end());
+    all.append(journal.begin(), journal.end());
+    return all.find(needle) != std::string::npos;
+}
+
+// Fingerprints are kept in the binary index next to the snapshot: a 32-byte
+// header, then sorted 32-byte records
+static bool indexHolds(const char* indexPath, const String& fingerprint, uint8_t uploaded) {
+    FingerprintAlgo algo;
+    uint8_t digest[FileFingerprint::MAX_DIGEST_LEN] = {0};
+    if (!FileFingerprint::parse(fingerprint.c_str(), algo, digest)) {
+        return false;
+    }
+    std::vector<uint8_t> raw = testFS.getFileContent(indexPath);
+    for (size_t off = sizeof(FingerprintRecord); off + sizeof(FingerprintRecord) <= raw.size();
+         off += sizeof(FingerprintRecord)) {
+        FingerprintRecord rec;
+        memcpy(&rec, &raw[off], sizeof(rec));
+        if (rec.algo == algo && rec.uploaded == uploaded &&
+            memcmp(rec.digest, digest, FileFingerprint::digestLen(algo)) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_file_change_detection_crc32_fingerprint() {
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"APAP\"}");
+
+    UploadStateManager manager;
+    manager.begin(testFS);
+    String fp = manager.calculateFingerprint(testFS, "/SETTINGS/CurrentSettings.json", FingerprintAlgo::Crc32);
+    TEST_ASSERT_TRUE(fp.startsWith("crc32:"));
+    manager.markFileUploaded("/SETTINGS/CurrentSettings.json", fp, 15);
+    manager.save(testFS);
+    TEST_ASSERT_TRUE(manager.compactIfDue(testFS));
+    TEST_ASSERT_TRUE(indexHolds("/littlefs/.upload_state.v2.idx", fp, 0x01));
+
+    // The algorithm is persisted with the entry and used for the comparison
+    UploadStateManager manager2;
+    manager2.begin(testFS);
+    TEST_ASSERT_FALSE(manager2.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"CPAP\"}");
+    TEST_ASSERT_TRUE(manager2.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+}
+
+void test_file_fingerprints_beyond_ram_table() {
+    // Far more files than the RAM change table (and the old 250-entry cap)
+    const int FILES = 600;
+    char path[48];
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "/DATALOG/2025%04d/%03d_BRP.edf", 101 + i / 10, i);
+        testFS.addFile(path, std::string(100 + i, 'x'));
+    }
+
+    UploadStateManager manager;
+    manager.begin(testFS);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "/DATALOG/2025%04d/%03d_BRP.edf", 101 + i / 10, i);
+        manager.markFileUploaded(path, "", 100 + i);
+    }
+    manager.save(testFS);
+    TEST_ASSERT_TRUE(testFS.exists("/littlefs/.upload_state.v2.idx"));
+
+    UploadStateManager manager2;
+    manager2.begin(testFS);
+    for (int i = 0; i < FILES; ++i) {
+        snprintf(path, sizeof(path), "/DATALOG/2025%04d/%03d_BRP.edf", 101 + i / 10, i);
+        TEST_ASSERT_FALSE(manager2.hasFileChanged(testFS, path));
+    }
+
+    // Removals reach the index as well
+    std::vector<String> paths;
+    paths.push_back("/DATALOG/20250101/000_BRP.edf");
+    manager2.removeFileEntriesForPaths(paths);
+    manager2.save(testFS);
+    UploadStateManager manager3;
+    manager3.begin(testFS);
+    TEST_ASSERT_TRUE(manager3.hasFileChanged(testFS, "/DATALOG/20250101/000_BRP.edf"));
+    TEST_ASSERT_FALSE(manager3.hasFileChanged(testFS, "/DATALOG/20250101/001_BRP.edf"));
+}
+
+void test_append_fingerprint_skips_full_rehash() {
+    std::string edf = makeEdf(1000, 'a');
+    testFS.addFile("/STR.edf", edf);
+
+    UploadStateManager manager;
+    manager.begin(testFS);
+    manager.markFileUploaded("/STR.edf", manager.calculateChecksum(testFS, "/STR.edf"), edf.size());
+
+    // First unchanged check is a full pass that also seeds the append fingerprint
+    TEST_ASSERT_FALSE(manager.hasFileChanged(testFS, "/STR.edf"));
+    manager.save(testFS);
+    TEST_ASSERT_TRUE(stateContains("A|"));
+
+    UploadStateManager manager2;
+    manager2.begin(testFS);
+
+    // Data records already fingerprinted are not read again: a rewrite deep in
+    // the body goes unseen, which is the append-only contract for STR.edf
+    edf[600] = 'z';
+    testFS.addFile("/STR.edf", edf);
+    TEST_ASSERT_FALSE(manager2.hasFileChanged(testFS, "/STR.edf"));
+
+    // The header is hashed on every check
+    edf[236] = '9';
+    testFS.addFile("/STR.edf", edf);
+    TEST_ASSERT_TRUE(manager2.hasFileChanged(testFS, "/STR.edf"));
+}
+
+void test_append_fingerprint_advances_over_tail() {
+    std::string edf = makeEdf(1000, 'a');
+    testFS.addFile("/STR.edf", edf);
+
+    UploadStateManager manager;
+    manager.begin(testFS);
+    manager.markFileUploaded("/STR.edf", manager.calculateChecksum(testFS, "/STR.edf"), edf.size());
+    TEST_ASSERT_FALSE(manager.hasFileChanged(testFS, "/STR.edf"));
+    manager.save(testFS);
+
+    // Next night: CPAP appends records and rewrites the record count
+    std::string grown = makeEdf(1300, 'a');
+    testFS.addFile("/STR.edf", grown);
+
+    UploadStateManager manager2;
+    manager2.begin(testFS);
+    TEST_ASSERT_TRUE(manager2.hasFileChanged(testFS, "/STR.edf"));
+    manager2.markFileUploaded("/STR.edf", manager2.calculateChecksum(testFS, "/STR.edf"), grown.size());
+    manager2.save(testFS);
+
+    UploadStateManager manager3;
+    manager3.begin(testFS);
+    TEST_ASSERT_FALSE(manager3.hasFileChanged(testFS, "/STR.edf"));
+
+    // A shrunk or rewritten file is not an append: fingerprint dropped, full MD5 decides
+    testFS.addFile("/STR.edf", makeEdf(900, 'b'));
+    TEST_ASSERT_TRUE(manager3.hasFileChanged(testFS, "/STR.edf"));
+}
+
 // Test folder completion tracking
 void test_folder_completion_basic() {
     UploadStateManager manager;
@@ -832,6 +1023,392 @@ void test_multiple_pending_folders_scan_update() {
     TEST_ASSERT_EQUAL(0, manager.getPendingFoldersCount());
 }
 
+// Circuit breaker / quarantine tests
+void test_backend_breaker_opens_after_threshold() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+
+    const unsigned long now = 1699876800;
+    TEST_ASSERT_TRUE(manager.isBackendAvailable(now));
+
+    // A single failure is retried normally
+    manager.recordBackendFailure(now);
+    TEST_ASSERT_TRUE(manager.isBackendAvailable(now));
+    TEST_ASSERT_EQUAL(0, manager.getBackendRetryAfter());
+
+    // Second consecutive failure opens the breaker for the base backoff
+    manager.recordBackendFailure(now);
+    TEST_ASSERT_FALSE(manager.isBackendAvailable(now));
+    TEST_ASSERT_EQUAL(now + 600, manager.getBackendRetryAfter());
+
+    // Half-open once the backoff expires
+    TEST_ASSERT_TRUE(manager.isBackendAvailable(now + 600));
+
+    // Failure in half-open state doubles the backoff
+    manager.recordBackendFailure(now + 600);
+    TEST_ASSERT_EQUAL(now + 600 + 1200, manager.getBackendRetryAfter());
+
+    // Success closes the breaker
+    manager.recordBackendSuccess();
+    TEST_ASSERT_TRUE(manager.isBackendAvailable(now + 600));
+    TEST_ASSERT_EQUAL(0, manager.getBackendRetryAfter());
+}
+
+void test_backend_breaker_backoff_capped() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+
+    const unsigned long now = 1699876800;
+    for (int i = 0; i < 20; i++) {
+        manager.recordBackendFailure(now);
+    }
+    TEST_ASSERT_EQUAL(now + 6 * 60 * 60, manager.getBackendRetryAfter());
+}
+
+void test_backend_breaker_never_blocks_without_valid_time() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+
+    for (int i = 0; i < 5; i++) {
+        manager.recordBackendFailure(1000);
+    }
+    TEST_ASSERT_TRUE(manager.isBackendAvailable(1000));
+}
+
+void test_folder_and_file_quarantine() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+
+    const unsigned long now = 1699876800;
+    manager.recordFolderFailure("20241101", now);
+    manager.recordFileFailure("/DATALOG/20241102/bad.edf", now);
+    TEST_ASSERT_FALSE(manager.isFolderQuarantined("20241101", now));
+    TEST_ASSERT_EQUAL(0, manager.getQuarantinedCount(now));
+
+    manager.recordFolderFailure("20241101", now);
+    manager.recordFileFailure("/DATALOG/20241102/bad.edf", now);
+    TEST_ASSERT_TRUE(manager.isFolderQuarantined("20241101", now));
+    TEST_ASSERT_TRUE(manager.isFileQuarantined("/DATALOG/20241102/bad.edf", now));
+    TEST_ASSERT_FALSE(manager.isFolderQuarantined("20241102", now));
+    TEST_ASSERT_EQUAL(2, manager.getQuarantinedCount(now));
+
+    // Expires after the base quarantine backoff
+    TEST_ASSERT_FALSE(manager.isFolderQuarantined("20241101", now + 3600));
+
+    manager.clearFolderQuarantine("20241101");
+    manager.clearFileQuarantine("/DATALOG/20241102/bad.edf");
+    TEST_ASSERT_EQUAL(0, manager.getQuarantinedCount(now));
+}
+
+void test_quarantine_persistence() {
+    const unsigned long now = 1699876800;
+    {
+        UploadStateManager manager;
+        manager.begin(testFS);
+        manager.recordBackendFailure(now);
+        manager.recordBackendFailure(now);
+        manager.recordFolderFailure("20241101", now);
+        manager.recordFolderFailure("20241101", now);
+        manager.save(testFS);
+    }
+
+    // Journal replay
+    UploadStateManager manager2;
+    manager2.begin(testFS);
+    TEST_ASSERT_FALSE(manager2.isBackendAvailable(now));
+    TEST_ASSERT_TRUE(manager2.isFolderQuarantined("20241101", now));
+
+}
+
+void test_quarantine_snapshot_lines() {
+    const unsigned long now = 1699876800;
+    const char* stateV2 =
+        "U2|2|1699876800\n"
+        "C|20241031\n"
+        "Q|B|0000000000000000|3|1699878000\n"
+        "Q|D|000000000134dacd|2|1699880400\n"
+        "Q|X|0000000000000001|2|1699880400\n";
+
+    testFS.addFile("/littlefs/.upload_state.v2", stateV2);
+
+    UploadStateManager manager;
+    manager.begin(testFS);
+    TEST_ASSERT_TRUE(manager.isFolderCompleted("20241031"));
+    TEST_ASSERT_FALSE(manager.isBackendAvailable(now));
+    TEST_ASSERT_EQUAL(1699878000, manager.getBackendRetryAfter());
+    TEST_ASSERT_TRUE(manager.isFolderQuarantined("20241101", now));
+    TEST_ASSERT_EQUAL(1, manager.getQuarantinedCount(now));
+}
+
+// ============================================================================
+// Shared store (DUAL mode: one record set, a bit per backend)
+// ============================================================================
+
+static std::string fileText(const char* path) {
+    std::vector<uint8_t> content = testFS.getFileContent(path);
+    return std::string(content.begin(), content.end());
+}
+
+void test_shared_store_tracks_backends_separately() {
+    UploadStateStore store(2);
+    store.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    store.begin(testFS);
+    UploadStateManager smb(&store, UPLOAD_STATE_SMB);
+    UploadStateManager cloud(&store, UPLOAD_STATE_CLOUD);
+
+    smb.markFolderCompleted("20241101");
+    smb.setCurrentRetryFolder("20241102");
+    smb.incrementCurrentRetryCount();
+    cloud.markFolderPending("20241103", 1699876800);
+    cloud.setLastUploadTimestamp(1699880000);
+    TEST_ASSERT_TRUE(smb.isFolderCompleted("20241101"));
+    TEST_ASSERT_FALSE(cloud.isFolderCompleted("20241101"));
+    TEST_ASSERT_EQUAL(1, smb.getCompletedFoldersCount());
+    TEST_ASSERT_EQUAL(0, cloud.getCompletedFoldersCount());
+    TEST_ASSERT_EQUAL(0, cloud.getCurrentRetryCount());
+    TEST_ASSERT_FALSE(smb.isPendingFolder("20241103"));
+    TEST_ASSERT_EQUAL(0, smb.getLastUploadTimestamp());
+
+    // One record and one file for both (the first compaction writes the snapshot)
+    cloud.markFolderCompleted("20241101");
+    cloud.save(testFS);
+    TEST_ASSERT_TRUE(store.compactIfDue(testFS));
+    std::string snap = fileText("/.upload_state.v3");
+    TEST_ASSERT_TRUE(snap.find("C|20241101|b3\n") != std::string::npos);
+    TEST_ASSERT_TRUE(snap.find("R|20241102|1\n") != std::string::npos);
+    TEST_ASSERT_TRUE(snap.find("T|1699880000|b2\n") != std::string::npos);
+
+    smb.removeFolderFromCompleted("20241101");
+    TEST_ASSERT_TRUE(cloud.isFolderCompleted("20241101"));
+    smb.save(testFS);
+    TEST_ASSERT_EQUAL_STRING("C-|20241101\n", fileText("/.upload_state.v3.log").c_str());
+
+    UploadStateStore reloaded(2);
+    reloaded.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    reloaded.begin(testFS);
+    UploadStateManager smb2(&reloaded, UPLOAD_STATE_SMB);
+    UploadStateManager cloud2(&reloaded, UPLOAD_STATE_CLOUD);
+    TEST_ASSERT_FALSE(smb2.isFolderCompleted("20241101"));
+    TEST_ASSERT_TRUE(cloud2.isFolderCompleted("20241101"));
+    TEST_ASSERT_EQUAL(1, smb2.getCurrentRetryCount());
+    TEST_ASSERT_TRUE(cloud2.isPendingFolder("20241103"));
+    TEST_ASSERT_EQUAL(1699880000, cloud2.getLastUploadTimestamp());
+}
+
+void test_shared_store_fingerprint_is_shared() {
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"APAP\"}");
+
+    UploadStateStore store(2);
+    store.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    store.begin(testFS);
+    UploadStateManager smb(&store, UPLOAD_STATE_SMB);
+    UploadStateManager cloud(&store, UPLOAD_STATE_CLOUD);
+
+    String crc = smb.calculateFingerprint(testFS, "/SETTINGS/CurrentSettings.json", FingerprintAlgo::Crc32);
+    smb.markFileUploaded("/SETTINGS/CurrentSettings.json", crc, 15);
+    TEST_ASSERT_FALSE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_TRUE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+
+    // SleepHQ reports MD5: re-taken as CRC32 the backend joins the entry
+    String md5 = cloud.calculateChecksum(testFS, "/SETTINGS/CurrentSettings.json");
+    String recorded = cloud.fingerprintForRecord(testFS, "/SETTINGS/CurrentSettings.json", md5);
+    TEST_ASSERT_EQUAL_STRING(crc.c_str(), recorded.c_str());
+    cloud.markFileUploaded("/SETTINGS/CurrentSettings.json", recorded, 15);
+    TEST_ASSERT_FALSE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_FALSE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    cloud.save(testFS);
+    TEST_ASSERT_TRUE(store.compactIfDue(testFS));
+    std::string snap = fileText("/.upload_state.v3");
+    TEST_ASSERT_TRUE(snap.find("U2|3|") == 0);
+    TEST_ASSERT_TRUE(snap.find("F|") == std::string::npos);
+    TEST_ASSERT_TRUE(indexHolds("/.upload_state.v3.idx", crc, 0x03));
+
+    // New content: SMB sends it, the cloud copy is now out of date
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"CPAP\"}");
+    TEST_ASSERT_TRUE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    crc = smb.calculateFingerprint(testFS, "/SETTINGS/CurrentSettings.json", FingerprintAlgo::Crc32);
+    smb.markFileUploaded("/SETTINGS/CurrentSettings.json", crc, 15);
+    TEST_ASSERT_FALSE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_TRUE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+
+    // Dropping one backend's record leaves the other's
+    std::vector<String> paths;
+    paths.push_back("/SETTINGS/CurrentSettings.json");
+    cloud.markFileUploaded("/SETTINGS/CurrentSettings.json", crc, 15);
+    cloud.removeFileEntriesForPaths(paths);
+    TEST_ASSERT_TRUE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_FALSE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+}
+
+void test_shared_store_same_size_change_across_algorithms() {
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"APAP\"}");
+
+    UploadStateStore store(2);
+    store.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    store.begin(testFS);
+    UploadStateManager smb(&store, UPLOAD_STATE_SMB);
+    UploadStateManager cloud(&store, UPLOAD_STATE_CLOUD);
+
+    String crc = smb.calculateFingerprint(testFS, "/SETTINGS/CurrentSettings.json", FingerprintAlgo::Crc32);
+    smb.markFileUploaded("/SETTINGS/CurrentSettings.json", crc, 15);
+
+    // Same size, new content: the cloud upload must not keep the old CRC32
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"CPAP\"}");
+    String md5 = cloud.calculateChecksum(testFS, "/SETTINGS/CurrentSettings.json");
+    cloud.markFileUploaded("/SETTINGS/CurrentSettings.json",
+                           cloud.fingerprintForRecord(testFS, "/SETTINGS/CurrentSettings.json", md5), 15);
+    TEST_ASSERT_FALSE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_TRUE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+
+    // SMB catches up and joins; a digest of another algorithm is never taken
+    // as the same content on size alone
+    crc = smb.calculateFingerprint(testFS, "/SETTINGS/CurrentSettings.json", FingerprintAlgo::Crc32);
+    smb.markFileUploaded("/SETTINGS/CurrentSettings.json", crc, 15);
+    TEST_ASSERT_FALSE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_FALSE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    testFS.addFile("/SETTINGS/CurrentSettings.json", "{\"mode\":\"ASV!\"}");
+    md5 = cloud.calculateChecksum(testFS, "/SETTINGS/CurrentSettings.json");
+    cloud.markFileUploaded("/SETTINGS/CurrentSettings.json", md5, 15);
+    TEST_ASSERT_FALSE(cloud.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+    TEST_ASSERT_TRUE(smb.hasFileChanged(testFS, "/SETTINGS/CurrentSettings.json"));
+}
+
+void test_shared_store_imports_legacy_files() {
+    testFS.addFile("/.upload_state.v2.smb", "U2|2|1699800000\nR|0|0\nC|20241101\n");
+    testFS.addFile("/.upload_state.v2.smb.log", "F|00000000000000aa|100|-\n");
+    testFS.addFile("/.upload_state.v2.cloud",
+                   "U2|2|1699900000\nR|20241103|2\nC|20241101\nC|20241102\nF|00000000000000aa|100|-\n");
+
+    UploadStateStore store(2);
+    store.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    store.begin(testFS);
+    TEST_ASSERT_TRUE(store.importLegacy(testFS, "/.upload_state.v2.smb", "/.upload_state.v2.smb.log", UPLOAD_STATE_SMB));
+    TEST_ASSERT_TRUE(store.importLegacy(testFS, "/.upload_state.v2.cloud", "/.upload_state.v2.cloud.log", UPLOAD_STATE_CLOUD));
+    TEST_ASSERT_FALSE(store.importLegacy(testFS, "/.upload_state.v2.cloud", "/.upload_state.v2.cloud.log", UPLOAD_STATE_CLOUD));
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v2.smb"));
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v2.smb.log"));
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v2.cloud"));
+
+    // Shared records are written once
+    std::string snap = fileText("/.upload_state.v3");
+    TEST_ASSERT_TRUE(snap.find("C|20241101|b3") != std::string::npos);
+    TEST_ASSERT_TRUE(snap.find("C|20241102|b2") != std::string::npos);
+    TEST_ASSERT_TRUE(snap.find("F|") == std::string::npos);
+    FingerprintIndex index;
+    TEST_ASSERT_TRUE(index.open(testFS, "/.upload_state.v3.idx"));
+    FingerprintRecord rec;
+    TEST_ASSERT_TRUE(index.find(0xaa, rec));
+    TEST_ASSERT_EQUAL(100, rec.fileSize);
+    TEST_ASSERT_EQUAL_HEX8(0x03, rec.uploaded);
+
+    UploadStateStore reloaded(2);
+    reloaded.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    reloaded.begin(testFS);
+    UploadStateManager smb(&reloaded, UPLOAD_STATE_SMB);
+    UploadStateManager cloud(&reloaded, UPLOAD_STATE_CLOUD);
+    TEST_ASSERT_EQUAL(1699800000, smb.getLastUploadTimestamp());
+    TEST_ASSERT_EQUAL(1699900000, cloud.getLastUploadTimestamp());
+    TEST_ASSERT_EQUAL(1, smb.getCompletedFoldersCount());
+    TEST_ASSERT_EQUAL(2, cloud.getCompletedFoldersCount());
+    TEST_ASSERT_EQUAL_STRING("20241103", cloud.getCurrentRetryFolder().c_str());
+    TEST_ASSERT_EQUAL(2, cloud.getCurrentRetryCount());
+    TEST_ASSERT_EQUAL(0, smb.getCurrentRetryCount());
+}
+
+void test_shared_store_defers_compaction() {
+    UploadStateStore store(2);
+    store.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    store.begin(testFS);
+    UploadStateManager smb(&store, UPLOAD_STATE_SMB);
+
+    // No snapshot yet: due, but the save itself only writes the journal
+    smb.markFolderCompleted("20230101");
+    TEST_ASSERT_TRUE(smb.save(testFS));
+    TEST_ASSERT_TRUE(smb.isCompactionDue());
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v3"));
+    TEST_ASSERT_TRUE(smb.compactIfDue(testFS));
+    TEST_ASSERT_FALSE(smb.isCompactionDue());
+    std::string snap = fileText("/.upload_state.v3");
+
+    // Past the line threshold the upload path keeps appending
+    char day[9];
+    for (int i = 0; i < 260; ++i) {
+        snprintf(day, sizeof(day), "2023%02d%02d", 2 + i / 28, 1 + i % 28);
+        smb.markFolderCompleted(day);
+        TEST_ASSERT_TRUE(smb.save(testFS));
+    }
+    TEST_ASSERT_TRUE(smb.isCompactionDue());
+    TEST_ASSERT_EQUAL_STRING(snap.c_str(), fileText("/.upload_state.v3").c_str());
+    TEST_ASSERT_TRUE(testFS.exists("/.upload_state.v3.log"));
+
+    // The background run folds the journal into the snapshot
+    TEST_ASSERT_TRUE(smb.compactIfDue(testFS));
+    TEST_ASSERT_FALSE(smb.isCompactionDue());
+    TEST_ASSERT_FALSE(testFS.exists("/.upload_state.v3.log"));
+    TEST_ASSERT_TRUE(fileText("/.upload_state.v3").find("C|20231108\n") != std::string::npos);
+
+    UploadStateStore reloaded(2);
+    reloaded.setPaths("/.upload_state.v3", "/.upload_state.v3.log");
+    reloaded.begin(testFS);
+    UploadStateManager smb2(&reloaded, UPLOAD_STATE_SMB);
+    TEST_ASSERT_EQUAL(261, smb2.getCompletedFoldersCount());
+}
+
+void test_deferred_open_file_uploads_after_recent_window() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+    testFS.addFile("/DATALOG/20240101/BRP.edf", "closed session");
+    testFS.addFile("/DATALOG/20240101/PLD.edf", "never closed");
+
+    // Night 1, folder recent: BRP uploaded, PLD still open and deferred
+    manager.markFileUploaded("/DATALOG/20240101/BRP.edf", "", 14);
+    TEST_ASSERT_FALSE(UploadStateManager::shouldMarkFolderCompleted(true, true, 1));
+    manager.setTotalFoldersCount(1);
+    TEST_ASSERT_FALSE(manager.isFolderCompleted("20240101"));
+    TEST_ASSERT_EQUAL(1, manager.getIncompleteFoldersCount());
+
+    // Later pass while still recent: only the deferred file is left to send
+    TEST_ASSERT_FALSE(manager.hasFileChanged(testFS, "/DATALOG/20240101/BRP.edf"));
+    TEST_ASSERT_TRUE(manager.hasFileChanged(testFS, "/DATALOG/20240101/PLD.edf"));
+
+    // Out of the recent window the folder is still incomplete, so it is
+    // rescanned, PLD uploads regardless of its EDF state, and it completes
+    TEST_ASSERT_TRUE(UploadStateManager::shouldMarkFolderCompleted(false, true, 0));
+    manager.markFolderCompleted("20240101");
+    TEST_ASSERT_EQUAL(0, manager.getIncompleteFoldersCount());
+
+    // An old folder with a failed file stays incomplete; a clean recent pass completes
+    TEST_ASSERT_FALSE(UploadStateManager::shouldMarkFolderCompleted(false, false, 0));
+    TEST_ASSERT_TRUE(UploadStateManager::shouldMarkFolderCompleted(true, false, 0));
+}
+
+void test_quarantined_file_does_not_quarantine_folder() {
+    UploadStateManager manager;
+    manager.begin(testFS);
+    const char* bad = "/DATALOG/20241101/bad.edf";
+    unsigned long now = 1699876800;
+
+    // The poison file fails twice and is quarantined on its own
+    manager.recordFileFailure(bad, now);
+    manager.recordFileFailure(bad, now);
+    TEST_ASSERT_TRUE(manager.isFileQuarantined(bad, now));
+
+    // Later sessions: 3 files, the quarantined one skipped, the other two sent
+    for (int session = 1; session <= 4; session++) {
+        unsigned long t = now + session * 60;
+        bool failed = UploadStateManager::isFolderPassFailure(3, 2, 1);
+        TEST_ASSERT_FALSE(failed);
+        if (failed) manager.recordFolderFailure("20241101", t);
+        else manager.clearFolderQuarantine("20241101");
+        TEST_ASSERT_FALSE(manager.isFolderQuarantined("20241101", t));
+    }
+
+    // Any other miss still counts against the folder
+    TEST_ASSERT_TRUE(UploadStateManager::isFolderPassFailure(3, 1, 1));
+    TEST_ASSERT_TRUE(UploadStateManager::isFolderPassFailure(3, 2, 0));
+    TEST_ASSERT_FALSE(UploadStateManager::isFolderPassFailure(3, 3, 0));
+}
+
 int main(int argc, char **argv) {
     UNITY_BEGIN();
     
@@ -859,6 +1436,11 @@ int main(int argc, char **argv) {
     RUN_TEST(test_file_change_detection_no_change);
     RUN_TEST(test_file_change_detection_with_change);
     RUN_TEST(test_mark_file_uploaded);
+    RUN_TEST(test_file_change_detection_uses_meta_cache);
+    RUN_TEST(test_file_change_detection_crc32_fingerprint);
+    RUN_TEST(test_file_fingerprints_beyond_ram_table);
+    RUN_TEST(test_append_fingerprint_skips_full_rehash);
+    RUN_TEST(test_append_fingerprint_advances_over_tail);
     
     // Folder completion tests
     RUN_TEST(test_folder_completion_basic);
@@ -890,6 +1472,23 @@ int main(int argc, char **argv) {
     RUN_TEST(test_pending_state_persistence_round_trip);
     RUN_TEST(test_backward_compatibility_missing_pending_field);
     RUN_TEST(test_incomplete_folders_count_with_pending);
+    RUN_TEST(test_deferred_open_file_uploads_after_recent_window);
+    
+    // Circuit breaker / quarantine tests
+    RUN_TEST(test_backend_breaker_opens_after_threshold);
+    RUN_TEST(test_backend_breaker_backoff_capped);
+    RUN_TEST(test_backend_breaker_never_blocks_without_valid_time);
+    RUN_TEST(test_folder_and_file_quarantine);
+    RUN_TEST(test_quarantine_persistence);
+    RUN_TEST(test_quarantine_snapshot_lines);
+    RUN_TEST(test_quarantined_file_does_not_quarantine_folder);
+
+    // Shared dual-backend store
+    RUN_TEST(test_shared_store_tracks_backends_separately);
+    RUN_TEST(test_shared_store_fingerprint_is_shared);
+    RUN_TEST(test_shared_store_same_size_change_across_algorithms);
+    RUN_TEST(test_shared_store_imports_legacy_files);
+    RUN_TEST(test_shared_store_defers_compaction);
     
     return UNITY_END();
 }